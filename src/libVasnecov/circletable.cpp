@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "circletable.h"
+#include <cmath>
+#include "configuration.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::CircleTable
+  \brief Таблицы cos/sin единичной окружности для всех допустимых разбиений.
+
+  Разбиения - степени двойки от \a cfg_tessellationSegmentsMin до \a cfg_tessellationSegmentsMax,
+  поэтому количество отрезков меняется ступенчато и фигура перестраивается только при смене ступени.
+  Таблицы строятся один раз при первом обращении и общие для всех фигур.
+ */
+
+namespace
+{
+    class Tables
+    {
+    public:
+        Tables() :
+            m_tables()
+        {
+            for(GLuint count = Vasnecov::cfg_tessellationSegmentsMin; count <= Vasnecov::cfg_tessellationSegmentsMax; count *= 2)
+            {
+                std::vector<QVector2D> table;
+                table.reserve(count);
+                for(GLuint i = 0; i < count; ++i)
+                {
+                    GLdouble angle(2.0*M_PI*i/count);
+                    table.push_back(QVector2D(std::cos(angle), std::sin(angle)));
+                }
+                m_tables.push_back(std::vector<QVector2D>());
+                m_tables.back().swap(table);
+            }
+        }
+
+        const std::vector<QVector2D> &table(GLuint segments) const
+        {
+            GLuint index(0);
+            for(GLuint count = Vasnecov::cfg_tessellationSegmentsMin;
+                count < segments && index + 1 < m_tables.size(); count *= 2)
+            {
+                ++index;
+            }
+            return m_tables[index];
+        }
+
+    private:
+        std::vector<std::vector<QVector2D> > m_tables;
+    };
+
+    const Tables &tables()
+    {
+        static const Tables instance; // Потокобезопасная инициализация
+        return instance;
+    }
+}
+
+GLuint Vasnecov::CircleTable::segments(GLfloat radiusPixels)
+{
+    // Прогиб хорды r*(1 - cos(pi/n)) не больше допустимой ошибки
+    GLdouble needed(cfg_tessellationSegmentsMin);
+    if(radiusPixels > cfg_tessellationPixelError)
+    {
+        needed = M_PI / std::acos(1.0 - cfg_tessellationPixelError / radiusPixels);
+    }
+
+    GLuint res(cfg_tessellationSegmentsMin);
+    while(res < needed && res < cfg_tessellationSegmentsMax)
+    {
+        res *= 2;
+    }
+    return res;
+}
+
+const std::vector<QVector2D> &Vasnecov::CircleTable::unitCircle(GLuint segments)
+{
+    return tables().table(segments);
+}
+
+void Vasnecov::CircleTable::arc(GLfloat radius, GLfloat startAngle, GLfloat spanAngle, GLuint segments,
+                                std::vector<QVector3D> &points)
+{
+    const std::vector<QVector2D> &table(unitCircle(segments));
+    const GLuint count(static_cast<GLuint>(table.size()));
+
+    GLuint steps(static_cast<GLuint>(std::ceil(std::fabs(spanAngle) * count / (2.0*M_PI))));
+    if(steps == 0)
+    {
+        steps = 1;
+    }
+
+    // Точки таблицы поворачиваются на начальный угол, для отрицательного раствора - отражаются
+    const GLfloat sign(spanAngle < 0.0f ? -1.0f : 1.0f);
+    const GLfloat cosStart(std::cos(startAngle));
+    const GLfloat sinStart(std::sin(startAngle));
+
+    points.reserve(points.size() + steps + 1);
+    for(GLuint i = 0; i < steps; ++i)
+    {
+        const QVector2D &unit(table[i % count]);
+        GLfloat c(unit.x());
+        GLfloat s(sign * unit.y());
+        points.push_back(QVector3D(radius * (c*cosStart - s*sinStart),
+                                   radius * (c*sinStart + s*cosStart),
+                                   0.0f));
+    }
+
+    GLfloat endAngle(startAngle + spanAngle);
+    points.push_back(QVector3D(radius * std::cos(endAngle), radius * std::sin(endAngle), 0.0f));
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Общие таблицы единичной окружности для адаптивного разбиения фигур
+#ifndef VASNECOV_CIRCLETABLE_H
+#define VASNECOV_CIRCLETABLE_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <vector>
+#include <QVector2D>
+#include <QVector3D>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace Vasnecov
+{
+    class CircleTable
+    {
+    public:
+        // Количество отрезков (степень двойки) для окружности заданного радиуса на экране
+        static GLuint segments(GLfloat radiusPixels);
+        // Точки (cos, sin) единичной окружности из segments отрезков, segments - результат segments()
+        static const std::vector<QVector2D> &unitCircle(GLuint segments);
+
+        // Разбиение дуги: точки от startAngle до startAngle + spanAngle (радианы), последняя - точно на конце
+        static void arc(GLfloat radius, GLfloat startAngle, GLfloat spanAngle, GLuint segments,
+                        std::vector<QVector3D> &points);
+
+    private:
+        CircleTable();
+    };
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_CIRCLETABLE_H
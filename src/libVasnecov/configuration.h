@@ -35,13 +35,68 @@ namespace Vasnecov
     const std::string cfg_dirMeshes = "stuff/meshes/";
 
     const std::string cfg_textureFormat = "png";
+    const std::string cfg_textureBakedFormat = "dds"; // Подготовленные текстуры (см. VasnecovUniverse::bakeTextures)
     const std::string cfg_meshFormat = "obj";
+    const std::string cfg_manifestPrefix = ".vasnecov_"; // Манифест директории ресурсов: <корень>.vasnecov_<формат>.manifest
+    const std::string cfg_manifestFormat = "manifest";
     const GLboolean cfg_readFromMTL = 1; // Читать имя текстуры из мтл-библиотеки, указанной в обж
     const GLboolean cfg_sortTransparency = true;
+    const GLfloat cfg_textureAlphaThreshold = 0.5f; // Порог альфы текстур, прозрачных только местами (0 или 255)
     const GLuint cfg_elementMaxLevel = 16; // Количество максимальных уровней для ВЭлемента
 
     const GLuint cfg_lampsCountMax = 8;
 
+    const GLuint cfg_jobWorkersMax = 16; // Рабочие потоки подготовки кадра
+    const GLuint cfg_jobGrainSize = 64; // Элементов в одной задаче
+
+    const GLuint cfg_reclaimTexturesPerFrame = 16; // Освобождаемых за кадр текстур удалённых элементов
+    const size_t cfg_textureUploadBudget = 8 * 1024 * 1024; // Байт новых текстур, передаваемых в OpenGL за кадр
+    const size_t cfg_textureMemoryBudget = 0; // Байт видеопамяти под текстуры файлов, 0 - без ограничения
+    const quint64 cfg_textureEvictFrames = 2; // Не вытеснять текстуры, использованные в последних кадрах
+    const GLuint cfg_resourcesUnloadDelay = 0; // Простой ресурса без пользователей до автоматической выгрузки, мс. 0 - только явная
+    const GLuint cfg_resourcesCheckPeriod = 1000; // Период проверки ресурсов при автоматической выгрузке, мс
+    const qint64 cfg_manifestSettleTime = 2000; // Более свежие изменения файлов манифест не запоминает, мс
+
+    const GLuint cfg_streamChunkSize = 4096; // Точек в блоке потоковой фигуры
+
+    const GLuint cfg_simplifyMinPoints = 4096; // Ломаные короче рисуются без упрощения
+    const GLuint cfg_simplifyBlockSize = 256; // Точек в блоке упрощения одного уровня
+    const GLuint cfg_simplifyLevelsMax = 12;
+    const GLfloat cfg_simplifyLevelFactor = 4.0f; // Рост допуска от уровня к уровню
+    const GLfloat cfg_simplifyBaseDivider = 1024.0f; // Допуск первого уровня - доля размера первого блока
+    const GLfloat cfg_simplifyPixelTolerance = 0.5f; // Допустимое отклонение на экране по умолчанию, пикс
+
+    const GLuint cfg_tessellationSegmentsMin = 8; // Разбиение окружностей в адаптивном режиме (степени двойки)
+    const GLuint cfg_tessellationSegmentsMax = 2048;
+    const GLfloat cfg_tessellationPixelError = 0.25f; // Допустимый прогиб хорды на экране, пикс
+
+    const GLboolean cfg_batchSmallFigures = true; // Пакетная отрисовка мелких непрозрачных фигур
+    const GLuint cfg_batchFigurePointsMax = 256; // Фигуры с большим количеством вершин рисуются отдельно
+
+    const GLuint cfg_cloudNodePoints = 16384; // Точек в узле облака точек
+    const GLuint cfg_cloudNodeGrid = 128; // Сетка прореживания узла облака (ячеек по стороне)
+    const GLuint cfg_cloudDepthMax = 20; // Глубина октодерева облака
+    const GLuint cfg_cloudPointBudget = 2000000; // Точек облака за кадр по умолчанию
+    const GLfloat cfg_cloudPixelSpacing = 2.0f; // Узел уточняется, пока его точки на экране реже, пикс
+
+    const GLuint cfg_particlesCapacity = 4096; // Ёмкость системы частиц по умолчанию
+    const GLfloat cfg_particlesStepMax = 0.1f; // Предельный шаг продвижения частиц, с
+
+    const GLuint cfg_labelAtlasSize = 2048; // Сторона текстуры атласа меток
+    const GLuint cfg_labelAtlasItemMax = 512; // Картинки меток крупнее получают свою текстуру
+    const GLuint cfg_labelAtlasShelfStep = 8; // Шаг высоты полок атласа
+    const GLuint cfg_labelAtlasPadding = 1; // Зазор между картинками против подмешивания соседей при фильтрации
+
+    const GLuint cfg_glyphAtlasSize = 1024; // Сторона текстуры атласа глифов одного шрифта
+    const GLuint cfg_glyphSdfSize = 32; // Размер шрифта, с которого снимается поле расстояний глифов, пикс
+    const GLuint cfg_glyphSdfSpread = 4; // Предел поля расстояний вокруг контура глифа, пикс
+    const GLuint cfg_glyphSdfOversample = 4; // Во сколько раз крупнее растеризуется глиф для расчёта поля
+    const GLfloat cfg_glyphSdfThreshold = 0.5f; // Порог альфы контура глифа
+    const GLfloat cfg_textHeightDefault = 14.0f; // Высота текста по умолчанию, пикс
+
+    const GLuint cfg_declutterCellSize = 64; // Ячейка сетки разрежения меток, пикс
+    const GLfloat cfg_declutterMargin = 4.0f; // Скрытая метка возвращается, только если вокруг неё свободно на столько, пикс
+
     inline timespec timeDefault() // Типа, конструктор для timespec
     {
         timespec td;
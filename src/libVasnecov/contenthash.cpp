@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "contenthash.h"
+#include <cstring>
+#include <QFile>
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace
+{
+    const quint64 prime1 = 0x9E3779B185EBCA87ULL;
+    const quint64 prime2 = 0xC2B2AE3D27D4EB4FULL;
+    const quint64 prime3 = 0x165667B19E3779F9ULL;
+    const quint64 prime4 = 0x85EBCA77C2B2AE63ULL;
+    const quint64 prime5 = 0x27D4EB2F165667C5ULL;
+
+    inline quint64 rotateLeft(quint64 value, GLuint bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+    // Чтение без требований к выравниванию, порядок байт - little-endian (как у всех целевых платформ)
+    inline quint64 read64(const uchar *data)
+    {
+        quint64 res;
+        memcpy(&res, data, sizeof(res));
+        return res;
+    }
+    inline quint32 read32(const uchar *data)
+    {
+        quint32 res;
+        memcpy(&res, data, sizeof(res));
+        return res;
+    }
+
+    inline quint64 round(quint64 acc, quint64 input)
+    {
+        acc += input * prime2;
+        acc = rotateLeft(acc, 31);
+        return acc * prime1;
+    }
+    inline quint64 mergeRound(quint64 acc, quint64 value)
+    {
+        acc ^= round(0, value);
+        return acc * prime1 + prime4;
+    }
+}
+
+/*!
+ \brief Хеш блока данных по схеме xxHash64: четыре независимые полосы по 8 байт, затем хвост.
+
+ Скорость - порядка пропускной способности памяти, так что хеш файла почти ничего не добавляет к его чтению.
+*/
+quint64 Vasnecov::contentHash(const void *data, size_t size, quint64 seed)
+{
+    const uchar *p(static_cast<const uchar *>(data));
+    const uchar *const end(p + size);
+    quint64 hash;
+
+    if(size >= 32)
+    {
+        const uchar *const limit(end - 32);
+        quint64 v1(seed + prime1 + prime2);
+        quint64 v2(seed + prime2);
+        quint64 v3(seed);
+        quint64 v4(seed - prime1);
+
+        do
+        {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        }
+        while(p <= limit);
+
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = mergeRound(hash, v1);
+        hash = mergeRound(hash, v2);
+        hash = mergeRound(hash, v3);
+        hash = mergeRound(hash, v4);
+    }
+    else
+    {
+        hash = seed + prime5;
+    }
+
+    hash += static_cast<quint64>(size);
+
+    for(; p + 8 <= end; p += 8)
+    {
+        hash ^= round(0, read64(p));
+        hash = rotateLeft(hash, 27) * prime1 + prime4;
+    }
+    if(p + 4 <= end)
+    {
+        hash ^= static_cast<quint64>(read32(p)) * prime1;
+        hash = rotateLeft(hash, 23) * prime2 + prime3;
+        p += 4;
+    }
+    for(; p < end; ++p)
+    {
+        hash ^= (*p) * prime5;
+        hash = rotateLeft(hash, 11) * prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+/*!
+ \brief Ключ содержимого файла (файл отображается в память). При ошибке ключ недействителен.
+*/
+Vasnecov::ContentKey Vasnecov::fileContentKey(const std::string &path, quint64 seed)
+{
+    ContentKey key;
+
+    QFile file(QString::fromStdString(path));
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        return key;
+    }
+
+    const qint64 size(file.size());
+    if(size == 0)
+    {
+        key.hash = contentHash(0, 0, seed);
+        key.size = 0;
+        return key;
+    }
+
+    uchar *map(file.map(0, size));
+    if(map)
+    {
+        key.hash = contentHash(map, static_cast<size_t>(size), seed);
+        key.size = size;
+        file.unmap(map);
+    }
+    return key;
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
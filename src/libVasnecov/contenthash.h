@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Хеш содержимого файлов ресурсов для поиска одинаковых ресурсов под разными именами
+#ifndef VASNECOV_CONTENTHASH_H
+#define VASNECOV_CONTENTHASH_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <string>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace Vasnecov
+{
+    // Ключ содержимого: хеш и размер файла
+    struct ContentKey
+    {
+        quint64 hash;
+        qint64 size;
+
+        ContentKey() :
+            hash(0),
+            size(-1)
+        {}
+        GLboolean isValid() const {return size >= 0;}
+        bool operator<(const ContentKey &other) const
+        {
+            return hash < other.hash || (hash == other.hash && size < other.size);
+        }
+    };
+
+    quint64 contentHash(const void *data, size_t size, quint64 seed = 0); // По схеме xxHash64
+    // Ключ содержимого файла. seed разделяет одинаковые файлы, которые загружаются в разные ресурсы
+    ContentKey fileContentKey(const std::string &path, quint64 seed = 0);
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_CONTENTHASH_H
@@ -16,6 +16,7 @@
 #include <QMutex>
 #include "types.h"
 #include "vasnecovpipeline.h"
+#include "syncstats.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
@@ -41,6 +42,16 @@ namespace Vasnecov
             m_wasUpdated(wasUpdated)
         {}
         GLboolean set(const T &value)
+        {
+            if(m_raw != value)
+            {
+                noteChange();
+                return renderSet(value);
+            }
+            return false;
+        }
+        // Запись из потока рендеринга во время синхронизации: в задержку синхронизации не попадает
+        GLboolean renderSet(const T &value)
         {
             if(m_raw != value)
             {
@@ -76,6 +87,7 @@ namespace Vasnecov
         // Для прямого изменения сложных типов
         T &editableRaw()
         {
+            noteChange();
             m_wasUpdated |= m_flag;
             return m_raw;
         }
@@ -90,6 +102,16 @@ namespace Vasnecov
             return m_pure;
         }
 
+    private:
+        void noteChange() const
+        {
+            // Для статистики нужен только момент первого изменения после синхронизации
+            if(!m_wasUpdated && SyncStats::isEnabled())
+            {
+                SyncStats::noteRawChange();
+            }
+        }
+
     private:
         T m_raw; // Грязные данные - из внешнего потока
         T m_pure; // Чистые - для рендеринга
@@ -103,6 +125,8 @@ class VasnecovPipeline;
 
 namespace Vasnecov
 {
+    class Reclaimer;
+
     class CoreObject
     {
     public:
@@ -141,6 +165,8 @@ namespace Vasnecov
         virtual GLenum renderUpdateData(); // обновление данных, вызов должен быть обёрнут мьютексом
 
         virtual void renderDraw() = 0; // Собственно, отрисовка элемента
+        // Передача ресурсов OpenGL перед отложенным удалением: сам объект удаляется в другом потоке
+        virtual void renderReleaseResources(Reclaimer *reclaimer) {Q_UNUSED(reclaimer);}
 
         GLboolean updaterIsUpdateFlag(GLenum flag) const;
         void updaterSetUpdateFlag(GLenum flag);
@@ -176,13 +202,13 @@ namespace Vasnecov
 
     inline void CoreObject::setName(const std::string &name)
     {
-        QMutexLocker locker(mtx_data);
+        StatsLocker locker(mtx_data, SyncStats::LockDesignerElement);
 
         m_name.set(name);
     }
     inline std::string CoreObject::name() const
     {
-        QMutexLocker locker(mtx_data);
+        StatsLocker locker(mtx_data, SyncStats::LockDesignerElement);
 
         std::string name(m_name.raw());
         return name;
@@ -190,7 +216,7 @@ namespace Vasnecov
 
     inline void CoreObject::setVisible(GLboolean visible)
     {
-        QMutexLocker locker(mtx_data);
+        StatsLocker locker(mtx_data, SyncStats::LockDesignerElement);
 
         m_isHidden.set(!visible);
     }
@@ -208,7 +234,7 @@ namespace Vasnecov
     }
     inline GLboolean CoreObject::isVisible() const
     {
-        QMutexLocker locker(mtx_data);
+        StatsLocker locker(mtx_data, SyncStats::LockDesignerElement);
 
         GLboolean visible(!m_isHidden.raw());
         return visible;
@@ -14,6 +14,8 @@
     #pragma GCC diagnostic ignored "-Weffc++"
 #endif
 #include <vector>
+#include <unordered_set>
+#include <algorithm>
 #include "technologist.h"
 
 #ifndef _MSC_VER
@@ -53,8 +55,12 @@ namespace Vasnecov
             for_each(m_pure.begin(), m_pure.end(), fun);
         }
 
+    protected:
+        virtual void elementRemoved(T *element) {Q_UNUSED(element);} // Вызывается для каждого удалённого из сырого списка
+
     protected:
         std::vector<T *> m_raw, m_buffer, m_pure;
+        std::unordered_set<T *> m_index; // Поиск по сырому списку без перебора
         GLboolean m_wasUpdated;
         const GLenum m_flag; // Флаг обновления
 
@@ -66,6 +72,7 @@ namespace Vasnecov
     template <typename T>
     ElementBox<T>::ElementBox() :
         m_raw(), m_buffer(), m_pure(),
+        m_index(),
         m_wasUpdated(false),
         m_flag()
     {}
@@ -79,13 +86,14 @@ namespace Vasnecov
             if(check)
             {
                 // Поиск дубликатов
-                if(m_raw.end() != find(m_raw.begin(), m_raw.end(), element))
+                if(m_index.count(element))
                 {
                     added = false;
                 }
             }
             if(added)
             {
+                m_index.insert(element);
                 m_raw.push_back(element);
                 m_buffer = m_raw;
                 m_wasUpdated = true;
@@ -134,7 +142,7 @@ namespace Vasnecov
     {
         if(element)
         {
-            if(find(m_raw.begin(), m_raw.end(), element) != m_raw.end())
+            if(m_index.count(element))
             {
                 return element;
             }
@@ -145,41 +153,53 @@ namespace Vasnecov
     template <typename T>
     GLboolean ElementBox<T>::removeElement(T *element)
     {
-        if(element)
+        if(element && m_index.erase(element))
         {
-            for(typename std::vector<T *>::iterator eit = m_raw.begin();
-                eit != m_raw.end(); ++eit)
+            typename std::vector<T *>::iterator eit = std::find(m_raw.begin(), m_raw.end(), element);
+            if(eit != m_raw.end())
             {
-                if((*eit) == element)
-                {
-                    m_raw.erase(eit);
-                    m_buffer = m_raw;
-                    m_wasUpdated = true;
-                    return true;
-                }
+                m_raw.erase(eit);
             }
+            m_buffer = m_raw;
+            m_wasUpdated = true;
+
+            elementRemoved(element);
+            return true;
         }
 
         return false;
     }
+    /*!
+     \brief Удаление списка элементов за один проход по сырому списку (и одно копирование в буфер).
+    */
     template <typename T>
     GLuint ElementBox<T>::removeElements(const std::vector<T *> &deletingList)
     {
-        GLuint count(0);
+        std::unordered_set<T *> deleting;
+        deleting.reserve(deletingList.size());
 
         for(typename std::vector<T *>::const_iterator dit = deletingList.begin();
             dit != deletingList.end(); ++dit)
         {
-            if(*dit)
+            if(*dit && m_index.erase(*dit))
             {
-                if(this->removeElement(*dit))
-                {
-                    ++count;
-                }
+                deleting.insert(*dit);
+                elementRemoved(*dit);
             }
         }
 
-        return count;
+        if(deleting.empty())
+        {
+            return 0;
+        }
+
+        m_raw.erase(std::remove_if(m_raw.begin(), m_raw.end(),
+                                   [&deleting](T *element) {return deleting.count(element) != 0;}),
+                    m_raw.end());
+        m_buffer = m_raw;
+        m_wasUpdated = true;
+
+        return static_cast<GLuint>(deleting.size());
     }
 }
 
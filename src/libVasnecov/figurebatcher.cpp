@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "figurebatcher.h"
+#include "vasnecovfigure.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::FigureBatcher
+  \brief Сборка мелких непрозрачных фигур в общие массивы для отрисовки одним вызовом.
+
+  Фигуры группируются по (примитив, толщина, освещение, тест глубины). Ломаные, замкнутые ломаные,
+  веера и полосы треугольников переводятся в отдельные отрезки и треугольники, чтобы фигуры одного
+  пакета можно было склеить. Вершины заранее переводятся в координаты мира (с учётом чужих матриц),
+  цвет передаётся массивом цветов. Заполнение массивов идёт параллельно через планировщик конвейера.
+ */
+
+Vasnecov::FigureBatcher::FigureBatcher(VasnecovPipeline *pipeline) :
+    m_pipeline(pipeline),
+    m_buckets(),
+    m_entries()
+{
+}
+
+void Vasnecov::FigureBatcher::begin()
+{
+    for(std::vector<Bucket>::iterator bit = m_buckets.begin(); bit != m_buckets.end(); ++bit)
+    {
+        bit->verticesCount = 0;
+        bit->indicesCount = 0;
+    }
+    m_entries.clear();
+}
+
+GLboolean Vasnecov::FigureBatcher::add(const VasnecovFigure *figure)
+{
+    if(!cfg_batchSmallFigures || !figure || !figure->renderBatchable())
+    {
+        return false;
+    }
+
+    Key key;
+    key.method = figure->renderBatchMethod();
+    key.thickness = figure->renderThickness();
+    key.lighting = figure->renderLighting();
+    key.depth = figure->renderDepth();
+
+    size_t bucket(0);
+    while(bucket < m_buckets.size() && !(m_buckets[bucket].key == key))
+    {
+        ++bucket;
+    }
+    if(bucket == m_buckets.size())
+    {
+        m_buckets.push_back(Bucket());
+        m_buckets.back().key = key;
+    }
+
+    Bucket &target(m_buckets[bucket]);
+
+    Entry entry;
+    entry.figure = figure;
+    entry.bucket = bucket;
+    entry.vertexOffset = target.verticesCount;
+    entry.indexOffset = target.indicesCount;
+    m_entries.push_back(entry);
+
+    target.verticesCount += figure->renderBatchVerticesCount();
+    target.indicesCount += figure->renderBatchIndicesCount();
+
+    return true;
+}
+
+void Vasnecov::FigureBatcher::draw()
+{
+    if(m_entries.empty())
+    {
+        return;
+    }
+
+    for(std::vector<Bucket>::iterator bit = m_buckets.begin(); bit != m_buckets.end(); ++bit)
+    {
+        bit->vertices.resize(bit->verticesCount);
+        bit->colors.resize(bit->verticesCount * 4);
+        bit->indices.resize(bit->indicesCount);
+    }
+
+    // Каждая фигура пишет в свой участок массивов, поэтому заполнение можно распараллелить
+    std::vector<Bucket> &buckets(m_buckets);
+    const std::vector<Entry> &entries(m_entries);
+    m_pipeline->jobs().parallelFor(entries.size(), cfg_jobGrainSize, [&buckets, &entries](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+        {
+            const Entry &entry(entries[i]);
+            Bucket &bucket(buckets[entry.bucket]);
+
+            entry.figure->renderFillBatch(bucket.vertices.data() + entry.vertexOffset,
+                                          bucket.colors.data() + entry.vertexOffset * 4,
+                                          bucket.indices.data() + entry.indexOffset,
+                                          entry.vertexOffset);
+        }
+    });
+
+    m_pipeline->setIdentityMatrixMV();
+    for(std::vector<Bucket>::const_iterator bit = m_buckets.begin(); bit != m_buckets.end(); ++bit)
+    {
+        if(bit->indicesCount)
+        {
+            m_pipeline->activateLamps(bit->key.lighting);
+            m_pipeline->activateDepth(bit->key.depth);
+            m_pipeline->setLineWidth(bit->key.thickness);
+            m_pipeline->setPointSize(bit->key.thickness);
+
+            m_pipeline->drawColoredElements(bit->key.method, &bit->indices, &bit->vertices, &bit->colors);
+        }
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Пакетная отрисовка мелких непрозрачных фигур
+#ifndef VASNECOV_FIGUREBATCHER_H
+#define VASNECOV_FIGUREBATCHER_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <vector>
+#include "vasnecovpipeline.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+class VasnecovFigure;
+
+namespace Vasnecov
+{
+    class FigureBatcher
+    {
+    public:
+        explicit FigureBatcher(VasnecovPipeline *pipeline);
+
+        void begin(); // Начало кадра
+        GLboolean add(const VasnecovFigure *figure); // false - фигура рисуется сама
+        void draw(); // Отрисовка всех накопленных пакетов
+
+    private:
+        // Состояние конвейера, общее для пакета
+        struct Key
+        {
+            VasnecovPipeline::ElementDrawingMethods method;
+            GLfloat thickness;
+            GLboolean lighting;
+            GLboolean depth;
+
+            bool operator==(const Key &other) const
+            {
+                return method == other.method &&
+                       thickness == other.thickness &&
+                       lighting == other.lighting &&
+                       depth == other.depth;
+            }
+        };
+        struct Bucket
+        {
+            Key key;
+            GLuint verticesCount;
+            GLuint indicesCount;
+            std::vector<QVector3D> vertices; // Уже в координатах мира
+            std::vector<GLubyte> colors; // RGBA на вершину
+            std::vector<GLuint> indices;
+
+            Bucket() :
+                key(),
+                verticesCount(0),
+                indicesCount(0),
+                vertices(),
+                colors(),
+                indices()
+            {}
+        };
+        struct Entry
+        {
+            const VasnecovFigure *figure;
+            size_t bucket;
+            GLuint vertexOffset;
+            GLuint indexOffset;
+        };
+
+    private:
+        VasnecovPipeline *const m_pipeline;
+        std::vector<Bucket> m_buckets; // Пакеты сохраняются между кадрами ради выделенной памяти
+        std::vector<Entry> m_entries;
+
+        Q_DISABLE_COPY(FigureBatcher)
+    };
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_FIGUREBATCHER_H
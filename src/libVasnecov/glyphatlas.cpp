@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "glyphatlas.h"
+#include <cmath>
+#include <QImage>
+#include <QPainter>
+#include <QFontMetricsF>
+#include "vasnecovpipeline.h"
+#include "configuration.h"
+#include "technologist.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::GlyphAtlas
+  \brief Атлас глифов одного шрифта: поле расстояний до контура, снятое один раз для всех размеров.
+
+  Глиф растеризуется при первом обращении в \a cfg_glyphSdfOversample раз крупнее, по растру считается
+  точное евклидово расстояние до контура, значения в текстуре - расстояние со знаком, сдвинутое к 0.5
+  на контуре. При линейной фильтрации и тесте альфы с порогом \a cfg_glyphSdfThreshold контур остаётся
+  чётким в любом масштабе, поэтому текстовые метки не растеризуются при каждом изменении текста.
+
+  Глифы из атласа не вытесняются. Не поместившиеся глифы не рисуются.
+ */
+
+namespace
+{
+    const GLfloat distanceInfinity(1e20f);
+
+    // Одномерное преобразование расстояний (Felzenszwalb, Huttenlocher): квадраты расстояний до нулей f
+    void distanceTransform(const GLfloat *f, GLint n, GLfloat *d, GLint *v, GLfloat *z)
+    {
+        GLint k(0);
+        v[0] = 0;
+        z[0] = -distanceInfinity;
+        z[1] = distanceInfinity;
+
+        for(GLint q = 1; q < n; ++q)
+        {
+            GLfloat s(((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2*q - 2*v[k]));
+            while(s <= z[k])
+            {
+                --k;
+                s = ((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2*q - 2*v[k]);
+            }
+            ++k;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = distanceInfinity;
+        }
+
+        k = 0;
+        for(GLint q = 0; q < n; ++q)
+        {
+            while(z[k + 1] < q)
+            {
+                ++k;
+            }
+            d[q] = (q - v[k])*(q - v[k]) + f[v[k]];
+        }
+    }
+
+    // Двумерное преобразование на месте: на входе 0 в точках контура и бесконечность в остальных
+    void distanceTransform(std::vector<GLfloat> &grid, GLint width, GLint height)
+    {
+        const GLint size(qMax(width, height));
+        std::vector<GLfloat> f(size), d(size), z(size + 1);
+        std::vector<GLint> v(size);
+
+        for(GLint x = 0; x < width; ++x)
+        {
+            for(GLint y = 0; y < height; ++y)
+            {
+                f[y] = grid[y*width + x];
+            }
+            distanceTransform(f.data(), height, d.data(), v.data(), z.data());
+            for(GLint y = 0; y < height; ++y)
+            {
+                grid[y*width + x] = d[y];
+            }
+        }
+        for(GLint y = 0; y < height; ++y)
+        {
+            GLfloat *row(&grid[y*width]);
+            std::copy(row, row + width, f.begin());
+            distanceTransform(f.data(), width, row, v.data(), z.data());
+        }
+    }
+}
+
+Vasnecov::GlyphAtlas::GlyphAtlas(VasnecovPipeline *pipeline, const QFont &font) :
+    m_pipeline(pipeline),
+    m_key(fontKey(font)),
+    m_font(font),
+    m_initialized(false),
+    m_lineSpacing(1.0f),
+    m_ascent(1.0f),
+    m_id(0),
+    m_glyphs(),
+    m_penX(0),
+    m_penY(0),
+    m_rowHeight(0),
+    m_full(false)
+{
+    m_font.setPixelSize(Vasnecov::cfg_glyphSdfSize * Vasnecov::cfg_glyphSdfOversample);
+    m_font.setStyleStrategy(QFont::PreferAntialias);
+}
+
+Vasnecov::GlyphAtlas::~GlyphAtlas()
+{
+    if(m_id)
+    {
+        glDeleteTextures(1, &m_id);
+    }
+}
+
+QString Vasnecov::GlyphAtlas::fontKey(const QFont &font)
+{
+    return QString("%1,%2,%3,%4").arg(font.family()).arg(font.weight()).arg(static_cast<int>(font.style())).arg(font.stretch());
+}
+
+const Vasnecov::GlyphAtlas::Glyph &Vasnecov::GlyphAtlas::renderGlyph(QChar character)
+{
+    std::map<GLuint, Glyph>::iterator it(m_glyphs.find(character.unicode()));
+    if(it != m_glyphs.end())
+    {
+        return it->second;
+    }
+
+    renderInitialize();
+
+    Glyph &glyph(m_glyphs[character.unicode()]);
+    renderBuildGlyph(character, glyph);
+    return glyph;
+}
+
+GLfloat Vasnecov::GlyphAtlas::renderLineSpacing()
+{
+    renderInitialize();
+    return m_lineSpacing;
+}
+
+GLfloat Vasnecov::GlyphAtlas::renderAscent()
+{
+    renderInitialize();
+    return m_ascent;
+}
+
+void Vasnecov::GlyphAtlas::renderInitialize()
+{
+    if(m_initialized)
+    {
+        return;
+    }
+    m_initialized = true;
+
+    // Метрики шрифта запрашиваются в потоке отрисовки, как и растеризация
+    const QFontMetricsF metrics(m_font);
+    const GLfloat em(m_font.pixelSize());
+    m_lineSpacing = metrics.lineSpacing() / em;
+    m_ascent = metrics.ascent() / em;
+}
+
+GLboolean Vasnecov::GlyphAtlas::renderCreateTexture()
+{
+    glGenTextures(1, &m_id);
+    if(!m_id)
+    {
+        Vasnecov::problem("Не удалось создать атлас глифов");
+        return false;
+    }
+
+    // Зазоры между глифами должны быть пустыми, иначе фильтрация подмешает мусор
+    const std::vector<GLubyte> empty(Vasnecov::cfg_glyphAtlasSize * Vasnecov::cfg_glyphAtlasSize, 0);
+
+    m_pipeline->enableTexture2D(m_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA8, Vasnecov::cfg_glyphAtlasSize, Vasnecov::cfg_glyphAtlasSize, 0,
+                 GL_ALPHA, GL_UNSIGNED_BYTE, empty.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return true;
+}
+
+void Vasnecov::GlyphAtlas::renderBuildGlyph(QChar character, Glyph &glyph)
+{
+    const GLint oversample(Vasnecov::cfg_glyphSdfOversample);
+    const GLint spread(Vasnecov::cfg_glyphSdfSpread);
+    const GLfloat em(Vasnecov::cfg_glyphSdfSize);
+
+    const QFontMetricsF metrics(m_font);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+    glyph.advance = metrics.horizontalAdvance(character) / (em * oversample);
+#else
+    glyph.advance = metrics.width(character) / (em * oversample);
+#endif
+
+    // Рамка глифа от точки пера, ось Y вниз
+    const QRectF box(metrics.boundingRect(character));
+    if(box.isEmpty() || m_full)
+    {
+        return;
+    }
+
+    const GLint width(static_cast<GLint>(std::ceil(box.width() / oversample)) + 2*spread);
+    const GLint height(static_cast<GLint>(std::ceil(box.height() / oversample)) + 2*spread);
+
+    GLint x(0), y(0);
+    if(!renderPlace(width, height, x, y))
+    {
+        Vasnecov::problem("Атлас глифов заполнен, шрифт: ", m_key.toStdString());
+        m_full = true;
+        return;
+    }
+
+    // Крупный растр глифа
+    const GLint rasterWidth(width * oversample);
+    const GLint rasterHeight(height * oversample);
+    QImage raster(rasterWidth, rasterHeight, QImage::Format_ARGB32_Premultiplied);
+    raster.fill(0);
+    {
+        QPainter painter(&raster);
+        painter.setRenderHint(QPainter::TextAntialiasing);
+        painter.setFont(m_font);
+        painter.setPen(Qt::white);
+        painter.drawText(QPointF(spread*oversample - box.left(), spread*oversample - box.top()), QString(character));
+    }
+
+    // Расстояния снаружи до глифа и внутри до фона
+    std::vector<GLfloat> outside(rasterWidth * rasterHeight);
+    std::vector<GLfloat> inside(rasterWidth * rasterHeight);
+    for(GLint j = 0; j < rasterHeight; ++j)
+    {
+        const QRgb *line(reinterpret_cast<const QRgb *>(raster.constScanLine(j)));
+        for(GLint i = 0; i < rasterWidth; ++i)
+        {
+            const GLboolean filled(qAlpha(line[i]) > 127);
+            outside[j*rasterWidth + i] = filled ? 0.0f : distanceInfinity;
+            inside[j*rasterWidth + i] = filled ? distanceInfinity : 0.0f;
+        }
+    }
+    distanceTransform(outside, rasterWidth, rasterHeight);
+    distanceTransform(inside, rasterWidth, rasterHeight);
+
+    // Поле снимается в центрах текселей атласа
+    std::vector<GLubyte> field(width * height);
+    const GLfloat range(2.0f * spread * oversample);
+    for(GLint j = 0; j < height; ++j)
+    {
+        for(GLint i = 0; i < width; ++i)
+        {
+            const GLint sample((j*oversample + oversample/2) * rasterWidth + i*oversample + oversample/2);
+            GLfloat distance;
+            if(outside[sample] == 0.0f)
+            {
+                distance = std::sqrt(inside[sample]) - 0.5f;
+            }
+            else
+            {
+                distance = 0.5f - std::sqrt(outside[sample]);
+            }
+            const GLfloat value(qBound(0.0f, 0.5f + distance / range, 1.0f));
+            field[j*width + i] = static_cast<GLubyte>(value * 255.0f + 0.5f);
+        }
+    }
+
+    m_pipeline->enableTexture2D(m_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_ALPHA, GL_UNSIGNED_BYTE, field.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // Строки поля идут сверху вниз: верх глифа - на меньшей текстурной координате
+    const GLfloat left(box.left() / oversample - spread);
+    const GLfloat top(spread - box.top() / oversample);
+    const GLfloat atlasSize(Vasnecov::cfg_glyphAtlasSize);
+
+    glyph.quadMin = QVector2D(left / em, (top - height) / em);
+    glyph.quadMax = QVector2D((left + width) / em, top / em);
+    glyph.textureMin = QVector2D(x / atlasSize, (y + height) / atlasSize);
+    glyph.textureMax = QVector2D((x + width) / atlasSize, y / atlasSize);
+    glyph.visible = true;
+}
+
+GLboolean Vasnecov::GlyphAtlas::renderPlace(GLint width, GLint height, GLint &x, GLint &y)
+{
+    const GLint size(Vasnecov::cfg_glyphAtlasSize);
+    if(!m_id && !renderCreateTexture())
+    {
+        return false;
+    }
+
+    // Глифы одного размера шрифта близки по высоте, поэтому хватает построчной укладки
+    if(m_penX + width > size)
+    {
+        m_penX = 0;
+        m_penY += m_rowHeight + 1;
+        m_rowHeight = 0;
+    }
+    if(width > size || m_penY + height > size)
+    {
+        return false;
+    }
+
+    x = m_penX;
+    y = m_penY;
+    m_penX += width + 1;
+    m_rowHeight = qMax(m_rowHeight, height);
+    return true;
+}
+
+//==================================================================================================
+
+/*!
+  \class Vasnecov::GlyphCache
+  \brief Атласы глифов, по одному на начертание шрифта. Атласы живут до удаления Вселенной.
+ */
+
+Vasnecov::GlyphCache::GlyphCache(VasnecovPipeline *pipeline) :
+    m_pipeline(pipeline),
+    m_atlases()
+{
+}
+
+Vasnecov::GlyphCache::~GlyphCache()
+{
+    for(std::vector<GlyphAtlas *>::iterator it = m_atlases.begin(); it != m_atlases.end(); ++it)
+    {
+        delete *it;
+    }
+}
+
+Vasnecov::GlyphAtlas *Vasnecov::GlyphCache::atlas(const QFont &font)
+{
+    const QString key(GlyphAtlas::fontKey(font));
+    for(std::vector<GlyphAtlas *>::const_iterator it = m_atlases.begin(); it != m_atlases.end(); ++it)
+    {
+        if((*it)->key() == key)
+        {
+            return *it;
+        }
+    }
+
+    m_atlases.push_back(new GlyphAtlas(m_pipeline, font));
+    return m_atlases.back();
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
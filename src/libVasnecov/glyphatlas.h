@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Атлас глифов шрифта в виде поля расстояний (для текстовых меток)
+#ifndef VASNECOV_GLYPHATLAS_H
+#define VASNECOV_GLYPHATLAS_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <map>
+#include <vector>
+#include <QFont>
+#include <QVector2D>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+class VasnecovPipeline;
+
+namespace Vasnecov
+{
+    class GlyphAtlas
+    {
+    public:
+        // Размеры - в долях размера шрифта (em), ось Y вверх от базовой линии
+        struct Glyph
+        {
+            QVector2D quadMin, quadMax;
+            QVector2D textureMin, textureMax; // Текстурные координаты углов quadMin и quadMax
+            GLfloat advance;
+            GLboolean visible; // Пробелы и не поместившиеся в атлас глифы не рисуются
+
+            Glyph() :
+                quadMin(), quadMax(),
+                textureMin(), textureMax(),
+                advance(0.0f),
+                visible(false)
+            {}
+        };
+
+    public:
+        GlyphAtlas(VasnecovPipeline *pipeline, const QFont &font);
+        ~GlyphAtlas();
+
+        static QString fontKey(const QFont &font); // Шрифты, отличающиеся только размером, делят один атлас
+        const QString &key() const {return m_key;}
+
+        // Методы ниже вызываются только в потоке отрисовки
+        const Glyph &renderGlyph(QChar character); // Недостающий глиф растеризуется один раз
+        GLfloat renderLineSpacing();
+        GLfloat renderAscent();
+        GLuint textureId() const {return m_id;}
+
+    private:
+        void renderInitialize();
+        GLboolean renderCreateTexture();
+        void renderBuildGlyph(QChar character, Glyph &glyph);
+        GLboolean renderPlace(GLint width, GLint height, GLint &x, GLint &y);
+
+    private:
+        VasnecovPipeline *const m_pipeline;
+        const QString m_key;
+        QFont m_font; // Шрифт растеризации (cfg_glyphSdfSize * cfg_glyphSdfOversample пикселей)
+        GLboolean m_initialized;
+        GLfloat m_lineSpacing;
+        GLfloat m_ascent;
+        GLuint m_id;
+        std::map<GLuint, Glyph> m_glyphs;
+        GLint m_penX, m_penY; // Место для следующего глифа
+        GLint m_rowHeight;
+        GLboolean m_full;
+
+        Q_DISABLE_COPY(GlyphAtlas)
+    };
+
+    // Атласы всех шрифтов Вселенной
+    class GlyphCache
+    {
+    public:
+        explicit GlyphCache(VasnecovPipeline *pipeline);
+        ~GlyphCache();
+
+        GlyphAtlas *atlas(const QFont &font); // Вызывается под мьютексом Вселенной
+
+    private:
+        VasnecovPipeline *const m_pipeline;
+        std::vector<GlyphAtlas *> m_atlases;
+
+        Q_DISABLE_COPY(GlyphCache)
+    };
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_GLYPHATLAS_H
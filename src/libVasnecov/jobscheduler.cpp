@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "jobscheduler.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::JobScheduler
+  \brief Небольшой пул потоков для распараллеливания подготовки кадра.
+
+  У каждого рабочего потока своя очередь задач. Поток берёт задачи со своего конца очереди, а
+  освободившись - перехватывает их с начала чужих очередей. Вызывающий (рендерящий) поток тоже
+  участвует в работе и возвращается только после выполнения всех задач.
+
+  Вызовы OpenGL в задачах недопустимы: контекст есть только у рендерящего потока.
+
+  При нулевом количестве рабочих потоков все задачи выполняются последовательно в вызывающем
+  потоке, в порядке возрастания индексов (детерминированный режим).
+ */
+
+Vasnecov::JobScheduler::JobScheduler(GLuint workersCount) :
+    m_workers(),
+    m_queues(),
+
+    mtx_wake(),
+    m_wake(),
+    mtx_done(),
+    m_done(),
+
+    m_queued(0),
+    m_pending(0),
+    m_stopping(false)
+{
+    startWorkers(workersCount);
+}
+
+Vasnecov::JobScheduler::~JobScheduler()
+{
+    stopWorkers();
+}
+
+void Vasnecov::JobScheduler::setWorkersCount(GLuint count)
+{
+    if(count > cfg_jobWorkersMax)
+    {
+        count = cfg_jobWorkersMax;
+    }
+
+    if(count != workersCount())
+    {
+        stopWorkers();
+        startWorkers(count);
+    }
+}
+
+/*!
+ \brief Количество рабочих потоков по умолчанию: все ядра, кроме рендерящего.
+*/
+GLuint Vasnecov::JobScheduler::defaultWorkersCount()
+{
+    GLint ideal(QThread::idealThreadCount() - 1);
+    if(ideal <= 0)
+    {
+        return 0;
+    }
+    return qMin(static_cast<GLuint>(ideal), cfg_jobWorkersMax);
+}
+
+void Vasnecov::JobScheduler::parallelFor(size_t count, size_t grain, const RangeJob &job)
+{
+    if(!count)
+    {
+        return;
+    }
+    if(!grain)
+    {
+        grain = 1;
+    }
+
+    // Однопоточный режим или слишком мало работы
+    if(m_workers.empty() || count <= grain)
+    {
+        for(size_t begin = 0; begin < count; begin += grain)
+        {
+            job(begin, qMin(begin + grain, count));
+        }
+        return;
+    }
+
+    GLint tasksCount(0);
+    {
+        QMutexLocker locker(&mtx_wake);
+
+        size_t queue(0);
+        for(size_t begin = 0; begin < count; begin += grain)
+        {
+            Task task;
+            task.job = &job;
+            task.begin = begin;
+            task.end = qMin(begin + grain, count);
+
+            TaskQueue *tq(m_queues[queue]);
+            tq->mutex.lock();
+            tq->tasks.push_back(task);
+            tq->mutex.unlock();
+
+            ++tasksCount;
+            queue = (queue + 1) % m_queues.size();
+        }
+
+        m_pending.fetchAndAddOrdered(tasksCount);
+        m_queued.fetchAndAddOrdered(tasksCount);
+        m_wake.wakeAll();
+    }
+
+    // Вызывающий поток работает наравне со всеми
+    const GLuint ownQueue(static_cast<GLuint>(m_queues.size() - 1));
+    Task task;
+    while(takeTask(ownQueue, task))
+    {
+        executeTask(task);
+    }
+
+    QMutexLocker locker(&mtx_done);
+    while(m_pending.loadAcquire() > 0)
+    {
+        m_done.wait(&mtx_done);
+    }
+}
+
+void Vasnecov::JobScheduler::startWorkers(GLuint count)
+{
+    m_stopping = false;
+
+    for(GLuint i = 0; i < count + 1; ++i)
+    {
+        m_queues.push_back(new TaskQueue());
+    }
+    for(GLuint i = 0; i < count; ++i)
+    {
+        Worker *worker(new Worker(this, i));
+        m_workers.push_back(worker);
+        worker->start();
+    }
+}
+
+void Vasnecov::JobScheduler::stopWorkers()
+{
+    {
+        QMutexLocker locker(&mtx_wake);
+        m_stopping = true;
+        m_wake.wakeAll();
+    }
+
+    for(std::vector<Worker *>::iterator wit = m_workers.begin();
+        wit != m_workers.end(); ++wit)
+    {
+        (*wit)->wait();
+        delete (*wit);
+    }
+    m_workers.clear();
+
+    for(std::vector<TaskQueue *>::iterator qit = m_queues.begin();
+        qit != m_queues.end(); ++qit)
+    {
+        delete (*qit);
+    }
+    m_queues.clear();
+}
+
+GLboolean Vasnecov::JobScheduler::takeTask(GLuint queue, Task &task)
+{
+    // Своя очередь
+    {
+        TaskQueue *tq(m_queues[queue]);
+        QMutexLocker locker(&tq->mutex);
+
+        if(!tq->tasks.empty())
+        {
+            task = tq->tasks.back();
+            tq->tasks.pop_back();
+            m_queued.fetchAndAddOrdered(-1);
+            return true;
+        }
+    }
+
+    // Перехват из чужих
+    for(size_t i = 1; i < m_queues.size(); ++i)
+    {
+        TaskQueue *tq(m_queues[(queue + i) % m_queues.size()]);
+        QMutexLocker locker(&tq->mutex);
+
+        if(!tq->tasks.empty())
+        {
+            task = tq->tasks.front();
+            tq->tasks.pop_front();
+            m_queued.fetchAndAddOrdered(-1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Vasnecov::JobScheduler::executeTask(const Task &task)
+{
+    (*task.job)(task.begin, task.end);
+
+    if(m_pending.fetchAndAddOrdered(-1) == 1)
+    {
+        QMutexLocker locker(&mtx_done);
+        m_done.wakeAll();
+    }
+}
+
+void Vasnecov::JobScheduler::workerLoop(GLuint index)
+{
+    for(;;)
+    {
+        {
+            QMutexLocker locker(&mtx_wake);
+            while(m_queued.loadAcquire() <= 0 && !m_stopping)
+            {
+                m_wake.wait(&mtx_wake);
+            }
+            if(m_stopping)
+            {
+                return;
+            }
+        }
+
+        Task task;
+        while(takeTask(index, task))
+        {
+            executeTask(task);
+        }
+    }
+}
+
+void Vasnecov::JobScheduler::Worker::run()
+{
+    m_scheduler->workerLoop(m_index);
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
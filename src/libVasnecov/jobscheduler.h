@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Планировщик задач рендерера (пул потоков с перехватом работы)
+#ifndef VASNECOV_JOBSCHEDULER_H
+#define VASNECOV_JOBSCHEDULER_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <deque>
+#include <vector>
+#include <functional>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QThread>
+#include "configuration.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace Vasnecov
+{
+    /*
+     * Задачи одного вызова не должны зависеть друг от друга и писать в общие данные, кроме атомарных
+     * флагов: тогда результат совпадает с последовательным выполнением (0 потоков) при любом их числе.
+     */
+    class JobScheduler
+    {
+    public:
+        typedef std::function<void (size_t begin, size_t end)> RangeJob;
+
+    public:
+        explicit JobScheduler(GLuint workersCount = 0);
+        ~JobScheduler();
+
+        // 0 - детерминированный однопоточный режим: всё выполняется в вызывающем потоке по порядку
+        void setWorkersCount(GLuint count);
+        GLuint workersCount() const;
+
+        // Разбиение диапазона [0, count) на куски по grain и выполнение их всеми потоками.
+        // Возврат - после завершения всех кусков. Вызывается только из одного потока (обычно рендерящего).
+        void parallelFor(size_t count, size_t grain, const RangeJob &job);
+
+        template <typename T, typename F>
+        void forEach(const std::vector<T *> &elements, F fun, size_t grain = cfg_jobGrainSize);
+
+        static GLuint defaultWorkersCount();
+
+    protected:
+        struct Task
+        {
+            const RangeJob *job;
+            size_t begin;
+            size_t end;
+
+            Task() :
+                job(0),
+                begin(0),
+                end(0)
+            {}
+        };
+        struct TaskQueue
+        {
+            QMutex mutex;
+            std::deque<Task> tasks;
+
+            TaskQueue() :
+                mutex(),
+                tasks()
+            {}
+        };
+
+        class Worker : public QThread
+        {
+        public:
+            Worker(JobScheduler *scheduler, GLuint index) :
+                QThread(),
+                m_scheduler(scheduler),
+                m_index(index)
+            {}
+        protected:
+            void run();
+        private:
+            JobScheduler *m_scheduler;
+            GLuint m_index;
+
+            Q_DISABLE_COPY(Worker)
+        };
+
+    protected:
+        void startWorkers(GLuint count);
+        void stopWorkers();
+
+        GLboolean takeTask(GLuint queue, Task &task); // Своя очередь - с конца, чужие - с начала
+        void executeTask(const Task &task);
+        void workerLoop(GLuint index);
+
+    private:
+        std::vector<Worker *> m_workers;
+        std::vector<TaskQueue *> m_queues; // Очередь на каждый поток и ещё одна - для вызывающего
+
+        QMutex mtx_wake;
+        QWaitCondition m_wake;
+        QMutex mtx_done;
+        QWaitCondition m_done;
+
+        QAtomicInt m_queued; // Задачи в очередях
+        QAtomicInt m_pending; // Незавершённые задачи текущего вызова
+        GLboolean m_stopping;
+
+    private:
+        Q_DISABLE_COPY(JobScheduler)
+    };
+
+    inline GLuint JobScheduler::workersCount() const
+    {
+        return static_cast<GLuint>(m_workers.size());
+    }
+
+    template <typename T, typename F>
+    inline void JobScheduler::forEach(const std::vector<T *> &elements, F fun, size_t grain)
+    {
+        parallelFor(elements.size(), grain, [&elements, &fun](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                fun(elements[i]);
+            }
+        });
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_JOBSCHEDULER_H
@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "labelatlas.h"
+#include <QImage>
+#include "vasnecovpipeline.h"
+#include "configuration.h"
+#include "technologist.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::LabelAtlas
+  \brief Атлас картинок меток: одна текстура вместо текстуры на каждую метку.
+
+  Картинки раскладываются по полкам: высота полки кратна \a cfg_labelAtlasShelfStep, в полку попадают
+  картинки близкой высоты. Освобождённые промежутки полки сливаются и используются повторно, опустевшие
+  верхние полки убираются. Если места нет, вытесняются давно не рисовавшиеся участки (кроме использованных
+  в текущем кадре), их метки загружают картинки заново при следующей отрисовке.
+ */
+
+Vasnecov::LabelAtlas::LabelAtlas(VasnecovPipeline *pipeline) :
+    m_pipeline(pipeline),
+    m_id(0),
+    m_entries(),
+    m_freeEntries(),
+    m_shelves(),
+    m_top(0),
+    m_frame(1)
+{
+}
+
+Vasnecov::LabelAtlas::~LabelAtlas()
+{
+    if(m_id)
+    {
+        glDeleteTextures(1, &m_id);
+    }
+}
+
+GLboolean Vasnecov::LabelAtlas::fits(GLsizei width, GLsizei height) const
+{
+    return width > 0 && height > 0 &&
+           width <= static_cast<GLsizei>(Vasnecov::cfg_labelAtlasItemMax) &&
+           height <= static_cast<GLsizei>(Vasnecov::cfg_labelAtlasItemMax);
+}
+
+Vasnecov::LabelAtlas::Handle Vasnecov::LabelAtlas::allocate(const QImage &image)
+{
+    Handle handle;
+    if(image.isNull() || !fits(image.width(), image.height()))
+    {
+        return handle;
+    }
+    if(!m_id && !createTexture())
+    {
+        return handle;
+    }
+
+    const GLint width(image.width() + Vasnecov::cfg_labelAtlasPadding);
+    const GLint height(image.height() + Vasnecov::cfg_labelAtlasPadding);
+
+    GLint shelf(-1);
+    GLint x(0);
+    while(!findSpace(width, height, shelf, x))
+    {
+        if(!evictOne())
+        {
+            return handle;
+        }
+    }
+
+    GLint index;
+    if(!m_freeEntries.empty())
+    {
+        index = m_freeEntries.back();
+        m_freeEntries.pop_back();
+    }
+    else
+    {
+        index = static_cast<GLint>(m_entries.size());
+        m_entries.push_back(Entry());
+    }
+
+    Entry &entry(m_entries[index]);
+    entry.shelf = shelf;
+    entry.x = x;
+    entry.width = width;
+    entry.height = image.height();
+    entry.lastUsed = m_frame;
+    entry.live = true;
+    ++m_shelves[shelf].entries;
+
+    handle.index = index;
+    handle.generation = entry.generation;
+
+    upload(x, m_shelves[shelf].y, image);
+
+    return handle;
+}
+
+GLboolean Vasnecov::LabelAtlas::update(const Handle &handle, const QImage &image)
+{
+    if(!resident(handle))
+    {
+        return false;
+    }
+
+    const Entry &entry(m_entries[handle.index]);
+    if(image.width() + static_cast<GLint>(Vasnecov::cfg_labelAtlasPadding) != entry.width || image.height() != entry.height)
+    {
+        return false;
+    }
+
+    upload(entry.x, m_shelves[entry.shelf].y, image);
+    return true;
+}
+
+void Vasnecov::LabelAtlas::release(Handle &handle)
+{
+    if(resident(handle))
+    {
+        freeEntry(handle.index);
+    }
+    handle = Handle();
+}
+
+QPoint Vasnecov::LabelAtlas::position(const Handle &handle) const
+{
+    if(!resident(handle))
+    {
+        return QPoint();
+    }
+    const Entry &entry(m_entries[handle.index]);
+    return QPoint(entry.x, m_shelves[entry.shelf].y);
+}
+
+GLsizei Vasnecov::LabelAtlas::size() const
+{
+    return Vasnecov::cfg_labelAtlasSize;
+}
+
+GLboolean Vasnecov::LabelAtlas::createTexture()
+{
+    glGenTextures(1, &m_id);
+    if(!m_id)
+    {
+        Vasnecov::problem("Не удалось создать атлас меток");
+        return false;
+    }
+
+    m_pipeline->enableTexture2D(m_id);
+    glTexImage2D(GL_TEXTURE_2D, 0, 4, Vasnecov::cfg_labelAtlasSize, Vasnecov::cfg_labelAtlasSize, 0,
+                 GL_BGRA_EXT, GL_UNSIGNED_BYTE, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return true;
+}
+
+void Vasnecov::LabelAtlas::upload(GLint x, GLint y, const QImage &image)
+{
+    // Строки QImage идут сверху вниз и ложатся в текстуру снизу вверх, как и у обычных текстур меток
+    QImage converted(image.format() == QImage::Format_ARGB32 ? image : image.convertToFormat(QImage::Format_ARGB32));
+    m_pipeline->enableTexture2D(m_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, converted.width(), converted.height(),
+                    GL_BGRA_EXT, GL_UNSIGNED_BYTE, converted.constBits());
+}
+
+GLboolean Vasnecov::LabelAtlas::findSpace(GLint width, GLint height, GLint &shelf, GLint &x)
+{
+    const GLint step(Vasnecov::cfg_labelAtlasShelfStep);
+    const GLint shelfHeight(((height + step - 1) / step) * step);
+
+    // Полка своей высоты или чуть выше; пустая полка подходит для любой не большей картинки
+    for(size_t i = 0; i < m_shelves.size(); ++i)
+    {
+        Shelf &candidate(m_shelves[i]);
+        if(candidate.height < shelfHeight)
+        {
+            continue;
+        }
+        if(candidate.height > shelfHeight + shelfHeight/2 && candidate.entries)
+        {
+            continue;
+        }
+        if(takeSpan(candidate, width, x))
+        {
+            shelf = static_cast<GLint>(i);
+            return true;
+        }
+    }
+
+    if(m_top + shelfHeight <= static_cast<GLint>(Vasnecov::cfg_labelAtlasSize))
+    {
+        m_shelves.push_back(Shelf(m_top, shelfHeight, Vasnecov::cfg_labelAtlasSize));
+        m_top += shelfHeight;
+
+        shelf = static_cast<GLint>(m_shelves.size() - 1);
+        return takeSpan(m_shelves.back(), width, x);
+    }
+
+    return false;
+}
+
+GLboolean Vasnecov::LabelAtlas::takeSpan(Shelf &shelf, GLint width, GLint &x)
+{
+    for(std::vector<std::pair<GLint, GLint> >::iterator it = shelf.free.begin(); it != shelf.free.end(); ++it)
+    {
+        if(it->second >= width)
+        {
+            x = it->first;
+            it->first += width;
+            it->second -= width;
+            if(it->second == 0)
+            {
+                shelf.free.erase(it);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void Vasnecov::LabelAtlas::freeSpan(Shelf &shelf, GLint x, GLint width)
+{
+    std::vector<std::pair<GLint, GLint> >::iterator it(shelf.free.begin());
+    while(it != shelf.free.end() && it->first < x)
+    {
+        ++it;
+    }
+    it = shelf.free.insert(it, std::make_pair(x, width));
+
+    // Слияние с соседями
+    std::vector<std::pair<GLint, GLint> >::iterator next(it + 1);
+    if(next != shelf.free.end() && it->first + it->second == next->first)
+    {
+        it->second += next->second;
+        shelf.free.erase(next);
+    }
+    if(it != shelf.free.begin())
+    {
+        std::vector<std::pair<GLint, GLint> >::iterator prev(it - 1);
+        if(prev->first + prev->second == it->first)
+        {
+            prev->second += it->second;
+            shelf.free.erase(it);
+        }
+    }
+}
+
+void Vasnecov::LabelAtlas::freeEntry(GLint index)
+{
+    Entry &entry(m_entries[index]);
+    Shelf &shelf(m_shelves[entry.shelf]);
+
+    freeSpan(shelf, entry.x, entry.width);
+    --shelf.entries;
+
+    entry.live = false;
+    ++entry.generation;
+    m_freeEntries.push_back(index);
+
+    // Пустые верхние полки возвращают место для полок любой высоты
+    while(!m_shelves.empty() && m_shelves.back().entries == 0)
+    {
+        m_top = m_shelves.back().y;
+        m_shelves.pop_back();
+    }
+}
+
+GLboolean Vasnecov::LabelAtlas::evictOne()
+{
+    GLint oldest(-1);
+    for(size_t i = 0; i < m_entries.size(); ++i)
+    {
+        const Entry &entry(m_entries[i]);
+        if(entry.live && entry.lastUsed < m_frame &&
+           (oldest < 0 || entry.lastUsed < m_entries[oldest].lastUsed))
+        {
+            oldest = static_cast<GLint>(i);
+        }
+    }
+
+    if(oldest < 0)
+    {
+        return false;
+    }
+
+    freeEntry(oldest);
+    return true;
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
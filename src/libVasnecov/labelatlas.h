@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Общая текстура (атлас) для картинок меток
+#ifndef VASNECOV_LABELATLAS_H
+#define VASNECOV_LABELATLAS_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <vector>
+#include <QPoint>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+class QImage;
+class VasnecovPipeline;
+
+namespace Vasnecov
+{
+    class LabelAtlas
+    {
+    public:
+        // Ссылка на участок атласа. Участок, вытесненный другим, перестаёт быть действительным
+        struct Handle
+        {
+            GLint index;
+            GLuint generation;
+
+            Handle() :
+                index(-1),
+                generation(0)
+            {}
+            GLboolean isValid() const {return index >= 0;}
+        };
+
+    public:
+        explicit LabelAtlas(VasnecovPipeline *pipeline);
+        ~LabelAtlas();
+
+        // Все методы, кроме fits(), вызываются только в потоке отрисовки
+        GLboolean fits(GLsizei width, GLsizei height) const;
+        Handle allocate(const QImage &image); // Размещение и загрузка картинки. Недействительная ссылка, если места нет
+        GLboolean update(const Handle &handle, const QImage &image); // Перезапись участка картинкой того же размера
+        void release(Handle &handle);
+        GLboolean resident(const Handle &handle) const;
+        void markUsed(const Handle &handle); // Участки, используемые в текущем кадре, не вытесняются
+        void nextFrame();
+
+        QPoint position(const Handle &handle) const; // Положение участка в пикселях текстуры
+        GLuint textureId() const;
+        GLsizei size() const;
+
+    private:
+        struct Entry
+        {
+            GLint shelf;
+            GLint x;
+            GLint width; // С учётом отступа
+            GLint height; // Без отступа
+            GLuint generation;
+            GLuint lastUsed;
+            GLboolean live;
+
+            Entry() :
+                shelf(-1),
+                x(0),
+                width(0),
+                height(0),
+                generation(0),
+                lastUsed(0),
+                live(false)
+            {}
+        };
+        struct Shelf
+        {
+            GLint y;
+            GLint height;
+            std::vector<std::pair<GLint, GLint> > free; // Свободные промежутки (x, ширина), по возрастанию x
+            GLuint entries;
+
+            Shelf(GLint p_y, GLint p_height, GLint width) :
+                y(p_y),
+                height(p_height),
+                free(1, std::make_pair(0, width)),
+                entries(0)
+            {}
+        };
+
+        GLboolean createTexture();
+        void upload(GLint x, GLint y, const QImage &image);
+        GLboolean findSpace(GLint width, GLint height, GLint &shelf, GLint &x);
+        GLboolean takeSpan(Shelf &shelf, GLint width, GLint &x);
+        void freeSpan(Shelf &shelf, GLint x, GLint width);
+        void freeEntry(GLint index);
+        GLboolean evictOne(); // Вытеснение давно не использованного участка
+
+    private:
+        VasnecovPipeline *m_pipeline;
+        GLuint m_id;
+        std::vector<Entry> m_entries;
+        std::vector<GLint> m_freeEntries;
+        std::vector<Shelf> m_shelves;
+        GLint m_top; // Занятая полками высота
+        GLuint m_frame;
+
+        Q_DISABLE_COPY(LabelAtlas)
+    };
+
+    inline GLuint LabelAtlas::textureId() const
+    {
+        return m_id;
+    }
+    inline GLboolean LabelAtlas::resident(const Handle &handle) const
+    {
+        return handle.isValid() && handle.index < static_cast<GLint>(m_entries.size()) &&
+               m_entries[handle.index].live && m_entries[handle.index].generation == handle.generation;
+    }
+    inline void LabelAtlas::markUsed(const Handle &handle)
+    {
+        if(resident(handle))
+        {
+            m_entries[handle.index].lastUsed = m_frame;
+        }
+    }
+    inline void LabelAtlas::nextFrame()
+    {
+        ++m_frame;
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_LABELATLAS_H
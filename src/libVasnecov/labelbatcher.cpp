@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "labelbatcher.h"
+#include "vasnecovlabel.h"
+#include "configuration.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::LabelBatcher
+  \brief Сборка меток с картинками в атласе в общий список прямоугольников для отрисовки одним вызовом.
+
+  Вершины сразу переводятся в координаты окна (как делает \a VasnecovPipeline::setMatrixOrtho2D()),
+  цвет меток передаётся массивом цветов. Метки, которые рисуются сами, сбрасывают накопленный пакет,
+  поэтому порядок наложения меток сохраняется.
+
+  Текстовые метки (\a VasnecovText) собираются так же, по прямоугольнику на глиф, но в пакеты атласов
+  глифов: их текстура - поле расстояний, и пакет рисуется с тестом альфы.
+ */
+
+Vasnecov::LabelBatcher::LabelBatcher(VasnecovPipeline *pipeline) :
+    m_pipeline(pipeline),
+    m_texture(0),
+    m_distanceField(false),
+    m_count(0),
+    m_vertices(),
+    m_textures(),
+    m_colors(),
+    m_indices()
+{
+}
+
+void Vasnecov::LabelBatcher::begin()
+{
+    m_count = 0;
+    m_vertices.clear();
+    m_textures.clear();
+    m_colors.clear();
+    m_indices.clear();
+}
+
+GLboolean Vasnecov::LabelBatcher::add(VasnecovLabel *label)
+{
+    if(!label)
+    {
+        return true;
+    }
+    if(label->renderIsHidden())
+    {
+        return true; // Нечего рисовать, пакет не прерывается
+    }
+    if(!label->renderPrepareAtlas())
+    {
+        return false;
+    }
+
+    const GLuint quads(label->renderBatchQuads());
+    if(!quads)
+    {
+        return true;
+    }
+
+    GLuint texture(label->renderAtlasTexture());
+    GLboolean distanceField(label->renderDistanceField());
+    if(m_count && (texture != m_texture || distanceField != m_distanceField))
+    {
+        draw();
+    }
+    m_texture = texture;
+    m_distanceField = distanceField;
+
+    const GLuint base(m_count * 4);
+    const GLuint size(base + quads * 4);
+    m_vertices.resize(size);
+    m_textures.resize(size);
+    m_colors.resize(size * 4);
+    label->renderFillBatch(&m_vertices[base], &m_textures[base], &m_colors[base * 4]);
+
+    const GLuint quad[6] = {0, 1, 2, 2, 3, 0};
+    for(GLuint q = base; q < size; q += 4)
+    {
+        for(GLuint i = 0; i < 6; ++i)
+        {
+            m_indices.push_back(q + quad[i]);
+        }
+    }
+    m_count += quads;
+
+    return true;
+}
+
+void Vasnecov::LabelBatcher::draw()
+{
+    if(!m_count)
+    {
+        return;
+    }
+
+    m_pipeline->setIdentityMatrixMV();
+    m_pipeline->enableTexture2D(m_texture);
+    if(m_distanceField)
+    {
+        m_pipeline->enableAlphaTest(Vasnecov::cfg_glyphSdfThreshold);
+    }
+    m_pipeline->drawColoredElements(VasnecovPipeline::Triangles, &m_indices, &m_vertices, &m_colors, &m_textures);
+    if(m_distanceField)
+    {
+        m_pipeline->disableAlphaTest();
+    }
+
+    begin();
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Пакетная отрисовка меток из атласа
+#ifndef VASNECOV_LABELBATCHER_H
+#define VASNECOV_LABELBATCHER_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <vector>
+#include "vasnecovpipeline.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+class VasnecovLabel;
+
+namespace Vasnecov
+{
+    class LabelBatcher
+    {
+    public:
+        explicit LabelBatcher(VasnecovPipeline *pipeline);
+
+        void begin(); // Начало кадра
+        GLboolean add(VasnecovLabel *label); // false - метка рисуется сама (после draw() накопленного)
+        void draw(); // Отрисовка накопленных меток, вызывается в режиме setOrtho2D()
+
+    private:
+        VasnecovPipeline *const m_pipeline;
+        GLuint m_texture; // Атлас накопленных меток
+        GLboolean m_distanceField;
+        GLuint m_count; // Прямоугольников
+        std::vector<QVector3D> m_vertices; // В координатах окна
+        std::vector<QVector2D> m_textures;
+        std::vector<GLubyte> m_colors;
+        std::vector<GLuint> m_indices;
+
+        Q_DISABLE_COPY(LabelBatcher)
+    };
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_LABELBATCHER_H
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "labelplacer.h"
+#include <algorithm>
+#include "vasnecovlabel.h"
+#include "configuration.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::LabelPlacer
+  \brief Размещение меток мира на экране перед их отрисовкой.
+
+  Опорные точки всех меток проецируются одним проходом, метки за пределами окна просмотра и за камерой
+  отсекаются до любой работы по отрисовке.
+
+  При разрежении прямоугольники меток на экране раскладываются по равномерной сетке в порядке убывания
+  приоритета, метка, задевающая уже размещённую, скрывается. Гистерезис: при равном приоритете первыми
+  размещаются показанные в прошлом кадре, а скрытая метка возвращается, только если вокруг неё свободно
+  на \a cfg_declutterMargin, поэтому метки на границе перекрытия не мерцают.
+ */
+
+Vasnecov::LabelPlacer::LabelPlacer(VasnecovPipeline *pipeline) :
+    m_pipeline(pipeline),
+    m_anchors(),
+    m_order(),
+    m_columns(0),
+    m_rows(0),
+    m_cells(),
+    m_usedCells(),
+    m_boxes()
+{
+}
+
+void Vasnecov::LabelPlacer::place(const std::vector<VasnecovLabel *> &labels, GLboolean declutter)
+{
+    // Опорные точки в видовых координатах, проекция - пакетом
+    m_anchors.resize(labels.size());
+    for(size_t i = 0; i < labels.size(); ++i)
+    {
+        const VasnecovLabel *label(labels[i]);
+        if(label->m_alienMs.pure())
+        {
+            m_anchors[i] = label->m_Ms.pure() * label->m_alienMs.pure()->column(3);
+        }
+        else
+        {
+            m_anchors[i] = label->m_Ms.pure().column(3);
+        }
+    }
+    m_pipeline->projectPoints(m_anchors);
+
+    const GLfloat width(m_pipeline->viewWidth());
+    const GLfloat height(m_pipeline->viewHeight());
+
+    for(size_t i = 0; i < labels.size(); ++i)
+    {
+        VasnecovLabel *label(labels[i]);
+        const QVector4D &anchor(m_anchors[i]);
+
+        label->pure_anchor = anchor;
+        label->pure_onScreen = !label->renderIsHidden() &&
+                               anchor.z() >= -1.0f && anchor.z() <= 1.0f &&
+                               anchor.x() + label->pure_boundsMax.x() >= 0.0f &&
+                               anchor.x() + label->pure_boundsMin.x() <= width &&
+                               anchor.y() + label->pure_boundsMax.y() >= 0.0f &&
+                               anchor.y() + label->pure_boundsMin.y() <= height;
+        if(!declutter)
+        {
+            label->pure_decluttered = false;
+        }
+    }
+
+    if(declutter)
+    {
+        this->declutter(labels);
+    }
+}
+
+void Vasnecov::LabelPlacer::declutter(const std::vector<VasnecovLabel *> &labels)
+{
+    const GLint cell(Vasnecov::cfg_declutterCellSize);
+    const GLint columns((m_pipeline->viewWidth() + cell - 1) / cell);
+    const GLint rows((m_pipeline->viewHeight() + cell - 1) / cell);
+    if(columns != m_columns || rows != m_rows)
+    {
+        m_columns = columns;
+        m_rows = rows;
+        m_cells.assign(m_columns * m_rows, std::vector<GLuint>());
+        m_usedCells.clear();
+    }
+    if(!m_columns || !m_rows)
+    {
+        return;
+    }
+
+    // Сетка опустошается по занятым ячейкам, ёмкость списков сохраняется
+    for(std::vector<GLuint>::const_iterator it = m_usedCells.begin(); it != m_usedCells.end(); ++it)
+    {
+        m_cells[*it].clear();
+    }
+    m_usedCells.clear();
+    m_boxes.clear();
+
+    m_order.clear();
+    for(GLuint i = 0; i < labels.size(); ++i)
+    {
+        if(labels[i]->pure_onScreen)
+        {
+            m_order.push_back(i);
+        }
+    }
+    std::stable_sort(m_order.begin(), m_order.end(), [&labels](GLuint a, GLuint b)
+    {
+        const GLint pa(labels[a]->m_priority.pure()), pb(labels[b]->m_priority.pure());
+        if(pa != pb)
+        {
+            return pa > pb;
+        }
+        return !labels[a]->pure_decluttered && labels[b]->pure_decluttered;
+    });
+
+    const GLfloat margin(Vasnecov::cfg_declutterMargin);
+    for(std::vector<GLuint>::const_iterator it = m_order.begin(); it != m_order.end(); ++it)
+    {
+        VasnecovLabel *label(labels[*it]);
+        const QVector4D &anchor(m_anchors[*it]);
+
+        Box box;
+        box.x0 = anchor.x() + label->pure_boundsMin.x();
+        box.y0 = anchor.y() + label->pure_boundsMin.y();
+        box.x1 = anchor.x() + label->pure_boundsMax.x();
+        box.y1 = anchor.y() + label->pure_boundsMax.y();
+
+        Box probe(box);
+        if(label->pure_decluttered)
+        {
+            probe.x0 -= margin;
+            probe.y0 -= margin;
+            probe.x1 += margin;
+            probe.y1 += margin;
+        }
+
+        label->pure_decluttered = collides(probe);
+        if(!label->pure_decluttered)
+        {
+            insert(box);
+        }
+    }
+}
+
+GLboolean Vasnecov::LabelPlacer::collides(const Box &box) const
+{
+    const GLfloat cell(Vasnecov::cfg_declutterCellSize);
+    const GLint c0(qBound(0, static_cast<GLint>(box.x0 / cell), m_columns - 1));
+    const GLint c1(qBound(0, static_cast<GLint>(box.x1 / cell), m_columns - 1));
+    const GLint r0(qBound(0, static_cast<GLint>(box.y0 / cell), m_rows - 1));
+    const GLint r1(qBound(0, static_cast<GLint>(box.y1 / cell), m_rows - 1));
+
+    for(GLint r = r0; r <= r1; ++r)
+    {
+        for(GLint c = c0; c <= c1; ++c)
+        {
+            const std::vector<GLuint> &placed(m_cells[r*m_columns + c]);
+            for(std::vector<GLuint>::const_iterator it = placed.begin(); it != placed.end(); ++it)
+            {
+                const Box &other(m_boxes[*it]);
+                if(box.x0 < other.x1 && other.x0 < box.x1 && box.y0 < other.y1 && other.y0 < box.y1)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void Vasnecov::LabelPlacer::insert(const Box &box)
+{
+    const GLuint index(static_cast<GLuint>(m_boxes.size()));
+    m_boxes.push_back(box);
+
+    const GLfloat cell(Vasnecov::cfg_declutterCellSize);
+    const GLint c0(qBound(0, static_cast<GLint>(box.x0 / cell), m_columns - 1));
+    const GLint c1(qBound(0, static_cast<GLint>(box.x1 / cell), m_columns - 1));
+    const GLint r0(qBound(0, static_cast<GLint>(box.y0 / cell), m_rows - 1));
+    const GLint r1(qBound(0, static_cast<GLint>(box.y1 / cell), m_rows - 1));
+
+    for(GLint r = r0; r <= r1; ++r)
+    {
+        for(GLint c = c0; c <= c1; ++c)
+        {
+            const GLuint id(r*m_columns + c);
+            if(m_cells[id].empty())
+            {
+                m_usedCells.push_back(id);
+            }
+            m_cells[id].push_back(index);
+        }
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
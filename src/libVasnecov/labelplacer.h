@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Размещение меток на экране: отсечение невидимых и разрежение перекрытых
+#ifndef VASNECOV_LABELPLACER_H
+#define VASNECOV_LABELPLACER_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <vector>
+#include <QVector4D>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+class VasnecovPipeline;
+class VasnecovLabel;
+
+namespace Vasnecov
+{
+    class LabelPlacer
+    {
+    public:
+        explicit LabelPlacer(VasnecovPipeline *pipeline);
+
+        // Вызывается в потоке отрисовки перед рисованием меток мира (после задания его окна просмотра)
+        void place(const std::vector<VasnecovLabel *> &labels, GLboolean declutter);
+
+    private:
+        struct Box
+        {
+            GLfloat x0, y0, x1, y1;
+        };
+
+        void declutter(const std::vector<VasnecovLabel *> &labels);
+        GLboolean collides(const Box &box) const;
+        void insert(const Box &box);
+
+    private:
+        VasnecovPipeline *const m_pipeline;
+        std::vector<QVector4D> m_anchors;
+        std::vector<GLuint> m_order;
+
+        // Сетка по окну просмотра: в ячейке - номера занявших её прямоугольников
+        GLint m_columns, m_rows;
+        std::vector<std::vector<GLuint> > m_cells;
+        std::vector<GLuint> m_usedCells;
+        std::vector<Box> m_boxes;
+
+        Q_DISABLE_COPY(LabelPlacer)
+    };
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_LABELPLACER_H
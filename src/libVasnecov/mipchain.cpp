@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "mipchain.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define VASNECOV_MIPCHAIN_SSE
+    #include <emmintrin.h>
+#endif
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::MipChain
+  \brief Уровни детализации текстуры, подготовленные заранее.
+
+  Цепочка строится в потоке загрузки, поэтому потоку отрисовки остаётся только передать готовые уровни
+  в OpenGL (по glTexImage2D на уровень) вместо gluBuild2DMipmaps под мьютексом Вселенной.
+
+  Каждый уровень - среднее квадратов 2x2 предыдущего, с округлением. Четыре точки результата считаются
+  за раз (SSE2, при его отсутствии - обычным циклом).
+ */
+
+Vasnecov::MipChain::MipChain() :
+    m_base(),
+    m_levels(),
+    m_data(),
+    m_alpha(TextureAlphaOpaque)
+{
+}
+
+void Vasnecov::MipChain::build(const QImage &image)
+{
+    clear();
+    if(image.isNull())
+    {
+        return;
+    }
+
+    const GLboolean alphaChannel(image.hasAlphaChannel());
+    if(image.format() == QImage::Format_ARGB32 || image.format() == QImage::Format_RGB32)
+    {
+        m_base = image;
+    }
+    else
+    {
+        m_base = image.convertToFormat(alphaChannel ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    }
+    // Канал альфы в PNG ещё не значит прозрачности: непрозрачные картинки рисуются без смешивания
+    if(alphaChannel)
+    {
+        m_alpha = scanAlpha(m_base.constBits(), static_cast<size_t>(m_base.width()) * m_base.height());
+    }
+
+    Level level;
+    level.width = m_base.width();
+    level.height = m_base.height();
+    level.offset = 0;
+    m_levels.push_back(level);
+
+    // Разметка всех уровней - до выделения памяти, чтобы выделить её один раз
+    size_t total(0);
+    while(level.width > 1 || level.height > 1)
+    {
+        level.width = qMax(level.width / 2, 1);
+        level.height = qMax(level.height / 2, 1);
+        level.offset = total;
+        total += static_cast<size_t>(level.width) * level.height * 4;
+        m_levels.push_back(level);
+    }
+    m_data.resize(total);
+
+    for(GLuint i = 1; i < m_levels.size(); ++i)
+    {
+        downsample(levelBits(i - 1), m_levels[i - 1].width, m_levels[i - 1].height, &m_data[m_levels[i].offset]);
+    }
+}
+
+void Vasnecov::MipChain::clear()
+{
+    m_base = QImage();
+    m_levels.clear();
+    std::vector<GLubyte>().swap(m_data);
+    m_alpha = TextureAlphaOpaque;
+}
+
+const GLubyte *Vasnecov::MipChain::levelBits(GLuint level) const
+{
+    if(!level)
+    {
+        return m_base.constBits();
+    }
+    return &m_data[m_levels[level].offset];
+}
+
+size_t Vasnecov::MipChain::bytes() const
+{
+    if(m_levels.empty())
+    {
+        return 0;
+    }
+    return static_cast<size_t>(m_levels[0].width) * m_levels[0].height * 4 + m_data.size();
+}
+
+void Vasnecov::MipChain::downsample(const GLubyte *src, GLsizei width, GLsizei height, GLubyte *dst)
+{
+    const GLsizei dstWidth(qMax(width / 2, 1));
+    const GLsizei dstHeight(qMax(height / 2, 1));
+    const size_t stride(static_cast<size_t>(width) * 4);
+
+    for(GLsizei y = 0; y < dstHeight; ++y)
+    {
+        const GLubyte *row0(src + stride * (height > 1 ? 2 * y : 0));
+        const GLubyte *row1(height > 1 ? row0 + stride : row0);
+        GLubyte *out(dst + static_cast<size_t>(dstWidth) * 4 * y);
+        GLsizei x(0);
+
+        if(width > 1)
+        {
+#ifdef VASNECOV_MIPCHAIN_SSE
+            const __m128i zero(_mm_setzero_si128());
+            const __m128i round(_mm_set1_epi16(2));
+
+            for(; x + 4 <= dstWidth; x += 4)
+            {
+                __m128i half[2];
+                for(GLuint h = 0; h < 2; ++h)
+                {
+                    // Четыре точки строки -> две точки результата в 16-битных каналах
+                    const __m128i a(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8 + h * 16)));
+                    const __m128i b(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8 + h * 16)));
+                    const __m128i low(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+                    const __m128i high(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+                    const __m128i sum(_mm_unpacklo_epi64(_mm_add_epi16(low, _mm_srli_si128(low, 8)),
+                                                         _mm_add_epi16(high, _mm_srli_si128(high, 8))));
+                    half[h] = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x * 4), _mm_packus_epi16(half[0], half[1]));
+            }
+#endif
+            for(; x < dstWidth; ++x)
+            {
+                const GLubyte *a(row0 + x * 8);
+                const GLubyte *b(row1 + x * 8);
+                for(GLuint c = 0; c < 4; ++c)
+                {
+                    out[x * 4 + c] = static_cast<GLubyte>((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) >> 2);
+                }
+            }
+        }
+        else
+        {
+            for(GLuint c = 0; c < 4; ++c)
+            {
+                out[c] = static_cast<GLubyte>((row0[c] + row1[c] + 1) >> 1);
+            }
+        }
+    }
+}
+
+/*!
+ \brief Определение вида прозрачности: непрозрачная, только 0 и 255 (отбрасывание фрагментов) или смешивание.
+
+ Точки проверяются по четыре за раз. Промежуточное значение альфы сразу решает дело, поэтому проверка
+ прекращается на первом же таком участке.
+*/
+Vasnecov::TextureAlpha Vasnecov::MipChain::scanAlpha(const GLubyte *bgra, size_t count)
+{
+    GLboolean transparent(false); // Есть альфа меньше 255
+    size_t i(0);
+
+#ifdef VASNECOV_MIPCHAIN_SSE
+    const __m128i mask(_mm_set1_epi32(static_cast<int>(0xff000000)));
+    const __m128i zero(_mm_setzero_si128());
+    const __m128i ones(_mm_cmpeq_epi32(zero, zero));
+    __m128i notFull(zero), middle(zero);
+
+    const size_t vectorCount(count & ~static_cast<size_t>(3));
+    while(i < vectorCount)
+    {
+        const size_t end(qMin(vectorCount, i + 1024));
+        for(; i < end; i += 4)
+        {
+            const __m128i alpha(_mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bgra + i * 4)), mask));
+            const __m128i full(_mm_cmpeq_epi32(alpha, mask));
+            const __m128i empty(_mm_cmpeq_epi32(alpha, zero));
+            notFull = _mm_or_si128(notFull, _mm_andnot_si128(full, ones));
+            middle = _mm_or_si128(middle, _mm_andnot_si128(_mm_or_si128(full, empty), ones));
+        }
+        if(_mm_movemask_epi8(middle))
+        {
+            return TextureAlphaBlended;
+        }
+    }
+    transparent = _mm_movemask_epi8(notFull) != 0;
+#endif
+
+    for(; i < count; ++i)
+    {
+        const GLubyte alpha(bgra[i * 4 + 3]);
+        if(alpha != 255)
+        {
+            if(alpha)
+            {
+                return TextureAlphaBlended;
+            }
+            transparent = true;
+        }
+    }
+
+    return transparent ? TextureAlphaTested : TextureAlphaOpaque;
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Цепочка уровней детализации текстуры, строится вне потока отрисовки
+#ifndef VASNECOV_MIPCHAIN_H
+#define VASNECOV_MIPCHAIN_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <vector>
+#include <QImage>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace Vasnecov
+{
+    class MipChain
+    {
+    public:
+        MipChain();
+
+        // Картинка приводится к 32 битам на точку (в памяти - BGRA), уровни уменьшаются вдвое до 1x1
+        void build(const QImage &image);
+        void clear();
+
+        GLuint levelsCount() const {return static_cast<GLuint>(m_levels.size());}
+        GLsizei levelWidth(GLuint level) const {return m_levels[level].width;}
+        GLsizei levelHeight(GLuint level) const {return m_levels[level].height;}
+        const GLubyte *levelBits(GLuint level) const;
+        const QImage &base() const {return m_base;} // Нулевой уровень
+        size_t bytes() const; // Объём всех уровней
+        GLboolean hasAlpha() const {return m_alpha != TextureAlphaOpaque;}
+        TextureAlpha alpha() const {return m_alpha;} // По нулевому уровню
+
+        // Усреднение квадратов 2x2 (по краю картинки в одну точку - повтор крайней)
+        static void downsample(const GLubyte *src, GLsizei width, GLsizei height, GLubyte *dst);
+        // Вид прозрачности count точек (B, G, R, A)
+        static TextureAlpha scanAlpha(const GLubyte *bgra, size_t count);
+
+    private:
+        struct Level
+        {
+            GLsizei width, height;
+            size_t offset; // Для уровней, начиная с первого, - смещение в m_data
+        };
+
+        QImage m_base; // Нулевой уровень - сама картинка, без копирования
+        std::vector<Level> m_levels;
+        std::vector<GLubyte> m_data;
+        TextureAlpha m_alpha;
+
+        Q_DISABLE_COPY(MipChain)
+    };
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_MIPCHAIN_H
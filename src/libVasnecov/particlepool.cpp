@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "particlepool.h"
+#include <algorithm>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define VASNECOV_PARTICLES_SSE
+    #include <xmmintrin.h>
+#endif
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::ParticlePool
+  \brief Пул частиц фиксированной ёмкости.
+
+  Поля частиц хранятся отдельными массивами, живые частицы всегда занимают начало массивов: умершая
+  частица замещается последней. Испускание и удаление частиц память не выделяют.
+
+  Продвижение частиц выполняется четвёрками (SSE, при его отсутствии - обычным циклом того же вида).
+ */
+
+Vasnecov::ParticlePool::ParticlePool() :
+    m_px(), m_py(), m_pz(),
+    m_vx(), m_vy(), m_vz(),
+    m_r(), m_g(), m_b(), m_a(),
+    m_age(), m_life(),
+    m_fade(),
+    m_vertices(),
+    m_capacity(0),
+    m_size(0)
+{
+}
+
+void Vasnecov::ParticlePool::setCapacity(GLuint capacity)
+{
+    if(capacity == m_capacity)
+    {
+        return;
+    }
+
+    m_capacity = capacity;
+    m_size = qMin(m_size, capacity);
+
+    const size_t padded((capacity + 3) & ~3u);
+    std::vector<GLfloat> *fields[] = {&m_px, &m_py, &m_pz, &m_vx, &m_vy, &m_vz,
+                                      &m_r, &m_g, &m_b, &m_a, &m_age, &m_life, &m_fade};
+    for(size_t i = 0; i < sizeof(fields)/sizeof(fields[0]); ++i)
+    {
+        fields[i]->resize(padded, 0.0f);
+    }
+    // Незанятые ячейки тоже участвуют в расчёте четвёрок. Живые частицы не трогаются
+    std::fill(m_life.begin() + m_size, m_life.end(), 1.0f);
+    m_vertices.resize(capacity);
+}
+
+GLboolean Vasnecov::ParticlePool::emit(const Vasnecov::Particle &particle)
+{
+    if(m_size >= m_capacity)
+    {
+        return false;
+    }
+
+    const GLuint i(m_size);
+    m_px[i] = particle.position.x();
+    m_py[i] = particle.position.y();
+    m_pz[i] = particle.position.z();
+    m_vx[i] = particle.velocity.x();
+    m_vy[i] = particle.velocity.y();
+    m_vz[i] = particle.velocity.z();
+    m_r[i] = particle.color.redF();
+    m_g[i] = particle.color.greenF();
+    m_b[i] = particle.color.blueF();
+    m_a[i] = particle.color.alphaF();
+    m_age[i] = 0.0f;
+    m_life[i] = particle.life > 0.0f ? particle.life : 1.0f;
+    m_fade[i] = 1.0f;
+
+    ++m_size;
+    return true;
+}
+
+void Vasnecov::ParticlePool::clear()
+{
+    m_size = 0;
+}
+
+void Vasnecov::ParticlePool::advance(GLfloat dt, const QVector3D &acceleration)
+{
+    // Сначала удаляются частицы, которые не доживут до конца шага
+    for(GLuint i = 0; i < m_size;)
+    {
+        if(m_age[i] + dt >= m_life[i])
+        {
+            kill(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    if(m_size)
+    {
+        integrate(dt, acceleration);
+        fillVertices();
+    }
+}
+
+void Vasnecov::ParticlePool::kill(GLuint index)
+{
+    const GLuint last(m_size - 1);
+    if(index != last)
+    {
+        m_px[index] = m_px[last];
+        m_py[index] = m_py[last];
+        m_pz[index] = m_pz[last];
+        m_vx[index] = m_vx[last];
+        m_vy[index] = m_vy[last];
+        m_vz[index] = m_vz[last];
+        m_r[index] = m_r[last];
+        m_g[index] = m_g[last];
+        m_b[index] = m_b[last];
+        m_a[index] = m_a[last];
+        m_age[index] = m_age[last];
+        m_life[index] = m_life[last];
+    }
+    --m_size;
+}
+
+void Vasnecov::ParticlePool::integrate(GLfloat dt, const QVector3D &acceleration)
+{
+    const GLuint count((m_size + 3) & ~3u);
+    GLfloat *px(m_px.data()), *py(m_py.data()), *pz(m_pz.data());
+    GLfloat *vx(m_vx.data()), *vy(m_vy.data()), *vz(m_vz.data());
+    GLfloat *age(m_age.data()), *fade(m_fade.data());
+    const GLfloat *life(m_life.data());
+
+#ifdef VASNECOV_PARTICLES_SSE
+    const __m128 t(_mm_set1_ps(dt));
+    const __m128 ax(_mm_set1_ps(acceleration.x() * dt));
+    const __m128 ay(_mm_set1_ps(acceleration.y() * dt));
+    const __m128 az(_mm_set1_ps(acceleration.z() * dt));
+    const __m128 one(_mm_set1_ps(1.0f));
+
+    for(GLuint i = 0; i < count; i += 4)
+    {
+        __m128 v(_mm_add_ps(_mm_loadu_ps(vx + i), ax));
+        _mm_storeu_ps(vx + i, v);
+        _mm_storeu_ps(px + i, _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(v, t)));
+
+        v = _mm_add_ps(_mm_loadu_ps(vy + i), ay);
+        _mm_storeu_ps(vy + i, v);
+        _mm_storeu_ps(py + i, _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(v, t)));
+
+        v = _mm_add_ps(_mm_loadu_ps(vz + i), az);
+        _mm_storeu_ps(vz + i, v);
+        _mm_storeu_ps(pz + i, _mm_add_ps(_mm_loadu_ps(pz + i), _mm_mul_ps(v, t)));
+
+        __m128 a(_mm_add_ps(_mm_loadu_ps(age + i), t));
+        _mm_storeu_ps(age + i, a);
+        _mm_storeu_ps(fade + i, _mm_sub_ps(one, _mm_div_ps(a, _mm_loadu_ps(life + i))));
+    }
+#else
+    const GLfloat ax(acceleration.x() * dt);
+    const GLfloat ay(acceleration.y() * dt);
+    const GLfloat az(acceleration.z() * dt);
+
+    for(GLuint i = 0; i < count; ++i)
+    {
+        vx[i] += ax;
+        vy[i] += ay;
+        vz[i] += az;
+        px[i] += vx[i] * dt;
+        py[i] += vy[i] * dt;
+        pz[i] += vz[i] * dt;
+        age[i] += dt;
+        fade[i] = 1.0f - age[i] / life[i];
+    }
+#endif
+}
+
+void Vasnecov::ParticlePool::fillVertices()
+{
+    for(GLuint i = 0; i < m_size; ++i)
+    {
+        ParticleVertex &vertex(m_vertices[i]);
+        vertex.xyz[0] = m_px[i];
+        vertex.xyz[1] = m_py[i];
+        vertex.xyz[2] = m_pz[i];
+        vertex.rgba[0] = static_cast<GLubyte>(m_r[i] * 255.0f + 0.5f);
+        vertex.rgba[1] = static_cast<GLubyte>(m_g[i] * 255.0f + 0.5f);
+        vertex.rgba[2] = static_cast<GLubyte>(m_b[i] * 255.0f + 0.5f);
+        vertex.rgba[3] = static_cast<GLubyte>(qBound(0.0f, m_a[i] * m_fade[i], 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
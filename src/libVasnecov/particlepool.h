@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Пул частиц с хранением по полям (структура массивов)
+#ifndef VASNECOV_PARTICLEPOOL_H
+#define VASNECOV_PARTICLEPOOL_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <vector>
+#include <QColor>
+#include <QVector3D>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace Vasnecov
+{
+    struct Particle
+    {
+        QVector3D position;
+        QVector3D velocity;
+        QColor color;
+        GLfloat life; // Время жизни, с. Прозрачность убывает до нуля к концу жизни
+
+        Particle() :
+            position(),
+            velocity(),
+            color(255, 255, 255, 255),
+            life(1.0f)
+        {}
+        Particle(const QVector3D &p, const QVector3D &v, const QColor &c, GLfloat l) :
+            position(p),
+            velocity(v),
+            color(c),
+            life(l)
+        {}
+    };
+
+    // Запись для отрисовки: координаты и цвет подряд, как в Vasnecov::PointCloudFile
+    struct ParticleVertex
+    {
+        GLfloat xyz[3];
+        GLubyte rgba[4];
+    };
+
+    class ParticlePool
+    {
+    public:
+        ParticlePool();
+
+        void setCapacity(GLuint capacity); // Единственный метод, выделяющий память
+        GLuint capacity() const;
+        GLuint size() const;
+
+        GLboolean emit(const Particle &particle); // false, если пул заполнен
+        void clear();
+
+        // Удаление отживших, продвижение живых на dt и заполнение записей отрисовки
+        void advance(GLfloat dt, const QVector3D &acceleration);
+        const ParticleVertex *vertices() const;
+
+    private:
+        void kill(GLuint index);
+        void integrate(GLfloat dt, const QVector3D &acceleration);
+        void fillVertices();
+
+    private:
+        // Размер массивов кратен 4 для обработки четвёрками без хвоста
+        std::vector<GLfloat> m_px, m_py, m_pz;
+        std::vector<GLfloat> m_vx, m_vy, m_vz;
+        std::vector<GLfloat> m_r, m_g, m_b, m_a;
+        std::vector<GLfloat> m_age, m_life;
+        std::vector<GLfloat> m_fade; // Текущая доля начальной непрозрачности
+        std::vector<ParticleVertex> m_vertices;
+        GLuint m_capacity;
+        GLuint m_size;
+    };
+
+    inline GLuint ParticlePool::capacity() const
+    {
+        return m_capacity;
+    }
+    inline GLuint ParticlePool::size() const
+    {
+        return m_size;
+    }
+    inline const ParticleVertex *ParticlePool::vertices() const
+    {
+        return m_vertices.data();
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_PARTICLEPOOL_H
@@ -0,0 +1,481 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pointcloudfile.h"
+#include <cstring>
+#include <limits>
+#include <unordered_set>
+#include "configuration.h"
+#include "technologist.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::PointCloudFile
+  \brief Облако точек в файле с октодеревом уровней детализации.
+
+  Файл целиком отображается в память (QFile::map), в оперативную память читаются только заголовок и
+  узлы дерева, точки подкачиваются системой по мере обращения к ним при отрисовке.
+
+  Формат (little-endian):
+  \li заголовок: "VNCLOUD1", версия (uint32), количество узлов (uint32), количество точек (uint64),
+  габарит облака (6 float);
+  \li узлы: габарит (6 float), первая точка (uint64), количество точек (uint32), потомки (8 int32, -1 - нет),
+  расстояние между точками (float);
+  \li точки: x, y, z (float) и цвет RGBA (4 байта), точки каждого узла лежат подряд.
+
+  Корень - узел 0. Каждый узел хранит прореженную по сетке выборку своей области, остальные точки уходят
+  в потомков, поэтому облако, нарисованное до любой глубины, не содержит повторов. Габарит узла охватывает
+  всё его поддерево, а не только собственную выборку: по нему отсекаются и потомки.
+ */
+
+namespace
+{
+    const char cloudMagic[8] = {'V', 'N', 'C', 'L', 'O', 'U', 'D', '1'};
+    const quint32 cloudVersion = 1;
+
+    template <typename T>
+    inline T readValue(const uchar *&data)
+    {
+        T value;
+        memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+        return value;
+    }
+
+    template <typename T>
+    inline void writeValue(QFile &file, const T &value)
+    {
+        file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    inline void writeVector(QFile &file, const QVector3D &vector)
+    {
+        writeValue<float>(file, vector.x());
+        writeValue<float>(file, vector.y());
+        writeValue<float>(file, vector.z());
+    }
+
+    // Построение дерева в памяти перед записью
+    class CloudBuilder
+    {
+    public:
+        CloudBuilder(const std::vector<QVector3D> &points, const std::vector<QColor> &colors) :
+            m_points(points),
+            m_colors(colors),
+            nodes(),
+            order()
+        {}
+
+        GLint build(std::vector<GLuint> &ids, const QVector3D &boxMin, GLfloat size, GLuint depth)
+        {
+            GLint index(static_cast<GLint>(nodes.size()));
+            nodes.push_back(Vasnecov::PointCloudFile::Node());
+
+            GLboolean leaf(depth >= Vasnecov::cfg_cloudDepthMax || ids.size() <= Vasnecov::cfg_cloudNodePoints);
+
+            // Сетка укрупняется, пока занятых ячеек больше, чем точек в узле: тогда выборка по точке на ячейку
+            // покрывает весь куб равномерно, независимо от порядка точек (сканы лидаров идут полосами)
+            GLuint grid(Vasnecov::cfg_cloudNodeGrid);
+            if(!leaf)
+            {
+                std::unordered_set<quint64> cells;
+                for(std::vector<GLuint>::const_iterator it = ids.begin(); it != ids.end(); ++it)
+                {
+                    cells.insert(cellKey(m_points[*it], boxMin, size / grid, grid));
+                }
+                while(cells.size() > Vasnecov::cfg_cloudNodePoints && grid > 1)
+                {
+                    grid /= 2;
+                    std::unordered_set<quint64> coarse;
+                    coarse.reserve(cells.size() / 4);
+                    for(std::unordered_set<quint64>::const_iterator cit = cells.begin(); cit != cells.end(); ++cit)
+                    {
+                        coarse.insert(coarserKey(*cit));
+                    }
+                    cells.swap(coarse);
+                }
+            }
+            const GLfloat cell(size / grid);
+
+            // Выборка по сетке: по точке на ячейку
+            std::unordered_set<quint64> taken;
+            std::vector<GLuint> rest;
+            quint64 first(order.size());
+
+            for(std::vector<GLuint>::const_iterator it = ids.begin(); it != ids.end(); ++it)
+            {
+                if(leaf)
+                {
+                    order.push_back(*it);
+                    continue;
+                }
+
+                quint64 key(cellKey(m_points[*it], boxMin, cell, grid));
+
+                if(order.size() - first < Vasnecov::cfg_cloudNodePoints && taken.insert(key).second)
+                {
+                    order.push_back(*it);
+                }
+                else
+                {
+                    rest.push_back(*it);
+                }
+            }
+            std::vector<GLuint>().swap(ids);
+
+            Vasnecov::PointCloudFile::Node &node(nodes[index]);
+            node.first = first;
+            node.count = static_cast<GLuint>(order.size() - first);
+            node.spacing = leaf ? 0.0f : cell;
+            nodeBox(node, first);
+
+            if(!rest.empty())
+            {
+                const GLfloat half(size * 0.5f);
+                std::vector<GLuint> octants[8];
+                for(std::vector<GLuint>::const_iterator it = rest.begin(); it != rest.end(); ++it)
+                {
+                    const QVector3D &p(m_points[*it]);
+                    GLuint octant((p.x() >= boxMin.x() + half ? 1 : 0) |
+                                  (p.y() >= boxMin.y() + half ? 2 : 0) |
+                                  (p.z() >= boxMin.z() + half ? 4 : 0));
+                    octants[octant].push_back(*it);
+                }
+                std::vector<GLuint>().swap(rest);
+
+                for(GLuint i = 0; i < 8; ++i)
+                {
+                    if(!octants[i].empty())
+                    {
+                        QVector3D childMin(boxMin.x() + ((i & 1) ? half : 0.0f),
+                                           boxMin.y() + ((i & 2) ? half : 0.0f),
+                                           boxMin.z() + ((i & 4) ? half : 0.0f));
+                        GLint child(build(octants[i], childMin, half, depth + 1));
+                        nodes[index].children[i] = child; // Ссылка node недействительна после рекурсии
+                        mergeBox(nodes[index], nodes[child]);
+                    }
+                }
+            }
+
+            return index;
+        }
+
+        void pointRecord(GLuint id, uchar *record) const
+        {
+            const QVector3D &p(m_points[id]);
+            float xyz[3] = {p.x(), p.y(), p.z()};
+            memcpy(record, xyz, sizeof(xyz));
+
+            if(id < m_colors.size())
+            {
+                record[12] = static_cast<uchar>(m_colors[id].red());
+                record[13] = static_cast<uchar>(m_colors[id].green());
+                record[14] = static_cast<uchar>(m_colors[id].blue());
+                record[15] = static_cast<uchar>(m_colors[id].alpha());
+            }
+            else
+            {
+                memset(record + 12, 255, 4);
+            }
+        }
+
+    private:
+        static quint64 cellIndex(GLfloat value, GLuint grid)
+        {
+            if(value <= 0.0f)
+            {
+                return 0;
+            }
+            return qMin(static_cast<quint64>(value), static_cast<quint64>(grid - 1));
+        }
+        static quint64 cellKey(const QVector3D &point, const QVector3D &boxMin, GLfloat cell, GLuint grid)
+        {
+            QVector3D local((point - boxMin) / cell);
+            quint64 key(cellIndex(local.x(), grid));
+            key = (key << 21) | cellIndex(local.y(), grid);
+            key = (key << 21) | cellIndex(local.z(), grid);
+            return key;
+        }
+        static quint64 coarserKey(quint64 key) // Ячейка сетки вдвое крупнее
+        {
+            const quint64 mask((1ull << 21) - 1);
+            return (((key >> 42) & mask) >> 1) << 42 |
+                   (((key >> 21) & mask) >> 1) << 21 |
+                   ((key & mask) >> 1);
+        }
+
+        // Выборка узла непуста: у листа все его точки, у остальных - хотя бы одна ячейка
+        void nodeBox(Vasnecov::PointCloudFile::Node &node, quint64 first) const
+        {
+            if(node.count == 0)
+            {
+                return;
+            }
+            node.boxMin = node.boxMax = m_points[order[first]];
+            for(quint64 i = first + 1; i < order.size(); ++i)
+            {
+                const QVector3D &p(m_points[order[i]]);
+                node.boxMin = QVector3D(qMin(node.boxMin.x(), p.x()), qMin(node.boxMin.y(), p.y()), qMin(node.boxMin.z(), p.z()));
+                node.boxMax = QVector3D(qMax(node.boxMax.x(), p.x()), qMax(node.boxMax.y(), p.y()), qMax(node.boxMax.z(), p.z()));
+            }
+        }
+        static void mergeBox(Vasnecov::PointCloudFile::Node &node, const Vasnecov::PointCloudFile::Node &child)
+        {
+            node.boxMin = QVector3D(qMin(node.boxMin.x(), child.boxMin.x()),
+                                    qMin(node.boxMin.y(), child.boxMin.y()),
+                                    qMin(node.boxMin.z(), child.boxMin.z()));
+            node.boxMax = QVector3D(qMax(node.boxMax.x(), child.boxMax.x()),
+                                    qMax(node.boxMax.y(), child.boxMax.y()),
+                                    qMax(node.boxMax.z(), child.boxMax.z()));
+        }
+
+    private:
+        const std::vector<QVector3D> &m_points;
+        const std::vector<QColor> &m_colors;
+
+    public:
+        std::vector<Vasnecov::PointCloudFile::Node> nodes;
+        std::vector<GLuint> order; // Номера исходных точек в порядке записи
+    };
+}
+
+Vasnecov::PointCloudFile::Node::Node() :
+    boxMin(),
+    boxMax(),
+    first(0),
+    count(0),
+    children(),
+    spacing(0.0f)
+{
+    for(GLuint i = 0; i < 8; ++i)
+    {
+        children[i] = -1;
+    }
+}
+
+/*!
+ \brief Открытие и отображение файла в память. При ошибке объект остаётся пустым (\a isValid() ложно).
+*/
+Vasnecov::PointCloudFile::PointCloudFile(const std::string &fileName) :
+    m_fileName(fileName),
+    m_file(QString::fromStdString(fileName)),
+    m_map(0),
+    m_points(0),
+    m_pointsCount(0),
+    m_nodes(),
+    m_boxMin(),
+    m_boxMax()
+{
+    if(!m_file.open(QIODevice::ReadOnly))
+    {
+        Vasnecov::problem("Не удалось открыть файл облака точек: ", fileName);
+        return;
+    }
+
+    const qint64 fileSize(m_file.size());
+    if(fileSize < static_cast<qint64>(HeaderSize))
+    {
+        Vasnecov::problem("Неверный файл облака точек: ", fileName);
+        return;
+    }
+
+    m_map = m_file.map(0, fileSize);
+    if(!m_map)
+    {
+        Vasnecov::problem("Не удалось отобразить в память файл облака точек: ", fileName);
+        return;
+    }
+
+    const uchar *data(m_map);
+    if(memcmp(data, cloudMagic, sizeof(cloudMagic)) != 0)
+    {
+        Vasnecov::problem("Неверный файл облака точек: ", fileName);
+        return;
+    }
+    data += sizeof(cloudMagic);
+
+    if(readValue<quint32>(data) != cloudVersion)
+    {
+        Vasnecov::problem("Неподдерживаемая версия файла облака точек: ", fileName);
+        return;
+    }
+
+    const quint32 nodesCount(readValue<quint32>(data));
+    const quint64 pointsCount(readValue<quint64>(data));
+
+    float box[6];
+    for(GLuint i = 0; i < 6; ++i)
+    {
+        box[i] = readValue<float>(data);
+    }
+
+    // Проверки записаны без сложений и умножений значений из заголовка: огромные счётчики не должны
+    // переполнением пройти проверку. Номера узлов хранятся в qint32, поэтому их не больше INT_MAX
+    const quint64 bodySize(static_cast<quint64>(fileSize) - HeaderSize);
+    if(nodesCount == 0 ||
+       nodesCount > static_cast<quint32>(std::numeric_limits<qint32>::max()) ||
+       nodesCount > bodySize / NodeSize)
+    {
+        Vasnecov::problem("Файл облака точек повреждён: ", fileName);
+        return;
+    }
+    const quint64 pointsOffset(HeaderSize + static_cast<quint64>(nodesCount) * NodeSize);
+    if(pointsCount > (static_cast<quint64>(fileSize) - pointsOffset) / PointSize)
+    {
+        Vasnecov::problem("Файл облака точек повреждён: ", fileName);
+        return;
+    }
+
+    m_nodes.resize(nodesCount);
+    for(std::vector<Node>::iterator it = m_nodes.begin(); it != m_nodes.end(); ++it)
+    {
+        const GLint index(static_cast<GLint>(it - m_nodes.begin()));
+
+        float nodeBox[6];
+        for(GLuint i = 0; i < 6; ++i)
+        {
+            nodeBox[i] = readValue<float>(data);
+        }
+        it->boxMin = QVector3D(nodeBox[0], nodeBox[1], nodeBox[2]);
+        it->boxMax = QVector3D(nodeBox[3], nodeBox[4], nodeBox[5]);
+        it->first = readValue<quint64>(data);
+        it->count = readValue<quint32>(data);
+        // Узлы записаны в прямом порядке обхода: потомок всегда дальше родителя. Иначе в дереве
+        // возможен цикл, и обход при отрисовке не закончится
+        GLboolean damaged(false);
+        for(GLuint i = 0; i < 8; ++i)
+        {
+            it->children[i] = readValue<qint32>(data);
+            if(it->children[i] != -1 &&
+               (it->children[i] <= index || it->children[i] >= static_cast<GLint>(nodesCount)))
+            {
+                damaged = true;
+            }
+        }
+        it->spacing = readValue<float>(data);
+
+        if(damaged || it->count > pointsCount || it->first > pointsCount - it->count)
+        {
+            Vasnecov::problem("Файл облака точек повреждён: ", fileName);
+            m_nodes.clear();
+            return;
+        }
+    }
+
+    m_boxMin = QVector3D(box[0], box[1], box[2]);
+    m_boxMax = QVector3D(box[3], box[4], box[5]);
+    m_pointsCount = pointsCount;
+    m_points = m_map + pointsOffset;
+}
+
+Vasnecov::PointCloudFile::~PointCloudFile()
+{
+    if(m_map)
+    {
+        m_file.unmap(m_map);
+    }
+}
+
+/*!
+ \brief Построение октодерева по набору точек и запись его в файл.
+
+ Корень описывает куб, охватывающий все точки. В узел отбирается по одной точке на занятую ячейку сетки
+ в кубе узла. Сетка - \a cfg_cloudNodeGrid ячеек по стороне, укрупняемая вдвое, пока занятых ячеек больше
+ \a cfg_cloudNodePoints. Остальные точки распределяются по октантам.
+ Узлы не глубже \a cfg_cloudDepthMax с небольшим остатком становятся листьями и хранят все свои точки.
+
+ \return true при успешной записи
+*/
+GLboolean Vasnecov::PointCloudFile::write(const std::string &fileName,
+                                          const std::vector<QVector3D> &points,
+                                          const std::vector<QColor> &colors)
+{
+    if(points.empty())
+    {
+        Vasnecov::problem("Пустое облако точек: ", fileName);
+        return false;
+    }
+
+    QVector3D boxMin(points.front());
+    QVector3D boxMax(points.front());
+    for(std::vector<QVector3D>::const_iterator it = points.begin(); it != points.end(); ++it)
+    {
+        boxMin = QVector3D(qMin(boxMin.x(), it->x()), qMin(boxMin.y(), it->y()), qMin(boxMin.z(), it->z()));
+        boxMax = QVector3D(qMax(boxMax.x(), it->x()), qMax(boxMax.y(), it->y()), qMax(boxMax.z(), it->z()));
+    }
+    QVector3D extent(boxMax - boxMin);
+    GLfloat size(qMax(qMax(extent.x(), extent.y()), extent.z()));
+    if(size <= 0.0f)
+    {
+        size = 1.0f;
+    }
+
+    CloudBuilder builder(points, colors);
+    {
+        std::vector<GLuint> ids(points.size());
+        for(GLuint i = 0; i < ids.size(); ++i)
+        {
+            ids[i] = i;
+        }
+        builder.build(ids, boxMin, size, 0);
+    }
+
+    QFile file(QString::fromStdString(fileName));
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        Vasnecov::problem("Не удалось создать файл облака точек: ", fileName);
+        return false;
+    }
+
+    file.write(cloudMagic, sizeof(cloudMagic));
+    writeValue<quint32>(file, cloudVersion);
+    writeValue<quint32>(file, static_cast<quint32>(builder.nodes.size()));
+    writeValue<quint64>(file, static_cast<quint64>(builder.order.size()));
+    writeVector(file, boxMin);
+    writeVector(file, boxMax);
+
+    for(std::vector<Node>::const_iterator it = builder.nodes.begin(); it != builder.nodes.end(); ++it)
+    {
+        writeVector(file, it->boxMin);
+        writeVector(file, it->boxMax);
+        writeValue<quint64>(file, it->first);
+        writeValue<quint32>(file, it->count);
+        for(GLuint i = 0; i < 8; ++i)
+        {
+            writeValue<qint32>(file, it->children[i]);
+        }
+        writeValue<float>(file, it->spacing);
+    }
+
+    // Точки пишутся блоками, чтобы не держать в памяти второй полный массив
+    const GLuint blockPoints(Vasnecov::cfg_cloudNodePoints);
+    std::vector<uchar> block(blockPoints * PointSize);
+    for(size_t from = 0; from < builder.order.size(); from += blockPoints)
+    {
+        size_t count(qMin(static_cast<size_t>(blockPoints), builder.order.size() - from));
+        for(size_t i = 0; i < count; ++i)
+        {
+            builder.pointRecord(builder.order[from + i], &block[i * PointSize]);
+        }
+        file.write(reinterpret_cast<const char *>(block.data()), count * PointSize);
+    }
+
+    if(file.error() != QFileDevice::NoError)
+    {
+        Vasnecov::problem("Ошибка записи файла облака точек: ", fileName);
+        return false;
+    }
+    return true;
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Файл облака точек с октодеревом уровней детализации, отображаемый в память
+#ifndef VASNECOV_POINTCLOUDFILE_H
+#define VASNECOV_POINTCLOUDFILE_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <string>
+#include <vector>
+#include <QFile>
+#include <QColor>
+#include <QVector3D>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace Vasnecov
+{
+    class PointCloudFile
+    {
+    public:
+        struct Node
+        {
+            QVector3D boxMin; // Габарит точек узла и всех его потомков
+            QVector3D boxMax;
+            quint64 first; // Первая точка узла в файле
+            GLuint count;
+            GLint children[8]; // -1 - нет потомка
+            GLfloat spacing; // Расстояние между точками узла (ячейка сетки выборки)
+
+            Node();
+        };
+
+        static const GLuint PointSize = 16; // 3 float координаты и 4 байта цвета RGBA
+        static const GLuint HeaderSize = 48;
+        static const GLuint NodeSize = 72;
+
+    public:
+        explicit PointCloudFile(const std::string &fileName);
+        ~PointCloudFile();
+
+        GLboolean isValid() const;
+        const std::string &fileName() const;
+
+        quint64 pointsCount() const;
+        const std::vector<Node> &nodes() const;
+        const QVector3D &boxMin() const;
+        const QVector3D &boxMax() const;
+        const GLubyte *points() const; // Отображённые в память точки, порядок - по узлам
+
+        // Построение октодерева и запись файла. colors - пустой (белый цвет) или по цвету на точку
+        static GLboolean write(const std::string &fileName,
+                               const std::vector<QVector3D> &points,
+                               const std::vector<QColor> &colors = std::vector<QColor>());
+
+    private:
+        std::string m_fileName;
+        QFile m_file;
+        uchar *m_map;
+        const GLubyte *m_points;
+        quint64 m_pointsCount;
+        std::vector<Node> m_nodes;
+        QVector3D m_boxMin;
+        QVector3D m_boxMax;
+
+        Q_DISABLE_COPY(PointCloudFile)
+    };
+
+    inline GLboolean PointCloudFile::isValid() const
+    {
+        return m_points != 0;
+    }
+    inline const std::string &PointCloudFile::fileName() const
+    {
+        return m_fileName;
+    }
+    inline quint64 PointCloudFile::pointsCount() const
+    {
+        return m_pointsCount;
+    }
+    inline const std::vector<PointCloudFile::Node> &PointCloudFile::nodes() const
+    {
+        return m_nodes;
+    }
+    inline const QVector3D &PointCloudFile::boxMin() const
+    {
+        return m_boxMin;
+    }
+    inline const QVector3D &PointCloudFile::boxMax() const
+    {
+        return m_boxMax;
+    }
+    inline const GLubyte *PointCloudFile::points() const
+    {
+        return m_points;
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_POINTCLOUDFILE_H
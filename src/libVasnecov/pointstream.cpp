@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pointstream.h"
+#include "configuration.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::PointStream
+  \brief Кольцевой буфер точек из блоков фиксированного размера для часто дописываемых ломаных (треки и т.п.).
+
+  Поток конструктора копит только новые точки, при синхронизации они дописываются в хвост последнего блока.
+  Самые старые точки сверх максимальной длины вытесняются сдвигом начала первого блока, целиком
+  вытесненный блок уходит в запас и используется повторно. Центр масс считается по суммам координат.
+  Все операции пропорциональны количеству новых точек, а не длине трека.
+ */
+
+Vasnecov::PointStream::PointStream(GLenum &wasUpdated, const GLenum flag) :
+    m_flag(flag),
+    m_wasUpdated(wasUpdated),
+
+    raw_enabled(false),
+    raw_maxLength(0),
+    raw_clear(false),
+    raw_pending(),
+    raw_size(0),
+
+    pure_enabled(false),
+    pure_maxLength(0),
+    pure_chunks(),
+    pure_spare(),
+    pure_first(0),
+    pure_size(0),
+    pure_pushed(0),
+    pure_sum()
+{
+}
+
+void Vasnecov::PointStream::setEnabled(GLboolean enabled)
+{
+    if(raw_enabled != enabled)
+    {
+        raw_enabled = enabled;
+        clear();
+    }
+}
+
+void Vasnecov::PointStream::setMaxLength(GLuint maxLength)
+{
+    if(raw_maxLength != maxLength)
+    {
+        raw_maxLength = maxLength;
+        if(raw_maxLength && raw_size > raw_maxLength)
+        {
+            raw_size = raw_maxLength;
+        }
+        prepareUpdate();
+    }
+}
+
+void Vasnecov::PointStream::append(const QVector3D &point)
+{
+    raw_pending.push_back(point);
+
+    if(!raw_maxLength || raw_size < raw_maxLength)
+    {
+        ++raw_size;
+    }
+
+    // Если отрисовка долго не забирает точки, лишние вытесняются уже здесь
+    if(raw_maxLength && raw_pending.size() >= 2 * static_cast<size_t>(raw_maxLength))
+    {
+        raw_pending.erase(raw_pending.begin(), raw_pending.end() - raw_maxLength);
+        raw_clear = true;
+    }
+
+    prepareUpdate();
+}
+
+void Vasnecov::PointStream::append(const std::vector<QVector3D> &points)
+{
+    if(points.empty())
+    {
+        return;
+    }
+
+    std::vector<QVector3D>::const_iterator from(points.begin());
+    if(raw_maxLength && points.size() >= raw_maxLength)
+    {
+        // Все прежние точки всё равно будут вытеснены
+        from = points.end() - raw_maxLength;
+        raw_pending.clear();
+        raw_clear = true;
+    }
+    raw_pending.insert(raw_pending.end(), from, points.end());
+
+    raw_size += static_cast<GLuint>(points.end() - from);
+    if(raw_maxLength && raw_size > raw_maxLength)
+    {
+        raw_size = raw_maxLength;
+    }
+
+    if(raw_maxLength && raw_pending.size() >= 2 * static_cast<size_t>(raw_maxLength))
+    {
+        raw_pending.erase(raw_pending.begin(), raw_pending.end() - raw_maxLength);
+        raw_clear = true;
+    }
+
+    prepareUpdate();
+}
+
+void Vasnecov::PointStream::clear()
+{
+    raw_pending.clear();
+    raw_size = 0;
+    raw_clear = true;
+
+    prepareUpdate();
+}
+
+GLenum Vasnecov::PointStream::update(PolylinePyramid *pyramid)
+{
+    if((m_wasUpdated & m_flag) != 0)
+    {
+        pure_enabled = raw_enabled;
+        pure_maxLength = raw_maxLength;
+
+        if(raw_clear)
+        {
+            renderClear();
+            raw_clear = false;
+
+            if(pyramid)
+            {
+                pyramid->clear(pure_pushed);
+            }
+        }
+
+        for(std::vector<QVector3D>::const_iterator it = raw_pending.begin(); it != raw_pending.end(); ++it)
+        {
+            renderPush(*it);
+            if(pyramid)
+            {
+                pyramid->append(*it);
+            }
+        }
+        raw_pending.clear(); // Ёмкость сохраняется
+
+        if(pure_maxLength && pure_size > pure_maxLength)
+        {
+            while(pure_size > pure_maxLength)
+            {
+                renderEvict();
+            }
+            if(pyramid)
+            {
+                pyramid->evictBefore(firstNumber());
+            }
+        }
+
+        m_wasUpdated = m_wasUpdated &~ m_flag;
+        return m_flag;
+    }
+    return 0;
+}
+
+QVector3D Vasnecov::PointStream::cm() const
+{
+    if(!pure_size)
+    {
+        return QVector3D();
+    }
+    return QVector3D(pure_sum[0] / pure_size,
+                     pure_sum[1] / pure_size,
+                     pure_sum[2] / pure_size);
+}
+
+GLuint Vasnecov::PointStream::chunkFirst(size_t index, GLboolean withJoint) const
+{
+    if(index == 0)
+    {
+        return pure_first;
+    }
+    // Первая точка остальных блоков - стык с предыдущим
+    return withJoint ? 0 : 1;
+}
+
+void Vasnecov::PointStream::feed(PolylinePyramid &pyramid) const
+{
+    for(size_t i = 0; i < pure_chunks.size(); ++i)
+    {
+        const std::vector<QVector3D> &points(pure_chunks[i]);
+        for(size_t j = chunkFirst(i, false); j < points.size(); ++j)
+        {
+            pyramid.append(points[j]);
+        }
+    }
+}
+
+void Vasnecov::PointStream::prepareUpdate()
+{
+    m_wasUpdated |= m_flag;
+}
+
+void Vasnecov::PointStream::renderPush(const QVector3D &point)
+{
+    if(pure_chunks.empty() || pure_chunks.back().size() >= Vasnecov::cfg_streamChunkSize)
+    {
+        std::vector<QVector3D> chunk;
+        if(!pure_spare.empty())
+        {
+            chunk.swap(pure_spare.back());
+            pure_spare.pop_back();
+            chunk.clear();
+        }
+        else
+        {
+            chunk.reserve(Vasnecov::cfg_streamChunkSize);
+        }
+
+        if(!pure_chunks.empty())
+        {
+            chunk.push_back(pure_chunks.back().back());
+        }
+        pure_chunks.push_back(std::vector<QVector3D>());
+        pure_chunks.back().swap(chunk);
+    }
+
+    pure_chunks.back().push_back(point);
+    ++pure_size;
+    ++pure_pushed;
+
+    pure_sum[0] += point.x();
+    pure_sum[1] += point.y();
+    pure_sum[2] += point.z();
+}
+
+void Vasnecov::PointStream::renderEvict()
+{
+    if(pure_chunks.empty())
+    {
+        return;
+    }
+
+    const QVector3D &point(pure_chunks.front()[pure_first]);
+    pure_sum[0] -= point.x();
+    pure_sum[1] -= point.y();
+    pure_sum[2] -= point.z();
+    --pure_size;
+    ++pure_first;
+
+    if(pure_first >= pure_chunks.front().size())
+    {
+        if(pure_spare.size() < 2)
+        {
+            pure_spare.push_back(std::vector<QVector3D>());
+            pure_spare.back().swap(pure_chunks.front());
+        }
+        pure_chunks.pop_front();
+
+        // Стыковая точка следующего блока совпадает с вытесненной
+        pure_first = 1;
+        if(pure_chunks.empty())
+        {
+            pure_first = 0;
+            pure_sum[0] = pure_sum[1] = pure_sum[2] = 0.0;
+        }
+    }
+}
+
+void Vasnecov::PointStream::renderClear()
+{
+    while(!pure_chunks.empty())
+    {
+        pure_spare.push_back(std::vector<QVector3D>());
+        pure_spare.back().swap(pure_chunks.front());
+        pure_chunks.pop_front();
+    }
+    // В запасе держится не больше пары блоков
+    if(pure_spare.size() > 2)
+    {
+        pure_spare.resize(2);
+    }
+
+    pure_first = 0;
+    pure_size = 0;
+    pure_sum[0] = pure_sum[1] = pure_sum[2] = 0.0;
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Потоковый (только дописываемый) набор точек фигуры
+#ifndef VASNECOV_POINTSTREAM_H
+#define VASNECOV_POINTSTREAM_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <deque>
+#include <vector>
+#include <QVector3D>
+#include "types.h"
+#include "polylinepyramid.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace Vasnecov
+{
+    class PointStream
+    {
+    public:
+        PointStream(GLenum &wasUpdated, const GLenum flag);
+
+        // Методы потока конструктора (под мьютексом элемента)
+        void setEnabled(GLboolean enabled);
+        GLboolean enabled() const;
+        void setMaxLength(GLuint maxLength); // 0 - без ограничения
+        GLuint maxLength() const;
+
+        void append(const QVector3D &point);
+        void append(const std::vector<QVector3D> &points);
+        void clear();
+        GLuint size() const; // Количество точек с учётом ещё не синхронизированных
+
+        // Методы потока отрисовки
+        GLenum update(PolylinePyramid *pyramid = 0); // Пирамида упрощений достраивается вместе с потоком
+        GLboolean pureEnabled() const;
+        GLuint pureSize() const;
+        QVector3D cm() const;
+        quint64 firstNumber() const; // Сквозной номер первой хранимой точки
+        const QVector3D &firstPoint() const; // Только для непустого потока
+        void feed(PolylinePyramid &pyramid) const; // Передача всех хранимых точек
+
+        // Блоки хранятся подряд; первая точка каждого блока, кроме первого, повторяет последнюю точку предыдущего,
+        // чтобы ломаная рисовалась поблочно без разрывов
+        size_t chunksCount() const;
+        const std::vector<QVector3D> &chunk(size_t index) const;
+        GLuint chunkFirst(size_t index, GLboolean withJoint) const; // Первая рисуемая точка блока
+
+    private:
+        void prepareUpdate();
+
+        void renderPush(const QVector3D &point);
+        void renderEvict();
+        void renderClear();
+
+    private:
+        const GLenum m_flag;
+        GLenum &m_wasUpdated;
+
+        GLboolean raw_enabled;
+        GLuint raw_maxLength;
+        GLboolean raw_clear; // Сбросить накопленные точки при синхронизации
+        std::vector<QVector3D> raw_pending; // Точки, добавленные после последней синхронизации
+        GLuint raw_size;
+
+        GLboolean pure_enabled;
+        GLuint pure_maxLength;
+        std::deque<std::vector<QVector3D> > pure_chunks;
+        std::vector<std::vector<QVector3D> > pure_spare; // Освобождённые блоки для повторного использования
+        GLuint pure_first; // Первая живая точка первого блока
+        GLuint pure_size;
+        quint64 pure_pushed; // Всего добавлено точек
+        GLdouble pure_sum[3]; // Сумма координат для центра масс
+
+        Q_DISABLE_COPY(PointStream)
+    };
+
+    inline GLboolean PointStream::enabled() const
+    {
+        return raw_enabled;
+    }
+    inline GLuint PointStream::maxLength() const
+    {
+        return raw_maxLength;
+    }
+    inline GLuint PointStream::size() const
+    {
+        return raw_size;
+    }
+    inline GLboolean PointStream::pureEnabled() const
+    {
+        return pure_enabled;
+    }
+    inline GLuint PointStream::pureSize() const
+    {
+        return pure_size;
+    }
+    inline quint64 PointStream::firstNumber() const
+    {
+        return pure_pushed - pure_size;
+    }
+    inline const QVector3D &PointStream::firstPoint() const
+    {
+        return pure_chunks.front()[pure_first];
+    }
+    inline size_t PointStream::chunksCount() const
+    {
+        return pure_chunks.size();
+    }
+    inline const std::vector<QVector3D> &PointStream::chunk(size_t index) const
+    {
+        return pure_chunks[index];
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_POINTSTREAM_H
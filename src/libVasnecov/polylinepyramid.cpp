@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "polylinepyramid.h"
+#include "configuration.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::PolylinePyramid
+  \brief Уровни упрощения ломаной (Дуглас-Пекер поблочно), достраиваемые по мере добавления точек.
+
+  Каждый уровень получает точки предыдущего и упрощает их блоками по \a cfg_simplifyBlockSize с сохранением
+  концов блока, поэтому первая и последняя точки ломаной есть на всех уровнях. Допуск растёт в
+  \a cfg_simplifyLevelFactor раз от уровня к уровню, погрешность блока относительно исходной ломаной -
+  его допуск плюс погрешность входных точек. Точки хвоста, ещё не набравшие блок, берутся с более подробных уровней.
+
+  Каждая точка получает сквозной номер, по которому отбрасывается начало (для вытесняющих потоков).
+  Погрешности и габарит хранятся поблочно, поэтому после отбрасывания они считаются только по оставшимся
+  блокам, а допуск новых блоков берётся по размерам блока, который ещё не отброшен.
+ */
+
+Vasnecov::PolylinePyramid::PolylinePyramid() :
+    m_levels(),
+    m_next(0),
+    m_version(0),
+    m_tolerance(0.0f),
+    m_toleranceNumber(0),
+    m_empty(true),
+    m_min(),
+    m_max()
+{
+}
+
+void Vasnecov::PolylinePyramid::clear(quint64 firstNumber)
+{
+    m_levels.clear();
+    m_next = firstNumber;
+    m_tolerance = 0.0f;
+    m_toleranceNumber = 0;
+    m_empty = true;
+    m_min = QVector3D();
+    m_max = QVector3D();
+    ++m_version;
+}
+
+void Vasnecov::PolylinePyramid::append(const QVector3D &point)
+{
+    if(m_empty)
+    {
+        m_min = point;
+        m_max = point;
+        m_empty = false;
+    }
+    else
+    {
+        m_min = QVector3D(qMin(m_min.x(), point.x()), qMin(m_min.y(), point.y()), qMin(m_min.z(), point.z()));
+        m_max = QVector3D(qMax(m_max.x(), point.x()), qMax(m_max.y(), point.y()), qMax(m_max.z(), point.z()));
+    }
+
+    push(0, Node(point, m_next));
+    ++m_next;
+    ++m_version;
+}
+
+void Vasnecov::PolylinePyramid::build(const std::vector<QVector3D> &vertices, const std::vector<GLuint> &indices)
+{
+    clear();
+    for(std::vector<GLuint>::const_iterator it = indices.begin(); it != indices.end(); ++it)
+    {
+        if(*it < vertices.size())
+        {
+            append(vertices[*it]);
+        }
+    }
+}
+
+void Vasnecov::PolylinePyramid::evictBefore(quint64 number)
+{
+    for(std::vector<Level>::iterator lit = m_levels.begin(); lit != m_levels.end(); ++lit)
+    {
+        while(!lit->points.empty() && lit->points.front().number < number)
+        {
+            lit->points.pop_front();
+        }
+
+        // Блок отброшен целиком, когда следующий начинается не позже number
+        GLboolean evicted(false);
+        while(lit->blocks.size() > 1 && lit->blocks[1].number <= number)
+        {
+            lit->blocks.pop_front();
+            evicted = true;
+        }
+        if(evicted)
+        {
+            lit->error = 0.0f;
+            for(std::deque<Block>::const_iterator bit = lit->blocks.begin(); bit != lit->blocks.end(); ++bit)
+            {
+                lit->error = qMax(lit->error, bit->error);
+            }
+        }
+    }
+
+    if(!m_levels.empty())
+    {
+        // Допуск новых блоков - по последнему ненулевому блоку из оставшихся
+        if(m_toleranceNumber < number)
+        {
+            const std::deque<Block> &blocks(m_levels.front().blocks);
+            for(std::deque<Block>::const_reverse_iterator bit = blocks.rbegin(); bit != blocks.rend(); ++bit)
+            {
+                GLfloat tolerance((bit->max - bit->min).length() / Vasnecov::cfg_simplifyBaseDivider);
+                if(tolerance > 0.0f)
+                {
+                    m_tolerance = tolerance;
+                    m_toleranceNumber = bit->number;
+                    break;
+                }
+            }
+        }
+        updateBounds();
+    }
+    ++m_version;
+}
+
+GLfloat Vasnecov::PolylinePyramid::levelError(GLuint level) const
+{
+    // Точки уровня без готовых блоков берутся с более подробных уровней
+    GLfloat error(0.0f);
+    for(GLuint i = 0; i < level && i < m_levels.size(); ++i)
+    {
+        error = qMax(error, m_levels[i].error);
+    }
+    return error;
+}
+
+GLuint Vasnecov::PolylinePyramid::chooseLevel(GLfloat tolerance) const
+{
+    for(GLuint level = levelsCount(); level > 0; --level)
+    {
+        if(levelError(level) <= tolerance)
+        {
+            return level;
+        }
+    }
+    return 0;
+}
+
+void Vasnecov::PolylinePyramid::levelPoints(GLuint level, std::vector<QVector3D> &points,
+                                            const QVector3D *first, quint64 firstNumber) const
+{
+    points.clear();
+    if(level == 0 || level > m_levels.size())
+    {
+        return;
+    }
+
+    GLboolean any(false);
+    quint64 last(0);
+    if(first)
+    {
+        points.push_back(*first);
+        any = true;
+        last = firstNumber;
+    }
+
+    // Номера точек возрастают: сначала готовые точки уровня, затем хвосты всё более подробных уровней
+    auto take = [&](const Node &node)
+    {
+        if(node.number >= firstNumber && (!any || node.number > last))
+        {
+            points.push_back(node.point);
+            last = node.number;
+            any = true;
+        }
+    };
+
+    const Level &top(m_levels[level - 1]);
+    for(std::deque<Node>::const_iterator it = top.points.begin(); it != top.points.end(); ++it)
+    {
+        take(*it);
+    }
+    for(GLuint i = level; i > 0; --i)
+    {
+        const std::vector<Node> &input(m_levels[i - 1].input);
+        for(std::vector<Node>::const_iterator it = input.begin(); it != input.end(); ++it)
+        {
+            take(*it);
+        }
+    }
+}
+
+void Vasnecov::PolylinePyramid::push(GLuint level, const Node &node)
+{
+    if(level >= Vasnecov::cfg_simplifyLevelsMax)
+    {
+        return;
+    }
+    if(level >= m_levels.size())
+    {
+        m_levels.resize(level + 1);
+    }
+
+    m_levels[level].input.push_back(node);
+    if(m_levels[level].input.size() >= Vasnecov::cfg_simplifyBlockSize)
+    {
+        flush(level);
+    }
+}
+
+void Vasnecov::PolylinePyramid::flush(GLuint level)
+{
+    std::vector<Node> input;
+    input.swap(m_levels[level].input);
+
+    QVector3D bMin(input.front().point);
+    QVector3D bMax(input.front().point);
+    if(level == 0)
+    {
+        for(std::vector<Node>::const_iterator it = input.begin(); it != input.end(); ++it)
+        {
+            bMin = QVector3D(qMin(bMin.x(), it->point.x()), qMin(bMin.y(), it->point.y()), qMin(bMin.z(), it->point.z()));
+            bMax = QVector3D(qMax(bMax.x(), it->point.x()), qMax(bMax.y(), it->point.y()), qMax(bMax.z(), it->point.z()));
+        }
+        if(m_tolerance == 0.0f)
+        {
+            // Пока все точки совпадают, допуск нулевой и упрощение точное
+            m_tolerance = (bMax - bMin).length() / Vasnecov::cfg_simplifyBaseDivider;
+            m_toleranceNumber = input.front().number;
+        }
+    }
+
+    GLfloat tolerance(m_tolerance);
+    for(GLuint i = 0; i < level; ++i)
+    {
+        tolerance *= Vasnecov::cfg_simplifyLevelFactor;
+    }
+
+    std::vector<GLboolean> keep;
+    simplify(input, tolerance, keep);
+
+    // Входные точки уровня сами отклоняются от исходной ломаной на погрешность предыдущего уровня
+    const GLfloat error(tolerance + (level ? m_levels[level - 1].error : 0.0f));
+    m_levels[level].blocks.push_back(Block(input.front().number, error, bMin, bMax));
+    m_levels[level].error = qMax(m_levels[level].error, error);
+
+    // Первая точка блока уже принята предыдущим блоком, кроме самого первого
+    size_t from(m_levels[level].started ? 1 : 0);
+    m_levels[level].started = true;
+    for(size_t i = from; i < input.size(); ++i)
+    {
+        if(keep[i])
+        {
+            m_levels[level].points.push_back(input[i]);
+            push(level + 1, input[i]); // Может добавить уровень, ссылки на m_levels после этого недействительны
+        }
+    }
+
+    m_levels[level].input.push_back(input.back());
+}
+
+void Vasnecov::PolylinePyramid::updateBounds()
+{
+    const Level &first(m_levels.front());
+
+    GLboolean any(false);
+    auto grow = [&](const QVector3D &bMin, const QVector3D &bMax)
+    {
+        if(!any)
+        {
+            m_min = bMin;
+            m_max = bMax;
+            any = true;
+        }
+        else
+        {
+            m_min = QVector3D(qMin(m_min.x(), bMin.x()), qMin(m_min.y(), bMin.y()), qMin(m_min.z(), bMin.z()));
+            m_max = QVector3D(qMax(m_max.x(), bMax.x()), qMax(m_max.y(), bMax.y()), qMax(m_max.z(), bMax.z()));
+        }
+    };
+
+    for(std::deque<Block>::const_iterator bit = first.blocks.begin(); bit != first.blocks.end(); ++bit)
+    {
+        grow(bit->min, bit->max);
+    }
+    for(std::vector<Node>::const_iterator it = first.input.begin(); it != first.input.end(); ++it)
+    {
+        grow(it->point, it->point);
+    }
+}
+
+void Vasnecov::PolylinePyramid::simplify(const std::vector<Node> &input, GLfloat tolerance, std::vector<GLboolean> &keep) const
+{
+    keep.assign(input.size(), false);
+    if(input.empty())
+    {
+        return;
+    }
+    keep.front() = true;
+    keep.back() = true;
+
+    std::vector<std::pair<size_t, size_t> > ranges;
+    ranges.push_back(std::make_pair(static_cast<size_t>(0), input.size() - 1));
+
+    while(!ranges.empty())
+    {
+        size_t a(ranges.back().first);
+        size_t b(ranges.back().second);
+        ranges.pop_back();
+
+        if(b <= a + 1)
+        {
+            continue;
+        }
+
+        const QVector3D &pa(input[a].point);
+        const QVector3D segment(input[b].point - pa);
+        const GLfloat segmentLength2(segment.lengthSquared());
+
+        GLfloat maxDistance(-1.0f);
+        size_t found(a);
+        for(size_t i = a + 1; i < b; ++i)
+        {
+            QVector3D offset(input[i].point - pa);
+            if(segmentLength2 > 0.0f)
+            {
+                GLfloat t(QVector3D::dotProduct(offset, segment) / segmentLength2);
+                t = qBound(0.0f, t, 1.0f);
+                offset -= segment * t;
+            }
+
+            GLfloat distance(offset.length());
+            if(distance > maxDistance)
+            {
+                maxDistance = distance;
+                found = i;
+            }
+        }
+
+        if(maxDistance > tolerance)
+        {
+            keep[found] = true;
+            ranges.push_back(std::make_pair(a, found));
+            ranges.push_back(std::make_pair(found, b));
+        }
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
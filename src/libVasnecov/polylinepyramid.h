@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Пирамида упрощений ломаной для отрисовки с учётом размера на экране
+#ifndef VASNECOV_POLYLINEPYRAMID_H
+#define VASNECOV_POLYLINEPYRAMID_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <deque>
+#include <vector>
+#include <QVector3D>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace Vasnecov
+{
+    class PolylinePyramid
+    {
+    public:
+        PolylinePyramid();
+
+        void clear(quint64 firstNumber = 0); // Номер, который получит следующая точка
+        void append(const QVector3D &point);
+        void build(const std::vector<QVector3D> &vertices, const std::vector<GLuint> &indices);
+        void evictBefore(quint64 number); // Отбрасывание точек с номерами меньше заданного
+
+        quint64 nextNumber() const;
+        GLuint levelsCount() const; // Без исходного уровня
+        GLfloat levelError(GLuint level) const; // Допуск уровня относительно исходной ломаной
+        GLuint chooseLevel(GLfloat tolerance) const; // Самый грубый уровень с погрешностью не больше tolerance, 0 - исходный
+        GLuint version() const; // Меняется при каждом изменении
+
+        const QVector3D &boxMin() const;
+        const QVector3D &boxMax() const;
+
+        // Точки уровня от первой до последней. first - точная первая точка, если начало было отброшено
+        void levelPoints(GLuint level, std::vector<QVector3D> &points,
+                         const QVector3D *first = 0, quint64 firstNumber = 0) const;
+
+    private:
+        struct Node
+        {
+            QVector3D point;
+            quint64 number;
+
+            Node(const QVector3D &p, quint64 n) :
+                point(p),
+                number(n)
+            {}
+        };
+        struct Block // Упрощённый блок уровня
+        {
+            quint64 number; // Номер первой точки блока
+            GLfloat error; // Погрешность точек блока относительно исходной ломаной
+            QVector3D min; // Габарит исходных точек блока (только на первом уровне)
+            QVector3D max;
+
+            Block(quint64 n, GLfloat e, const QVector3D &bMin, const QVector3D &bMax) :
+                number(n),
+                error(e),
+                min(bMin),
+                max(bMax)
+            {}
+        };
+        struct Level
+        {
+            std::deque<Node> points; // Упрощённые точки
+            std::vector<Node> input; // Точки предыдущего уровня, ещё не прошедшие упрощение. Первая - стыковая
+            std::deque<Block> blocks; // Блоки, точки которых ещё не отброшены
+            GLfloat error; // Наибольшая погрешность среди blocks
+            GLboolean started; // Первый блок уже упрощён
+
+            Level() :
+                points(),
+                input(),
+                blocks(),
+                error(0.0f),
+                started(false)
+            {}
+        };
+
+        void push(GLuint level, const Node &node);
+        void flush(GLuint level);
+        void simplify(const std::vector<Node> &input, GLfloat tolerance, std::vector<GLboolean> &keep) const;
+        void updateBounds(); // По оставшимся блокам первого уровня и его неупрощённому хвосту
+
+    private:
+        std::vector<Level> m_levels; // m_levels[0] - первый уровень упрощения
+        quint64 m_next;
+        GLuint m_version;
+        GLfloat m_tolerance; // Допуск первого уровня для новых блоков, по размерам ненулевого блока
+        quint64 m_toleranceNumber; // Номер первой точки блока, по которому задан допуск
+        GLboolean m_empty;
+        QVector3D m_min;
+        QVector3D m_max;
+    };
+
+    inline quint64 PolylinePyramid::nextNumber() const
+    {
+        return m_next;
+    }
+    inline GLuint PolylinePyramid::levelsCount() const
+    {
+        return static_cast<GLuint>(m_levels.size());
+    }
+    inline GLuint PolylinePyramid::version() const
+    {
+        return m_version;
+    }
+    inline const QVector3D &PolylinePyramid::boxMin() const
+    {
+        return m_min;
+    }
+    inline const QVector3D &PolylinePyramid::boxMax() const
+    {
+        return m_max;
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_POLYLINEPYRAMID_H
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "reclaimer.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::Reclaimer
+  \brief Очередь отложенного удаления.
+
+  Удаление больших изделий (векторы вершин, строки, личные текстуры) прямо в синхронизации
+  давало провалы кадров. Теперь удаление разделено:
+  - имена текстур OpenGL освобождаются в потоке отрисовки небольшими порциями, по кадру на порцию;
+  - память объектов освобождается в фоновом потоке.
+
+  Деструкторы объектов, переданных в \a dispose, не должны обращаться к OpenGL.
+ */
+
+Vasnecov::Reclaimer::Reclaimer() :
+    m_worker(0),
+    mtx_queue(),
+    m_wake(),
+    m_empty(),
+    m_queue(),
+    m_busy(false),
+    m_stopping(false),
+
+    m_textures()
+{
+}
+
+Vasnecov::Reclaimer::~Reclaimer()
+{
+    if(m_worker)
+    {
+        {
+            QMutexLocker locker(&mtx_queue);
+            m_stopping = true;
+            m_wake.wakeAll();
+        }
+        // Поток доделывает очередь до конца
+        m_worker->wait();
+        delete m_worker;
+        m_worker = 0;
+    }
+
+    // Как и деструктор текстуры, рассчитывает на текущий контекст
+    if(!m_textures.empty())
+    {
+        glDeleteTextures(static_cast<GLsizei>(m_textures.size()), &m_textures[0]);
+    }
+}
+
+void Vasnecov::Reclaimer::renderReleaseTexture(GLuint id)
+{
+    if(id)
+    {
+        m_textures.push_back(id);
+    }
+}
+
+GLuint Vasnecov::Reclaimer::renderReleaseBatch(GLuint count)
+{
+    if(m_textures.empty() || !count)
+    {
+        return 0;
+    }
+
+    GLuint released(qMin(count, static_cast<GLuint>(m_textures.size())));
+    glDeleteTextures(static_cast<GLsizei>(released), &m_textures[m_textures.size() - released]);
+    m_textures.resize(m_textures.size() - released);
+
+    return released;
+}
+
+void Vasnecov::Reclaimer::flush()
+{
+    QMutexLocker locker(&mtx_queue);
+    while(!m_queue.empty() || m_busy)
+    {
+        m_empty.wait(&mtx_queue);
+    }
+}
+
+GLuint Vasnecov::Reclaimer::pendingObjects()
+{
+    QMutexLocker locker(&mtx_queue);
+    return static_cast<GLuint>(m_queue.size());
+}
+
+void Vasnecov::Reclaimer::enqueue(std::vector<Deleter> &deleters)
+{
+    QMutexLocker locker(&mtx_queue);
+
+    m_queue.insert(m_queue.end(), deleters.begin(), deleters.end());
+    deleters.clear();
+
+    if(!m_worker)
+    {
+        m_worker = new Worker(this);
+        m_worker->start(QThread::LowestPriority);
+    }
+    m_wake.wakeOne();
+}
+
+void Vasnecov::Reclaimer::workerLoop()
+{
+    QMutexLocker locker(&mtx_queue);
+
+    for(;;)
+    {
+        while(m_queue.empty() && !m_stopping)
+        {
+            m_empty.wakeAll();
+            m_wake.wait(&mtx_queue);
+        }
+        if(m_queue.empty())
+        {
+            m_empty.wakeAll();
+            return;
+        }
+
+        Deleter deleter;
+        deleter.swap(m_queue.front());
+        m_queue.pop_front();
+        m_busy = true;
+
+        locker.unlock();
+        deleter();
+        locker.relock();
+
+        m_busy = false;
+    }
+}
+
+void Vasnecov::Reclaimer::Worker::run()
+{
+    m_reclaimer->workerLoop();
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
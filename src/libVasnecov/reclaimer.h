@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Отложенное удаление элементов вне потока отрисовки
+#ifndef VASNECOV_RECLAIMER_H
+#define VASNECOV_RECLAIMER_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <deque>
+#include <vector>
+#include <functional>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include "configuration.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace Vasnecov
+{
+    class Reclaimer
+    {
+    public:
+        Reclaimer();
+        ~Reclaimer();
+
+        // Передача объектов на удаление в фоновый поток. Ресурсы OpenGL к этому моменту должны быть отданы
+        template <typename T>
+        void dispose(std::vector<T *> &objects);
+
+        // Методы потока отрисовки (контекста OpenGL)
+        void renderReleaseTexture(GLuint id);
+        GLuint renderReleaseBatch(GLuint count = cfg_reclaimTexturesPerFrame); // Возврат - количество освобождённых
+
+        void flush(); // Ожидание опустошения фоновой очереди
+        GLuint pendingTextures() const;
+        GLuint pendingObjects();
+
+    protected:
+        typedef std::function<void ()> Deleter;
+
+        class Worker : public QThread
+        {
+        public:
+            explicit Worker(Reclaimer *reclaimer) :
+                QThread(),
+                m_reclaimer(reclaimer)
+            {}
+        protected:
+            void run();
+        private:
+            Reclaimer *m_reclaimer;
+
+            Q_DISABLE_COPY(Worker)
+        };
+
+    protected:
+        void enqueue(std::vector<Deleter> &deleters);
+        void workerLoop();
+
+    private:
+        Worker *m_worker; // Создаётся при первом удалении
+        QMutex mtx_queue;
+        QWaitCondition m_wake;
+        QWaitCondition m_empty;
+        std::deque<Deleter> m_queue;
+        GLboolean m_busy;
+        GLboolean m_stopping;
+
+        std::vector<GLuint> m_textures; // Только поток отрисовки
+
+    private:
+        Q_DISABLE_COPY(Reclaimer)
+    };
+
+    inline GLuint Reclaimer::pendingTextures() const
+    {
+        return static_cast<GLuint>(m_textures.size());
+    }
+
+    template <typename T>
+    inline void Reclaimer::dispose(std::vector<T *> &objects)
+    {
+        if(objects.empty())
+        {
+            return;
+        }
+
+        std::vector<Deleter> deleters;
+        deleters.reserve(objects.size());
+        for(typename std::vector<T *>::iterator oit = objects.begin();
+            oit != objects.end(); ++oit)
+        {
+            T *object(*oit);
+            deleters.push_back([object]()
+            {
+                delete object;
+            });
+        }
+        objects.clear();
+
+        enqueue(deleters);
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_RECLAIMER_H
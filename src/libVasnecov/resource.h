@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Общая часть ресурсов Вселенной (меши, текстуры): учёт пользователей для выгрузки
+#ifndef VASNECOV_RESOURCE_H
+#define VASNECOV_RESOURCE_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <QAtomicInt>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+class VasnecovUniverse;
+
+namespace Vasnecov
+{
+    /*
+     * Пользователи ресурса - элементы, которые на него ссылаются (изделия, материалы, метки).
+     * Элемент увеличивает счётчик, когда ресурс появляется в его сырых данных, и уменьшает,
+     * когда ресурс оттуда уже убран. Ресурс без пользователей Вселенная может выгрузить.
+     */
+    class Resource
+    {
+    public:
+        // Элементы живут в разных мирах, поэтому счётчик атомарный
+        void designerAddUser();
+        GLboolean designerRemoveUser(); // true - пользователей больше не осталось
+        GLboolean isUsed() const;
+
+    protected:
+        Resource() :
+            m_users(0),
+            m_unusedSince(-1)
+        {}
+        virtual ~Resource() {}
+
+    private:
+        QAtomicInt m_users;
+        qint64 m_unusedSince; // Начало простоя для автоматической выгрузки, мс. Под mtx_resources Вселенной
+
+        friend class ::VasnecovUniverse;
+
+        Q_DISABLE_COPY(Resource)
+    };
+
+    // Удерживает ресурс от выгрузки между поиском по имени и передачей элементу
+    template <typename T>
+    class ResourceHandle
+    {
+    public:
+        ResourceHandle() :
+            m_resource(0)
+        {}
+        ~ResourceHandle()
+        {
+            reset(0);
+        }
+        void reset(T *resource) // Вызывается под mtx_resources, пока ресурс точно не выгружен
+        {
+            if(resource)
+            {
+                resource->designerAddUser();
+            }
+            if(m_resource)
+            {
+                m_resource->designerRemoveUser();
+            }
+            m_resource = resource;
+        }
+        T *get() const {return m_resource;}
+
+    private:
+        T *m_resource;
+
+        Q_DISABLE_COPY(ResourceHandle)
+    };
+
+    inline void Resource::designerAddUser()
+    {
+        m_users.ref();
+    }
+    inline GLboolean Resource::designerRemoveUser()
+    {
+        return !m_users.deref();
+    }
+    inline GLboolean Resource::isUsed() const
+    {
+        return m_users.load() != 0;
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_RESOURCE_H
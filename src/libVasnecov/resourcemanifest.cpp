@@ -0,0 +1,488 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "resourcemanifest.h"
+#include <algorithm>
+#include <set>
+#include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDirIterator>
+#include <QDateTime>
+#include <QByteArray>
+#include <QList>
+#include "configuration.h"
+#include "technologist.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace
+{
+    const char *const manifestHeader = "vasnecov-manifest\t1";
+
+    inline GLboolean endsWith(const std::string &name, const std::string &suffix)
+    {
+        return name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // Имя - последнее поле строки, знаки табуляции в нём возвращаются обратно
+    std::string tail(const QList<QByteArray> &fields, int from)
+    {
+        QByteArray res(fields.at(from));
+        for(int i = from + 1; i < fields.size(); ++i)
+        {
+            res.append('\t');
+            res.append(fields.at(i));
+        }
+        return std::string(res.constData(), res.size());
+    }
+
+    inline QByteArray field(const std::string &text)
+    {
+        return QByteArray(text.data(), static_cast<int>(text.size()));
+    }
+}
+
+/*!
+  \class Vasnecov::ResourceManifest
+  \brief Манифест директории ресурсов: файлы, их размеры, время изменения, ключи содержимого
+  и наличие подготовленных файлов. Хранится в корне директории между запусками.
+
+  Обход директорий заменяется проверкой времени изменения каждой директории (одно обращение
+  к файловой системе на директорию, а не на файл): содержимое перечитывается только у изменившихся.
+  Ключ содержимого файла не пересчитывается, пока совпадают размер и время изменения, а в директориях,
+  не изменившихся с прошлого запуска, файлы не проверяются вовсе. Поэтому перезапись файла на месте
+  (без создания нового файла) замечается только после изменения самой директории.
+  Изменения, сделанные за последние \a cfg_manifestSettleTime, не запоминаются: время изменения
+  на многих файловых системах грубее, и такие изменения могли бы повториться незамеченными.
+
+  Если манифест не записывается (например, директория только для чтения), всё работает,
+  но каждый запуск обходит директории заново.
+ */
+
+Vasnecov::ResourceManifest::ResourceManifest(const std::string &format, const std::string &cacheFormat) :
+    m_format(format),
+    m_cacheFormat(cacheFormat),
+
+    mtx_data(),
+    m_root(),
+    m_dirs(),
+    m_modified(false)
+{
+}
+
+void Vasnecov::ResourceManifest::list(const std::string &root, const std::string &targetDir, GLboolean withSub, std::vector<std::string> &files)
+{
+    QString target(QDir::cleanPath(QString::fromStdString(targetDir)));
+    std::string dirName;
+    if(!target.isEmpty() && target != ".")
+    {
+        dirName = target.toStdString() + "/";
+    }
+
+    QMutexLocker locker(&mtx_data);
+
+    setRoot(root);
+    listDir(dirName, withSub, files);
+}
+
+GLboolean Vasnecov::ResourceManifest::isListed(const std::string &path)
+{
+    QMutexLocker locker(&mtx_data);
+
+    return findFile(path, true) != 0;
+}
+
+GLboolean Vasnecov::ResourceManifest::mayHaveCache(const std::string &path)
+{
+    QMutexLocker locker(&mtx_data);
+
+    const File *file(findFile(path, true));
+    return !file || file->cached;
+}
+
+void Vasnecov::ResourceManifest::setCached(const std::string &path)
+{
+    // Сверенная при этом запуске директория не перечитывается, и без отметки
+    // подготовленный файл был бы виден только со следующего запуска
+    QMutexLocker locker(&mtx_data);
+
+    File *file(findFile(path, false));
+    if(file && !file->cached)
+    {
+        file->cached = true;
+        m_modified = true;
+    }
+}
+
+Vasnecov::ContentKey Vasnecov::ResourceManifest::contentKey(const std::string &path, quint64 seed)
+{
+    {
+        QMutexLocker locker(&mtx_data);
+
+        // Директория не менялась: запись манифеста верна без обращения к файлу
+        Directory *dir(0);
+        const File *file(findFile(path, true, &dir));
+        if(file && dir->unchanged && file->modified >= 0 && file->seed == seed && file->key.isValid())
+        {
+            return file->key;
+        }
+    }
+
+    const QFileInfo info(QString::fromStdString(path));
+    if(!info.exists())
+    {
+        return ContentKey();
+    }
+    const qint64 size(info.size());
+    const qint64 modified(settled(info.lastModified()));
+
+    {
+        QMutexLocker locker(&mtx_data);
+
+        const File *file(findFile(path, false));
+        if(file && modified >= 0 && file->modified == modified && file->size == size && file->seed == seed && file->key.isValid())
+        {
+            return file->key;
+        }
+    }
+
+    // Чтение файла - без блокировки, список мог измениться: запись ищется заново
+    const ContentKey key(fileContentKey(path, seed));
+
+    QMutexLocker locker(&mtx_data);
+
+    File *file(findFile(path, false));
+    if(file)
+    {
+        file->size = size;
+        file->modified = modified;
+        file->seed = seed;
+        file->key = key;
+        m_modified = true;
+    }
+    return key;
+}
+
+GLboolean Vasnecov::ResourceManifest::save()
+{
+    QMutexLocker locker(&mtx_data);
+
+    if(!m_modified || m_root.empty())
+    {
+        return true;
+    }
+
+    QByteArray data(manifestHeader);
+    data.append('\t');
+    data.append(field(m_format));
+    data.append('\n');
+
+    for(std::map<std::string, Directory>::const_iterator dit = m_dirs.begin(); dit != m_dirs.end(); ++dit)
+    {
+        const Directory &dir(dit->second);
+
+        data.append("D\t");
+        data.append(QByteArray::number(dir.modified));
+        data.append('\t');
+        data.append(field(dit->first));
+        data.append('\n');
+
+        for(std::vector<std::string>::const_iterator sit = dir.subdirs.begin(); sit != dir.subdirs.end(); ++sit)
+        {
+            data.append("S\t");
+            data.append(field(*sit));
+            data.append('\n');
+        }
+        for(std::vector<File>::const_iterator fit = dir.files.begin(); fit != dir.files.end(); ++fit)
+        {
+            data.append("F\t");
+            data.append(QByteArray::number(fit->size));
+            data.append('\t');
+            data.append(QByteArray::number(fit->modified));
+            data.append('\t');
+            data.append(QByteArray::number(fit->seed, 16));
+            data.append('\t');
+            data.append(QByteArray::number(fit->key.hash, 16));
+            data.append('\t');
+            data.append(QByteArray::number(fit->key.size));
+            data.append('\t');
+            data.append(fit->cached ? '1' : '0');
+            data.append('\t');
+            data.append(field(fit->name));
+            data.append('\n');
+        }
+    }
+
+    // Прежний манифест заменяется атомарно: прерванная запись его не портит и не удаляет
+    QSaveFile file(QString::fromStdString(manifestPath()));
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    if(file.write(data) != data.size())
+    {
+        file.cancelWriting();
+        return false;
+    }
+    if(!file.commit())
+    {
+        return false;
+    }
+
+    m_modified = false;
+    return true;
+}
+
+void Vasnecov::ResourceManifest::setRoot(const std::string &root)
+{
+    if(root != m_root)
+    {
+        m_root = root;
+        m_dirs.clear();
+        m_modified = false;
+
+        load();
+    }
+}
+
+void Vasnecov::ResourceManifest::load()
+{
+    QFile file(QString::fromStdString(manifestPath()));
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        return;
+    }
+    const QList<QByteArray> lines(file.readAll().split('\n'));
+    file.close();
+
+    if(lines.isEmpty() || lines.at(0) != QByteArray(manifestHeader) + "\t" + field(m_format))
+    {
+        return; // Другая версия или другой формат: манифест строится заново
+    }
+
+    Directory *dir(0);
+    GLboolean ok(true);
+    for(int i = 1; i < lines.size() && ok; ++i)
+    {
+        if(lines.at(i).isEmpty())
+        {
+            continue;
+        }
+
+        const QList<QByteArray> fields(lines.at(i).split('\t'));
+        bool parsed[5] = {true, true, true, true, true};
+
+        if(fields.at(0) == "D" && fields.size() >= 3)
+        {
+            dir = &m_dirs[tail(fields, 2)];
+            dir->modified = fields.at(1).toLongLong(&parsed[0]);
+        }
+        else if(fields.at(0) == "S" && fields.size() >= 2 && dir)
+        {
+            dir->subdirs.push_back(tail(fields, 1));
+        }
+        else if(fields.at(0) == "F" && fields.size() >= 8 && dir)
+        {
+            File entry;
+            entry.size = fields.at(1).toLongLong(&parsed[0]);
+            entry.modified = fields.at(2).toLongLong(&parsed[1]);
+            entry.seed = fields.at(3).toULongLong(&parsed[2], 16);
+            entry.key.hash = fields.at(4).toULongLong(&parsed[3], 16);
+            entry.key.size = fields.at(5).toLongLong(&parsed[4]);
+            entry.cached = fields.at(6) == "1";
+            entry.name = tail(fields, 7);
+            dir->files.push_back(entry);
+        }
+        else
+        {
+            ok = false;
+        }
+        ok = ok && parsed[0] && parsed[1] && parsed[2] && parsed[3] && parsed[4];
+    }
+
+    if(!ok)
+    {
+        Vasnecov::problem("Манифест ресурсов испорчен и будет построен заново: ", manifestPath());
+        m_dirs.clear();
+        return;
+    }
+    for(std::map<std::string, Directory>::iterator dit = m_dirs.begin(); dit != m_dirs.end(); ++dit)
+    {
+        std::sort(dit->second.files.begin(), dit->second.files.end());
+    }
+}
+
+void Vasnecov::ResourceManifest::listDir(const std::string &dirName, GLboolean withSub, std::vector<std::string> &files)
+{
+    // Время изменения берётся до чтения: изменения во время чтения заметит следующий список
+    const QFileInfo info(QString::fromStdString(m_root + dirName));
+    if(!info.isDir())
+    {
+        erase(dirName);
+        return;
+    }
+    const qint64 modified(settled(info.lastModified()));
+
+    Directory &dir(m_dirs[dirName]);
+    if(modified < 0 || dir.modified != modified)
+    {
+        rescan(dirName, dir);
+        dir.modified = modified;
+        dir.unchanged = false;
+    }
+    else if(!dir.checked)
+    {
+        dir.unchanged = true; // Перечитанная при этом запуске директория так и проверяется пофайлово
+    }
+    dir.checked = true;
+
+    for(std::vector<File>::const_iterator fit = dir.files.begin(); fit != dir.files.end(); ++fit)
+    {
+        files.push_back(dirName + fit->name);
+    }
+
+    if(withSub)
+    {
+        const std::vector<std::string> subdirs(dir.subdirs);
+        for(std::vector<std::string>::const_iterator sit = subdirs.begin(); sit != subdirs.end(); ++sit)
+        {
+            listDir(dirName + *sit + "/", withSub, files);
+        }
+    }
+}
+
+void Vasnecov::ResourceManifest::rescan(const std::string &dirName, Directory &dir)
+{
+    std::vector<File> oldFiles;
+    std::vector<std::string> oldSubdirs;
+    oldFiles.swap(dir.files);
+    oldSubdirs.swap(dir.subdirs);
+
+    const std::string suffix("." + m_format);
+    const std::string cacheSuffix(m_cacheFormat.empty() ? std::string() : "." + m_cacheFormat);
+    std::set<std::string> caches; // Имена подготовленных файлов без расширения
+
+    QDirIterator iterator(QString::fromStdString(m_root + dirName), QDirIterator::NoIteratorFlags);
+    while(iterator.hasNext())
+    {
+        iterator.next();
+
+        const std::string name(iterator.fileName().toStdString());
+        if(name == "." || name == "..")
+        {
+            continue;
+        }
+
+        if(iterator.fileInfo().isDir())
+        {
+            dir.subdirs.push_back(name);
+        }
+        else if(endsWith(name, suffix))
+        {
+            File entry;
+            entry.name = name;
+            dir.files.push_back(entry);
+        }
+        else if(!cacheSuffix.empty() && endsWith(name, cacheSuffix))
+        {
+            caches.insert(name.substr(0, name.size() - cacheSuffix.size()));
+        }
+    }
+
+    std::sort(dir.subdirs.begin(), dir.subdirs.end());
+    std::sort(dir.files.begin(), dir.files.end());
+
+    // Ключи содержимого оставшихся файлов сохраняются, их проверит contentKey()
+    for(std::vector<File>::iterator fit = dir.files.begin(); fit != dir.files.end(); ++fit)
+    {
+        std::vector<File>::const_iterator oit = std::lower_bound(oldFiles.begin(), oldFiles.end(), *fit);
+        if(oit != oldFiles.end() && oit->name == fit->name)
+        {
+            *fit = *oit;
+        }
+        fit->cached = caches.count(fit->name.substr(0, fit->name.size() - suffix.size())) != 0;
+    }
+
+    for(std::vector<std::string>::const_iterator sit = oldSubdirs.begin(); sit != oldSubdirs.end(); ++sit)
+    {
+        if(!std::binary_search(dir.subdirs.begin(), dir.subdirs.end(), *sit))
+        {
+            erase(dirName + *sit + "/");
+        }
+    }
+
+    m_modified = true;
+}
+
+void Vasnecov::ResourceManifest::erase(const std::string &dirName)
+{
+    std::map<std::string, Directory>::iterator dit = m_dirs.lower_bound(dirName);
+    while(dit != m_dirs.end() && dit->first.compare(0, dirName.size(), dirName) == 0)
+    {
+        m_dirs.erase(dit++);
+        m_modified = true;
+    }
+}
+
+Vasnecov::ResourceManifest::File *Vasnecov::ResourceManifest::findFile(const std::string &path, GLboolean checkedOnly, Directory **directory)
+{
+    if(m_root.empty() || path.compare(0, m_root.size(), m_root) != 0)
+    {
+        return 0;
+    }
+
+    const size_t slash(path.rfind('/'));
+    if(slash == std::string::npos || slash < m_root.size() - 1)
+    {
+        return 0;
+    }
+
+    std::map<std::string, Directory>::iterator dit = m_dirs.find(path.substr(m_root.size(), slash + 1 - m_root.size()));
+    if(dit == m_dirs.end() || (checkedOnly && !dit->second.checked))
+    {
+        return 0;
+    }
+
+    File probe;
+    probe.name = path.substr(slash + 1);
+
+    std::vector<File> &files(dit->second.files);
+    std::vector<File>::iterator fit = std::lower_bound(files.begin(), files.end(), probe);
+    if(fit != files.end() && fit->name == probe.name)
+    {
+        if(directory)
+        {
+            *directory = &dit->second;
+        }
+        return &(*fit);
+    }
+    return 0;
+}
+
+std::string Vasnecov::ResourceManifest::manifestPath() const
+{
+    return m_root + Vasnecov::cfg_manifestPrefix + m_format + "." + Vasnecov::cfg_manifestFormat;
+}
+
+qint64 Vasnecov::ResourceManifest::settled(const QDateTime &time)
+{
+    const qint64 modified(time.toMSecsSinceEpoch());
+    if(QDateTime::currentMSecsSinceEpoch() - modified < Vasnecov::cfg_manifestSettleTime)
+    {
+        return -1;
+    }
+    return modified;
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Манифест директории ресурсов: список файлов между запусками, без полного обхода директорий
+#ifndef VASNECOV_RESOURCEMANIFEST_H
+#define VASNECOV_RESOURCEMANIFEST_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <string>
+#include <vector>
+#include <map>
+#include <QMutex>
+#include "contenthash.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+class QDateTime;
+
+namespace Vasnecov
+{
+    class ResourceManifest
+    {
+    public:
+        // Файлы с расширением format. cacheFormat - подготовленные файлы рядом с ними (пусто - нет таких)
+        ResourceManifest(const std::string &format, const std::string &cacheFormat = "");
+
+        // Файлы поддиректории targetDir корня root (имена - относительно корня), в порядке манифеста:
+        // по директориям, по именам. Перечитываются только директории, изменённые с прошлого раза
+        void list(const std::string &root, const std::string &targetDir, GLboolean withSub, std::vector<std::string> &files);
+
+        // Дальше path - полный путь файла. Файлы вне последнего списка проверяются как обычно
+        GLboolean isListed(const std::string &path); // Файл был в директории при последнем списке
+        GLboolean mayHaveCache(const std::string &path); // false - подготовленного файла точно нет
+        void setCached(const std::string &path); // Подготовленный файл записан
+        ContentKey contentKey(const std::string &path, quint64 seed = 0); // Без чтения файла, если он не менялся
+
+        GLboolean save(); // Запись в корень, если что-то изменилось. Можно вызывать из любого потока
+
+    protected:
+        struct File
+        {
+            std::string name;
+            qint64 size;
+            qint64 modified; // мс, -1 - ключ содержимого не проверен
+            quint64 seed;
+            ContentKey key;
+            GLboolean cached;
+
+            File() :
+                name(),
+                size(-1),
+                modified(-1),
+                seed(0),
+                key(),
+                cached(false)
+            {}
+            bool operator<(const File &other) const {return name < other.name;}
+        };
+        struct Directory
+        {
+            qint64 modified; // мс, -1 - перечитать при следующем списке
+            GLboolean checked; // Сверена с диском при этом запуске
+            GLboolean unchanged; // При первой сверке совпала с манифестом: размеры и время файлов верны
+            std::vector<std::string> subdirs;
+            std::vector<File> files; // По именам
+
+            Directory() :
+                modified(-1),
+                checked(false),
+                unchanged(false),
+                subdirs(),
+                files()
+            {}
+        };
+
+    protected:
+        // Вызываются под mtx_data
+        void setRoot(const std::string &root);
+        void load();
+        void listDir(const std::string &dirName, GLboolean withSub, std::vector<std::string> &files);
+        void rescan(const std::string &dirName, Directory &dir);
+        void erase(const std::string &dirName); // Директория со всеми поддиректориями
+        File *findFile(const std::string &path, GLboolean checkedOnly, Directory **directory = 0);
+        std::string manifestPath() const;
+        static qint64 settled(const QDateTime &time); // -1 для слишком свежих изменений
+
+    private:
+        const std::string m_format;
+        const std::string m_cacheFormat;
+
+        QMutex mtx_data; // Потоки загрузки обращаются одновременно
+        std::string m_root;
+        std::map<std::string, Directory> m_dirs; // Имена директорий - относительно корня, с "/" на конце
+        GLboolean m_modified;
+
+    private:
+        Q_DISABLE_COPY(ResourceManifest)
+    };
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_RESOURCEMANIFEST_H
@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "syncstats.h"
+#include <chrono>
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::SyncStats
+  \brief Счётчики и гистограммы для разбора задержек картинки.
+
+  Собираются:
+  - время ожидания и удержания мьютексов данных по видам захвата (см. \a Vasnecov::StatsLocker): места
+  захвата одного вида сливаются в один счётчик;
+  - количество неудачных tryLock в потоке отрисовки;
+  - задержка от самого раннего изменения сырых данных до синхронизации, в которой оно стало чистым.
+  Это худший случай внутри синхронизации: по замеру на синхронизацию, а не на каждый элемент;
+  - задержка от этой синхронизации до окончания отрисовки кадра.
+
+  Сбор по умолчанию выключен. Данные общие для всех Вселенных процесса.
+ */
+
+namespace
+{
+    class AtomicHistogram
+    {
+    public:
+        AtomicHistogram() :
+            m_count(0),
+            m_sum(0),
+            m_max(0)
+        {
+            for(GLuint i = 0; i < Vasnecov::SyncStats::HistogramBuckets; ++i)
+            {
+                m_buckets[i].store(0);
+            }
+        }
+
+        void add(quint64 nsecs)
+        {
+            quint64 usecs(nsecs / 1000);
+            GLuint index(0);
+            while(usecs && index < Vasnecov::SyncStats::HistogramBuckets - 1)
+            {
+                usecs >>= 1;
+                ++index;
+            }
+
+            m_buckets[index].fetchAndAddRelaxed(1);
+            m_count.fetchAndAddRelaxed(1);
+            m_sum.fetchAndAddRelaxed(nsecs);
+
+            quint64 max(m_max.load());
+            while(nsecs > max && !m_max.testAndSetRelaxed(max, nsecs))
+            {
+                max = m_max.load();
+            }
+        }
+        void reset()
+        {
+            m_count.store(0);
+            m_sum.store(0);
+            m_max.store(0);
+            for(GLuint i = 0; i < Vasnecov::SyncStats::HistogramBuckets; ++i)
+            {
+                m_buckets[i].store(0);
+            }
+        }
+        Vasnecov::SyncStats::Histogram snapshot() const
+        {
+            Vasnecov::SyncStats::Histogram res;
+            res.count = m_count.load();
+            res.sum = m_sum.load();
+            res.max = m_max.load();
+            for(GLuint i = 0; i < Vasnecov::SyncStats::HistogramBuckets; ++i)
+            {
+                res.buckets[i] = m_buckets[i].load();
+            }
+            return res;
+        }
+
+    private:
+        QAtomicInteger<quint64> m_count;
+        QAtomicInteger<quint64> m_sum;
+        QAtomicInteger<quint64> m_max;
+        QAtomicInteger<quint64> m_buckets[Vasnecov::SyncStats::HistogramBuckets];
+
+        Q_DISABLE_COPY(AtomicHistogram)
+    };
+
+    struct AtomicLockCounters
+    {
+        QAtomicInteger<quint64> attempts;
+        QAtomicInteger<quint64> failures;
+        AtomicHistogram wait;
+        AtomicHistogram hold;
+
+        AtomicLockCounters() :
+            attempts(0),
+            failures(0),
+            wait(),
+            hold()
+        {}
+    };
+
+    AtomicLockCounters s_locks[Vasnecov::SyncStats::LockKindsCount];
+    AtomicHistogram s_latencies[Vasnecov::SyncStats::LatenciesCount];
+
+    QAtomicInteger<quint64> s_changedSince(0); // Самое раннее несинхронизированное изменение
+    QAtomicInteger<quint64> s_pureSince(0); // Синхронизация, ещё не попавшая в кадр
+}
+
+QAtomicInt Vasnecov::SyncStats::s_enabled(0);
+
+Vasnecov::SyncStats::Histogram::Histogram() :
+    count(0),
+    sum(0),
+    max(0)
+{
+    for(GLuint i = 0; i < HistogramBuckets; ++i)
+    {
+        buckets[i] = 0;
+    }
+}
+
+quint64 Vasnecov::SyncStats::Histogram::mean() const
+{
+    if(!count)
+    {
+        return 0;
+    }
+    return sum / count;
+}
+
+quint64 Vasnecov::SyncStats::Histogram::percentile(GLfloat part) const
+{
+    if(!count)
+    {
+        return 0;
+    }
+
+    quint64 target(static_cast<quint64>(part * count));
+    quint64 accumulated(0);
+    for(GLuint i = 0; i < HistogramBuckets; ++i)
+    {
+        accumulated += buckets[i];
+        if(accumulated > target || accumulated == count)
+        {
+            return static_cast<quint64>(1) << i;
+        }
+    }
+    return static_cast<quint64>(1) << (HistogramBuckets - 1);
+}
+
+void Vasnecov::SyncStats::setEnabled(GLboolean enabled)
+{
+    if(!enabled)
+    {
+        s_changedSince.store(0);
+        s_pureSince.store(0);
+    }
+    s_enabled.store(enabled ? 1 : 0);
+}
+
+void Vasnecov::SyncStats::reset()
+{
+    for(GLuint i = 0; i < LockKindsCount; ++i)
+    {
+        s_locks[i].attempts.store(0);
+        s_locks[i].failures.store(0);
+        s_locks[i].wait.reset();
+        s_locks[i].hold.reset();
+    }
+    for(GLuint i = 0; i < LatenciesCount; ++i)
+    {
+        s_latencies[i].reset();
+    }
+    s_changedSince.store(0);
+    s_pureSince.store(0);
+}
+
+Vasnecov::SyncStats::LockCounters Vasnecov::SyncStats::lockCounters(LockKind kind)
+{
+    LockCounters res;
+    if(kind < LockKindsCount)
+    {
+        res.attempts = s_locks[kind].attempts.load();
+        res.failures = s_locks[kind].failures.load();
+        res.wait = s_locks[kind].wait.snapshot();
+        res.hold = s_locks[kind].hold.snapshot();
+    }
+    return res;
+}
+
+Vasnecov::SyncStats::Histogram Vasnecov::SyncStats::latency(Latency type)
+{
+    if(type < LatenciesCount)
+    {
+        return s_latencies[type].snapshot();
+    }
+    return Histogram();
+}
+
+quint64 Vasnecov::SyncStats::now()
+{
+    return static_cast<quint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Vasnecov::SyncStats::addLockWait(LockKind kind, quint64 nsecs)
+{
+    s_locks[kind].wait.add(nsecs);
+}
+
+void Vasnecov::SyncStats::addLockHold(LockKind kind, quint64 nsecs)
+{
+    s_locks[kind].hold.add(nsecs);
+}
+
+void Vasnecov::SyncStats::addTryLock(LockKind kind, GLboolean success)
+{
+    s_locks[kind].attempts.fetchAndAddRelaxed(1);
+    if(!success)
+    {
+        s_locks[kind].failures.fetchAndAddRelaxed(1);
+    }
+}
+
+/*!
+ \brief Отметка изменения сырых данных. Запоминается только самое раннее изменение до синхронизации.
+*/
+void Vasnecov::SyncStats::noteRawChange()
+{
+    if(!s_changedSince.load())
+    {
+        s_changedSince.testAndSetRelaxed(0, now());
+    }
+}
+
+/*!
+ \brief Отметка полной синхронизации (Вселенная и все миры).
+
+ Изменение, сделанное во время самой синхронизации, может попасть в этот же замер с заниженной задержкой.
+*/
+void Vasnecov::SyncStats::notePure()
+{
+    quint64 changed(s_changedSince.fetchAndStoreOrdered(0));
+    if(changed)
+    {
+        quint64 pure(now());
+        s_latencies[LatencyOldestChange].add(pure - changed);
+        s_pureSince.testAndSetRelaxed(0, pure);
+    }
+}
+
+void Vasnecov::SyncStats::noteFrame()
+{
+    quint64 pure(s_pureSince.fetchAndStoreOrdered(0));
+    if(pure)
+    {
+        s_latencies[LatencyPureToFrame].add(now() - pure);
+    }
+}
+
+const char *Vasnecov::SyncStats::kindName(LockKind kind)
+{
+    switch(kind)
+    {
+        case LockRenderUniverse:
+            return "render universe";
+        case LockRenderWorld:
+            return "render world";
+        case LockDesignerUniverse:
+            return "universe";
+        case LockDesignerWorld:
+            return "world";
+        case LockDesignerElement:
+            return "element";
+        case LockDesignerLamp:
+            return "lamp";
+        case LockDesignerProduct:
+            return "product";
+        case LockDesignerFigure:
+            return "figure";
+        case LockDesignerLabel:
+            return "label";
+        case LockDesignerMaterial:
+            return "material";
+        default:
+            return "unknown";
+    }
+}
+
+/*!
+ \brief Текстовая сводка: количество, среднее, 50/99 перцентили (мкс) и максимум по всем счётчикам.
+*/
+QString Vasnecov::SyncStats::report()
+{
+    QString res;
+
+    if(!isEnabled())
+    {
+        res = "Sync stats: disabled";
+        return res;
+    }
+
+    res = "Sync stats (us: count mean p50 p99 max)";
+
+    for(GLuint i = 0; i < LockKindsCount; ++i)
+    {
+        LockCounters counters(lockCounters(static_cast<LockKind>(i)));
+        if(!counters.wait.count && !counters.hold.count && !counters.attempts)
+        {
+            continue;
+        }
+
+        res += QString("\nlock kind %1: wait %2 %3 %4 %5 %6, hold %7 %8 %9 %10 %11")
+               .arg(kindName(static_cast<LockKind>(i)))
+               .arg(counters.wait.count)
+               .arg(counters.wait.mean() / 1000)
+               .arg(counters.wait.percentile(0.5f))
+               .arg(counters.wait.percentile(0.99f))
+               .arg(counters.wait.max / 1000)
+               .arg(counters.hold.count)
+               .arg(counters.hold.mean() / 1000)
+               .arg(counters.hold.percentile(0.5f))
+               .arg(counters.hold.percentile(0.99f))
+               .arg(counters.hold.max / 1000);
+
+        if(counters.attempts)
+        {
+            res += QString(", tryLock failed %1 of %2").arg(counters.failures).arg(counters.attempts);
+        }
+    }
+
+    const char *latencyNames[LatenciesCount] = {"oldest change -> pure", "pure -> frame"};
+    for(GLuint i = 0; i < LatenciesCount; ++i)
+    {
+        Histogram hist(latency(static_cast<Latency>(i)));
+        res += QString("\nlatency %1: %2 %3 %4 %5 %6")
+               .arg(latencyNames[i])
+               .arg(hist.count)
+               .arg(hist.mean() / 1000)
+               .arg(hist.percentile(0.5f))
+               .arg(hist.percentile(0.99f))
+               .arg(hist.max / 1000);
+    }
+
+    return res;
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Статистика блокировок и задержек синхронизации
+#ifndef VASNECOV_SYNCSTATS_H
+#define VASNECOV_SYNCSTATS_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <QMutex>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QString>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace Vasnecov
+{
+    class SyncStats
+    {
+    public:
+        // Виды захвата мьютексов данных. Все места захвата одного вида (например, все методы фигур)
+        // учитываются вместе, отдельные вызовы не различаются
+        enum LockKind
+        {
+            LockRenderUniverse = 0, // tryLock Вселенной в потоке отрисовки
+            LockRenderWorld, // tryLock миров в потоке отрисовки
+            LockDesignerUniverse,
+            LockDesignerWorld,
+            LockDesignerElement, // Общие методы элементов
+            LockDesignerLamp,
+            LockDesignerProduct,
+            LockDesignerFigure,
+            LockDesignerLabel,
+            LockDesignerMaterial,
+            LockKindsCount
+        };
+        enum Latency
+        {
+            LatencyOldestChange = 0, // Один замер на синхронизацию: от самого раннего несинхронизированного изменения
+            LatencyPureToFrame, // От синхронизации до отрисованного кадра
+            LatenciesCount
+        };
+
+        static const GLuint HistogramBuckets = 24; // Корзина i - значения меньше 2^i мкс, последняя - всё остальное
+
+        // Снимок гистограммы (значения в наносекундах)
+        struct Histogram
+        {
+            quint64 count;
+            quint64 sum;
+            quint64 max;
+            quint64 buckets[HistogramBuckets];
+
+            Histogram();
+            quint64 mean() const;
+            quint64 percentile(GLfloat part) const; // Верхняя граница корзины, мкс
+        };
+        struct LockCounters
+        {
+            quint64 attempts; // Только для tryLock
+            quint64 failures;
+            Histogram wait;
+            Histogram hold;
+
+            LockCounters() :
+                attempts(0),
+                failures(0),
+                wait(),
+                hold()
+            {}
+        };
+
+    public:
+        // Пока сбор выключен, затраты - одно чтение атомарной переменной
+        static void setEnabled(GLboolean enabled);
+        static GLboolean isEnabled();
+        static void reset();
+
+        static LockCounters lockCounters(LockKind kind);
+        static Histogram latency(Latency type);
+        static QString report();
+
+        static quint64 now(); // Монотонное время, нс
+
+        // Сбор данных
+        static void addLockWait(LockKind kind, quint64 nsecs);
+        static void addLockHold(LockKind kind, quint64 nsecs);
+        static void addTryLock(LockKind kind, GLboolean success);
+
+        static void noteRawChange(); // Первое изменение элемента после синхронизации
+        static void notePure(); // Все домены синхронизированы
+        static void noteFrame(); // Кадр отрисован
+
+        static const char *kindName(LockKind kind);
+
+    private:
+        static QAtomicInt s_enabled;
+    };
+
+    inline GLboolean SyncStats::isEnabled()
+    {
+        return s_enabled.load() != 0;
+    }
+
+    // Аналог QMutexLocker с учётом ожидания и удержания мьютекса
+    class StatsLocker
+    {
+    public:
+        StatsLocker(QMutex *mutex, SyncStats::LockKind kind) :
+            m_mutex(mutex),
+            m_kind(kind),
+            m_lockedAt(0),
+            m_locked(false)
+        {
+            relock();
+        }
+        ~StatsLocker()
+        {
+            unlock();
+        }
+
+        void unlock()
+        {
+            if(m_locked)
+            {
+                m_locked = false;
+                if(m_lockedAt)
+                {
+                    SyncStats::addLockHold(m_kind, SyncStats::now() - m_lockedAt);
+                    m_lockedAt = 0;
+                }
+                m_mutex->unlock();
+            }
+        }
+        void relock()
+        {
+            if(m_mutex && !m_locked)
+            {
+                if(SyncStats::isEnabled())
+                {
+                    quint64 start(SyncStats::now());
+                    m_mutex->lock();
+                    m_lockedAt = SyncStats::now();
+                    SyncStats::addLockWait(m_kind, m_lockedAt - start);
+                }
+                else
+                {
+                    m_mutex->lock();
+                }
+                m_locked = true;
+            }
+        }
+
+    private:
+        QMutex *m_mutex;
+        const SyncStats::LockKind m_kind;
+        quint64 m_lockedAt;
+        GLboolean m_locked;
+
+        Q_DISABLE_COPY(StatsLocker)
+    };
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_SYNCSTATS_H
@@ -0,0 +1,793 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "texturefile.h"
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <QImage>
+#include <QOpenGLContext>
+#include "mipchain.h"
+#include "technologist.h"
+#ifndef GL_EXT_texture_compression_s3tc
+    #define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+    #define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+    #define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+    #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::TextureFile
+  \brief Текстура, подготовленная заранее: файл DDS со всеми уровнями детализации.
+
+  Файл целиком отображается в память (QFile::map) и передаётся в OpenGL прямо оттуда: без декодирования
+  PNG, преобразования точек и построения уровней. Сжатые уровни (S3TC: DXT1, DXT3, DXT5) передаются через
+  glCompressedTexImage2D и остаются сжатыми в видеопамяти. Если контекст их не поддерживает, уровни
+  распаковываются при передаче.
+
+  Читаются DDS без заголовка DX10: сжатые DXT1/3/5 и несжатые 32 бита на точку (B, G, R, A в памяти).
+  Пишутся DXT1 (картинка без прозрачности), DXT5 или несжатые. Сжатие - по описывающему параллелепипеду
+  цветов блока, этого достаточно для текстур моделей. В зарезервированных словах заголовка записывается
+  вид прозрачности картинки: по сжатой альфе его уже не определить без распаковки.
+ */
+
+namespace
+{
+    typedef void (APIENTRY *CompressedTexImage2D)(GLenum target, GLint level, GLenum internalFormat,
+                                                  GLsizei width, GLsizei height, GLint border,
+                                                  GLsizei imageSize, const GLvoid *data);
+    CompressedTexImage2D compressedTexImage2D(0); // Задаётся при инициализации отрисовки
+
+    const quint32 ddsMagic = 0x20534444; // "DDS "
+    const quint32 ddsTag = 0x434e5356; // "VSNC"
+    const GLsizei ddsSizeMax = 32768;
+
+    // Флаги заголовка, формата точек и возможностей
+    enum
+    {
+        DdsCaps				= 0x00000001,
+        DdsHeight			= 0x00000002,
+        DdsWidth			= 0x00000004,
+        DdsPitch			= 0x00000008,
+        DdsPixelFormat		= 0x00001000,
+        DdsMipmapCount		= 0x00020000,
+        DdsLinearSize		= 0x00080000,
+
+        PfAlphaPixels		= 0x00000001,
+        PfFourCC			= 0x00000004,
+        PfRGB				= 0x00000040,
+
+        CapsComplex			= 0x00000008,
+        CapsTexture			= 0x00001000,
+        CapsMipmap			= 0x00400000
+    };
+
+    // Номера 32-битных слов заголовка, вместе с меткой
+    enum
+    {
+        WordMagic			= 0,
+        WordSize			= 1,
+        WordFlags			= 2,
+        WordHeight			= 3,
+        WordWidth			= 4,
+        WordPitch			= 5,
+        WordMipmaps			= 7,
+        WordTag				= 8, // Первое зарезервированное слово: метка Vasnecov
+        WordAlpha			= 9, // Вид прозрачности (Vasnecov::TextureAlpha), если есть метка
+        WordPfSize			= 19,
+        WordPfFlags			= 20,
+        WordPfFourCC		= 21,
+        WordPfBits			= 22,
+        WordPfRed			= 23,
+        WordPfGreen			= 24,
+        WordPfBlue			= 25,
+        WordPfAlpha			= 26,
+        WordCaps			= 27,
+        WordsCount			= 32
+    };
+
+    inline quint32 fourCC(char a, char b, char c, char d)
+    {
+        return static_cast<quint32>(static_cast<quint8>(a)) |
+               (static_cast<quint32>(static_cast<quint8>(b)) << 8) |
+               (static_cast<quint32>(static_cast<quint8>(c)) << 16) |
+               (static_cast<quint32>(static_cast<quint8>(d)) << 24);
+    }
+
+    inline GLuint blockBytes(Vasnecov::TextureFile::Format format)
+    {
+        return format == Vasnecov::TextureFile::FormatDXT1 ? 8 : 16;
+    }
+
+    inline qint64 levelSize(Vasnecov::TextureFile::Format format, GLsizei width, GLsizei height)
+    {
+        if(format == Vasnecov::TextureFile::FormatBGRA || format == Vasnecov::TextureFile::FormatBGRX)
+        {
+            return static_cast<qint64>(width) * height * 4;
+        }
+        return static_cast<qint64>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+
+    // Цвет 5:6:5 <-> B, G, R
+    inline quint16 packColor(const GLint *bgr)
+    {
+        return static_cast<quint16>(((bgr[2] >> 3) << 11) | ((bgr[1] >> 2) << 5) | (bgr[0] >> 3));
+    }
+    inline void unpackColor(quint16 color, GLint *bgr)
+    {
+        const GLint r((color >> 11) & 31), g((color >> 5) & 63), b(color & 31);
+        bgr[0] = (b << 3) | (b >> 2);
+        bgr[1] = (g << 2) | (g >> 4);
+        bgr[2] = (r << 3) | (r >> 2);
+    }
+
+    // Блок 4x4 точек (B, G, R, A) с повтором крайних точек у маленьких уровней
+    void gatherBlock(const GLubyte *pixels, GLsizei width, GLsizei height, GLsizei bx, GLsizei by, GLubyte *block)
+    {
+        for(GLsizei y = 0; y < 4; ++y)
+        {
+            const GLsizei sy(qMin(by * 4 + y, height - 1));
+            for(GLsizei x = 0; x < 4; ++x)
+            {
+                const GLsizei sx(qMin(bx * 4 + x, width - 1));
+                memcpy(block + (y * 4 + x) * 4, pixels + (static_cast<size_t>(sy) * width + sx) * 4, 4);
+            }
+        }
+    }
+
+    // Цвет блока -> 8 байт DXT1 в четырёхцветном режиме
+    void encodeColorBlock(const GLubyte *block, GLubyte *out)
+    {
+        GLint low[3] = {255, 255, 255};
+        GLint high[3] = {0, 0, 0};
+        for(GLuint i = 0; i < 16; ++i)
+        {
+            for(GLuint c = 0; c < 3; ++c)
+            {
+                low[c] = qMin(low[c], static_cast<GLint>(block[i * 4 + c]));
+                high[c] = qMax(high[c], static_cast<GLint>(block[i * 4 + c]));
+            }
+        }
+        // Концы отрезка сдвигаются внутрь: ошибка на промежуточных цветах меньше
+        for(GLuint c = 0; c < 3; ++c)
+        {
+            const GLint inset((high[c] - low[c]) >> 4);
+            low[c] += inset;
+            high[c] -= inset;
+        }
+
+        quint16 c0(packColor(high)), c1(packColor(low));
+        if(c0 < c1)
+        {
+            std::swap(c0, c1);
+        }
+
+        GLint palette[4][3];
+        unpackColor(c0, palette[0]);
+        unpackColor(c1, palette[1]);
+        for(GLuint c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        quint32 indices(0);
+        if(c0 != c1) // Иначе весь блок - первый цвет
+        {
+            for(GLuint i = 0; i < 16; ++i)
+            {
+                GLuint best(0);
+                GLint bestDistance(INT_MAX);
+                for(GLuint p = 0; p < 4; ++p)
+                {
+                    GLint distance(0);
+                    for(GLuint c = 0; c < 3; ++c)
+                    {
+                        const GLint d(static_cast<GLint>(block[i * 4 + c]) - palette[p][c]);
+                        distance += d * d;
+                    }
+                    if(distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= best << (2 * i);
+            }
+        }
+
+        out[0] = static_cast<GLubyte>(c0 & 0xff);
+        out[1] = static_cast<GLubyte>(c0 >> 8);
+        out[2] = static_cast<GLubyte>(c1 & 0xff);
+        out[3] = static_cast<GLubyte>(c1 >> 8);
+        for(GLuint b = 0; b < 4; ++b)
+        {
+            out[4 + b] = static_cast<GLubyte>((indices >> (8 * b)) & 0xff);
+        }
+    }
+
+    // Альфа блока -> 8 байт DXT5 в восьмиуровневом режиме
+    void encodeAlphaBlock(const GLubyte *block, GLubyte *out)
+    {
+        GLint low(255), high(0);
+        for(GLuint i = 0; i < 16; ++i)
+        {
+            low = qMin(low, static_cast<GLint>(block[i * 4 + 3]));
+            high = qMax(high, static_cast<GLint>(block[i * 4 + 3]));
+        }
+
+        GLint palette[8];
+        palette[0] = high;
+        palette[1] = low;
+        for(GLint p = 1; p < 7; ++p)
+        {
+            palette[p + 1] = ((7 - p) * high + p * low) / 7;
+        }
+
+        quint64 indices(0);
+        if(high != low)
+        {
+            for(GLuint i = 0; i < 16; ++i)
+            {
+                GLuint best(0);
+                GLint bestDistance(INT_MAX);
+                for(GLuint p = 0; p < 8; ++p)
+                {
+                    const GLint distance(qAbs(static_cast<GLint>(block[i * 4 + 3]) - palette[p]));
+                    if(distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= static_cast<quint64>(best) << (3 * i);
+            }
+        }
+
+        out[0] = static_cast<GLubyte>(high);
+        out[1] = static_cast<GLubyte>(low);
+        for(GLuint b = 0; b < 6; ++b)
+        {
+            out[2 + b] = static_cast<GLubyte>((indices >> (8 * b)) & 0xff);
+        }
+    }
+
+    void encodeLevel(Vasnecov::TextureFile::Format format, const GLubyte *pixels, GLsizei width, GLsizei height,
+                     std::vector<GLubyte> &encoded)
+    {
+        const GLsizei blocksX((width + 3) / 4), blocksY((height + 3) / 4);
+        encoded.resize(static_cast<size_t>(blocksX) * blocksY * blockBytes(format));
+
+        GLubyte block[64];
+        GLubyte *out(encoded.data());
+        for(GLsizei by = 0; by < blocksY; ++by)
+        {
+            for(GLsizei bx = 0; bx < blocksX; ++bx)
+            {
+                gatherBlock(pixels, width, height, bx, by, block);
+                if(format == Vasnecov::TextureFile::FormatDXT5)
+                {
+                    encodeAlphaBlock(block, out);
+                    out += 8;
+                }
+                encodeColorBlock(block, out);
+                out += 8;
+            }
+        }
+    }
+
+    // 8 байт цвета -> 16 точек (B, G, R, A). fourColors - режим DXT3/5, где нет прозрачного цвета
+    void decodeColorBlock(const GLubyte *in, GLboolean fourColors, GLubyte *block)
+    {
+        const quint16 c0(static_cast<quint16>(in[0] | (in[1] << 8)));
+        const quint16 c1(static_cast<quint16>(in[2] | (in[3] << 8)));
+
+        GLint palette[4][4];
+        unpackColor(c0, palette[0]);
+        unpackColor(c1, palette[1]);
+        palette[0][3] = palette[1][3] = 255;
+        for(GLuint c = 0; c < 3; ++c)
+        {
+            if(fourColors || c0 > c1)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            else
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+        palette[2][3] = 255;
+        palette[3][3] = (fourColors || c0 > c1) ? 255 : 0;
+
+        const quint32 indices(in[4] | (in[5] << 8) | (in[6] << 16) | (static_cast<quint32>(in[7]) << 24));
+        for(GLuint i = 0; i < 16; ++i)
+        {
+            const GLint *color(palette[(indices >> (2 * i)) & 3]);
+            for(GLuint c = 0; c < 4; ++c)
+            {
+                block[i * 4 + c] = static_cast<GLubyte>(color[c]);
+            }
+        }
+    }
+
+    void decodeAlphaBlock(const GLubyte *in, Vasnecov::TextureFile::Format format, GLubyte *block)
+    {
+        if(format == Vasnecov::TextureFile::FormatDXT3)
+        {
+            for(GLuint i = 0; i < 16; ++i)
+            {
+                const GLint nibble((in[i / 2] >> ((i & 1) * 4)) & 0x0f);
+                block[i * 4 + 3] = static_cast<GLubyte>(nibble * 17);
+            }
+            return;
+        }
+
+        GLint palette[8];
+        palette[0] = in[0];
+        palette[1] = in[1];
+        if(palette[0] > palette[1])
+        {
+            for(GLint p = 1; p < 7; ++p)
+            {
+                palette[p + 1] = ((7 - p) * palette[0] + p * palette[1]) / 7;
+            }
+        }
+        else
+        {
+            for(GLint p = 1; p < 5; ++p)
+            {
+                palette[p + 1] = ((5 - p) * palette[0] + p * palette[1]) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        quint64 indices(0);
+        for(GLuint b = 0; b < 6; ++b)
+        {
+            indices |= static_cast<quint64>(in[2 + b]) << (8 * b);
+        }
+        for(GLuint i = 0; i < 16; ++i)
+        {
+            block[i * 4 + 3] = static_cast<GLubyte>(palette[(indices >> (3 * i)) & 7]);
+        }
+    }
+
+    void decodeLevel(Vasnecov::TextureFile::Format format, const Vasnecov::TextureFile::Level &level,
+                     std::vector<GLubyte> &pixels)
+    {
+        pixels.resize(static_cast<size_t>(level.width) * level.height * 4);
+
+        const GLsizei blocksX((level.width + 3) / 4), blocksY((level.height + 3) / 4);
+        const GLuint bytes(blockBytes(format));
+
+        GLubyte block[64];
+        for(GLsizei by = 0; by < blocksY; ++by)
+        {
+            for(GLsizei bx = 0; bx < blocksX; ++bx)
+            {
+                const GLubyte *in(level.data + (static_cast<size_t>(by) * blocksX + bx) * bytes);
+                if(format == Vasnecov::TextureFile::FormatDXT1)
+                {
+                    decodeColorBlock(in, false, block);
+                }
+                else
+                {
+                    decodeColorBlock(in + 8, true, block);
+                    decodeAlphaBlock(in, format, block);
+                }
+
+                for(GLsizei y = 0; y < 4 && by * 4 + y < level.height; ++y)
+                {
+                    for(GLsizei x = 0; x < 4 && bx * 4 + x < level.width; ++x)
+                    {
+                        memcpy(&pixels[(static_cast<size_t>(by * 4 + y) * level.width + bx * 4 + x) * 4],
+                               block + (y * 4 + x) * 4, 4);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ \brief Открытие и отображение файла в память. При ошибке объект остаётся пустым (\a isValid() ложно).
+*/
+Vasnecov::TextureFile::TextureFile(const std::string &fileName) :
+    m_fileName(fileName),
+    m_file(QString::fromStdString(fileName)),
+    m_map(0),
+    m_format(FormatUndefined),
+    m_alpha(TextureAlphaOpaque),
+    m_levels()
+{
+    if(!m_file.open(QIODevice::ReadOnly))
+    {
+        Vasnecov::problem("Не удалось открыть файл текстуры: ", fileName);
+        return;
+    }
+
+    const qint64 fileSize(m_file.size());
+    if(fileSize < static_cast<qint64>(HeaderSize))
+    {
+        Vasnecov::problem("Неверный файл текстуры: ", fileName);
+        return;
+    }
+
+    m_map = m_file.map(0, fileSize);
+    if(!m_map)
+    {
+        Vasnecov::problem("Не удалось отобразить в память файл текстуры: ", fileName);
+        return;
+    }
+
+    quint32 header[WordsCount];
+    memcpy(header, m_map, sizeof(header));
+    if(header[WordMagic] != ddsMagic || header[WordSize] != 124 || header[WordPfSize] != 32)
+    {
+        Vasnecov::problem("Неверный файл текстуры: ", fileName);
+        return;
+    }
+
+    const quint32 pfFlags(header[WordPfFlags]);
+    if(pfFlags & PfFourCC)
+    {
+        if(header[WordPfFourCC] == fourCC('D', 'X', 'T', '1'))
+        {
+            m_format = FormatDXT1;
+            m_alpha = (pfFlags & PfAlphaPixels) ? TextureAlphaTested : TextureAlphaOpaque; // Альфа DXT1 - 0 или 255
+        }
+        else if(header[WordPfFourCC] == fourCC('D', 'X', 'T', '3'))
+        {
+            m_format = FormatDXT3;
+            m_alpha = TextureAlphaBlended;
+        }
+        else if(header[WordPfFourCC] == fourCC('D', 'X', 'T', '5'))
+        {
+            m_format = FormatDXT5;
+            m_alpha = TextureAlphaBlended;
+        }
+    }
+    else if((pfFlags & PfRGB) && header[WordPfBits] == 32 &&
+            header[WordPfRed] == 0x00ff0000 && header[WordPfGreen] == 0x0000ff00 && header[WordPfBlue] == 0x000000ff)
+    {
+        const GLboolean alpha((pfFlags & PfAlphaPixels) && header[WordPfAlpha] == 0xff000000);
+        m_alpha = alpha ? TextureAlphaBlended : TextureAlphaOpaque; // Уточняется по нулевому уровню
+        m_format = alpha ? FormatBGRA : FormatBGRX;
+    }
+    if(m_format == FormatUndefined)
+    {
+        Vasnecov::problem("Неподдерживаемый формат файла текстуры: ", fileName);
+        return;
+    }
+
+    const GLsizei width(static_cast<GLsizei>(header[WordWidth]));
+    const GLsizei height(static_cast<GLsizei>(header[WordHeight]));
+    if(width <= 0 || height <= 0 || width > ddsSizeMax || height > ddsSizeMax)
+    {
+        Vasnecov::problem("Текстура неверного размера: ", fileName);
+        return;
+    }
+
+    GLuint count(1);
+    if((header[WordFlags] & DdsMipmapCount) && header[WordMipmaps] > 1)
+    {
+        count = header[WordMipmaps];
+    }
+
+    std::vector<Level> levels;
+    Level level;
+    level.width = width;
+    level.height = height;
+    qint64 offset(HeaderSize);
+    for(GLuint i = 0; i < count; ++i)
+    {
+        const qint64 size(levelSize(m_format, level.width, level.height));
+        if(offset + size > fileSize)
+        {
+            Vasnecov::problem("Файл текстуры повреждён: ", fileName);
+            return;
+        }
+        level.data = m_map + offset;
+        level.size = static_cast<GLsizei>(size);
+        levels.push_back(level);
+        offset += size;
+
+        if(level.width == 1 && level.height == 1)
+        {
+            break;
+        }
+        level.width = qMax(level.width / 2, 1);
+        level.height = qMax(level.height / 2, 1);
+    }
+
+    m_levels.swap(levels);
+
+    // Вид прозрачности записан при подготовке, иначе несжатый нулевой уровень проверяется здесь же
+    if(m_format == FormatDXT3 || m_format == FormatDXT5)
+    {
+        if(header[WordTag] == ddsTag && header[WordAlpha] <= TextureAlphaBlended)
+        {
+            m_alpha = static_cast<TextureAlpha>(header[WordAlpha]);
+        }
+    }
+    else if(m_format == FormatBGRA)
+    {
+        m_alpha = Vasnecov::MipChain::scanAlpha(m_levels.front().data,
+                                                static_cast<size_t>(m_levels.front().width) * m_levels.front().height);
+    }
+}
+
+Vasnecov::TextureFile::~TextureFile()
+{
+    if(m_map)
+    {
+        m_file.unmap(m_map);
+    }
+}
+
+GLboolean Vasnecov::TextureFile::isMipmapComplete() const
+{
+    return !m_levels.empty() && m_levels.back().width == 1 && m_levels.back().height == 1;
+}
+
+size_t Vasnecov::TextureFile::bytes() const
+{
+    size_t res(0);
+    for(std::vector<Level>::const_iterator it = m_levels.begin(); it != m_levels.end(); ++it)
+    {
+        res += it->size;
+    }
+    return res;
+}
+
+size_t Vasnecov::TextureFile::gpuBytes() const
+{
+    if(!isCompressed() || isCompressionSupported())
+    {
+        return bytes();
+    }
+
+    size_t res(0);
+    for(std::vector<Level>::const_iterator it = m_levels.begin(); it != m_levels.end(); ++it)
+    {
+        res += static_cast<size_t>(it->width) * it->height * 4;
+    }
+    return res;
+}
+
+void Vasnecov::TextureFile::averageColor(GLubyte *bgra) const
+{
+    if(!isMipmapComplete())
+    {
+        bgra[0] = bgra[1] = bgra[2] = 128;
+        bgra[3] = 255;
+        return;
+    }
+
+    const Level &level(m_levels.back());
+    if(isCompressed())
+    {
+        std::vector<GLubyte> pixels;
+        decodeLevel(m_format, level, pixels);
+        memcpy(bgra, pixels.data(), 4);
+    }
+    else
+    {
+        memcpy(bgra, level.data, 4);
+    }
+    if(!hasAlpha())
+    {
+        bgra[3] = 255;
+    }
+}
+
+QImage Vasnecov::TextureFile::image() const
+{
+    if(m_levels.empty())
+    {
+        return QImage();
+    }
+
+    const Level &level(m_levels.front());
+    std::vector<GLubyte> pixels;
+    const GLubyte *bits(level.data);
+    if(isCompressed())
+    {
+        decodeLevel(m_format, level, pixels);
+        bits = pixels.data();
+    }
+
+    QImage res(level.width, level.height, hasAlpha() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    for(GLsizei y = 0; y < level.height; ++y)
+    {
+        memcpy(res.scanLine(y), bits + static_cast<size_t>(y) * level.width * 4, static_cast<size_t>(level.width) * 4);
+    }
+    if(!hasAlpha()) // Байт альфы у BGRX не определён, а RGB32 требует 255
+    {
+        for(GLsizei y = 0; y < level.height; ++y)
+        {
+            quint32 *line(reinterpret_cast<quint32 *>(res.scanLine(y)));
+            for(GLsizei x = 0; x < level.width; ++x)
+            {
+                line[x] |= 0xff000000;
+            }
+        }
+    }
+    return res;
+}
+
+GLboolean Vasnecov::TextureFile::upload() const
+{
+    if(m_levels.empty())
+    {
+        return false;
+    }
+
+    GLenum compressedFormat(0);
+    switch(m_format)
+    {
+        case FormatDXT1:
+            compressedFormat = hasAlpha() ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            break;
+        case FormatDXT3:
+            compressedFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+            break;
+        case FormatDXT5:
+            compressedFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            break;
+        default:
+            break;
+    }
+
+    const GLint components(hasAlpha() ? 4 : 3);
+    std::vector<GLubyte> pixels; // Распакованный уровень, если сжатые текстуры не поддерживаются
+
+    for(GLuint i = 0; i < m_levels.size(); ++i)
+    {
+        const Level &level(m_levels[i]);
+        if(!compressedFormat)
+        {
+            glTexImage2D(GL_TEXTURE_2D, i, components, level.width, level.height, 0,
+                         GL_BGRA_EXT, GL_UNSIGNED_BYTE, level.data);
+        }
+        else if(compressedTexImage2D)
+        {
+            compressedTexImage2D(GL_TEXTURE_2D, i, compressedFormat, level.width, level.height, 0,
+                                 level.size, level.data);
+        }
+        else
+        {
+            decodeLevel(m_format, level, pixels);
+            glTexImage2D(GL_TEXTURE_2D, i, components, level.width, level.height, 0,
+                         GL_BGRA_EXT, GL_UNSIGNED_BYTE, pixels.data());
+        }
+    }
+    return true;
+}
+
+/*!
+ \brief Построение уровней детализации картинки и запись их в файл DDS.
+
+ \return true при успешной записи
+*/
+GLboolean Vasnecov::TextureFile::write(const std::string &fileName, const QImage &image, GLboolean compress)
+{
+    Vasnecov::MipChain chain;
+    chain.build(image);
+    if(!chain.levelsCount())
+    {
+        Vasnecov::problem("Пустая картинка текстуры: ", fileName);
+        return false;
+    }
+
+    const GLboolean alpha(chain.hasAlpha());
+    Format format(alpha ? FormatBGRA : FormatBGRX);
+    if(compress)
+    {
+        format = alpha ? FormatDXT5 : FormatDXT1;
+    }
+
+    quint32 header[WordsCount];
+    memset(header, 0, sizeof(header));
+    header[WordMagic] = ddsMagic;
+    header[WordSize] = 124;
+    header[WordFlags] = DdsCaps | DdsHeight | DdsWidth | DdsPixelFormat | DdsMipmapCount |
+                          (compress ? DdsLinearSize : DdsPitch);
+    header[WordHeight] = chain.levelHeight(0);
+    header[WordWidth] = chain.levelWidth(0);
+    header[WordPitch] = compress ? static_cast<quint32>(levelSize(format, chain.levelWidth(0), chain.levelHeight(0)))
+                                   : chain.levelWidth(0) * 4;
+    header[WordMipmaps] = chain.levelsCount();
+    header[WordTag] = ddsTag;
+    header[WordAlpha] = chain.alpha();
+    header[WordPfSize] = 32;
+    if(compress)
+    {
+        header[WordPfFlags] = PfFourCC;
+        header[WordPfFourCC] = alpha ? fourCC('D', 'X', 'T', '5') : fourCC('D', 'X', 'T', '1');
+    }
+    else
+    {
+        header[WordPfFlags] = PfRGB | (alpha ? PfAlphaPixels : 0);
+        header[WordPfBits] = 32;
+        header[WordPfRed] = 0x00ff0000;
+        header[WordPfGreen] = 0x0000ff00;
+        header[WordPfBlue] = 0x000000ff;
+        header[WordPfAlpha] = alpha ? 0xff000000 : 0;
+    }
+    header[WordCaps] = CapsTexture;
+    if(chain.levelsCount() > 1)
+    {
+        header[WordCaps] |= CapsComplex | CapsMipmap;
+    }
+
+    QFile file(QString::fromStdString(fileName));
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        Vasnecov::problem("Не удалось создать файл текстуры: ", fileName);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+    std::vector<GLubyte> encoded;
+    for(GLuint i = 0; i < chain.levelsCount(); ++i)
+    {
+        const GLsizei width(chain.levelWidth(i)), height(chain.levelHeight(i));
+        if(compress)
+        {
+            encodeLevel(format, chain.levelBits(i), width, height, encoded);
+            file.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+        }
+        else
+        {
+            file.write(reinterpret_cast<const char *>(chain.levelBits(i)), levelSize(format, width, height));
+        }
+    }
+
+    if(file.error() != QFileDevice::NoError)
+    {
+        Vasnecov::problem("Ошибка записи файла текстуры: ", fileName);
+        return false;
+    }
+    return true;
+}
+
+void Vasnecov::TextureFile::renderInitialize(const QString &extensions)
+{
+    compressedTexImage2D = 0;
+
+    QOpenGLContext *context(QOpenGLContext::currentContext());
+    if(!context || !extensions.contains("GL_EXT_texture_compression_s3tc"))
+    {
+        return;
+    }
+
+    compressedTexImage2D = reinterpret_cast<CompressedTexImage2D>(context->getProcAddress("glCompressedTexImage2D"));
+    if(!compressedTexImage2D)
+    {
+        compressedTexImage2D = reinterpret_cast<CompressedTexImage2D>(context->getProcAddress("glCompressedTexImage2DARB"));
+    }
+}
+
+GLboolean Vasnecov::TextureFile::isCompressionSupported()
+{
+    return compressedTexImage2D != 0;
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Подготовленная текстура (DDS) с готовыми уровнями детализации, отображаемая в память
+#ifndef VASNECOV_TEXTUREFILE_H
+#define VASNECOV_TEXTUREFILE_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <string>
+#include <vector>
+#include <QFile>
+#include <QString>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+class QImage;
+
+namespace Vasnecov
+{
+    class TextureFile
+    {
+    public:
+        enum Format
+        {
+            FormatUndefined = 0,
+            FormatBGRA, // 32 бита на точку, в памяти - B, G, R, A
+            FormatBGRX, // То же без прозрачности
+            FormatDXT1,
+            FormatDXT3,
+            FormatDXT5
+        };
+
+        struct Level
+        {
+            GLsizei width, height;
+            const GLubyte *data; // Отображённые в память данные уровня
+            GLsizei size;
+        };
+
+        static const GLuint HeaderSize = 128; // Метка "DDS " и заголовок
+
+    public:
+        explicit TextureFile(const std::string &fileName);
+        ~TextureFile();
+
+        GLboolean isValid() const;
+        const std::string &fileName() const;
+
+        Format format() const;
+        GLboolean isCompressed() const;
+        GLboolean hasAlpha() const;
+        TextureAlpha alpha() const; // Сжатые с альфой без записанного вида прозрачности считаются смешиваемыми
+        const std::vector<Level> &levels() const;
+        GLboolean isMipmapComplete() const; // Есть все уровни до 1x1
+        size_t bytes() const;
+        size_t gpuBytes() const; // Объём в видеопамяти: без поддержки сжатия уровни распаковываются
+        void averageColor(GLubyte *bgra) const; // Цвет уровня 1x1, при неполной цепочке - серый
+        QImage image() const; // Нулевой уровень, распакованный
+
+        // Передача всех уровней в привязанную к GL_TEXTURE_2D текстуру. Только в потоке отрисовки
+        GLboolean upload() const;
+
+        // Запись картинки с уровнями детализации. compress - сжатие DXT1 (без прозрачности) или DXT5,
+        // иначе - без сжатия, 32 бита на точку
+        static GLboolean write(const std::string &fileName, const QImage &image, GLboolean compress = true);
+
+        // Поиск поддержки сжатых текстур в текущем контексте, вызывается при инициализации отрисовки.
+        // Без поддержки сжатые уровни распаковываются при передаче
+        static void renderInitialize(const QString &extensions);
+        static GLboolean isCompressionSupported();
+
+    private:
+        std::string m_fileName;
+        QFile m_file;
+        uchar *m_map;
+        Format m_format;
+        TextureAlpha m_alpha;
+        std::vector<Level> m_levels;
+
+        Q_DISABLE_COPY(TextureFile)
+    };
+
+    inline GLboolean TextureFile::isValid() const
+    {
+        return !m_levels.empty();
+    }
+    inline const std::string &TextureFile::fileName() const
+    {
+        return m_fileName;
+    }
+    inline TextureFile::Format TextureFile::format() const
+    {
+        return m_format;
+    }
+    inline GLboolean TextureFile::isCompressed() const
+    {
+        return m_format == FormatDXT1 || m_format == FormatDXT3 || m_format == FormatDXT5;
+    }
+    inline GLboolean TextureFile::hasAlpha() const
+    {
+        return m_alpha != TextureAlphaOpaque;
+    }
+    inline TextureAlpha TextureFile::alpha() const
+    {
+        return m_alpha;
+    }
+    inline const std::vector<TextureFile::Level> &TextureFile::levels() const
+    {
+        return m_levels;
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_TEXTUREFILE_H
@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "textureresidency.h"
+#include <algorithm>
+#include "vasnecovtexture.h"
+#include "vasnecovpipeline.h"
+#include "technologist.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::TextureResidency
+  \brief Учёт видеопамяти текстур и вытеснение по давности использования.
+
+  Каждая текстура знает свой объём в видеопамяти (со всеми уровнями) и отмечается при привязке в кадре.
+  В конце кадра, если сумма превышает бюджет, вытесняются текстуры, дольше всех не использовавшиеся
+  (но не в последние \a cfg_textureEvictFrames кадров). Вытесненная текстура сохраняет имя OpenGL и рисуется
+  одной точкой своего среднего цвета, а её данные остаются только в файле.
+
+  При следующем использовании текстура перечитывается в фоновом потоке (картинка с построением уровней
+  или подготовленный файл) и передаётся в OpenGL в потоке отрисовки, в пределах бюджета загрузки кадра.
+
+  Вытесняются только текстуры, знающие свой файл (диффузные, загруженные из директории текстур).
+ */
+
+Vasnecov::TextureResidency::TextureResidency(VasnecovPipeline *pipeline) :
+    m_pipeline(pipeline),
+
+    m_worker(0),
+    mtx_queue(),
+    m_wake(),
+    m_requests(),
+    m_ready(),
+    m_stopping(false),
+
+    m_textures(),
+    m_uploading(),
+    m_candidates(),
+    m_budget(Vasnecov::cfg_textureMemoryBudget),
+    m_residentBytes(0),
+    m_frame(0)
+{
+}
+
+Vasnecov::TextureResidency::~TextureResidency()
+{
+    if(m_worker)
+    {
+        {
+            QMutexLocker locker(&mtx_queue);
+            m_stopping = true;
+            m_requests.clear();
+            m_wake.wakeAll();
+        }
+        m_worker->wait();
+        delete m_worker;
+        m_worker = 0;
+    }
+}
+
+void Vasnecov::TextureResidency::renderSetBudget(size_t bytes)
+{
+    m_budget = bytes;
+}
+
+void Vasnecov::TextureResidency::renderAdd(VasnecovTexture *texture)
+{
+    if(texture && texture->id() && texture->isEvictable())
+    {
+        m_textures.push_back(texture);
+        m_residentBytes += texture->gpuBytes();
+    }
+}
+
+GLboolean Vasnecov::TextureResidency::renderRemove(VasnecovTexture *texture)
+{
+    if(texture->m_residency == VasnecovTexture::Reloading)
+    {
+        return false; // Она в очереди фонового потока, выгружать можно после передачи
+    }
+
+    std::vector<VasnecovTexture *>::iterator tit = std::find(m_textures.begin(), m_textures.end(), texture);
+    if(tit != m_textures.end())
+    {
+        m_residentBytes -= texture->gpuBytes();
+        m_textures.erase(tit);
+    }
+    return true;
+}
+
+size_t Vasnecov::TextureResidency::renderUploadReady(size_t budget)
+{
+    {
+        QMutexLocker locker(&mtx_queue);
+        m_uploading.insert(m_uploading.end(), m_ready.begin(), m_ready.end());
+        m_ready.clear();
+    }
+
+    size_t uploaded(0);
+    std::vector<VasnecovTexture *>::iterator tit = m_uploading.begin();
+    for(; tit != m_uploading.end() && uploaded < budget; ++tit)
+    {
+        VasnecovTexture *texture(*tit);
+        const size_t size(texture->uploadSize());
+
+        if(size && texture->loadImage())
+        {
+            uploaded += size;
+        }
+        else
+        {
+            // Файл пропал или испорчен: текстура остаётся средним цветом и больше не учитывается
+            Vasnecov::problem("Вытесненная текстура не перечитана");
+            texture->m_residency = VasnecovTexture::Evicted;
+            m_textures.erase(std::remove(m_textures.begin(), m_textures.end(), texture), m_textures.end());
+        }
+    }
+    m_uploading.erase(m_uploading.begin(), tit);
+
+    return uploaded;
+}
+
+void Vasnecov::TextureResidency::renderEndFrame()
+{
+    ++m_frame;
+
+    m_residentBytes = 0;
+    for(std::vector<VasnecovTexture *>::const_iterator tit = m_textures.begin(); tit != m_textures.end(); ++tit)
+    {
+        VasnecovTexture *texture(*tit);
+        if(texture->m_used)
+        {
+            texture->m_used = false;
+            texture->m_lastUsed = m_frame;
+
+            if(texture->m_residency == VasnecovTexture::Evicted)
+            {
+                texture->m_residency = VasnecovTexture::Reloading;
+                request(texture);
+            }
+        }
+        m_residentBytes += texture->gpuBytes();
+    }
+
+    if(!m_budget || m_residentBytes <= m_budget)
+    {
+        return;
+    }
+
+    m_candidates.clear();
+    for(std::vector<VasnecovTexture *>::const_iterator tit = m_textures.begin(); tit != m_textures.end(); ++tit)
+    {
+        if((*tit)->m_residency == VasnecovTexture::Resident && m_frame - (*tit)->m_lastUsed > Vasnecov::cfg_textureEvictFrames)
+        {
+            m_candidates.push_back(*tit);
+        }
+    }
+    std::sort(m_candidates.begin(), m_candidates.end(), [](const VasnecovTexture *a, const VasnecovTexture *b)
+    {
+        return a->m_lastUsed < b->m_lastUsed;
+    });
+
+    for(std::vector<VasnecovTexture *>::const_iterator tit = m_candidates.begin();
+        tit != m_candidates.end() && m_residentBytes > m_budget; ++tit)
+    {
+        m_residentBytes -= (*tit)->gpuBytes();
+        (*tit)->renderEvict();
+        m_residentBytes += (*tit)->gpuBytes();
+    }
+}
+
+void Vasnecov::TextureResidency::request(VasnecovTexture *texture)
+{
+    QMutexLocker locker(&mtx_queue);
+
+    m_requests.push_back(texture);
+
+    if(!m_worker)
+    {
+        m_worker = new Worker(this);
+        m_worker->start(QThread::LowPriority);
+    }
+    m_wake.wakeOne();
+}
+
+void Vasnecov::TextureResidency::workerLoop()
+{
+    QMutexLocker locker(&mtx_queue);
+
+    for(;;)
+    {
+        while(m_requests.empty() && !m_stopping)
+        {
+            m_wake.wait(&mtx_queue);
+        }
+        if(m_stopping)
+        {
+            return;
+        }
+
+        VasnecovTexture *texture(m_requests.front());
+        m_requests.pop_front();
+
+        locker.unlock();
+        texture->prepareReload();
+        locker.relock();
+
+        m_ready.push_back(texture);
+        m_pipeline->setSomethingWasUpdated(); // Кадр с перечитанной текстурой
+    }
+}
+
+void Vasnecov::TextureResidency::Worker::run()
+{
+    m_residency->workerLoop();
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
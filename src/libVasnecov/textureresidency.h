@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Бюджет видеопамяти текстур: вытеснение давно не используемых и их фоновая перезагрузка
+#ifndef VASNECOV_TEXTURERESIDENCY_H
+#define VASNECOV_TEXTURERESIDENCY_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <deque>
+#include <vector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include "configuration.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+class VasnecovPipeline;
+class VasnecovTexture;
+
+namespace Vasnecov
+{
+    class TextureResidency
+    {
+    public:
+        explicit TextureResidency(VasnecovPipeline *pipeline);
+        ~TextureResidency();
+
+        // Методы потока отрисовки
+        void renderSetBudget(size_t bytes); // 0 - без ограничения
+        void renderAdd(VasnecovTexture *texture); // Только что загруженная текстура
+        GLboolean renderRemove(VasnecovTexture *texture); // Перед выгрузкой. false - текстура ещё перечитывается
+        size_t renderUploadReady(size_t budget); // Передача перечитанных текстур, возврат - переданный объём
+        void renderEndFrame(); // Учёт использования, запросы перезагрузки, вытеснение сверх бюджета
+
+        size_t renderBudget() const {return m_budget;}
+        size_t renderResidentBytes() const {return m_residentBytes;}
+
+    protected:
+        class Worker : public QThread
+        {
+        public:
+            explicit Worker(TextureResidency *residency) :
+                QThread(),
+                m_residency(residency)
+            {}
+        protected:
+            void run();
+        private:
+            TextureResidency *m_residency;
+
+            Q_DISABLE_COPY(Worker)
+        };
+
+    protected:
+        void request(VasnecovTexture *texture);
+        void workerLoop();
+
+    private:
+        VasnecovPipeline *const m_pipeline;
+
+        Worker *m_worker; // Создаётся при первом запросе перезагрузки
+        QMutex mtx_queue;
+        QWaitCondition m_wake;
+        std::deque<VasnecovTexture *> m_requests;
+        std::vector<VasnecovTexture *> m_ready;
+        GLboolean m_stopping;
+
+        // Только поток отрисовки
+        std::vector<VasnecovTexture *> m_textures;
+        std::vector<VasnecovTexture *> m_uploading; // Перечитанные, ждущие бюджета загрузки
+        std::vector<VasnecovTexture *> m_candidates;
+        size_t m_budget;
+        size_t m_residentBytes;
+        quint64 m_frame;
+
+    private:
+        Q_DISABLE_COPY(TextureResidency)
+    };
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_TEXTURERESIDENCY_H
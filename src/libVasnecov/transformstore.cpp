@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "transformstore.h"
+#include <algorithm>
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class Vasnecov::TransformStore
+  \brief Хранилище трансформаций в виде структуры массивов.
+
+  Координаты, кватернионы и масштабы всех элементов лежат в отдельных непрерывных массивах,
+  поэтому сборка матриц идёт по четыре элемента за раз (SSE) без перескоков по памяти.
+  Родительские связи задаются индексами; родитель всегда добавляется раньше потомка, что позволяет
+  получить мировые матрицы одним проходом.
+
+  Используется для пакетного пересчёта матриц иерархий изделий.
+ */
+
+Vasnecov::TransformStore::TransformStore() :
+    m_px(), m_py(), m_pz(),
+    m_qw(), m_qx(), m_qy(), m_qz(),
+    m_scale(),
+    m_parent(),
+    m_fixed(),
+
+    m_local(),
+    m_world()
+{
+}
+
+void Vasnecov::TransformStore::clear()
+{
+    m_px.clear();
+    m_py.clear();
+    m_pz.clear();
+    m_qw.clear();
+    m_qx.clear();
+    m_qy.clear();
+    m_qz.clear();
+    m_scale.clear();
+    m_parent.clear();
+    m_fixed.clear();
+
+    m_local.clear();
+    m_world.clear();
+}
+
+void Vasnecov::TransformStore::reserve(size_t count)
+{
+    m_px.reserve(count);
+    m_py.reserve(count);
+    m_pz.reserve(count);
+    m_qw.reserve(count);
+    m_qx.reserve(count);
+    m_qy.reserve(count);
+    m_qz.reserve(count);
+    m_scale.reserve(count);
+    m_parent.reserve(count);
+    m_fixed.reserve(count);
+
+    m_local.reserve(count * 16);
+    m_world.reserve(count * 16);
+}
+
+Vasnecov::TransformStore::Handle Vasnecov::TransformStore::add(const QVector3D &position,
+                                                               const QQuaternion &rotation,
+                                                               GLfloat scale,
+                                                               Handle parent)
+{
+    Handle handle(static_cast<Handle>(m_parent.size()));
+
+    m_px.push_back(position.x());
+    m_py.push_back(position.y());
+    m_pz.push_back(position.z());
+    m_qw.push_back(rotation.scalar());
+    m_qx.push_back(rotation.x());
+    m_qy.push_back(rotation.y());
+    m_qz.push_back(rotation.z());
+    m_scale.push_back(scale);
+
+    if(parent >= handle)
+    {
+        parent = NoParent;
+    }
+    m_parent.push_back(parent);
+    m_fixed.push_back(false);
+
+    m_local.resize(m_local.size() + 16, 0.0f);
+    m_world.resize(m_world.size() + 16, 0.0f);
+
+    return handle;
+}
+
+Vasnecov::TransformStore::Handle Vasnecov::TransformStore::addFixed(const QMatrix4x4 &matrix)
+{
+    Handle handle(add(QVector3D(), QQuaternion(), 1.0f, NoParent));
+    m_fixed[handle] = true;
+
+    const GLfloat *data(matrix.constData());
+    std::copy(data, data + 16, m_local.begin() + handle * 16);
+
+    return handle;
+}
+
+void Vasnecov::TransformStore::setPosition(Handle handle, const QVector3D &position)
+{
+    m_px[handle] = position.x();
+    m_py[handle] = position.y();
+    m_pz[handle] = position.z();
+}
+
+void Vasnecov::TransformStore::setRotation(Handle handle, const QQuaternion &rotation)
+{
+    m_qw[handle] = rotation.scalar();
+    m_qx[handle] = rotation.x();
+    m_qy[handle] = rotation.y();
+    m_qz[handle] = rotation.z();
+}
+
+void Vasnecov::TransformStore::setScale(Handle handle, GLfloat scale)
+{
+    m_scale[handle] = scale;
+}
+
+void Vasnecov::TransformStore::update()
+{
+    composeLocal();
+    resolveWorld();
+}
+
+void Vasnecov::TransformStore::worldMatrix(Handle handle, QMatrix4x4 &matrix) const
+{
+    const GLfloat *data(worldData(handle));
+    std::copy(data, data + 16, matrix.data());
+}
+
+/*!
+ \brief Сборка матрицы из смещения, вращения и масштаба: M = T * R * S.
+
+ Кватернион должен быть нормированным. Результат записывается по столбцам (как в QMatrix4x4 и OpenGL).
+*/
+void Vasnecov::TransformStore::compose(const QVector3D &position, const QQuaternion &rotation, GLfloat scale, GLfloat *matrix)
+{
+    const GLfloat w(rotation.scalar()), x(rotation.x()), y(rotation.y()), z(rotation.z());
+
+    const GLfloat xx(x * x), yy(y * y), zz(z * z);
+    const GLfloat xy(x * y), xz(x * z), yz(y * z);
+    const GLfloat wx(w * x), wy(w * y), wz(w * z);
+
+    matrix[0] = (1.0f - 2.0f * (yy + zz)) * scale;
+    matrix[1] = 2.0f * (xy + wz) * scale;
+    matrix[2] = 2.0f * (xz - wy) * scale;
+    matrix[3] = 0.0f;
+
+    matrix[4] = 2.0f * (xy - wz) * scale;
+    matrix[5] = (1.0f - 2.0f * (xx + zz)) * scale;
+    matrix[6] = 2.0f * (yz + wx) * scale;
+    matrix[7] = 0.0f;
+
+    matrix[8] = 2.0f * (xz + wy) * scale;
+    matrix[9] = 2.0f * (yz - wx) * scale;
+    matrix[10] = (1.0f - 2.0f * (xx + yy)) * scale;
+    matrix[11] = 0.0f;
+
+    matrix[12] = position.x();
+    matrix[13] = position.y();
+    matrix[14] = position.z();
+    matrix[15] = 1.0f;
+}
+
+/*!
+ \brief Произведение матриц 4x4 (по столбцам): result = a * b.
+
+ \note result не должен совпадать с a или b.
+*/
+void Vasnecov::TransformStore::multiply(const GLfloat *a, const GLfloat *b, GLfloat *result)
+{
+#ifdef __SSE2__
+    const __m128 a0(_mm_loadu_ps(a));
+    const __m128 a1(_mm_loadu_ps(a + 4));
+    const __m128 a2(_mm_loadu_ps(a + 8));
+    const __m128 a3(_mm_loadu_ps(a + 12));
+
+    for(GLuint j = 0; j < 4; ++j)
+    {
+        const GLfloat *bc(b + j * 4);
+        __m128 col(_mm_mul_ps(a0, _mm_set1_ps(bc[0])));
+        col = _mm_add_ps(col, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+        col = _mm_add_ps(col, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+        col = _mm_add_ps(col, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+        _mm_storeu_ps(result + j * 4, col);
+    }
+#else
+    for(GLuint j = 0; j < 4; ++j)
+    {
+        for(GLuint i = 0; i < 4; ++i)
+        {
+            result[j * 4 + i] = a[i] * b[j * 4] +
+                                a[4 + i] * b[j * 4 + 1] +
+                                a[8 + i] * b[j * 4 + 2] +
+                                a[12 + i] * b[j * 4 + 3];
+        }
+    }
+#endif
+}
+
+void Vasnecov::TransformStore::composeLocal()
+{
+    const size_t count(m_parent.size());
+    size_t i(0);
+
+#ifdef __SSE2__
+    // По четыре элемента за раз: компоненты берутся из массивов напрямую,
+    // после расчёта столбцы транспонируются в матрицы элементов.
+    const __m128 one(_mm_set1_ps(1.0f));
+    const __m128 two(_mm_set1_ps(2.0f));
+    const __m128 zero(_mm_setzero_ps());
+
+    for(; i + 4 <= count; i += 4)
+    {
+        const __m128 w(_mm_loadu_ps(&m_qw[i]));
+        const __m128 x(_mm_loadu_ps(&m_qx[i]));
+        const __m128 y(_mm_loadu_ps(&m_qy[i]));
+        const __m128 z(_mm_loadu_ps(&m_qz[i]));
+        const __m128 s(_mm_loadu_ps(&m_scale[i]));
+
+        const __m128 xx(_mm_mul_ps(x, x)), yy(_mm_mul_ps(y, y)), zz(_mm_mul_ps(z, z));
+        const __m128 xy(_mm_mul_ps(x, y)), xz(_mm_mul_ps(x, z)), yz(_mm_mul_ps(y, z));
+        const __m128 wx(_mm_mul_ps(w, x)), wy(_mm_mul_ps(w, y)), wz(_mm_mul_ps(w, z));
+        const __m128 ts(_mm_mul_ps(two, s));
+
+        __m128 c0[4] = {_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), s),
+                        _mm_mul_ps(_mm_add_ps(xy, wz), ts),
+                        _mm_mul_ps(_mm_sub_ps(xz, wy), ts),
+                        zero};
+        __m128 c1[4] = {_mm_mul_ps(_mm_sub_ps(xy, wz), ts),
+                        _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), s),
+                        _mm_mul_ps(_mm_add_ps(yz, wx), ts),
+                        zero};
+        __m128 c2[4] = {_mm_mul_ps(_mm_add_ps(xz, wy), ts),
+                        _mm_mul_ps(_mm_sub_ps(yz, wx), ts),
+                        _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), s),
+                        zero};
+        __m128 c3[4] = {_mm_loadu_ps(&m_px[i]),
+                        _mm_loadu_ps(&m_py[i]),
+                        _mm_loadu_ps(&m_pz[i]),
+                        one};
+
+        _MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+        _MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+        _MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+        _MM_TRANSPOSE4_PS(c3[0], c3[1], c3[2], c3[3]);
+
+        for(GLuint k = 0; k < 4; ++k)
+        {
+            if(m_fixed[i + k])
+            {
+                continue;
+            }
+            GLfloat *local(&m_local[(i + k) * 16]);
+            _mm_storeu_ps(local, c0[k]);
+            _mm_storeu_ps(local + 4, c1[k]);
+            _mm_storeu_ps(local + 8, c2[k]);
+            _mm_storeu_ps(local + 12, c3[k]);
+        }
+    }
+#endif
+
+    for(; i < count; ++i)
+    {
+        if(!m_fixed[i])
+        {
+            compose(QVector3D(m_px[i], m_py[i], m_pz[i]),
+                    QQuaternion(m_qw[i], m_qx[i], m_qy[i], m_qz[i]),
+                    m_scale[i],
+                    &m_local[i * 16]);
+        }
+    }
+}
+
+void Vasnecov::TransformStore::resolveWorld()
+{
+    const size_t count(m_parent.size());
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        const GLfloat *local(&m_local[i * 16]);
+        GLfloat *world(&m_world[i * 16]);
+
+        if(m_parent[i] != NoParent)
+        {
+            multiply(&m_world[m_parent[i] * 16], local, world);
+        }
+        else
+        {
+            std::copy(local, local + 16, world);
+        }
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Пакетный расчёт матриц трансформаций (структура массивов)
+#ifndef VASNECOV_TRANSFORMSTORE_H
+#define VASNECOV_TRANSFORMSTORE_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <vector>
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include "types.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+namespace Vasnecov
+{
+    /*
+     * Рабочее пространство пакетного пересчёта, а не постоянная таблица элементов: матрицы по-прежнему
+     * хранятся в элементах (MutualData), которые читает поток рендеринга. Сейчас используется для
+     * поддеревьев изделий; хранилище живёт у корня дерева, и clear() сохраняет выделенную память.
+     */
+    class TransformStore
+    {
+    public:
+        typedef GLint Handle;
+        static const Handle NoParent = -1;
+
+    public:
+        TransformStore();
+
+        void clear();
+        void reserve(size_t count);
+        size_t size() const;
+
+        // Трансформация TRS. Родитель должен быть добавлен раньше потомка
+        Handle add(const QVector3D &position, const QQuaternion &rotation, GLfloat scale = 1.0f, Handle parent = NoParent);
+        // Готовая (внешняя) матрица, не пересчитывается
+        Handle addFixed(const QMatrix4x4 &matrix);
+
+        void setPosition(Handle handle, const QVector3D &position);
+        void setRotation(Handle handle, const QQuaternion &rotation);
+        void setScale(Handle handle, GLfloat scale);
+
+        Handle parent(Handle handle) const;
+
+        // Расчёт локальных и мировых матриц всех элементов
+        void update();
+
+        const GLfloat *worldData(Handle handle) const; // 16 чисел по столбцам, как в QMatrix4x4
+        void worldMatrix(Handle handle, QMatrix4x4 &matrix) const;
+
+        // Одиночная сборка матрицы T * R * S (по столбцам)
+        static void compose(const QVector3D &position, const QQuaternion &rotation, GLfloat scale, GLfloat *matrix);
+        static void multiply(const GLfloat *a, const GLfloat *b, GLfloat *result);
+
+    private:
+        void composeLocal();
+        void resolveWorld();
+
+    private:
+        // Структура массивов: каждая компонента лежит непрерывно
+        std::vector<GLfloat> m_px, m_py, m_pz;
+        std::vector<GLfloat> m_qw, m_qx, m_qy, m_qz;
+        std::vector<GLfloat> m_scale;
+        std::vector<Handle> m_parent;
+        std::vector<GLboolean> m_fixed;
+
+        std::vector<GLfloat> m_local; // по 16 чисел на элемент
+        std::vector<GLfloat> m_world;
+    };
+
+    inline size_t TransformStore::size() const
+    {
+        return m_parent.size();
+    }
+    inline TransformStore::Handle TransformStore::parent(Handle handle) const
+    {
+        return m_parent[handle];
+    }
+    inline const GLfloat *TransformStore::worldData(Handle handle) const
+    {
+        return &m_world[handle * 16];
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOV_TRANSFORMSTORE_H
@@ -71,6 +71,7 @@ namespace Vasnecov
         Vasnecov::PolygonDrawingTypes drawingType; // GL_FILL, GL_LINE, GL_POINT
         GLboolean depth; // Тест глубины
         GLboolean light;
+        GLboolean labelsDeclutter; // Разрежение перекрывающихся меток
 
         WorldParameters() :
             projection(WorldTypePerspective),
@@ -78,7 +79,8 @@ namespace Vasnecov
             width(320), height(280),
             drawingType(Vasnecov::PolygonDrawingTypeNormal),
             depth(true),
-            light(true)
+            light(true),
+            labelsDeclutter(false)
         {
         }
         bool operator!=(const WorldParameters& other) const
@@ -90,7 +92,8 @@ namespace Vasnecov
                    height != other.height ||
                    drawingType != other.drawingType ||
                    depth != other.depth ||
-                   light != other.light;
+                   light != other.light ||
+                   labelsDeclutter != other.labelsDeclutter;
         }
         bool operator==(const WorldParameters& other) const
         {
@@ -101,7 +104,8 @@ namespace Vasnecov
                    height == other.height &&
                    drawingType == other.drawingType &&
                    depth == other.depth &&
-                   light == other.light;
+                   light == other.light &&
+                   labelsDeclutter == other.labelsDeclutter;
         }
     };
     struct Perspective
@@ -170,6 +174,12 @@ namespace Vasnecov
         TextureTypeDiffuse = 2,
         TextureTypeNormal = 3
     };
+    enum TextureAlpha
+    {
+        TextureAlphaOpaque = 0, // Альфа везде 255 (или её нет)
+        TextureAlphaTested = 1, // Только 0 и 255: рисуется с отбрасыванием фрагментов, без сортировки
+        TextureAlphaBlended = 2 // Есть промежуточные значения: смешивание и сортировка
+    };
 
     struct Attributes
     {
@@ -226,6 +236,48 @@ namespace Vasnecov
         }
     };
 
+    // Аналитическое описание окружности, дуги или сектора для адаптивного разбиения (углы в радианах)
+    struct ArcParameters
+    {
+        enum Kind
+        {
+            None = 0,
+            Circle,
+            Arc,
+            Pie
+        };
+
+        Kind kind;
+        GLfloat radius;
+        GLfloat startAngle;
+        GLfloat spanAngle;
+
+        ArcParameters() :
+            kind(None),
+            radius(0.0f),
+            startAngle(0.0f),
+            spanAngle(0.0f)
+        {}
+        ArcParameters(Kind k, GLfloat r, GLfloat start = 0.0f, GLfloat span = 0.0f) :
+            kind(k),
+            radius(r),
+            startAngle(start),
+            spanAngle(span)
+        {}
+
+        bool operator!=(const ArcParameters& other) const
+        {
+            return !(*this == other);
+        }
+        bool operator==(const ArcParameters& other) const
+        {
+            return kind == other.kind &&
+                   radius == other.radius &&
+                   startAngle == other.startAngle &&
+                   spanAngle == other.spanAngle;
+        }
+    };
+
     class Line
     {
     public:
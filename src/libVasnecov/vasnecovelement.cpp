@@ -9,6 +9,7 @@
 
 #include "vasnecovelement.h"
 #include "technologist.h"
+#include "transformstore.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
@@ -42,7 +43,8 @@ VasnecovAbstractElement::VasnecovAbstractElement(QMutex *mutex, VasnecovPipeline
     raw_qX(), raw_qY(), raw_qZ(),
 
     m_Ms(raw_wasUpdated, MatrixMs),
-    m_alienMs(raw_wasUpdated, AlienMatrix, 0)
+    m_alienMs(raw_wasUpdated, AlienMatrix, 0),
+    raw_attachments(0)
 {
     raw_qX = raw_qX.fromAxisAndAngle(1.0, 0.0, 0.0, raw_angles.x());
     raw_qY = raw_qY.fromAxisAndAngle(0.0, 1.0, 0.0, raw_angles.y());
@@ -57,7 +59,7 @@ VasnecovAbstractElement::VasnecovAbstractElement(QMutex *mutex, VasnecovPipeline
 */
 void VasnecovAbstractElement::setCoordinates(const QVector3D &coordinates)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
     if(raw_coordinates != coordinates)
     {
@@ -89,7 +91,7 @@ void VasnecovAbstractElement::incrementCoordinates(const QVector3D &increment)
 {
     if(increment.x() != 0.0 || increment.y() != 0.0 || increment.z() != 0.0)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
         raw_coordinates += increment;
         designerUpdateMatrixMs();
@@ -117,7 +119,7 @@ void VasnecovAbstractElement::incrementCoordinates(GLfloat x, GLfloat y, GLfloat
 */
 QVector3D VasnecovAbstractElement::coordinates() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
     QVector3D coordinates(raw_coordinates);
     return coordinates;
@@ -131,7 +133,7 @@ QVector3D VasnecovAbstractElement::coordinates() const
 */
 void VasnecovAbstractElement::setAngles(const QVector3D &angles)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
     if(raw_angles != angles)
     {
@@ -186,7 +188,7 @@ void VasnecovAbstractElement::incrementAngles(const QVector3D &increment)
 {
     if(increment.x() != 0.0 || increment.y() != 0.0 || increment.z() != 0.0)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
         GLenum rotate(0);
 
@@ -281,7 +283,7 @@ void VasnecovAbstractElement::incrementAnglesRad(GLfloat x, GLfloat y, GLfloat z
 */
 QVector3D VasnecovAbstractElement::angles() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
     QVector3D angles(raw_angles);
     return angles;
@@ -291,10 +293,17 @@ void VasnecovAbstractElement::setPositionFromElement(const VasnecovAbstractEleme
 {
     if(element)
     {
-        QMutexLocker locker(mtx_data);
+        // Элемент может быть из другого мира (со своим мьютексом), поэтому блокировки не вкладываются
+        QMatrix4x4 matrix;
+        {
+            Vasnecov::StatsLocker locker(element->mtx_data, Vasnecov::SyncStats::LockDesignerElement);
+            matrix = element->designerMatrixMs();
+        }
+
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
         // NOTE: After this element's coordinates, angles & quaternions will be not actual
-        m_Ms.set(element->designerMatrixMs());
+        m_Ms.set(matrix);
     }
 }
 /*!
@@ -303,31 +312,63 @@ void VasnecovAbstractElement::setPositionFromElement(const VasnecovAbstractEleme
 */
 void VasnecovAbstractElement::detachFromOtherElement()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
-    m_alienMs.set(0);
+    designerSetAlienMatrix(0);
 }
 
 void VasnecovAbstractElement::attachToElement(const VasnecovAbstractElement *element)
 {
     if(element)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
+
+        designerSetAlienMatrix(element->designerExportingMatrix());
+    }
+}
+/*!
+ \brief Смена чужой матрицы с обновлением обратного индекса мира.
+
+ По индексу Вселенная при удалении элемента находит прикреплённые к нему элементы, не перебирая все списки.
+*/
+void VasnecovAbstractElement::designerSetAlienMatrix(const QMatrix4x4 *alienMs)
+{
+    const QMatrix4x4 *oldMs(m_alienMs.raw());
+    if(oldMs == alienMs)
+    {
+        return;
+    }
 
-        m_alienMs.set(element->designerExportingMatrix());
+    if(raw_attachments)
+    {
+        if(oldMs)
+        {
+            typedef Vasnecov::AttachmentIndex::iterator Iterator;
+            std::pair<Iterator, Iterator> range(raw_attachments->equal_range(oldMs));
+            for(Iterator ait = range.first; ait != range.second; ++ait)
+            {
+                if(ait->second == this)
+                {
+                    raw_attachments->erase(ait);
+                    break;
+                }
+            }
+        }
+        if(alienMs)
+        {
+            raw_attachments->insert(std::make_pair(alienMs, this));
+        }
     }
+
+    m_alienMs.set(alienMs);
 }
 
 void VasnecovAbstractElement::designerUpdateMatrixMs()
 {
     // Сначала вращение по оси Z, далее - X-Y.
     QMatrix4x4 newMatrix;
-    newMatrix.translate(raw_coordinates);
+    Vasnecov::TransformStore::compose(raw_coordinates, raw_qZ * raw_qX * raw_qY, 1.0f, newMatrix.data());
 
-    QQuaternion qRot;
-    qRot = raw_qZ * raw_qX * raw_qY;
-
-    newMatrix.rotate(qRot);
     m_Ms.set(newMatrix);
 }
 
@@ -382,7 +423,7 @@ VasnecovElement::VasnecovElement(QMutex *mutex, VasnecovPipeline *pipeline, cons
 */
 void VasnecovElement::setColor(const QColor &color)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
     m_color.set(color);
 }
@@ -479,7 +520,7 @@ void VasnecovElement::setColorAlphaF(GLfloat alpha)
 */
 QColor VasnecovElement::color() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
     QColor color(m_color.raw());
     return color;
@@ -493,7 +534,7 @@ QColor VasnecovElement::color() const
 */
 void VasnecovElement::setScale(GLfloat scale)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
     if(m_scale.set(scale))
     {
@@ -508,7 +549,7 @@ void VasnecovElement::setScale(GLfloat scale)
 */
 GLfloat VasnecovElement::scale() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
     GLfloat scale(m_scale.raw());
     return scale;
@@ -521,7 +562,7 @@ GLfloat VasnecovElement::scale() const
 */
 GLboolean VasnecovElement::isTransparency() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerElement);
 
     GLfloat transparency(m_isTransparency.raw());
     return transparency;
@@ -561,17 +602,7 @@ bool VasnecovElement::renderCompareByDirectDistance(VasnecovElement *first, Vasn
 void VasnecovElement::designerUpdateMatrixMs()
 {
     QMatrix4x4 newMatrix;
-    newMatrix.translate(raw_coordinates);
-
-    QQuaternion qRot;
-    qRot = raw_qZ * raw_qX * raw_qY;
-
-    newMatrix.rotate(qRot);
-
-    if(m_scale.raw() != 1.0)
-    {
-        newMatrix.scale(m_scale.raw(), m_scale.raw(), m_scale.raw());
-    }
+    Vasnecov::TransformStore::compose(raw_coordinates, raw_qZ * raw_qX * raw_qY, m_scale.raw(), newMatrix.data());
 
     m_Ms.set(newMatrix);
 }
@@ -15,12 +15,22 @@
     #pragma GCC diagnostic ignored "-Weffc++"
 #endif
 #include <QQuaternion>
+#include <unordered_map>
 #include "coreobject.h"
 #include "vasnecovpipeline.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
 
+class VasnecovAbstractElement;
+
+namespace Vasnecov
+{
+    // Обратный индекс прикреплений: экспортируемая матрица -> элементы одного мира, прикреплённые к ней.
+    // Защищается мьютексом мира
+    typedef std::unordered_multimap<const QMatrix4x4 *, VasnecovAbstractElement *> AttachmentIndex;
+}
+
 class VasnecovAbstractElement : public Vasnecov::CoreObject
 {
 public:
@@ -54,7 +64,10 @@ protected:
     QMatrix4x4 designerMatrixMs() const;
     const QMatrix4x4 *designerExportingMatrix() const;
     virtual void designerUpdateMatrixMs();
-    GLboolean designerRemoveThisAlienMatrix(const QMatrix4x4 *alienMs); // Обнуление чужой матрицы, равной заданной параметром
+    GLboolean designerRemoveThisAlienMatrix(const QMatrix4x4 *alienMs); // Обнуление чужой матрицы, равной заданной параметром (индекс не трогает)
+
+    void designerSetAttachmentIndex(Vasnecov::AttachmentIndex *index);
+    void designerSetAlienMatrix(const QMatrix4x4 *alienMs); // С учётом индекса прикреплений
 
 protected:
     // Методы, вызываемые рендерером (прямое обращение к основным данным без мьютексов). Префикс render
@@ -74,6 +87,7 @@ protected:
 
     Vasnecov::MutualData<QMatrix4x4> m_Ms;
     Vasnecov::MutualData<const QMatrix4x4*> m_alienMs;
+    Vasnecov::AttachmentIndex *raw_attachments; // Индекс мира, в котором создан элемент
 
     enum Updated // Изменение данных
     {
@@ -81,6 +95,8 @@ protected:
         AlienMatrix 	= 0x0010
     };
 
+    friend class VasnecovUniverse;
+
 private:
     Q_DISABLE_COPY(VasnecovAbstractElement)
 };
@@ -180,6 +196,10 @@ inline GLboolean VasnecovAbstractElement::designerRemoveThisAlienMatrix(const QM
     }
     return false;
 }
+inline void VasnecovAbstractElement::designerSetAttachmentIndex(Vasnecov::AttachmentIndex *index)
+{
+    raw_attachments = index;
+}
 inline const QMatrix4x4 &VasnecovAbstractElement::renderMatrixMs() const
 {
     return m_Ms.pure();
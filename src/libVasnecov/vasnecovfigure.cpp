@@ -9,6 +9,7 @@
 
 #include "vasnecovfigure.h"
 #include "technologist.h"
+#include "circletable.h"
 #include <QFile>
 #include <QSize>
 #ifndef _MSC_VER
@@ -27,9 +28,22 @@ VasnecovFigure::VasnecovFigure(QMutex *mutex, VasnecovPipeline *pipeline, const
     VasnecovElement(mutex, pipeline, name),
     m_type(raw_wasUpdated, Type, VasnecovPipeline::LoopLine),
     m_points(raw_wasUpdated, Points, true),
+    m_stream(raw_wasUpdated, Stream),
+    m_simplification(raw_wasUpdated, Simplification, Vasnecov::cfg_simplifyPixelTolerance),
     m_thickness(raw_wasUpdated, Thickness, 1.0f),
     m_lighting(raw_wasUpdated, Lighting, false),
-    m_depth(raw_wasUpdated, Depth, true)
+    m_depth(raw_wasUpdated, Depth, true),
+    m_arc(raw_wasUpdated, Arc),
+    raw_adaptiveTessellation(false),
+
+    pure_pyramid(),
+    pure_pyramidActive(false),
+    pure_pyramidStream(false),
+    pure_lodPoints(),
+    pure_lodLevel(0),
+    pure_lodVersion(0),
+    pure_tessPoints(),
+    pure_tessSegments(0)
 {
 }
 /*!
@@ -167,8 +181,16 @@ std::vector<QVector3D> VasnecovFigure::readPointsFromObj(const std::string &file
 */
 void VasnecovFigure::setPoints(const std::vector <QVector3D> &points)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
+    m_arc.set(Vasnecov::ArcParameters());
+
+    if(m_stream.enabled())
+    {
+        m_stream.clear();
+        m_stream.append(points);
+        return;
+    }
     m_points.set(points);
 }
 /*!
@@ -179,22 +201,54 @@ void VasnecovFigure::setPoints(const std::vector <QVector3D> &points)
 */
 void VasnecovFigure::addLastPoint(const QVector3D &point)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
+    m_arc.set(Vasnecov::ArcParameters());
+
+    if(m_stream.enabled())
+    {
+        m_stream.append(point);
+        return;
+    }
     m_points.addLast(point);
 }
 
+void VasnecovFigure::addLastPoints(const std::vector<QVector3D> &points)
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_arc.set(Vasnecov::ArcParameters());
+
+    if(m_stream.enabled())
+    {
+        m_stream.append(points);
+        return;
+    }
+    for(std::vector<QVector3D>::const_iterator it = points.begin(); it != points.end(); ++it)
+    {
+        m_points.addLast(*it);
+    }
+}
+
 void VasnecovFigure::removeLastPoint()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
+    if(designerStreamingProblem())
+    {
+        return;
+    }
     m_points.removeLast();
 }
 
 void VasnecovFigure::replaceLastPoint(const QVector3D &point)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
+    if(designerStreamingProblem())
+    {
+        return;
+    }
     m_points.replaceLast(point);
 }
 /*!
@@ -204,37 +258,112 @@ void VasnecovFigure::replaceLastPoint(const QVector3D &point)
 */
 void VasnecovFigure::clearPoints()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
+    m_arc.set(Vasnecov::ArcParameters());
+
+    m_stream.clear();
     m_points.clear();
 }
 
 GLuint VasnecovFigure::pointsAmount() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
+    if(m_stream.enabled())
+    {
+        return m_stream.size();
+    }
     return m_points.rawVerticesSize();
 }
 
 void VasnecovFigure::addFirstPoint(const QVector3D &point)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_arc.set(Vasnecov::ArcParameters());
 
+    if(designerStreamingProblem())
+    {
+        return;
+    }
     m_points.addFirst(point);
 }
 void VasnecovFigure::removeFirstPoint()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
+    if(designerStreamingProblem())
+    {
+        return;
+    }
     m_points.removeFirst();
 }
 
 void VasnecovFigure::replaceFirstPoint(const QVector3D &point)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
+    if(designerStreamingProblem())
+    {
+        return;
+    }
     m_points.replaceFirst(point);
 }
+
+/*!
+ \brief Включение потокового режима. Накопленные точки фигуры очищаются.
+
+ \param maxLength - максимальное количество хранимых точек, 0 - без ограничения
+*/
+void VasnecovFigure::enableStreaming(GLuint maxLength)
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_arc.set(Vasnecov::ArcParameters());
+
+    m_points.clear();
+    m_stream.setMaxLength(maxLength);
+    m_stream.setEnabled(true);
+}
+
+void VasnecovFigure::disableStreaming()
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_stream.setEnabled(false);
+}
+
+GLboolean VasnecovFigure::streaming() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    return m_stream.enabled();
+}
+
+void VasnecovFigure::setStreamingMaxLength(GLuint maxLength)
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_stream.setMaxLength(maxLength);
+}
+
+GLuint VasnecovFigure::streamingMaxLength() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    return m_stream.maxLength();
+}
+
+GLboolean VasnecovFigure::designerStreamingProblem() const
+{
+    if(m_stream.enabled())
+    {
+        Vasnecov::problem("Операция недоступна для фигуры в потоковом режиме: " + m_name.raw());
+        return true;
+    }
+    return false;
+}
 /*!
  \brief
 
@@ -244,14 +373,14 @@ void VasnecovFigure::replaceFirstPoint(const QVector3D &point)
 */
 GLboolean VasnecovFigure::setType(VasnecovFigure::Types type)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
     return designerSetType(type);
 }
 
 VasnecovFigure::Types VasnecovFigure::type() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
     switch(m_type.raw())
     {
@@ -282,7 +411,7 @@ GLint VasnecovFigure::setThickness(GLfloat thick)
 {
     if(thick >= 1.0f && thick <= 16.0f)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
         m_thickness.set(thick);
 
         return 1;
@@ -295,29 +424,77 @@ GLint VasnecovFigure::setThickness(GLfloat thick)
 
 GLfloat VasnecovFigure::thickness() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
     return m_thickness.raw();
 }
 
 void VasnecovFigure::setOptimization(GLboolean optimize)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
     m_points.setOptimization(optimize);
 }
 GLboolean VasnecovFigure::optimization() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
     return m_points.optimization();
 }
 
+/*!
+ \brief Допустимое отклонение упрощённой ломаной на экране.
+
+ Ломаные (обычные и замкнутые) и потоковые фигуры длиннее \a cfg_simplifyMinPoints рисуются с самого грубого уровня
+ упрощения, отклонение которого меньше заданного числа пикселей. Концы ломаной сохраняются точно.
+
+ \param pixels допуск в пикселях, 0 - рисовать всегда полностью
+*/
+void VasnecovFigure::setSimplification(GLfloat pixels)
+{
+    if(pixels < 0.0f)
+    {
+        pixels = 0.0f;
+    }
+
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_simplification.set(pixels);
+}
+GLfloat VasnecovFigure::simplification() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    return m_simplification.raw();
+}
+
+/*!
+ \brief Адаптивное разбиение окружностей, дуг и секторов.
+
+ В этом режиме \a createCircle, \a createArc и \a createPie запоминают параметры фигуры, а количество
+ отрезков выбирается при отрисовке по радиусу на экране (параметр factor не используется).
+ Уже созданные фигуры не меняются.
+*/
+void VasnecovFigure::setAdaptiveTessellation(GLboolean adaptive)
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    raw_adaptiveTessellation = adaptive;
+}
+GLboolean VasnecovFigure::adaptiveTessellation() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    return raw_adaptiveTessellation;
+}
+
 void VasnecovFigure::createLine(GLfloat length, const QColor &color)
 {
     if(length > 0.0)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+        m_arc.set(Vasnecov::ArcParameters());
 
         designerSetType(VasnecovFigure::TypeLines);
 
@@ -334,7 +511,9 @@ void VasnecovFigure::createLine(const QVector3D &first, const QVector3D &second,
 {
     if(first != second)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+        m_arc.set(Vasnecov::ArcParameters());
 
         designerSetType(VasnecovFigure::TypeLines);
 
@@ -359,7 +538,7 @@ void VasnecovFigure::createCircle(GLfloat r, const QColor &color, GLuint factor)
 {
     if(r > 0.0 && factor > 0)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
         designerSetType(VasnecovFigure::TypePolylineLoop);
 
@@ -368,6 +547,15 @@ void VasnecovFigure::createCircle(GLfloat r, const QColor &color, GLuint factor)
             m_color.set(color);
         }
 
+        if(raw_adaptiveTessellation)
+        {
+            // Точки строятся при отрисовке по размеру на экране
+            m_points.clear();
+            m_arc.set(Vasnecov::ArcParameters(Vasnecov::ArcParameters::Circle, r));
+            return;
+        }
+        m_arc.set(Vasnecov::ArcParameters());
+
         std::vector<QVector3D> circ;
         circ.reserve(factor);
 
@@ -387,7 +575,7 @@ void VasnecovFigure::createArc(GLfloat r, GLfloat startAngle, GLfloat spanAngle,
 {
     if(r > 0.0 && spanAngle != 0.0 && factor > 0)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
         designerSetType(VasnecovFigure::TypePolyline);
 
@@ -396,6 +584,15 @@ void VasnecovFigure::createArc(GLfloat r, GLfloat startAngle, GLfloat spanAngle,
             m_color.set(color);
         }
 
+        if(raw_adaptiveTessellation)
+        {
+            // Точки строятся при отрисовке по размеру на экране
+            m_points.clear();
+            m_arc.set(Vasnecov::ArcParameters(Vasnecov::ArcParameters::Arc, r, startAngle*c_degToRad, spanAngle*c_degToRad));
+            return;
+        }
+        m_arc.set(Vasnecov::ArcParameters());
+
         startAngle *= c_degToRad;
         spanAngle *= c_degToRad;
 
@@ -439,7 +636,7 @@ void VasnecovFigure::createPie(GLfloat r, GLfloat startAngle, GLfloat spanAngle,
 {
     if(r > 0.0 && spanAngle != 0.0 && factor > 0)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
         designerSetType(VasnecovFigure::TypePolygons);
 
@@ -448,6 +645,15 @@ void VasnecovFigure::createPie(GLfloat r, GLfloat startAngle, GLfloat spanAngle,
             m_color.set(color);
         }
 
+        if(raw_adaptiveTessellation)
+        {
+            // Точки строятся при отрисовке по размеру на экране
+            m_points.clear();
+            m_arc.set(Vasnecov::ArcParameters(Vasnecov::ArcParameters::Pie, r, startAngle*c_degToRad, spanAngle*c_degToRad));
+            return;
+        }
+        m_arc.set(Vasnecov::ArcParameters());
+
         startAngle *= c_degToRad;
         spanAngle *= c_degToRad;
 
@@ -492,7 +698,9 @@ void VasnecovFigure::createSquareGrid(GLfloat width, GLfloat height, const QColo
 {
     if(horizontals || verticals)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+        m_arc.set(Vasnecov::ArcParameters());
 
         designerSetType(VasnecovFigure::TypeLines);
 
@@ -547,7 +755,9 @@ void VasnecovFigure::createSquareGrid(GLfloat width, GLfloat height, const QColo
 
 void VasnecovFigure::createMeshFromFile(const std::string &fileName, const QColor &color)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_arc.set(Vasnecov::ArcParameters());
 
     designerSetType(VasnecovFigure::TypeLines);
 
@@ -561,7 +771,9 @@ void VasnecovFigure::createMeshFromFile(const std::string &fileName, const QColo
 
 void VasnecovFigure::createMeshFromPoints(const std::vector<QVector3D> &points, const QColor &color)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_arc.set(Vasnecov::ArcParameters());
 
     designerSetType(VasnecovFigure::TypeLines);
 
@@ -605,27 +817,29 @@ GLboolean VasnecovFigure::designerSetType(VasnecovFigure::Types type)
 GLenum VasnecovFigure::renderUpdateData()
 {
     // Проверка прозрачности
-    GLboolean transp = false;
-
-    if(m_color.raw().alphaF() < 1.0f)
-    {
-        transp = true;
-    }
-    m_isTransparency.set(transp);
+    m_isTransparency.renderSet(renderTransparencyRequired());
 
     // Далее, как обычно
     GLenum updated(raw_wasUpdated);
 
     if(raw_wasUpdated)
     {
-        if((raw_wasUpdated & Points) != Points) // FIXME: correct updating
+        if((raw_wasUpdated & (Points | Stream)) == 0) // FIXME: correct updating
         {
             pure_pipeline->setSomethingWasUpdated();
         }
 
         // Копирование сырых данных в основные
         m_type.update();
-        m_points.update();
+        m_simplification.update();
+        if(m_arc.update())
+        {
+            pure_tessSegments = 0;
+        }
+        GLenum pointsUpdated(m_points.update());
+        pointsUpdated |= m_stream.update((pure_pyramidActive && pure_pyramidStream) ? &pure_pyramid : 0);
+
+        renderUpdatePyramid(pointsUpdated);
 
         m_thickness.update();
         m_lighting.update();
@@ -655,15 +869,347 @@ void VasnecovFigure::renderDraw()
         pure_pipeline->setLineWidth(m_thickness.pure());
         pure_pipeline->setPointSize(m_thickness.pure());
 
-        pure_pipeline->drawElements(m_type.pure(),
-                                    m_points.pureIndices(),
-                                    m_points.pureVertices());
+        if(m_arc.pure().kind != Vasnecov::ArcParameters::None)
+        {
+            renderDrawTessellated();
+            return;
+        }
+        if(pure_pyramidActive && renderDrawSimplified())
+        {
+            return;
+        }
+
+        if(m_stream.pureEnabled())
+        {
+            // Блоки рисуются по отдельности, стыковые точки повторяются только для ломаной
+            GLboolean points(m_type.pure() == VasnecovPipeline::Points);
+            VasnecovPipeline::ElementDrawingMethods method(points ? VasnecovPipeline::Points : VasnecovPipeline::PolyLine);
+
+            for(size_t i = 0; i < m_stream.chunksCount(); ++i)
+            {
+                const std::vector<QVector3D> &chunk(m_stream.chunk(i));
+                GLuint first(m_stream.chunkFirst(i, !points));
+
+                pure_pipeline->drawArrays(method, &chunk, first, static_cast<GLsizei>(chunk.size() - first));
+            }
+        }
+        else
+        {
+            pure_pipeline->drawElements(m_type.pure(),
+                                        m_points.pureIndices(),
+                                        m_points.pureVertices());
+        }
+    }
+}
+
+/*!
+ \brief Перестроение пирамиды упрощений. Потоковая фигура достраивает её сама при синхронизации,
+ обычной ломаной с точками, добавленными только в конец, дописываются новые точки.
+*/
+void VasnecovFigure::renderUpdatePyramid(GLenum pointsUpdated)
+{
+    GLboolean stream(m_stream.pureEnabled());
+    GLboolean wanted(m_simplification.pure() > 0.0f);
+
+    if(wanted)
+    {
+        if(stream)
+        {
+            wanted = m_type.pure() != VasnecovPipeline::Points;
+        }
+        else
+        {
+            wanted = (m_type.pure() == VasnecovPipeline::PolyLine || m_type.pure() == VasnecovPipeline::LoopLine) &&
+                     m_points.pureIndices()->size() >= Vasnecov::cfg_simplifyMinPoints;
+        }
+    }
+
+    if(!wanted)
+    {
+        if(pure_pyramidActive)
+        {
+            pure_pyramid.clear();
+            pure_pyramidActive = false;
+        }
+        return;
+    }
+
+    // Дописанные в конец точки догружаются в пирамиду, полное перестроение - только при правке старых
+    size_t appendedFrom(0);
+    if(pure_pyramidActive && !pure_pyramidStream && !stream && pointsUpdated &&
+       m_points.pureAppended(appendedFrom))
+    {
+        const std::vector<QVector3D> &vertices(*m_points.pureVertices());
+        const std::vector<GLuint> &indices(*m_points.pureIndices());
+        for(size_t i = appendedFrom; i < indices.size(); ++i)
+        {
+            pure_pyramid.append(vertices[indices[i]]);
+        }
+        return;
+    }
+
+    if(!pure_pyramidActive || pure_pyramidStream != stream || (!stream && pointsUpdated))
+    {
+        if(stream)
+        {
+            pure_pyramid.clear(m_stream.firstNumber());
+            m_stream.feed(pure_pyramid);
+        }
+        else
+        {
+            pure_pyramid.build(*m_points.pureVertices(), *m_points.pureIndices());
+        }
+        pure_pyramidActive = true;
+        pure_pyramidStream = stream;
+    }
+}
+
+/*!
+ \brief Отрисовка уровня упрощения, подходящего для текущей камеры.
+ \return false, если нужна полная отрисовка
+*/
+GLboolean VasnecovFigure::renderDrawSimplified()
+{
+    GLboolean stream(m_stream.pureEnabled());
+    size_t count(stream ? m_stream.pureSize() : m_points.pureIndices()->size());
+    if(count < Vasnecov::cfg_simplifyMinPoints)
+    {
+        return false;
+    }
+
+    QMatrix4x4 M(m_Ms.pure());
+    if(m_alienMs.pure())
+    {
+        M = (*m_alienMs.pure()) * m_Ms.pure();
+    }
+
+    GLfloat unitsPerPixel(pure_pipeline->pixelSize(M, pure_pyramid.boxMin(), pure_pyramid.boxMax()));
+    if(unitsPerPixel <= 0.0f)
+    {
+        return false;
+    }
+
+    GLuint level(pure_pyramid.chooseLevel(unitsPerPixel * m_simplification.pure()));
+    if(!level)
+    {
+        return false;
+    }
+
+    if(level != pure_lodLevel || pure_pyramid.version() != pure_lodVersion)
+    {
+        if(stream)
+        {
+            pure_pyramid.levelPoints(level, pure_lodPoints, &m_stream.firstPoint(), m_stream.firstNumber());
+        }
+        else
+        {
+            pure_pyramid.levelPoints(level, pure_lodPoints);
+        }
+        pure_lodLevel = level;
+        pure_lodVersion = pure_pyramid.version();
+    }
+
+    VasnecovPipeline::ElementDrawingMethods method(stream ? VasnecovPipeline::PolyLine : m_type.pure());
+    pure_pipeline->drawArrays(method, &pure_lodPoints, 0, static_cast<GLsizei>(pure_lodPoints.size()));
+
+    return true;
+}
+
+/*!
+ \brief Отрисовка адаптивной окружности (дуги, сектора). Точки перестраиваются только при смене ступени разбиения.
+*/
+void VasnecovFigure::renderDrawTessellated()
+{
+    const Vasnecov::ArcParameters &arc(m_arc.pure());
+
+    QMatrix4x4 M(m_Ms.pure());
+    if(m_alienMs.pure())
+    {
+        M = (*m_alienMs.pure()) * m_Ms.pure();
+    }
+
+    GLuint segments(pure_tessSegments);
+    GLfloat unitsPerPixel(pure_pipeline->pixelSize(M,
+                                                   QVector3D(-arc.radius, -arc.radius, 0.0f),
+                                                   QVector3D(arc.radius, arc.radius, 0.0f)));
+    if(unitsPerPixel > 0.0f)
+    {
+        segments = Vasnecov::CircleTable::segments(arc.radius / unitsPerPixel);
+    }
+    else if(!segments)
+    {
+        segments = Vasnecov::cfg_tessellationSegmentsMin; // Фигура за камерой
+    }
+
+    if(segments != pure_tessSegments)
+    {
+        pure_tessPoints.clear();
+        switch(arc.kind)
+        {
+            case Vasnecov::ArcParameters::Circle:
+            {
+                const std::vector<QVector2D> &table(Vasnecov::CircleTable::unitCircle(segments));
+                pure_tessPoints.reserve(table.size());
+                for(std::vector<QVector2D>::const_iterator it = table.begin(); it != table.end(); ++it)
+                {
+                    pure_tessPoints.push_back(QVector3D(arc.radius * it->x(), arc.radius * it->y(), 0.0f));
+                }
+                break;
+            }
+            case Vasnecov::ArcParameters::Arc:
+                Vasnecov::CircleTable::arc(arc.radius, arc.startAngle, arc.spanAngle, segments, pure_tessPoints);
+                break;
+            case Vasnecov::ArcParameters::Pie:
+                pure_tessPoints.push_back(QVector3D(0, 0, 0)); // Начальная позиция в центре круга
+                Vasnecov::CircleTable::arc(arc.radius, arc.startAngle, arc.spanAngle, segments, pure_tessPoints);
+                break;
+            default:
+                break;
+        }
+        pure_tessSegments = segments;
+    }
+
+    pure_pipeline->drawArrays(m_type.pure(), &pure_tessPoints, 0, static_cast<GLsizei>(pure_tessPoints.size()));
+}
+
+/*!
+ \brief Фигура может быть нарисована в составе пакета: видимая, с обычным набором точек и небольшая.
+*/
+GLboolean VasnecovFigure::renderBatchable() const
+{
+    if(m_isHidden.pure() ||
+       m_stream.pureEnabled() ||
+       pure_pyramidActive ||
+       m_arc.pure().kind != Vasnecov::ArcParameters::None)
+    {
+        return false;
+    }
+
+    size_t count(m_points.pureVertices()->size());
+    return count > 0 &&
+           count <= Vasnecov::cfg_batchFigurePointsMax &&
+           renderBatchIndicesCount() > 0;
+}
+
+/*!
+ \brief Примитив пакета: составные примитивы раскладываются на отдельные отрезки и треугольники.
+*/
+VasnecovPipeline::ElementDrawingMethods VasnecovFigure::renderBatchMethod() const
+{
+    switch(m_type.pure())
+    {
+        case VasnecovPipeline::Points:
+            return VasnecovPipeline::Points;
+        case VasnecovPipeline::Lines:
+        case VasnecovPipeline::LoopLine:
+        case VasnecovPipeline::PolyLine:
+            return VasnecovPipeline::Lines;
+        default:
+            return VasnecovPipeline::Triangles;
+    }
+}
+
+GLuint VasnecovFigure::renderBatchIndicesCount() const
+{
+    GLuint count(static_cast<GLuint>(m_points.pureIndices()->size()));
+
+    switch(m_type.pure())
+    {
+        case VasnecovPipeline::Points:
+            return count;
+        case VasnecovPipeline::Lines:
+            return count - count % 2;
+        case VasnecovPipeline::LoopLine:
+            return (count >= 2) ? count * 2 : 0;
+        case VasnecovPipeline::PolyLine:
+            return (count >= 2) ? (count - 1) * 2 : 0;
+        case VasnecovPipeline::Triangles:
+            return count - count % 3;
+        case VasnecovPipeline::FanTriangle:
+        case VasnecovPipeline::StripTriangle:
+            return (count >= 3) ? (count - 2) * 3 : 0;
+        default:
+            return 0;
+    }
+}
+
+/*!
+ \brief Заполнение участка пакета. Вызывается из рабочих потоков, поэтому только читает чистые данные.
+
+ \param base номер первой вершины фигуры в пакете
+*/
+void VasnecovFigure::renderFillBatch(QVector3D *vertices, GLubyte *colors, GLuint *indices, GLuint base) const
+{
+    QMatrix4x4 M(m_Ms.pure());
+    if(m_alienMs.pure())
+    {
+        M = (*m_alienMs.pure()) * m_Ms.pure();
+    }
+
+    const std::vector<QVector3D> &points(*m_points.pureVertices());
+    const QColor &color(m_color.pure());
+    const GLubyte rgba[4] = {static_cast<GLubyte>(color.red()),
+                             static_cast<GLubyte>(color.green()),
+                             static_cast<GLubyte>(color.blue()),
+                             static_cast<GLubyte>(color.alpha())};
+
+    for(size_t i = 0; i < points.size(); ++i)
+    {
+        vertices[i] = M.map(points[i]);
+        colors[i*4] = rgba[0];
+        colors[i*4 + 1] = rgba[1];
+        colors[i*4 + 2] = rgba[2];
+        colors[i*4 + 3] = rgba[3];
+    }
+
+    const std::vector<GLuint> &source(*m_points.pureIndices());
+    const GLuint count(renderBatchIndicesCount());
+    GLuint *out(indices);
+
+    switch(m_type.pure())
+    {
+        case VasnecovPipeline::LoopLine:
+        case VasnecovPipeline::PolyLine:
+            for(size_t i = 0; i + 1 < source.size(); ++i)
+            {
+                *out++ = base + source[i];
+                *out++ = base + source[i + 1];
+            }
+            if(m_type.pure() == VasnecovPipeline::LoopLine)
+            {
+                *out++ = base + source.back();
+                *out++ = base + source.front();
+            }
+            break;
+        case VasnecovPipeline::FanTriangle:
+            for(size_t i = 1; i + 1 < source.size(); ++i)
+            {
+                *out++ = base + source[0];
+                *out++ = base + source[i];
+                *out++ = base + source[i + 1];
+            }
+            break;
+        case VasnecovPipeline::StripTriangle:
+            for(size_t i = 0; i + 2 < source.size(); ++i)
+            {
+                // Чередование обхода, как в самой полосе
+                *out++ = base + source[(i % 2) ? i + 1 : i];
+                *out++ = base + source[(i % 2) ? i : i + 1];
+                *out++ = base + source[i + 2];
+            }
+            break;
+        default:
+            for(GLuint i = 0; i < count; ++i)
+            {
+                *out++ = base + source[i];
+            }
+            break;
     }
 }
 
 GLfloat VasnecovFigure::renderCalculateDistanceToPlane(const QVector3D &planePoint, const QVector3D &normal)
 {
-    QVector3D centerPoint = m_points.cm();
+    QVector3D centerPoint = renderCm();
 
     if(m_alienMs.pure())
     {
@@ -14,15 +14,27 @@
 #ifndef _MSC_VER
     #pragma GCC diagnostic ignored "-Weffc++"
 #endif
+#include <deque>
+#include <unordered_map>
 #include "vasnecovelement.h"
+#include "pointstream.h"
+#include "polylinepyramid.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
 
+namespace Vasnecov
+{
+    class FigureBatcher;
+}
+
 // Класс фигур (плоских, по сути)
 class VasnecovFigure : public VasnecovElement
 {
     // Класс для управления массивами вершин и индексов
+    // Сырые данные принадлежат только потоку конструктора, при синхронизации копируются в чистые.
+    // Совпадающие вершины ищутся по хешу, освобождённые ячейки вершин помечаются пустыми и используются повторно,
+    // при большом количестве пустых ячеек массив уплотняется
     class VertexManager
     {
     public:
@@ -31,15 +43,30 @@ class VasnecovFigure : public VasnecovElement
             m_wasUpdated(wasUpdated),
             m_optimize(optimize),
             raw_vertices(),
+            raw_uses(),
+            raw_free(),
+            raw_lookup(),
             raw_indices(),
+            raw_live(0),
+            raw_sum(),
+            raw_changedSlots(),
+            raw_changedAll(true),
+            raw_keptFrom(0),
+            raw_keptPureFrom(0),
+            raw_keptCount(0),
             pure_vertices(),
             pure_indices(),
-            raw_cm(),
-            pure_cm()
+            pure_cm(),
+            pure_appendedOnly(false),
+            pure_appendedFrom(0)
         {}
         void setOptimization(GLboolean optimize)
         {
-            m_optimize = optimize;
+            if(m_optimize != optimize)
+            {
+                m_optimize = optimize;
+                rebuildLookup();
+            }
         }
         GLboolean optimization() const
         {
@@ -48,188 +75,119 @@ class VasnecovFigure : public VasnecovElement
 
         GLuint rawVerticesSize() const
         {
-            return (GLuint)raw_vertices.size();
+            return raw_live;
         }
 
         void set(const std::vector <QVector3D> &points)
         {
             // Заливка в сырые данные с удалением дубликатов точек
-            raw_vertices.clear();
-            raw_indices.clear();
+            reset();
 
             if(!points.empty())
             {
-                raw_indices.reserve(points.size());
-                // Резервирование для точек неактуально, т.к. их итоговое количество неизвестно
-
-                if(m_optimize)
+                if(!m_optimize)
                 {
-                    for(GLuint i = 0; i < points.size(); ++i)
-                    {
-                        GLuint fIndex(0);
-                        if(optimizedIndex(points[i], fIndex))
-                        {
-                            raw_indices.push_back(fIndex);
-                        }
-                        else
-                        {
-                            raw_vertices.push_back(points[i]);
-                            raw_indices.push_back((GLuint)raw_vertices.size() - 1);
-                        }
-                    }
+                    raw_vertices.reserve(points.size());
+                    raw_uses.reserve(points.size());
                 }
-                else
+                // Для оптимизированного режима резервирование неактуально, т.к. итоговое количество точек неизвестно
+
+                for(GLuint i = 0; i < points.size(); ++i)
                 {
-                    raw_vertices = points;
-                    for(GLuint i = 0; i < points.size(); ++i)
-                    {
-                        raw_indices.push_back(i);
-                    }
+                    raw_indices.push_back(acquire(points[i]));
                 }
             }
             prepareUpdate();
         }
         void clear()
         {
-            raw_vertices.clear();
-            raw_indices.clear();
+            reset();
 
             prepareUpdate();
         }
 
         void addLast(const QVector3D &point)
         {
-            // Т.к. рендер только читает чистые данные, то можно их прочитать и из другого потока
-            if(!pure_indices.empty())
+            if(raw_indices.empty() || raw_vertices[raw_indices.back()] != point)
             {
-                raw_vertices = pure_vertices;
-                raw_indices = pure_indices;
-
-                if(raw_vertices[raw_indices.back()] != point)
-                {
-                    if(m_optimize)
-                    {
-                        GLuint fIndex(0);
-                        if(optimizedIndex(point, fIndex))
-                        {
-                            raw_indices.push_back(fIndex);
-                        }
-                        else
-                        {
-                            raw_vertices.push_back(point);
-                            raw_indices.push_back((GLuint)raw_vertices.size() - 1);
-                        }
-                    }
-                    else
-                    {
-                        raw_vertices.push_back(point);
-                        raw_indices.push_back((GLuint)raw_vertices.size() - 1);
-                    }
-
-                    prepareUpdate();
-                }
-            }
-            else
-            {
-                raw_vertices.push_back(point);
-                raw_indices.push_back((GLuint)raw_vertices.size() - 1);
+                raw_indices.push_back(acquire(point)); // Хвост за общим участком копируется всегда
 
                 prepareUpdate();
             }
         }
         void removeLast()
         {
-            if(!pure_indices.empty())
+            if(!raw_indices.empty())
             {
-                raw_vertices = pure_vertices;
-                raw_indices = pure_indices;
-
-                removeByIndexIterator(raw_indices.end() - 1);
+                GLuint index(raw_indices.back());
+                changedBack();
+                raw_indices.pop_back();
+                if(raw_keptFrom > raw_indices.size()) // Удалён индекс из головы (общего участка нет)
+                {
+                    raw_keptFrom = static_cast<GLuint>(raw_indices.size());
+                }
+                release(index);
 
                 prepareUpdate();
             }
         }
         void replaceLast(const QVector3D &point)
         {
-            if(!pure_indices.empty())
+            if(!raw_indices.empty() && raw_vertices[raw_indices.back()] != point)
             {
-                raw_vertices = pure_vertices;
-                raw_indices = pure_indices;
+                // Вершина может использоваться другими индексами, поэтому заменяется ссылка, а не сама вершина
+                GLuint old(raw_indices.back());
+                changedBack();
+                raw_indices.back() = acquire(point);
+                release(old);
 
-                if(raw_vertices[raw_indices.back()] != point)
-                {
-                    // TODO: add replace with optimization removing
-                    raw_vertices[raw_indices.back()] = point;
-
-                    prepareUpdate();
-                }
+                prepareUpdate();
             }
         }
 
         void addFirst(const QVector3D &point)
         {
-            if(!pure_indices.empty())
-            {
-                raw_vertices = pure_vertices;
-                raw_indices = pure_indices;
-
-                if(raw_vertices[raw_indices.front()] != point)
-                {
-                    if(m_optimize)
-                    {
-                        GLuint fIndex(0);
-                        if(optimizedIndex(point, fIndex))
-                        {
-                            raw_indices.insert(raw_indices.begin(), fIndex);
-                        }
-                        else
-                        {
-                            raw_vertices.push_back(point);
-                            raw_indices.insert(raw_indices.begin(), (GLuint)raw_vertices.size() - 1);
-                        }
-                    }
-                    else
-                    {
-                        raw_vertices.push_back(point);
-                        raw_indices.insert(raw_indices.begin(), (GLuint)raw_vertices.size() - 1);
-                    }
-
-                    prepareUpdate();
-                }
-            }
-            else
+            if(raw_indices.empty() || raw_vertices[raw_indices.front()] != point)
             {
-                raw_vertices.push_back(point);
-                raw_indices.insert(raw_indices.begin(), (GLuint)raw_vertices.size() - 1);
+                raw_indices.push_front(acquire(point));
+                ++raw_keptFrom;
 
                 prepareUpdate();
             }
         }
         void removeFirst()
         {
-            if(!pure_indices.empty())
+            if(!raw_indices.empty())
             {
-                raw_vertices = pure_vertices;
-                raw_indices = pure_indices;
-
-                removeByIndexIterator(raw_indices.begin());
+                GLuint index(raw_indices.front());
+                if(raw_keptFrom)
+                {
+                    --raw_keptFrom;
+                }
+                else
+                {
+                    changedFront();
+                }
+                raw_indices.pop_front();
+                release(index);
 
                 prepareUpdate();
             }
         }
         void replaceFirst(const QVector3D &point)
         {
-            if(!pure_indices.empty())
+            if(!raw_indices.empty() && raw_vertices[raw_indices.front()] != point)
             {
-                raw_vertices = pure_vertices;
-                raw_indices = pure_indices;
-
-                if(raw_vertices[raw_indices.front()] != point)
+                GLuint old(raw_indices.front());
+                if(!raw_keptFrom)
                 {
-                    raw_vertices[raw_indices.front()] = point;
-
-                    prepareUpdate();
+                    changedFront(); // Заменённый индекс становится головой перед общим участком
+                    ++raw_keptFrom;
                 }
+                raw_indices.front() = acquire(point);
+                release(old);
+
+                prepareUpdate();
             }
         }
 
@@ -237,13 +195,38 @@ class VasnecovFigure : public VasnecovElement
         {
             if((m_wasUpdated & m_flag) != 0)
             {
-                pure_vertices.swap(raw_vertices);
-                pure_indices.swap(raw_indices);
-                pure_cm = raw_cm;
+                // Старые индексы не тронуты - точки только дописаны в конец
+                pure_appendedOnly = !raw_changedAll && !raw_keptFrom && !raw_keptPureFrom &&
+                                    raw_keptCount == pure_indices.size();
+                pure_appendedFrom = raw_keptCount;
+
+                // Копируются только изменения с прошлой синхронизации, кроме перестроений всего массива.
+                // Пустые ячейки копируются вместе со всеми: на них не ссылается ни один индекс
+                if(raw_changedAll)
+                {
+                    pure_vertices = raw_vertices;
+                    pure_indices.assign(raw_indices.begin(), raw_indices.end());
+                }
+                else
+                {
+                    updateChanged();
+                }
+                raw_changedSlots.clear();
+                raw_changedAll = false;
+                raw_keptFrom = 0;
+                raw_keptPureFrom = 0;
+                raw_keptCount = static_cast<GLuint>(raw_indices.size());
+
+                pure_cm = QVector3D(); // Нулевой по умолчанию
+                if(raw_live)
+                {
+                    pure_cm = QVector3D(raw_sum[0] / raw_live, raw_sum[1] / raw_live, raw_sum[2] / raw_live);
+                }
 
                 m_wasUpdated = m_wasUpdated &~ m_flag; // Удаление своего флага из общего
                 return m_flag;
             }
+            pure_appendedOnly = false;
             return 0;
         }
 
@@ -259,59 +242,207 @@ class VasnecovFigure : public VasnecovElement
         {
             return pure_cm;
         }
+        // Последний вызов update() только дописал индексы, начиная с from
+        GLboolean pureAppended(size_t &from) const
+        {
+            from = pure_appendedFrom;
+            return pure_appendedOnly;
+        }
 
     private:
-        GLboolean optimizedIndex(const QVector3D &vert, GLuint &fIndex) const
+        struct VertexHash
+        {
+            size_t operator()(const QVector3D &vert) const
+            {
+                // -0.0 и 0.0 равны при сравнении, поэтому должны давать одинаковый хеш
+                std::hash<float> hasher;
+                size_t res(hasher(vert.x() == 0.0f ? 0.0f : vert.x()));
+                res ^= hasher(vert.y() == 0.0f ? 0.0f : vert.y()) + 0x9e3779b9 + (res << 6) + (res >> 2);
+                res ^= hasher(vert.z() == 0.0f ? 0.0f : vert.z()) + 0x9e3779b9 + (res << 6) + (res >> 2);
+                return res;
+            }
+        };
+        typedef std::unordered_map<QVector3D, GLuint, VertexHash> VertexLookup;
+
+        // Индекс вершины для новой ссылки на точку
+        GLuint acquire(const QVector3D &vert)
         {
-            for(fIndex = 0; fIndex < raw_vertices.size(); ++fIndex)
+            if(m_optimize)
             {
-                if(vert == raw_vertices[fIndex])
+                VertexLookup::const_iterator found = raw_lookup.find(vert);
+                if(found != raw_lookup.end())
                 {
-                    return true;
+                    ++raw_uses[found->second];
+                    return found->second;
                 }
             }
-            return false;
-        }
-        void removeByIndexIterator(const std::vector<GLuint>::iterator &needed)
-        {
-            GLuint index = *needed;
 
-            // Поиск такого же индекса в списке индексов
-            // Если он есть, значит точка используется еще где-то, поэтому список точек не трогаем
-            std::vector<GLuint>::iterator found1, found2;
-            // Ищем в списке до самого итератора и после
-            found1 = find(raw_indices.begin(), needed, index);
-            found2 = find(needed + 1, raw_indices.end(), index);
+            GLuint index(0);
+            if(!raw_free.empty())
+            {
+                index = raw_free.back();
+                raw_free.pop_back();
+                raw_vertices[index] = vert;
+                raw_uses[index] = 1;
+            }
+            else
+            {
+                index = (GLuint)raw_vertices.size();
+                raw_vertices.push_back(vert);
+                raw_uses.push_back(1);
+            }
 
-            // Удаление самого индекса
-            std::vector<GLuint>::iterator next = raw_indices.erase(needed);
+            if(m_optimize)
+            {
+                raw_lookup.insert(VertexLookup::value_type(vert, index));
+            }
+            changedSlot(index);
+            addToSum(vert, 1.0);
+            ++raw_live;
 
-            if(found1 == needed && found2 == raw_indices.end()) // Не найден
+            return index;
+        }
+        // Снятие ссылки на вершину. Неиспользуемая вершина становится пустой ячейкой
+        void release(GLuint index)
+        {
+            if(--raw_uses[index] != 0)
             {
-                // Удаляем вершину
-                raw_vertices.erase(raw_vertices.begin() + index);
+                return;
+            }
 
-                // Изменяем индексы вершин после удалённой (сдвигаем на один)
-                for(std::vector<GLuint>::iterator iit = next; // итератор на индекс, следующий за удаляемым
-                    iit != raw_indices.end(); ++iit)
+            if(m_optimize)
+            {
+                VertexLookup::iterator found = raw_lookup.find(raw_vertices[index]);
+                if(found != raw_lookup.end() && found->second == index)
                 {
-                    --(*iit);
+                    raw_lookup.erase(found);
                 }
             }
+            addToSum(raw_vertices[index], -1.0);
+            --raw_live;
+
+            raw_free.push_back(index);
+
+            // Уплотнение - когда пустых ячеек больше, чем живых. Стоимость делится на вызвавшие его удаления
+            if(raw_free.size() > 64 && raw_free.size() > raw_live)
+            {
+                compact();
+            }
         }
-        void prepareUpdate() // FIXME: add checking comparity
+        void compact()
         {
-            m_wasUpdated |= m_flag;
+            std::vector<GLuint> remap(raw_vertices.size(), 0);
+            GLuint next(0);
+            for(GLuint i = 0; i < raw_vertices.size(); ++i)
+            {
+                if(raw_uses[i])
+                {
+                    raw_vertices[next] = raw_vertices[i];
+                    raw_uses[next] = raw_uses[i];
+                    remap[i] = next;
+                    ++next;
+                }
+            }
+            raw_vertices.resize(next);
+            raw_uses.resize(next);
+            raw_free.clear();
 
-            raw_cm = QVector3D(); // Нулевой по умолчанию
-            if(!raw_vertices.empty())
+            for(std::deque<GLuint>::iterator it = raw_indices.begin(); it != raw_indices.end(); ++it)
+            {
+                *it = remap[*it];
+            }
+            raw_changedAll = true;
+
+            rebuildLookup();
+        }
+        void rebuildLookup()
+        {
+            raw_lookup.clear();
+            if(m_optimize)
             {
                 for(GLuint i = 0; i < raw_vertices.size(); ++i)
                 {
-                    raw_cm += raw_vertices[i];
+                    if(raw_uses[i])
+                    {
+                        raw_lookup.insert(VertexLookup::value_type(raw_vertices[i], i));
+                    }
+                }
+            }
+        }
+        void reset()
+        {
+            raw_vertices.clear();
+            raw_uses.clear();
+            raw_free.clear();
+            raw_lookup.clear();
+            raw_indices.clear();
+            raw_live = 0;
+            raw_sum[0] = raw_sum[1] = raw_sum[2] = 0.0;
+            raw_changedAll = true;
+        }
+        // Учёт изменений для update(). Индексы: общий с чистыми данными участок raw_indices[raw_keptFrom, +raw_keptCount)
+        // совпадает с pure_indices[raw_keptPureFrom, +raw_keptCount), голова и хвост вокруг него - новые
+        void changedSlot(GLuint index)
+        {
+            if(!raw_changedAll)
+            {
+                raw_changedSlots.push_back(index);
+                // Много изменений - дешевле скопировать всё
+                if(raw_changedSlots.size() > raw_vertices.size() / 2 + 64)
+                {
+                    raw_changedAll = true;
+                    raw_changedSlots.clear();
+                }
+            }
+        }
+        void changedFront() // Первый индекс общего участка меняется или удаляется
+        {
+            if(raw_keptCount)
+            {
+                ++raw_keptPureFrom;
+                --raw_keptCount;
+            }
+        }
+        void changedBack() // Последний индекс меняется или удаляется
+        {
+            if(raw_keptCount && raw_keptFrom + raw_keptCount == raw_indices.size())
+            {
+                --raw_keptCount;
+            }
+        }
+        void updateChanged()
+        {
+            for(std::vector<GLuint>::const_iterator sit = raw_changedSlots.begin(); sit != raw_changedSlots.end(); ++sit)
+            {
+                if(*sit >= pure_vertices.size())
+                {
+                    pure_vertices.resize(raw_vertices.size());
                 }
-                raw_cm /= raw_vertices.size();
+                pure_vertices[*sit] = raw_vertices[*sit];
             }
+
+            // Общий участок остаётся на месте, сдвигается только при изменениях в голове
+            pure_indices.resize(raw_keptPureFrom + raw_keptCount);
+            if(raw_keptFrom > raw_keptPureFrom)
+            {
+                pure_indices.insert(pure_indices.begin(), raw_keptFrom - raw_keptPureFrom, 0);
+            }
+            else if(raw_keptFrom < raw_keptPureFrom)
+            {
+                pure_indices.erase(pure_indices.begin(), pure_indices.begin() + (raw_keptPureFrom - raw_keptFrom));
+            }
+            std::copy(raw_indices.begin(), raw_indices.begin() + raw_keptFrom, pure_indices.begin());
+            pure_indices.insert(pure_indices.end(), raw_indices.begin() + (raw_keptFrom + raw_keptCount), raw_indices.end());
+        }
+        void addToSum(const QVector3D &vert, GLdouble sign)
+        {
+            raw_sum[0] += sign * vert.x();
+            raw_sum[1] += sign * vert.y();
+            raw_sum[2] += sign * vert.z();
+        }
+        void prepareUpdate() // FIXME: add checking comparity
+        {
+            m_wasUpdated |= m_flag;
         }
 
     private:
@@ -319,14 +450,25 @@ class VasnecovFigure : public VasnecovElement
         GLenum &m_wasUpdated; // Ссылка на общий флаг обновлений
         GLboolean m_optimize;
 
-        std::vector<QVector3D> raw_vertices; // Точки сырых данных
-        std::vector<GLuint> raw_indices;
+        std::vector<QVector3D> raw_vertices; // Точки сырых данных, включая пустые ячейки
+        std::vector<GLuint> raw_uses; // Количество индексов, ссылающихся на вершину (0 - пустая ячейка)
+        std::vector<GLuint> raw_free; // Пустые ячейки для повторного использования
+        VertexLookup raw_lookup; // Вершина -> ячейка (только при оптимизации)
+        std::deque<GLuint> raw_indices;
+        GLuint raw_live; // Количество непустых вершин
+        GLdouble raw_sum[3]; // Сумма непустых вершин для центра масс
+        std::vector<GLuint> raw_changedSlots; // Ячейки вершин, записанные после синхронизации
+        GLboolean raw_changedAll; // Копировать всё (заливка, уплотнение)
+        GLuint raw_keptFrom; // Общий с чистыми данными участок индексов
+        GLuint raw_keptPureFrom;
+        GLuint raw_keptCount;
 
         std::vector<QVector3D> pure_vertices; // Уникальные вершины (без дубликатов) для отрисовки
         std::vector<GLuint> pure_indices; // Индексы отрисовки
 
-        QVector3D raw_cm;
         QVector3D pure_cm;
+        GLboolean pure_appendedOnly;
+        size_t pure_appendedFrom;
     };
 
 public:
@@ -356,9 +498,18 @@ public:
     void replaceFirstPoint(const QVector3D &point);
 
     void addLastPoint(const QVector3D &point);
+    void addLastPoints(const std::vector<QVector3D> &points);
     void removeLastPoint();
     void replaceLastPoint(const QVector3D &point);
 
+    // Потоковый режим: точки только дописываются в конец (треки), самые старые вытесняются сверх maxLength.
+    // Рисуется ломаной (или точками для TypePoints), удаление и замена отдельных точек недоступны
+    void enableStreaming(GLuint maxLength = 0);
+    void disableStreaming();
+    GLboolean streaming() const;
+    void setStreamingMaxLength(GLuint maxLength);
+    GLuint streamingMaxLength() const;
+
     GLboolean setType(VasnecovFigure::Types type);
     VasnecovFigure::Types type() const;
 
@@ -376,6 +527,14 @@ public:
     void setOptimization(GLboolean optimize);
     GLboolean optimization() const;
 
+    // Упрощение длинных ломаных при отрисовке: допустимое отклонение на экране в пикселях, 0 - выключено
+    void setSimplification(GLfloat pixels);
+    GLfloat simplification() const;
+
+    // Адаптивное разбиение окружностей, дуг и секторов по их размеру на экране
+    void setAdaptiveTessellation(GLboolean adaptive);
+    GLboolean adaptiveTessellation() const;
+
     // Making some simple figures
     void createLine(GLfloat length, const QColor &color = QColor());
     void createLine(const QVector3D &first, const QVector3D &second, const QColor &color = QColor());
@@ -389,9 +548,24 @@ public:
 
 protected:
     GLboolean designerSetType(VasnecovFigure::Types type);
+    GLboolean designerStreamingProblem() const; // Сообщение о недоступной в потоковом режиме операции
+
+    void renderUpdatePyramid(GLenum pointsUpdated);
+    GLboolean renderDrawSimplified();
+    void renderDrawTessellated();
+
+    // Пакетная отрисовка (см. Vasnecov::FigureBatcher)
+    virtual GLboolean renderBatchable() const;
+    VasnecovPipeline::ElementDrawingMethods renderBatchMethod() const;
+    GLuint renderBatchVerticesCount() const;
+    GLuint renderBatchIndicesCount() const;
+    void renderFillBatch(QVector3D *vertices, GLubyte *colors, GLuint *indices, GLuint base) const;
+    GLfloat renderThickness() const;
+    GLboolean renderDepth() const;
 
     GLenum renderUpdateData();
     void renderDraw();
+    virtual GLboolean renderTransparencyRequired() const; // Вызывается при синхронизации, по сырым данным
 
     GLfloat renderCalculateDistanceToPlane(const QVector3D &planePoint, const QVector3D &normal);
 
@@ -402,10 +576,23 @@ protected:
 protected:
     Vasnecov::MutualData<VasnecovPipeline::ElementDrawingMethods> m_type; // Тип отрисовки
     VertexManager m_points;
+    Vasnecov::PointStream m_stream; // Точки потокового режима
+    Vasnecov::MutualData<GLfloat> m_simplification; // Допуск упрощения, пикс
 
     Vasnecov::MutualData<GLfloat> m_thickness; // Толщина линий
     Vasnecov::MutualData<GLboolean> m_lighting; // Освещение фигуры
     Vasnecov::MutualData<GLboolean> m_depth; // Тест глубины
+    Vasnecov::MutualData<Vasnecov::ArcParameters> m_arc; // Параметры адаптивной окружности
+    GLboolean raw_adaptiveTessellation;
+
+    Vasnecov::PolylinePyramid pure_pyramid; // Уровни упрощения ломаной
+    GLboolean pure_pyramidActive;
+    GLboolean pure_pyramidStream; // Пирамида построена по потоку
+    std::vector<QVector3D> pure_lodPoints; // Точки выбранного уровня
+    GLuint pure_lodLevel;
+    GLuint pure_lodVersion;
+    std::vector<QVector3D> pure_tessPoints; // Точки адаптивной окружности
+    GLuint pure_tessSegments; // Текущая ступень разбиения, 0 - не построено
 
     enum Updated
     {
@@ -413,11 +600,15 @@ protected:
         Points		= 0x0400,
         Thickness	= 0x0800,
         Lighting	= 0x1000,
-        Depth		= 0x2000
+        Depth		= 0x2000,
+        Stream		= 0x4000,
+        Simplification = 0x8000,
+        Arc			= 0x10000
     };
 
     friend class VasnecovUniverse;
     friend class VasnecovWorld;
+    friend class Vasnecov::FigureBatcher;
 
 private:
     Q_DISABLE_COPY(VasnecovFigure)
@@ -425,38 +616,38 @@ private:
 
 inline void VasnecovFigure::enableLighting()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
     m_lighting.set(true);
 }
 inline void VasnecovFigure::disableLighting()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
     m_lighting.set(false);
 }
 inline GLboolean VasnecovFigure::lighting() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
     return m_lighting.raw();
 }
 
 inline void VasnecovFigure::enableDepth()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
     m_depth.set(true);
 }
 inline void VasnecovFigure::disableDepth()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
     m_depth.set(false);
 }
 inline GLboolean VasnecovFigure::depth() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
 
     return m_depth.raw();
 }
@@ -466,9 +657,30 @@ inline GLenum VasnecovFigure::renderType() const
 }
 inline QVector3D VasnecovFigure::renderCm() const
 {
+    if(m_stream.pureEnabled())
+    {
+        return m_stream.cm();
+    }
     return m_points.cm();
 }
 
+inline GLboolean VasnecovFigure::renderTransparencyRequired() const
+{
+    return m_color.raw().alphaF() < 1.0f;
+}
+inline GLfloat VasnecovFigure::renderThickness() const
+{
+    return m_thickness.pure();
+}
+inline GLboolean VasnecovFigure::renderDepth() const
+{
+    return m_depth.pure();
+}
+inline GLuint VasnecovFigure::renderBatchVerticesCount() const
+{
+    return static_cast<GLuint>(m_points.pureVertices()->size());
+}
+
 inline GLboolean VasnecovFigure::renderLighting() const
 {
     return m_lighting.pure();
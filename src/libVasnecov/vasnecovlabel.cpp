@@ -9,11 +9,43 @@
 
 #include "vasnecovlabel.h"
 #include <QImage>
+#include <QMatrix4x4>
 #include "vasnecovtexture.h"
+#include "reclaimer.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
 
+namespace
+{
+    // FNV-1a по значимым байтам строк (без выравнивания строк QImage). Размер и формат входят в хеш
+    quint64 imageHash(const QImage &image)
+    {
+        const quint64 prime(0x100000001b3ULL);
+        quint64 hash(0xcbf29ce484222325ULL);
+
+        const quint64 header[3] = {static_cast<quint64>(image.width()),
+                                   static_cast<quint64>(image.height()),
+                                   static_cast<quint64>(image.format())};
+        for(GLuint i = 0; i < 3; ++i)
+        {
+            hash = (hash ^ header[i]) * prime;
+        }
+
+        const int lineBytes((image.width() * image.depth() + 7) / 8);
+        for(int y = 0; y < image.height(); ++y)
+        {
+            const uchar *line(image.constScanLine(y));
+            for(int x = 0; x < lineBytes; ++x)
+            {
+                hash = (hash ^ line[x]) * prime;
+            }
+        }
+
+        return hash ? hash : 1; // 0 означает отсутствие картинки
+    }
+}
+
 /*!
  \brief
 
@@ -23,8 +55,10 @@
  \param name
  \param size
  \param texture
+ \param atlas
 */
-VasnecovLabel::VasnecovLabel(QMutex *mutex, VasnecovPipeline *pipeline, const std::string &name, const QVector2D &size, VasnecovTexture *texture) :
+VasnecovLabel::VasnecovLabel(QMutex *mutex, VasnecovPipeline *pipeline, const std::string &name, const QVector2D &size,
+                             VasnecovTexture *texture, Vasnecov::LabelAtlas *atlas) :
     VasnecovElement(mutex, pipeline, name),
     m_position(size.x()*0.5, size.y()*0.5),
     m_texturePosition(),
@@ -35,10 +69,22 @@ VasnecovLabel::VasnecovLabel(QMutex *mutex, VasnecovPipeline *pipeline, const st
 
     m_texture(texture),
     m_personalTexture(false),
-    raw_dataLabel(m_texture, size)
+    m_atlas(atlas),
+    m_atlasEntry(),
+    m_priority(raw_wasUpdated, Priority, 0),
+    raw_dataLabel(m_texture, size),
+    raw_image(0),
+    raw_imageHash(0),
+    pure_boundsMin(),
+    pure_boundsMax(),
+    pure_anchor(),
+    pure_onScreen(true),
+    pure_decluttered(false)
 {
     if(m_texture)
     {
+        m_texture->designerAddUser();
+
         if(!updaterCalculateTexturePosition())
         {
             updaterSetUpdateFlag(Zone);
@@ -59,6 +105,7 @@ VasnecovLabel::VasnecovLabel(QMutex *mutex, VasnecovPipeline *pipeline, const st
 */
 VasnecovLabel::~VasnecovLabel()
 {
+    delete raw_image;
     updaterRemoveOldPersonalTexture();
 }
 
@@ -73,7 +120,7 @@ VasnecovLabel::~VasnecovLabel()
 */
 void VasnecovLabel::setTextureZone(GLfloat x, GLfloat y, GLfloat width, GLfloat height)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLabel);
 
     if(raw_dataLabel.texturePoint != QVector2D(x ,y) ||
        raw_dataLabel.textureZone != QVector2D(width, height))
@@ -106,10 +153,20 @@ GLboolean VasnecovLabel::setTexture(VasnecovTexture *texture)
 {
     if(texture)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLabel);
 
         if(raw_dataLabel.texture != texture)
         {
+            // Незагруженная картинка setImage() больше не нужна
+            delete raw_image;
+            raw_image = 0;
+            raw_imageHash = 0;
+
+            texture->designerAddUser();
+            if(raw_dataLabel.texture)
+            {
+                raw_dataLabel.texture->designerRemoveUser();
+            }
             raw_dataLabel.texture = texture;
             updaterSetUpdateFlag(Texture);
             return true;
@@ -149,18 +206,35 @@ GLboolean VasnecovLabel::setImage(const QImage &image)
 {
     if(!image.isNull())
     {
-        if((image.width() & (image.width() - 1)) == 0 && (image.height() & (image.height() - 1)) == 0)
+        // Хеш и копия считаются вне блокировки
+        const quint64 hash(imageHash(image));
         {
-            // Делается копия картинки на куче (которая удалится сама текстурой после загрузки), чтобы не было проблем с многопоточностью
-            QImage *newImage = new QImage();
-            *newImage = image.copy(); // Необходимо вызывать именно copy() из-за особенностей копирования QImage
+            Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLabel);
 
-            QMutexLocker locker(mtx_data);
+            if(hash == raw_imageHash)
+            {
+                return true; // Такая картинка уже показана или ждёт загрузки
+            }
+        }
 
-            raw_dataLabel.texture = new VasnecovTextureInterface(newImage);
-            updaterSetUpdateFlag(Image);
-            return true;
+        // Делается копия картинки на куче (которая удалится сама текстурой после загрузки), чтобы не было проблем с многопоточностью
+        QImage *newImage = new QImage();
+        *newImage = image.copy(); // Необходимо вызывать именно copy() из-за особенностей копирования QImage
+
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLabel);
+
+        // Предыдущая картинка могла ещё не дойти до отрисовки
+        delete raw_image;
+        raw_image = newImage;
+        raw_imageHash = hash;
+        if(raw_dataLabel.texture)
+        {
+            raw_dataLabel.texture->designerRemoveUser();
         }
+        raw_dataLabel.texture = 0; // Повторный setTexture() прежней текстуры снова её задаст
+
+        updaterSetUpdateFlag(Image);
+        return true;
     }
     return false;
 }
@@ -185,10 +259,25 @@ GLboolean VasnecovLabel::setImage(const QImage &image, GLfloat x, GLfloat y, GLf
     return false;
 }
 
+void VasnecovLabel::setPriority(GLint priority)
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLabel);
+
+    m_priority.set(priority);
+}
+
+GLint VasnecovLabel::priority() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLabel);
+
+    return m_priority.raw();
+}
+
 /*!
  \brief Обновляет зону текстуры, которая накладывается на полигон.
 
   Положение отсчитывается из левой нижней точки текстуры по правой тройке.
+  Для картинки в атласе положение считается по самой картинке и затем переносится в атлас.
 
 */
 bool VasnecovLabel::updaterCalculateTexturePosition()
@@ -198,7 +287,12 @@ bool VasnecovLabel::updaterCalculateTexturePosition()
         GLfloat texWidth = m_texture->width();
         GLfloat texHeight = m_texture->height();
 
-        if(!m_texture->id()) // Текстура еще не загрузилась, значит будем пробовать в следующий раз
+        if(m_atlasEntry.isValid())
+        {
+            texWidth = m_texture->image()->width();
+            texHeight = m_texture->image()->height();
+        }
+        else if(!m_texture->id()) // Текстура еще не загрузилась, значит будем пробовать в следующий раз
         {
             return false;
         }
@@ -225,16 +319,111 @@ bool VasnecovLabel::updaterCalculateTexturePosition()
             m_vertices[2] = QVector3D(m_position.x(), m_position.y(), 0.0f);
             m_vertices[3] = QVector3D(-m_position.x(), m_position.y(), 0.0f);
 
-            m_textures[0] = QVector2D(m_texturePosition[0].x(), m_texturePosition[1].y());
-            m_textures[1] = QVector2D(m_texturePosition[1].x(), m_texturePosition[1].y());
-            m_textures[2] = QVector2D(m_texturePosition[1].x(), m_texturePosition[0].y());
-            m_textures[3] = QVector2D(m_texturePosition[0].x(), m_texturePosition[0].y());
+            renderFillTextureCoords();
+            renderUpdateBounds();
         }
     }
 
     return true;
 }
 
+/*!
+ \brief Текстурные координаты вершин по зоне текстуры (с переносом в атлас, если картинка в нём).
+
+ Пользуется только чистыми данными, поэтому вызывается и при перемещении картинки в атласе во время отрисовки.
+*/
+void VasnecovLabel::renderFillTextureCoords()
+{
+    QVector2D position[2] = {m_texturePosition[0], m_texturePosition[1]};
+
+    if(m_atlasEntry.isValid() && m_texture && m_texture->image())
+    {
+        const QPoint offset(m_atlas->position(m_atlasEntry));
+        const GLfloat atlasSize(m_atlas->size());
+        const GLfloat width(m_texture->image()->width());
+        const GLfloat height(m_texture->image()->height());
+
+        for(GLuint i = 0; i < 2; ++i)
+        {
+            position[i].setX((offset.x() + position[i].x()*width)/atlasSize);
+            position[i].setY((offset.y() + position[i].y()*height)/atlasSize);
+        }
+    }
+
+    m_textures[0] = QVector2D(position[0].x(), position[1].y());
+    m_textures[1] = QVector2D(position[1].x(), position[1].y());
+    m_textures[2] = QVector2D(position[1].x(), position[0].y());
+    m_textures[3] = QVector2D(position[0].x(), position[0].y());
+}
+
+/*!
+ \brief Габарит вершин метки для размещения на экране.
+*/
+void VasnecovLabel::renderUpdateBounds()
+{
+    if(m_vertices.empty())
+    {
+        pure_boundsMin = QVector2D();
+        pure_boundsMax = QVector2D();
+        return;
+    }
+
+    pure_boundsMin = QVector2D(m_vertices.front().x(), m_vertices.front().y());
+    pure_boundsMax = pure_boundsMin;
+    for(std::vector<QVector3D>::const_iterator it = m_vertices.begin(); it != m_vertices.end(); ++it)
+    {
+        pure_boundsMin.setX(qMin(pure_boundsMin.x(), it->x()));
+        pure_boundsMin.setY(qMin(pure_boundsMin.y(), it->y()));
+        pure_boundsMax.setX(qMax(pure_boundsMax.x(), it->x()));
+        pure_boundsMax.setY(qMax(pure_boundsMax.y(), it->y()));
+    }
+}
+
+/*!
+ \brief Размещение личной картинки в атласе.
+ \return false, если атласа нет, картинка для него велика или места не нашлось
+*/
+GLboolean VasnecovLabel::updaterPlaceInAtlas()
+{
+    const QImage *image(m_texture ? m_texture->image() : 0);
+    if(!m_atlas || !image || !m_atlas->fits(image->width(), image->height()))
+    {
+        return false;
+    }
+
+    m_atlasEntry = m_atlas->allocate(*image);
+    return m_atlasEntry.isValid();
+}
+
+/*!
+ \brief Замена личной картинки на месте: текстура (или участок атласа) не пересоздаётся.
+ \return false, если личной картинки нет или размеры отличаются. Тогда картинкой по-прежнему владеет вызывающий
+*/
+GLboolean VasnecovLabel::updaterReplaceImage(QImage *image)
+{
+    if(!m_personalTexture || !m_texture)
+    {
+        return false;
+    }
+
+    // Личные текстуры меток всегда интерфейсные
+    VasnecovTextureInterface *texture(static_cast<VasnecovTextureInterface *>(m_texture));
+    if(m_atlasEntry.isValid())
+    {
+        if(!texture->image() || texture->image()->size() != image->size())
+        {
+            return false;
+        }
+        // Вытесненный участок загрузится при подготовке к отрисовке
+        if(m_atlas->resident(m_atlasEntry) && !m_atlas->update(m_atlasEntry, *image))
+        {
+            return false;
+        }
+    }
+
+    return texture->replaceImage(image);
+}
+
 /*!
  \brief
 
@@ -250,31 +439,42 @@ GLenum VasnecovLabel::renderUpdateData()
     {
         pure_pipeline->setSomethingWasUpdated();
 
-        if(updaterIsUpdateFlag(Image))
+        if(updaterIsUpdateFlag(Texture) && raw_dataLabel.texture)
         {
-            // Текстура на куче, загруженная непосредственно в Метку
-            // Сначала удаляется старая текстура
             updaterRemoveOldPersonalTexture();
 
+            // Текстура из списка в Universe
             m_texture = raw_dataLabel.texture;
 
-            m_texture->loadImage();
-            m_personalTexture = true;
-
             ok = updaterCalculateTexturePosition();
 
-            updated |= Image;
+            updated |= Texture;
         }
-        if(updaterIsUpdateFlag(Texture))
+        // Картинка, заданная после текстуры, важнее её (setTexture() сбрасывает ожидающую картинку)
+        if(updaterIsUpdateFlag(Image) && raw_image)
         {
-            updaterRemoveOldPersonalTexture();
+            QImage *image(raw_image);
+            raw_image = 0;
 
-            // Текстура из списка в Universe
-            m_texture = raw_dataLabel.texture;
+            // Картинка того же размера заменяется без пересоздания текстуры
+            if(!updaterReplaceImage(image))
+            {
+                // Текстура на куче, загруженная непосредственно в Метку
+                // Сначала удаляется старая текстура
+                updaterRemoveOldPersonalTexture();
+
+                m_texture = new VasnecovTextureInterface(image);
+                m_personalTexture = true;
+
+                if(!updaterPlaceInAtlas())
+                {
+                    m_texture->loadImage();
+                }
+            }
 
             ok = updaterCalculateTexturePosition();
 
-            updated |= Texture;
+            updated |= Image;
         }
         if(updaterIsUpdateFlag(Size))
         {
@@ -293,6 +493,8 @@ GLenum VasnecovLabel::renderUpdateData()
             updated |= Zone;
         }
 
+        m_priority.update();
+
         updated |= VasnecovElement::renderUpdateData();
     }
 
@@ -330,8 +532,77 @@ void VasnecovLabel::renderDraw()
     }
 }
 
+/*!
+ \brief Имя личной текстуры освобождается в потоке отрисовки, сама метка удаляется в фоне.
+*/
+void VasnecovLabel::renderReleaseResources(Vasnecov::Reclaimer *reclaimer)
+{
+    if(m_atlasEntry.isValid())
+    {
+        m_atlas->release(m_atlasEntry);
+    }
+    if(m_personalTexture && m_texture)
+    {
+        reclaimer->renderReleaseTexture(m_texture->takeId());
+    }
+}
+
+/*!
+ \brief Подготовка картинки в атласе к отрисовке пакетом.
+
+ Вытесненная из атласа картинка загружается заново. Если места в атласе нет, метка переходит
+ на собственную текстуру и дальше рисуется сама.
+*/
+GLboolean VasnecovLabel::renderPrepareAtlas()
+{
+    if(!m_atlasEntry.isValid() || !m_texture)
+    {
+        return false;
+    }
+
+    if(!m_atlas->resident(m_atlasEntry))
+    {
+        if(!updaterPlaceInAtlas())
+        {
+            m_texture->loadImage();
+            renderFillTextureCoords();
+            return false;
+        }
+        renderFillTextureCoords();
+    }
+
+    m_atlas->markUsed(m_atlasEntry);
+    return true;
+}
+
+GLuint VasnecovLabel::renderAtlasTexture() const
+{
+    return m_atlas ? m_atlas->textureId() : 0;
+}
+
+void VasnecovLabel::renderFillBatch(QVector3D *vertices, QVector2D *textures, GLubyte *colors)
+{
+    // Опорная точка уже спроецирована при размещении меток мира
+    const QVector3D shift(pure_anchor.x(), pure_anchor.y(), pure_anchor.z());
+
+    const QColor &color(m_color.pure());
+    for(GLuint i = 0; i < m_vertices.size(); ++i)
+    {
+        vertices[i] = m_vertices[i] + shift;
+        textures[i] = m_textures[i];
+        colors[i*4] = static_cast<GLubyte>(color.red());
+        colors[i*4 + 1] = static_cast<GLubyte>(color.green());
+        colors[i*4 + 2] = static_cast<GLubyte>(color.blue());
+        colors[i*4 + 3] = static_cast<GLubyte>(color.alpha());
+    }
+}
+
 void VasnecovLabel::updaterRemoveOldPersonalTexture()
 {
+    if(m_atlasEntry.isValid())
+    {
+        m_atlas->release(m_atlasEntry);
+    }
     if(m_personalTexture)
     {
         delete m_texture;
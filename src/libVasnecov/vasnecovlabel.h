@@ -15,7 +15,9 @@
     #pragma GCC diagnostic ignored "-Weffc++"
 #endif
 #include <QVector2D>
+#include <QVector4D>
 #include "vasnecovelement.h"
+#include "labelatlas.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
@@ -24,6 +26,9 @@ class VasnecovTexture;
 
 namespace Vasnecov
 {
+    class LabelBatcher;
+    class LabelPlacer;
+
     struct LabelAttributes
     {
         QVector2D size;
@@ -49,7 +54,8 @@ public:
                   VasnecovPipeline *pipeline,
                   const std::string &name,
                   const QVector2D &size,
-                  VasnecovTexture *texture = 0);
+                  VasnecovTexture *texture = 0,
+                  Vasnecov::LabelAtlas *atlas = 0); // Картинки setImage() размещаются в атласе, если он задан
     ~VasnecovLabel();
 
     void setSize(GLfloat width, GLfloat height);
@@ -58,9 +64,14 @@ public:
 
     GLboolean setTexture(VasnecovTexture *texture);
     GLboolean setTexture(VasnecovTexture *texture, GLfloat x, GLfloat y, GLfloat width = 0.0, GLfloat height = 0.0);
+    // Картинка, совпадающая с уже заданной, повторно не загружается; картинка того же размера заменяется на месте
     GLboolean setImage(const QImage &image);
     GLboolean setImage(const QImage &image, GLfloat x, GLfloat y, GLfloat width = 0.0, GLfloat height = 0.0);
 
+    // При разрежении меток мира (VasnecovWorld::setLabelsDeclutter) перекрытые метки с меньшим приоритетом скрываются
+    void setPriority(GLint priority);
+    GLint priority() const;
+
 protected:
     VasnecovTexture *designerTexture() const {return raw_dataLabel.texture;}
 
@@ -68,10 +79,24 @@ protected:
     // Методы, которые вызываются на этапе обновления данных, т.е. имеют доступ и к сырым, и к нормальным
     bool updaterCalculateTexturePosition();
     void updaterRemoveOldPersonalTexture();
+    GLboolean updaterPlaceInAtlas();
+    GLboolean updaterReplaceImage(QImage *image);
 
 protected:
     GLenum renderUpdateData();
     void renderDraw();
+    void renderReleaseResources(Vasnecov::Reclaimer *reclaimer);
+
+    void renderFillTextureCoords();
+    void renderUpdateBounds();
+    GLboolean renderIsPlaced() const {return pure_onScreen && !pure_decluttered;} // Результат Vasnecov::LabelPlacer
+
+    // Пакетная отрисовка (см. Vasnecov::LabelBatcher)
+    virtual GLboolean renderPrepareAtlas(); // Картинка в атласе и готова к отрисовке в текущем кадре
+    virtual GLuint renderAtlasTexture() const;
+    virtual GLboolean renderDistanceField() const {return false;} // Текстура - поле расстояний (рисуется с тестом альфы)
+    GLuint renderBatchQuads() const {return static_cast<GLuint>(m_vertices.size() / 4);}
+    virtual void renderFillBatch(QVector3D *vertices, QVector2D *textures, GLubyte *colors); // По 4 вершины на прямоугольник
 
     VasnecovTexture *texture() const {return m_texture;}
 
@@ -85,19 +110,34 @@ protected:
 
     VasnecovTexture *m_texture;
     bool m_personalTexture; // Текстура создается Меткой сама только для себя
+    Vasnecov::LabelAtlas *const m_atlas;
+    Vasnecov::LabelAtlas::Handle m_atlasEntry; // Участок атласа с личной картинкой (сама текстура тогда не загружается)
+
+    Vasnecov::MutualData<GLint> m_priority;
 
     Vasnecov::LabelAttributes raw_dataLabel;
+    QImage *raw_image; // Картинка setImage(), ожидающая загрузки
+    quint64 raw_imageHash; // Хеш содержимого последней заданной картинки (0 - картинки нет)
+
+    // Размещение на экране (см. Vasnecov::LabelPlacer)
+    QVector2D pure_boundsMin, pure_boundsMax; // Габарит вершин относительно опорной точки, пикс
+    QVector4D pure_anchor; // Опорная точка в координатах окна, пересчитывается каждый кадр
+    GLboolean pure_onScreen;
+    GLboolean pure_decluttered; // Скрыта разрежением. Сохраняется между кадрами для гистерезиса
 
     enum Updated// Изменение данных
     {
         Image		= 0x0200,
         Texture		= 0x0400,
         Size		= 0x0800,
-        Zone		= 0x1000
+        Zone		= 0x1000,
+        Priority	= 0x8000
     };
 
     friend class VasnecovWorld;
     friend class VasnecovUniverse;
+    friend class Vasnecov::LabelBatcher;
+    friend class Vasnecov::LabelPlacer;
 
 private:
     Q_DISABLE_COPY(VasnecovLabel)
@@ -106,7 +146,7 @@ private:
 
 inline void VasnecovLabel::setSize(GLfloat width, GLfloat height)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLabel);
 
     raw_dataLabel.size.setX(width);
     raw_dataLabel.size.setY(height);
@@ -57,7 +57,7 @@ VasnecovLamp::VasnecovLamp(QMutex *mutex, VasnecovPipeline *pipeline, const std:
 */
 void VasnecovLamp::setType(LampTypes type)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLamp);
 
     m_type.set(type);
 }
@@ -95,7 +95,7 @@ void VasnecovLamp::setCelestialDirection(GLfloat x, GLfloat y, GLfloat z)
 */
 void VasnecovLamp::setAmbientColor(const QColor &color)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLamp);
 
     m_ambientColor.set(color);
 }
@@ -108,7 +108,7 @@ void VasnecovLamp::setAmbientColor(const QColor &color)
 */
 void VasnecovLamp::setDiffuseColor(const QColor &color)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLamp);
 
     m_diffuseColor.set(color);
 }
@@ -121,7 +121,7 @@ void VasnecovLamp::setDiffuseColor(const QColor &color)
 */
 void VasnecovLamp::setSpecularColor(const QColor &color)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLamp);
 
     m_specularColor.set(color);
 }
@@ -134,7 +134,7 @@ void VasnecovLamp::setSpecularColor(const QColor &color)
 */
 void VasnecovLamp::setSpotDirection(const QVector3D &direction)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLamp);
 
     if(m_spotDirection.set(direction))
     {
@@ -150,7 +150,7 @@ void VasnecovLamp::setSpotDirection(const QVector3D &direction)
 */
 void VasnecovLamp::setSpotExponent(GLfloat exponent)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLamp);
 
     if(m_spotExponent.set(exponent))
     {
@@ -166,7 +166,7 @@ void VasnecovLamp::setSpotExponent(GLfloat exponent)
 */
 void VasnecovLamp::setSpotAngle(GLfloat angle)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLamp);
 
     if(m_spotAngle.set(angle))
     {
@@ -191,7 +191,7 @@ void VasnecovLamp::setSpotAngle(GLfloat angle)
 */
 void VasnecovLamp::setConstantAttenuation(GLfloat attenuation)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLamp);
 
     m_constantAttenuation.set(attenuation);
 }
@@ -204,7 +204,7 @@ void VasnecovLamp::setConstantAttenuation(GLfloat attenuation)
 */
 void VasnecovLamp::setLinearAttenuation(GLfloat attenuation)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLamp);
 
     m_linearAttenuation.set(attenuation);
 }
@@ -217,7 +217,7 @@ void VasnecovLamp::setLinearAttenuation(GLfloat attenuation)
 */
 void VasnecovLamp::setQuadraticAttenuation(GLfloat attenuation)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLamp);
 
     m_quadraticAttenuation.set(attenuation);
 }
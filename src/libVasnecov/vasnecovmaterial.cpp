@@ -31,7 +31,9 @@ VasnecovMaterial::VasnecovMaterial(QMutex *mutex,
     m_diffuseColor(raw_wasUpdated, Diffuse, QColor(204, 204, 204, 255)),
     m_specularColor(raw_wasUpdated, Specular, QColor(0, 0, 0, 255)),
     m_emissionColor(raw_wasUpdated, Emission, QColor(0, 0, 0, 255)),
-    m_shininess(raw_wasUpdated, Shininess, 0)
+    m_shininess(raw_wasUpdated, Shininess, 0),
+
+    m_users(0)
 {
 //	QColor c;
 
@@ -64,8 +66,18 @@ VasnecovMaterial::VasnecovMaterial(QMutex *mutex,
     m_diffuseColor(raw_wasUpdated, Diffuse, QColor(204, 204, 204, 255)),
     m_specularColor(raw_wasUpdated, Specular, QColor(0, 0, 0, 255)),
     m_emissionColor(raw_wasUpdated, Emission, QColor(0, 0, 0, 255)),
-    m_shininess(raw_wasUpdated, Shininess, 0)
+    m_shininess(raw_wasUpdated, Shininess, 0),
+
+    m_users(0)
 {
+    if(textureD)
+    {
+        textureD->designerAddUser();
+    }
+    if(textureN)
+    {
+        textureN->designerAddUser();
+    }
 }
 
 /*!
@@ -76,9 +88,20 @@ VasnecovMaterial::VasnecovMaterial(QMutex *mutex,
 */
 void VasnecovMaterial::setTextureD(VasnecovTexture *textureD)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
-    m_textureD.set(textureD);
+    if(m_textureD.raw() != textureD)
+    {
+        if(textureD)
+        {
+            textureD->designerAddUser();
+        }
+        if(m_textureD.raw())
+        {
+            m_textureD.raw()->designerRemoveUser();
+        }
+        m_textureD.set(textureD);
+    }
 }
 
 /*!
@@ -89,7 +112,7 @@ void VasnecovMaterial::setTextureD(VasnecovTexture *textureD)
 */
 VasnecovTexture *VasnecovMaterial::textureD() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     VasnecovTexture *texture(m_textureD.raw());
     return texture;
@@ -103,9 +126,20 @@ VasnecovTexture *VasnecovMaterial::textureD() const
 */
 void VasnecovMaterial::setTextureN(VasnecovTexture *textureN)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
-    m_textureN.set(textureN);
+    if(m_textureN.raw() != textureN)
+    {
+        if(textureN)
+        {
+            textureN->designerAddUser();
+        }
+        if(m_textureN.raw())
+        {
+            m_textureN.raw()->designerRemoveUser();
+        }
+        m_textureN.set(textureN);
+    }
 }
 
 /*!
@@ -116,7 +150,7 @@ void VasnecovMaterial::setTextureN(VasnecovTexture *textureN)
 */
 VasnecovTexture *VasnecovMaterial::textureN() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     VasnecovTexture *texture(m_textureN.raw());
     return texture;
@@ -130,7 +164,7 @@ VasnecovTexture *VasnecovMaterial::textureN() const
 */
 void VasnecovMaterial::setAmbientColor(const QColor &color)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     m_ambientColor.set(color);
 }
@@ -143,7 +177,7 @@ void VasnecovMaterial::setAmbientColor(const QColor &color)
 */
 void VasnecovMaterial::setDiffuseColor(const QColor &color)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     m_diffuseColor.set(color);
 }
@@ -156,7 +190,7 @@ void VasnecovMaterial::setDiffuseColor(const QColor &color)
 */
 void VasnecovMaterial::setSpecularColor(const QColor &color)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     m_specularColor.set(color);
 }
@@ -169,7 +203,7 @@ void VasnecovMaterial::setSpecularColor(const QColor &color)
 */
 void VasnecovMaterial::setEmissionColor(const QColor &color)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     m_emissionColor.set(color);
 }
@@ -182,7 +216,7 @@ void VasnecovMaterial::setEmissionColor(const QColor &color)
 */
 void VasnecovMaterial::setShininess(GLfloat shininess)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     m_shininess.set(shininess);
 }
@@ -195,7 +229,7 @@ void VasnecovMaterial::setShininess(GLfloat shininess)
 */
 QColor VasnecovMaterial::ambientColor() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     QColor color(m_ambientColor.raw());
     return color;
@@ -208,7 +242,7 @@ QColor VasnecovMaterial::ambientColor() const
 */
 QColor VasnecovMaterial::diffuseColor() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     QColor color(m_diffuseColor.raw());
     return color;
@@ -221,7 +255,7 @@ QColor VasnecovMaterial::diffuseColor() const
 */
 QColor VasnecovMaterial::specularColor() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     QColor color(m_specularColor.raw());
     return color;
@@ -234,7 +268,7 @@ QColor VasnecovMaterial::specularColor() const
 */
 QColor VasnecovMaterial::emissionColor() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     QColor color(m_emissionColor.raw());
     return color;
@@ -247,7 +281,7 @@ QColor VasnecovMaterial::emissionColor() const
 */
 GLfloat VasnecovMaterial::shininess() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
 
     GLfloat shininess(m_shininess.raw());
     return shininess;
@@ -310,11 +344,22 @@ void VasnecovMaterial::renderDraw()
 
     if(m_textureD.pure())
     {
-        pure_pipeline->enableTexture2D(m_textureD.pure()->id());
+        pure_pipeline->enableTexture2D(m_textureD.pure()->renderUse());
+
+        // Дыры в текстуре отбрасываются, такие изделия рисуются среди непрозрачных
+        if(m_textureD.pure()->isAlphaTested())
+        {
+            pure_pipeline->enableAlphaTest(Vasnecov::cfg_textureAlphaThreshold);
+        }
+        else
+        {
+            pure_pipeline->disableAlphaTest();
+        }
     }
     else
     {
         pure_pipeline->disableTexture2D();
+        pure_pipeline->disableAlphaTest();
     }
 }
 
@@ -15,6 +15,7 @@
     #pragma GCC diagnostic ignored "-Weffc++"
 #endif
 #include <QColor>
+#include <QAtomicInt>
 #include "coreobject.h"
 #include "vasnecovtexture.h"
 #ifndef _MSC_VER
@@ -58,6 +59,12 @@ public:
 protected:
     void designerSetAmbientAndDiffuseColor(const QColor &color);
 
+    // Учёт изделий, использующих материал. Изделия живут в разных мирах, поэтому счётчик атомарный
+    void designerAddUser();
+    GLboolean designerRemoveUser(); // true - пользователей больше не осталось
+    GLboolean isUsed() const;
+    void designerReleaseTextures(); // Материал удаляется: его текстуры больше не заняты им
+
 protected:
     GLenum renderUpdateData();
     void renderDraw();
@@ -88,6 +95,8 @@ protected:
     Vasnecov::MutualData<QColor> m_emissionColor;
     Vasnecov::MutualData<GLfloat> m_shininess;
 
+    QAtomicInt m_users;
+
     enum
     {
         TextureD	= 0x0008,
@@ -108,6 +117,30 @@ private:
     Q_DISABLE_COPY(VasnecovMaterial)
 };
 
+inline void VasnecovMaterial::designerAddUser()
+{
+    m_users.ref();
+}
+inline GLboolean VasnecovMaterial::designerRemoveUser()
+{
+    return !m_users.deref();
+}
+inline GLboolean VasnecovMaterial::isUsed() const
+{
+    return m_users.load() != 0;
+}
+inline void VasnecovMaterial::designerReleaseTextures()
+{
+    if(m_textureD.raw())
+    {
+        m_textureD.raw()->designerRemoveUser();
+    }
+    if(m_textureN.raw())
+    {
+        m_textureN.raw()->designerRemoveUser();
+    }
+}
+
 inline VasnecovTexture *VasnecovMaterial::renderTextureD() const
 {
     return m_textureD.pure();
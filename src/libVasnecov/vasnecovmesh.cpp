@@ -28,6 +28,7 @@
  \param name
 */
 VasnecovMesh::VasnecovMesh(const std::string &meshPath, VasnecovPipeline *pipeline, const std::string &name) :
+    Vasnecov::Resource(),
     m_pipeline(pipeline),
     m_type(VasnecovPipeline::Points),
     m_name(name),
@@ -18,11 +18,12 @@
 #include <vector>
 #include "configuration.h"
 #include "vasnecovpipeline.h"
+#include "resource.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
 
-class VasnecovMesh
+class VasnecovMesh : public Vasnecov::Resource
 {
 public:
     VasnecovMesh(const std::string &meshPath, VasnecovPipeline *pipeline, const std::string &name = "");
@@ -33,6 +34,7 @@ public:
     GLboolean loadModel(const std::string &path, GLboolean readFromMTL = Vasnecov::cfg_readFromMTL); // Загрузка модели (obj-файл)
     void drawModel(); // Отрисовка модели
     QVector3D cm() const;
+    size_t bytes() const; // Объём данных модели
     void drawBorderBox(); // Рисовать ограничивающий бокс
 
 protected:
@@ -133,6 +135,13 @@ inline VasnecovPipeline::ElementDrawingMethods VasnecovMesh::type() const
     return m_type;
 }
 
+inline size_t VasnecovMesh::bytes() const
+{
+    return m_indices.size() * sizeof(GLuint) +
+           m_vertices.size() * sizeof(QVector3D) +
+           m_normals.size() * sizeof(QVector3D) +
+           m_textures.size() * sizeof(QVector2D);
+}
 inline QVector3D VasnecovMesh :: cm() const
 {
     return m_cm;
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "vasnecovparticles.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class VasnecovParticles
+  \brief Система частиц: множество затухающих и дрейфующих отметок в одном элементе.
+
+  Частицы испускаются в потоке конструктора в заранее зарезервированную очередь и переносятся в пул
+  (Vasnecov::ParticlePool) при синхронизации. Там же, в фазе обновления данных, частицы продвигаются
+  по времени и умирают, пока система не пуста, отрисовка запрашивается каждый кадр.
+ */
+
+VasnecovParticles::VasnecovParticles(QMutex *mutex, VasnecovPipeline *pipeline, const std::string &name, GLuint capacity) :
+    VasnecovFigure(mutex, pipeline, name),
+    m_capacity(raw_wasUpdated, Capacity, capacity),
+    m_acceleration(raw_wasUpdated, Acceleration),
+    raw_emitted(),
+    raw_clear(false),
+    raw_poolSize(0),
+    pure_pool(),
+    pure_ranges(1),
+    pure_timer()
+{
+    m_type.set(VasnecovPipeline::Points);
+    raw_emitted.reserve(capacity);
+    pure_pool.setCapacity(capacity);
+}
+
+VasnecovParticles::~VasnecovParticles()
+{
+}
+
+void VasnecovParticles::setCapacity(GLuint capacity)
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    if(m_capacity.set(capacity))
+    {
+        raw_emitted.reserve(capacity);
+        if(raw_emitted.size() > capacity)
+        {
+            raw_emitted.resize(capacity);
+        }
+    }
+}
+
+GLuint VasnecovParticles::capacity() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    return m_capacity.raw();
+}
+
+GLboolean VasnecovParticles::emit(const Vasnecov::Particle &particle)
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    if(!designerFreeSlots())
+    {
+        return false;
+    }
+    raw_emitted.push_back(particle);
+    return true;
+}
+
+GLboolean VasnecovParticles::emit(const QVector3D &position, const QVector3D &velocity, const QColor &color, GLfloat life)
+{
+    return emit(Vasnecov::Particle(position, velocity, color, life));
+}
+
+GLuint VasnecovParticles::emit(const std::vector<Vasnecov::Particle> &particles)
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    GLuint count(qMin(designerFreeSlots(), static_cast<GLuint>(particles.size())));
+    raw_emitted.insert(raw_emitted.end(), particles.begin(), particles.begin() + count);
+    return count;
+}
+
+void VasnecovParticles::clearParticles()
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    raw_emitted.clear();
+    raw_clear = true;
+}
+
+GLuint VasnecovParticles::particlesAmount() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    return (raw_clear ? 0 : raw_poolSize) + static_cast<GLuint>(raw_emitted.size());
+}
+
+void VasnecovParticles::setAcceleration(const QVector3D &acceleration)
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_acceleration.set(acceleration);
+}
+
+QVector3D VasnecovParticles::acceleration() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    return m_acceleration.raw();
+}
+
+GLenum VasnecovParticles::renderUpdateData()
+{
+    GLenum updated(raw_wasUpdated);
+
+    if(raw_wasUpdated)
+    {
+        if(m_capacity.update())
+        {
+            pure_pool.setCapacity(m_capacity.pure());
+        }
+        m_acceleration.update();
+    }
+
+    updated |= VasnecovFigure::renderUpdateData();
+
+    // Шаг по времени - от прошлого обновления, первое обновление частицы не двигает
+    GLfloat dt(0.0f);
+    if(pure_timer.isValid())
+    {
+        dt = qMin(pure_timer.restart() * 0.001f, Vasnecov::cfg_particlesStepMax);
+    }
+    else
+    {
+        pure_timer.start();
+    }
+
+    if(raw_clear)
+    {
+        pure_pool.clear();
+        raw_clear = false;
+    }
+
+    GLboolean alive(pure_pool.size() > 0 || !raw_emitted.empty());
+    if(pure_pool.size())
+    {
+        pure_pool.advance(dt, m_acceleration.pure());
+    }
+
+    // Новые частицы появляются в точке испускания и двигаются со следующего шага
+    if(!raw_emitted.empty())
+    {
+        for(std::vector<Vasnecov::Particle>::const_iterator it = raw_emitted.begin(); it != raw_emitted.end(); ++it)
+        {
+            if(!pure_pool.emit(*it))
+            {
+                break;
+            }
+        }
+        raw_emitted.clear();
+        pure_pool.advance(0.0f, QVector3D());
+    }
+
+    if(alive)
+    {
+        pure_pipeline->setSomethingWasUpdated();
+    }
+    raw_poolSize = pure_pool.size();
+
+    return updated;
+}
+
+/*!
+ \brief Сколько частиц ещё поместится в пул при следующей синхронизации.
+
+ Частицы, умирающие на следующем шаге, не учитываются, поэтому оценка осторожная: испущенная частица
+ точно будет показана, а не отброшена при переносе в пул.
+*/
+GLuint VasnecovParticles::designerFreeSlots() const
+{
+    const GLuint used((raw_clear ? 0 : raw_poolSize) + static_cast<GLuint>(raw_emitted.size()));
+    return m_capacity.raw() > used ? m_capacity.raw() - used : 0;
+}
+
+void VasnecovParticles::renderDraw()
+{
+    if(m_isHidden.pure() || !pure_pool.size())
+    {
+        return;
+    }
+
+    renderApplyTranslation();
+
+    pure_pipeline->activateLamps(false);
+    pure_pipeline->activateDepth(m_depth.pure());
+    pure_pipeline->setPointSize(m_thickness.pure());
+
+    pure_ranges.front() = std::make_pair(reinterpret_cast<const GLubyte *>(pure_pool.vertices()),
+                                         static_cast<GLsizei>(pure_pool.size()));
+    pure_pipeline->drawInterleavedPoints(sizeof(Vasnecov::ParticleVertex), pure_ranges);
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
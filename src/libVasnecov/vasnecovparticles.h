@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Система частиц (короткоживущие затухающие отметки)
+#ifndef VASNECOVPARTICLES_H
+#define VASNECOVPARTICLES_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <QElapsedTimer>
+#include "configuration.h"
+#include "vasnecovfigure.h"
+#include "particlepool.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+// Частицы рисуются точками одним вызовом, толщина фигуры задаёт размер точки.
+// Система всегда считается прозрачной, собственные точки фигуры не рисуются
+class VasnecovParticles : public VasnecovFigure
+{
+public:
+    VasnecovParticles(QMutex *mutex, VasnecovPipeline *pipeline, const std::string &name = std::string(),
+                      GLuint capacity = Vasnecov::cfg_particlesCapacity);
+    ~VasnecovParticles();
+
+    void setCapacity(GLuint capacity); // Лишние частицы отбрасываются
+    GLuint capacity() const;
+
+    // false, если очередь испускания или пул заполнены
+    GLboolean emit(const Vasnecov::Particle &particle);
+    GLboolean emit(const QVector3D &position, const QVector3D &velocity, const QColor &color, GLfloat life);
+    GLuint emit(const std::vector<Vasnecov::Particle> &particles); // Количество испущенных
+    void clearParticles();
+    GLuint particlesAmount() const; // Живые и ожидающие испускания
+
+    // Постоянное ускорение (дрейф), ед/с^2
+    void setAcceleration(const QVector3D &acceleration);
+    QVector3D acceleration() const;
+
+protected:
+    GLboolean renderBatchable() const;
+
+    GLenum renderUpdateData();
+    void renderDraw();
+    GLboolean renderTransparencyRequired() const; // Частицы затухают независимо от цвета элемента
+
+    GLuint designerFreeSlots() const; // Место в пуле с учётом очереди, по состоянию последней синхронизации
+
+protected:
+    Vasnecov::MutualData<GLuint> m_capacity;
+    Vasnecov::MutualData<QVector3D> m_acceleration;
+    std::vector<Vasnecov::Particle> raw_emitted; // Ёмкость зарезервирована, испускание не выделяет память
+    GLboolean raw_clear;
+    GLuint raw_poolSize; // Размер пула после последней синхронизации
+
+    Vasnecov::ParticlePool pure_pool;
+    std::vector<std::pair<const GLubyte *, GLsizei> > pure_ranges;
+    QElapsedTimer pure_timer;
+
+    enum Updated
+    {
+        Capacity		= 0x20000,
+        Acceleration	= 0x40000
+    };
+
+    friend class VasnecovUniverse;
+
+private:
+    Q_DISABLE_COPY(VasnecovParticles)
+};
+
+inline GLboolean VasnecovParticles::renderBatchable() const
+{
+    return false;
+}
+inline GLboolean VasnecovParticles::renderTransparencyRequired() const
+{
+    return true;
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOVPARTICLES_H
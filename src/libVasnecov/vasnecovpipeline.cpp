@@ -9,6 +9,7 @@
 
 #include "vasnecovpipeline.h"
 #include <algorithm>
+#include <cmath>
 #include <QGLContext>
 #include "configuration.h"
 #ifndef _MSC_VER
@@ -49,6 +50,8 @@ VasnecovPipeline::VasnecovPipeline(QGLContext *context) :
     m_backFaces(false),
     m_blending(true),
     m_smoothShading(true),
+    m_alphaTest(false),
+    m_alphaThreshold(0.0f),
 
     m_ambientColor(51, 51, 51, 255),
     m_materialColoringType(AmbientAndDiffuse),
@@ -61,7 +64,9 @@ VasnecovPipeline::VasnecovPipeline(QGLContext *context) :
     m_lineWidth(1.0f),
     m_pointSize(1.0f),
 
-    m_wasSomethingUpdated(true)
+    m_wasSomethingUpdated(1),
+
+    m_jobs()
 
 //	m_config()
 {
@@ -100,6 +105,9 @@ void VasnecovPipeline::initialize(QGLContext *context)
 
     glDisable(GL_TEXTURE_2D);
 
+    glDisable(GL_ALPHA_TEST);
+    glAlphaFunc(GL_GREATER, m_alphaThreshold);
+
 //	glColorMaterial(GL_FRONT, m_materialColoringType); // Рассеянный и дифузный задаются через glColor
     glEnable(GL_COLOR_MATERIAL); // Включить раскраску с помощью glColor
 
@@ -276,6 +284,128 @@ QVector4D VasnecovPipeline::projectPoint(const QMatrix4x4 &MV, const QVector3D &
 
     return pos;
 }
+/*!
+   \brief Пакетный вариант \a projectPoint() для точек, к которым модельно-видовая матрица уже применена.
+
+   Для опорных точек меток это избавляет от перемножения матриц на каждую метку. Точки за камерой
+   получают глубину вне диапазона [-1; 1].
+ */
+void VasnecovPipeline::projectPoints(std::vector<QVector4D> &points) const
+{
+    for(std::vector<QVector4D>::iterator it = points.begin(); it != points.end(); ++it)
+    {
+        QVector4D pos(m_P * (*it));
+
+        if(pos.w() <= 0.0f)
+        {
+            pos.setZ(2.0f);
+        }
+        else
+        {
+            const GLfloat div(1.0f/pos.w());
+            pos.setX(pos.x()*div);
+            pos.setY(pos.y()*div);
+            pos.setZ(pos.z()*div);
+        }
+        pos.setW(1.0f);
+        pos.setX((pos.x() + 1)*0.5*m_viewWidth);
+        pos.setY((pos.y() + 1)*0.5*m_viewHeight);
+
+        *it = pos;
+    }
+}
+/*!
+   \brief Оценка размера пикселя окна просмотра в единицах модели по её габаритам.
+
+   Габаритный параллелепипед проецируется на экран, результат - отношение его диагонали в модели
+   к диагонали проекции. Для перспективы это среднее значение по глубине.
+
+   \param MV матрица модельно-видовых преобразований
+   \return единиц модели в пикселе; 0, если оценка невозможна (габарит пуст или заходит за камеру)
+ */
+GLfloat VasnecovPipeline::pixelSize(const QMatrix4x4 &MV, const QVector3D &boxMin, const QVector3D &boxMax) const
+{
+    GLfloat modelSize((boxMax - boxMin).length());
+    if(modelSize <= 0.0f || m_viewWidth <= 0 || m_viewHeight <= 0)
+    {
+        return 0.0f;
+    }
+
+    QMatrix4x4 PMV(m_P * MV);
+    GLfloat minX(0.0f), minY(0.0f), maxX(0.0f), maxY(0.0f);
+
+    for(GLuint i = 0; i < 8; ++i)
+    {
+        QVector4D corner((i & 1) ? boxMax.x() : boxMin.x(),
+                         (i & 2) ? boxMax.y() : boxMin.y(),
+                         (i & 4) ? boxMax.z() : boxMin.z(),
+                         1.0f);
+        QVector4D pos(PMV * corner);
+        if(pos.w() <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        GLfloat x((pos.x()/pos.w() + 1.0f)*0.5f*m_viewWidth);
+        GLfloat y((pos.y()/pos.w() + 1.0f)*0.5f*m_viewHeight);
+        if(i == 0)
+        {
+            minX = maxX = x;
+            minY = maxY = y;
+        }
+        else
+        {
+            minX = qMin(minX, x);
+            maxX = qMax(maxX, x);
+            minY = qMin(minY, y);
+            maxY = qMax(maxY, y);
+        }
+    }
+
+    GLfloat screenSize(std::sqrt((maxX - minX)*(maxX - minX) + (maxY - minY)*(maxY - minY)));
+    if(screenSize < 1.0f)
+    {
+        screenSize = 1.0f;
+    }
+
+    return modelSize / screenSize;
+}
+/*!
+   \brief Проверка попадания габарита в пирамиду видимости.
+
+   Отбрасывается только габарит, все углы которого лежат снаружи одной из плоскостей отсечения,
+   поэтому проверка консервативна.
+ */
+GLboolean VasnecovPipeline::boxVisible(const QMatrix4x4 &MV, const QVector3D &boxMin, const QVector3D &boxMax) const
+{
+    QMatrix4x4 PMV(m_P * MV);
+    GLuint outside[6] = {0, 0, 0, 0, 0, 0};
+
+    for(GLuint i = 0; i < 8; ++i)
+    {
+        QVector4D corner((i & 1) ? boxMax.x() : boxMin.x(),
+                         (i & 2) ? boxMax.y() : boxMin.y(),
+                         (i & 4) ? boxMax.z() : boxMin.z(),
+                         1.0f);
+        QVector4D pos(PMV * corner);
+
+        if(pos.x() < -pos.w()) ++outside[0];
+        if(pos.x() > pos.w())  ++outside[1];
+        if(pos.y() < -pos.w()) ++outside[2];
+        if(pos.y() > pos.w())  ++outside[3];
+        if(pos.z() < -pos.w()) ++outside[4];
+        if(pos.z() > pos.w())  ++outside[5];
+    }
+
+    for(GLuint i = 0; i < 6; ++i)
+    {
+        if(outside[i] == 8)
+        {
+            return false;
+        }
+    }
+    return true;
+}
 /*!
  \brief
 
@@ -479,6 +609,91 @@ void VasnecovPipeline::drawElements(VasnecovPipeline::ElementDrawingMethods meth
         glDisableClientState(GL_VERTEX_ARRAY);
     }
 }
+/*!
+ \brief Отрисовка с цветом на каждую вершину (пакеты фигур и меток).
+
+ После отрисовки с массивом цветов текущий цвет OpenGL не определён, поэтому запомненный цвет сбрасывается.
+*/
+void VasnecovPipeline::drawColoredElements(VasnecovPipeline::ElementDrawingMethods method,
+                                           const std::vector<GLuint> *indices,
+                                           const std::vector<QVector3D> *vertices,
+                                           const std::vector<GLubyte> *colors,
+                                           const std::vector<QVector2D> *textures)
+{
+    if(indices && vertices && colors && !indices->empty())
+    {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 0, vertices->data());
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(4, GL_UNSIGNED_BYTE, 0, colors->data());
+        if(textures)
+        {
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            glTexCoordPointer(2, GL_FLOAT, 0, textures->data());
+        }
+
+        glDrawElements(method, indices->size(), GL_UNSIGNED_INT, indices->data());
+
+        if(textures)
+        {
+            glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        }
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+
+        m_color = QColor();
+    }
+}
+/*!
+ \brief Отрисовка части массива вершин без индексов (потоковые фигуры).
+*/
+void VasnecovPipeline::drawArrays(VasnecovPipeline::ElementDrawingMethods method,
+                                  const std::vector<QVector3D> *vertices,
+                                  GLuint first,
+                                  GLsizei count) const
+{
+    if(vertices && count > 0 && first + count <= vertices->size())
+    {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 0, vertices->data());
+
+        glDrawArrays(method, first, count);
+
+        glDisableClientState(GL_VERTEX_ARRAY);
+    }
+}
+/*!
+ \brief Отрисовка точек из чередующихся массивов координат (3 float) и цветов (4 байта RGBA за координатами).
+
+ Каждый диапазон задаётся указателем на первую запись и количеством точек, указатели массивов
+ переставляются на каждый диапазон, поэтому номера точек не ограничены размером GLint.
+*/
+void VasnecovPipeline::drawInterleavedPoints(GLsizei stride,
+                                             const std::vector<std::pair<const GLubyte *, GLsizei> > &ranges)
+{
+    if(ranges.empty())
+    {
+        return;
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    for(std::vector<std::pair<const GLubyte *, GLsizei> >::const_iterator it = ranges.begin(); it != ranges.end(); ++it)
+    {
+        if(it->first && it->second > 0)
+        {
+            glVertexPointer(3, GL_FLOAT, stride, it->first);
+            glColorPointer(4, GL_UNSIGNED_BYTE, stride, it->first + 3*sizeof(GLfloat));
+            glDrawArrays(GL_POINTS, 0, it->second);
+        }
+    }
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    m_color = QColor();
+}
 
 #ifndef _MSC_VER
     #pragma GCC diagnostic ignored "-Weffc++"
@@ -17,7 +17,9 @@
 #include <vector>
 #include <QColor>
 #include <QMatrix4x4>
+#include <QAtomicInt>
 #include "types.h"
+#include "jobscheduler.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
@@ -108,6 +110,11 @@ public:
     void addMatrixMV(const QMatrix4x4 *MV);
     void setMatrixOrtho2D(const QMatrix4x4 &MV);
     QVector4D projectPoint(const QMatrix4x4 &MV, const QVector3D &point = QVector3D());
+    void projectPoints(std::vector<QVector4D> &points) const; // Точки уже в видовых координатах (MV применена)
+    GLsizei viewWidth() const {return m_viewWidth;}
+    GLsizei viewHeight() const {return m_viewHeight;}
+    GLfloat pixelSize(const QMatrix4x4 &MV, const QVector3D &boxMin, const QVector3D &boxMax) const;
+    GLboolean boxVisible(const QMatrix4x4 &MV, const QVector3D &boxMin, const QVector3D &boxMax) const;
 
     void setBackgroundColor(const QColor &color = QColor(0, 0, 0, 0));
     void setColor(const QColor &color = QColor(255, 255, 255, 255));
@@ -135,6 +142,8 @@ public:
     void disableBlending(GLboolean strong = false);
     void enableSmoothShading(GLboolean strong = false);
     void disableSmoothShading(GLboolean strong = false);
+    void enableAlphaTest(GLfloat threshold, GLboolean strong = false); // Отбрасываются фрагменты с альфой не выше порога
+    void disableAlphaTest(GLboolean strong = false);
 
     void enableConcreteLamp(GLuint lamp, GLboolean strong = false);
     void disableConcreteLamp(GLuint lamp, GLboolean strong = false);
@@ -161,8 +170,20 @@ public:
                       const std::vector<QVector3D> *vertices,
                       const std::vector<QVector3D> *normals = 0,
                       const std::vector<QVector2D> *textures = 0) const;
-
-    void setSomethingWasUpdated() {m_wasSomethingUpdated = true;}
+    void drawColoredElements(ElementDrawingMethods method,
+                             const std::vector<GLuint> *indices,
+                             const std::vector<QVector3D> *vertices,
+                             const std::vector<GLubyte> *colors,
+                             const std::vector<QVector2D> *textures = 0);
+    void drawArrays(ElementDrawingMethods method,
+                    const std::vector<QVector3D> *vertices,
+                    GLuint first,
+                    GLsizei count) const;
+    void drawInterleavedPoints(GLsizei stride,
+                               const std::vector<std::pair<const GLubyte *, GLsizei> > &ranges);
+
+    void setSomethingWasUpdated() {m_wasSomethingUpdated.storeRelease(1);} // Может вызываться из рабочих потоков
+    Vasnecov::JobScheduler &jobs() {return m_jobs;}
 
 //	Vasnecov::Config &config();
 //	void setConfig(const Vasnecov::Config config);
@@ -173,8 +194,8 @@ protected:
 
     void setContext(const QGLContext *context);
 
-    void clearSomethingUpdates() {m_wasSomethingUpdated = false;}
-    bool wasSomethingUpdated() const {return m_wasSomethingUpdated;}
+    void clearSomethingUpdates() {m_wasSomethingUpdated.storeRelease(0);}
+    bool wasSomethingUpdated() const {return m_wasSomethingUpdated.loadAcquire() != 0;}
 
 protected:
     const QGLContext *m_context;
@@ -199,6 +220,8 @@ protected:
     GLboolean m_backFaces; // Отображение задних граней
     GLboolean m_blending; // Смещивание (для прозрачности)
     GLboolean m_smoothShading; // Плавное смещивание
+    GLboolean m_alphaTest; // Тест альфы
+    GLfloat m_alphaThreshold;
 
     QColor m_ambientColor;
     MaterialColoringTypes m_materialColoringType;
@@ -212,7 +235,9 @@ protected:
     GLfloat m_lineWidth;
     GLfloat m_pointSize;
 
-    bool m_wasSomethingUpdated;
+    QAtomicInt m_wasSomethingUpdated;
+
+    Vasnecov::JobScheduler m_jobs; // Распараллеливание подготовки кадра (без вызовов OpenGL)
 
 //	Vasnecov::Config m_config;
 
@@ -447,6 +472,27 @@ inline void VasnecovPipeline::disableSmoothShading(GLboolean strong)
         glShadeModel(GL_FLAT);
     }
 }
+inline void VasnecovPipeline::enableAlphaTest(GLfloat threshold, GLboolean strong)
+{
+    if(!m_alphaTest || strong)
+    {
+        m_alphaTest = true;
+        glEnable(GL_ALPHA_TEST);
+    }
+    if(threshold != m_alphaThreshold || strong)
+    {
+        m_alphaThreshold = threshold;
+        glAlphaFunc(GL_GREATER, m_alphaThreshold);
+    }
+}
+inline void VasnecovPipeline::disableAlphaTest(GLboolean strong)
+{
+    if(m_alphaTest || strong)
+    {
+        m_alphaTest = false;
+        glDisable(GL_ALPHA_TEST);
+    }
+}
 
 inline void VasnecovPipeline::enableConcreteLamp(GLuint lamp, GLboolean strong)
 {
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "vasnecovpointcloud.h"
+#include <queue>
+#include <limits>
+#include "technologist.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class VasnecovPointCloud
+  \brief Облако точек, читаемое из отображённого в память файла (см. Vasnecov::PointCloudFile).
+
+  В каждом кадре узлы октодерева обходятся от крупных на экране к мелким: узел уточняется потомками,
+  пока его точки ложатся на экран реже \a cfg_cloudPixelSpacing пикселей, невидимые узлы отбрасываются.
+  Обход прекращается при наборе бюджета точек, поэтому время кадра не зависит от размера облака.
+ */
+
+VasnecovPointCloud::VasnecovPointCloud(QMutex *mutex, VasnecovPipeline *pipeline, const std::string &name) :
+    VasnecovFigure(mutex, pipeline, name),
+    m_cloud(raw_wasUpdated, Cloud),
+    m_pointBudget(raw_wasUpdated, PointBudget, Vasnecov::cfg_cloudPointBudget),
+    pure_ranges()
+{
+    m_type.set(VasnecovPipeline::Points);
+}
+
+VasnecovPointCloud::~VasnecovPointCloud()
+{
+}
+
+/*!
+ \brief Загрузка облака из файла. Файл открывается до захвата мьютекса, чтобы не задерживать отрисовку.
+ \return true, если файл корректен
+*/
+GLboolean VasnecovPointCloud::loadFile(const std::string &fileName)
+{
+    std::shared_ptr<Vasnecov::PointCloudFile> cloud(new Vasnecov::PointCloudFile(fileName));
+    if(!cloud->isValid())
+    {
+        return false;
+    }
+
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_cloud.set(cloud);
+    return true;
+}
+
+void VasnecovPointCloud::clearCloud()
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_cloud.set(std::shared_ptr<Vasnecov::PointCloudFile>());
+}
+
+std::string VasnecovPointCloud::fileName() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    if(m_cloud.raw())
+    {
+        return m_cloud.raw()->fileName();
+    }
+    return std::string();
+}
+
+quint64 VasnecovPointCloud::cloudPointsCount() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    if(m_cloud.raw())
+    {
+        return m_cloud.raw()->pointsCount();
+    }
+    return 0;
+}
+
+void VasnecovPointCloud::setPointBudget(GLuint points)
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    m_pointBudget.set(points);
+}
+
+GLuint VasnecovPointCloud::pointBudget() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerFigure);
+
+    return m_pointBudget.raw();
+}
+
+/*!
+ \brief Выбор узлов для отрисовки по размеру на экране и бюджету точек.
+
+ \param M полная матрица модели
+*/
+void VasnecovPointCloud::renderSelectNodes(const QMatrix4x4 &M)
+{
+    pure_ranges.clear();
+
+    const Vasnecov::PointCloudFile &cloud(*m_cloud.pure());
+    const std::vector<Vasnecov::PointCloudFile::Node> &nodes(cloud.nodes());
+
+    // Приоритет - размер узла на экране в пикселях
+    typedef std::pair<GLfloat, GLint> Candidate;
+    std::priority_queue<Candidate> queue;
+
+    auto push = [&](GLint index)
+    {
+        const Vasnecov::PointCloudFile::Node &node(nodes[index]);
+        if(!pure_pipeline->boxVisible(M, node.boxMin, node.boxMax))
+        {
+            return;
+        }
+
+        GLfloat unitsPerPixel(pure_pipeline->pixelSize(M, node.boxMin, node.boxMax));
+        GLfloat priority(std::numeric_limits<GLfloat>::max()); // Узел заходит за камеру
+        if(unitsPerPixel > 0.0f)
+        {
+            priority = (node.boxMax - node.boxMin).length() / unitsPerPixel;
+        }
+        queue.push(Candidate(priority, index));
+    };
+
+    push(0);
+
+    const GLuint budget(m_pointBudget.pure());
+    GLuint total(0);
+    while(!queue.empty())
+    {
+        const Vasnecov::PointCloudFile::Node &node(nodes[queue.top().second]);
+        queue.pop();
+
+        if(node.count > budget - total)
+        {
+            continue; // Узлы поменьше ещё могут поместиться
+        }
+
+        if(node.count)
+        {
+            pure_ranges.push_back(std::make_pair(cloud.points() + node.first * Vasnecov::PointCloudFile::PointSize,
+                                                 static_cast<GLsizei>(node.count)));
+            total += node.count;
+        }
+
+        GLfloat unitsPerPixel(pure_pipeline->pixelSize(M, node.boxMin, node.boxMax));
+        if(unitsPerPixel <= 0.0f || node.spacing > unitsPerPixel * Vasnecov::cfg_cloudPixelSpacing)
+        {
+            for(GLuint i = 0; i < 8; ++i)
+            {
+                if(node.children[i] >= 0)
+                {
+                    push(node.children[i]);
+                }
+            }
+        }
+    }
+}
+
+GLenum VasnecovPointCloud::renderUpdateData()
+{
+    GLenum updated(raw_wasUpdated);
+
+    if(raw_wasUpdated)
+    {
+        if(m_cloud.update() | m_pointBudget.update())
+        {
+            pure_pipeline->setSomethingWasUpdated();
+        }
+    }
+
+    return updated | VasnecovFigure::renderUpdateData();
+}
+
+void VasnecovPointCloud::renderDraw()
+{
+    if(m_isHidden.pure() || !m_cloud.pure())
+    {
+        return;
+    }
+
+    QMatrix4x4 M(m_Ms.pure());
+    if(m_alienMs.pure())
+    {
+        M = (*m_alienMs.pure()) * m_Ms.pure();
+    }
+
+    renderSelectNodes(M);
+    if(pure_ranges.empty())
+    {
+        return;
+    }
+
+    renderApplyTranslation();
+
+    pure_pipeline->activateLamps(false);
+    pure_pipeline->activateDepth(m_depth.pure());
+    pure_pipeline->setPointSize(m_thickness.pure());
+
+    pure_pipeline->drawInterleavedPoints(Vasnecov::PointCloudFile::PointSize, pure_ranges);
+}
+
+GLfloat VasnecovPointCloud::renderCalculateDistanceToPlane(const QVector3D &planePoint, const QVector3D &normal)
+{
+    QVector3D centerPoint;
+    if(m_cloud.pure())
+    {
+        centerPoint = (m_cloud.pure()->boxMin() + m_cloud.pure()->boxMax()) * 0.5f;
+    }
+
+    if(m_alienMs.pure())
+    {
+        centerPoint = (*m_alienMs.pure()) * m_Ms.pure() * centerPoint;
+    }
+    else
+    {
+        centerPoint = m_Ms.pure() * centerPoint;
+    }
+
+    pure_distance = centerPoint.distanceToPlane(planePoint, normal);
+
+    return pure_distance;
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
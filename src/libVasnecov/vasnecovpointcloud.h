@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Облако точек из файла с уровнями детализации
+#ifndef VASNECOVPOINTCLOUD_H
+#define VASNECOVPOINTCLOUD_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <memory>
+#include <utility>
+#include "vasnecovfigure.h"
+#include "pointcloudfile.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+// Облако рисуется точками с цветом каждой точки. Толщина фигуры задаёт размер точки, собственные точки фигуры
+// (setPoints и т.п.) не рисуются
+class VasnecovPointCloud : public VasnecovFigure
+{
+public:
+    VasnecovPointCloud(QMutex *mutex, VasnecovPipeline *pipeline, const std::string &name = std::string());
+    ~VasnecovPointCloud();
+
+    GLboolean loadFile(const std::string &fileName); // Файл, записанный Vasnecov::PointCloudFile::write
+    void clearCloud();
+    std::string fileName() const;
+    quint64 cloudPointsCount() const;
+
+    // Предельное количество точек облака, рисуемых за кадр
+    void setPointBudget(GLuint points);
+    GLuint pointBudget() const;
+
+protected:
+    GLboolean renderBatchable() const;
+    void renderSelectNodes(const QMatrix4x4 &M);
+
+    GLenum renderUpdateData();
+    void renderDraw();
+
+    GLfloat renderCalculateDistanceToPlane(const QVector3D &planePoint, const QVector3D &normal);
+
+protected:
+    Vasnecov::MutualData<std::shared_ptr<Vasnecov::PointCloudFile> > m_cloud;
+    Vasnecov::MutualData<GLuint> m_pointBudget;
+
+    std::vector<std::pair<const GLubyte *, GLsizei> > pure_ranges; // Диапазоны точек выбранных узлов
+
+    enum Updated
+    {
+        Cloud		= 0x20000,
+        PointBudget	= 0x40000
+    };
+
+    friend class VasnecovUniverse;
+
+private:
+    Q_DISABLE_COPY(VasnecovPointCloud)
+};
+
+inline GLboolean VasnecovPointCloud::renderBatchable() const
+{
+    return false;
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOVPOINTCLOUD_H
@@ -11,10 +11,22 @@
 #include "technologist.h"
 #include "vasnecovmaterial.h"
 #include "vasnecovmesh.h"
+#include "transformstore.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
 
+struct VasnecovProduct::TransformWorkspace
+{
+    Vasnecov::TransformStore store;
+    std::vector<VasnecovProduct *> nodes;
+
+    TransformWorkspace() :
+        store(),
+        nodes()
+    {}
+};
+
 /*!
  \brief
 
@@ -29,6 +41,7 @@ VasnecovProduct::VasnecovProduct(QMutex *mutex, VasnecovPipeline *pipeline, Vasn
     VasnecovElement(mutex, pipeline),
     raw_M1(),
     raw_ownVisible(true),
+    raw_transforms(0),
 
     m_type(raw_wasUpdated, Type, type),
     m_parent(raw_wasUpdated, Parent, parent),
@@ -58,6 +71,7 @@ VasnecovProduct::VasnecovProduct(QMutex *mutex, VasnecovPipeline *pipeline, std:
     VasnecovElement(mutex, pipeline, name),
     raw_M1(),
     raw_ownVisible(true),
+    raw_transforms(0),
 
     m_type(raw_wasUpdated, Type, type),
     m_parent(raw_wasUpdated, Parent, parent),
@@ -86,6 +100,7 @@ VasnecovProduct::VasnecovProduct(QMutex *mutex, VasnecovPipeline *pipeline, std:
     VasnecovElement(mutex, pipeline, name),
     raw_M1(),
     raw_ownVisible(true),
+    raw_transforms(0),
 
     m_type(raw_wasUpdated, Type, ProductTypePart), // т.к. меш может быть только у детали
     m_parent(raw_wasUpdated, Parent, parent),
@@ -98,6 +113,11 @@ VasnecovProduct::VasnecovProduct(QMutex *mutex, VasnecovPipeline *pipeline, std:
     m_drawingBox(raw_wasUpdated, DrawingBox, false)
 {
     init();
+
+    if(mesh)
+    {
+        mesh->designerAddUser();
+    }
 }
 
 /*!
@@ -116,6 +136,7 @@ VasnecovProduct::VasnecovProduct(QMutex *mutex, VasnecovPipeline *pipeline, std:
     VasnecovElement(mutex, pipeline, name),
     raw_M1(),
     raw_ownVisible(true),
+    raw_transforms(0),
 
     m_type(raw_wasUpdated, Type, ProductTypePart), // т.к. меш может быть только у детали
     m_parent(raw_wasUpdated, Parent, parent),
@@ -128,6 +149,15 @@ VasnecovProduct::VasnecovProduct(QMutex *mutex, VasnecovPipeline *pipeline, std:
     m_drawingBox(raw_wasUpdated, DrawingBox, false)
 {
     init();
+
+    if(mesh)
+    {
+        mesh->designerAddUser();
+    }
+    if(material)
+    {
+        material->designerAddUser();
+    }
 }
 /*!
  \brief
@@ -137,18 +167,20 @@ VasnecovProduct::VasnecovProduct(QMutex *mutex, VasnecovPipeline *pipeline, std:
 VasnecovProduct::~VasnecovProduct()
 {
     /*
-     * Деструктор можно вызывать только в потоке рендеринга.
+     * Удалённые изделия уничтожаются в потоке Vasnecov::Reclaimer, а не в потоке рендеринга.
+     * Ресурсы OpenGL освобождаются заранее в renderReleaseResources, здесь к OpenGL обращаться нельзя.
      *
      * Продукт удаляется из списка родителя извне.
      * Меш не удаляется, т.к. сохраняется для других продуктов на будущее.
      * Материал удаляется извне, если не используется другими продуктами.
      * Дети все убиваются рекурсивно тоже извне.
      */
+    delete raw_transforms;
 }
 
 void VasnecovProduct::setVisible(GLboolean visible)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     designerOwnSetVisible(visible);
 }
@@ -159,14 +191,14 @@ void VasnecovProduct::setPositionFromElement(const VasnecovAbstractElement *elem
 
     if(element)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
         designerUpdateChildrenMatrix();
     }
 }
 
 void VasnecovProduct::switchDrawingBox()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     m_drawingBox.set(!m_drawingBox.raw());
 }
@@ -208,18 +240,11 @@ void VasnecovProduct::designerSetVisibleFromParent(bool visible)
 
 void VasnecovProduct::designerUpdateMatrixMs()
 {
-    QMatrix4x4 newMatrix(raw_M1);
-    newMatrix.translate(raw_coordinates);
-
-    QQuaternion qRot;
-    qRot = raw_qZ * raw_qX * raw_qY;
+    GLfloat local[16];
+    Vasnecov::TransformStore::compose(raw_coordinates, raw_qZ * raw_qX * raw_qY, m_scale.raw(), local);
 
-    newMatrix.rotate(qRot);
-
-    if(m_scale.raw() != 1.0)
-    {
-        newMatrix.scale(m_scale.raw(), m_scale.raw(), m_scale.raw());
-    }
+    QMatrix4x4 newMatrix;
+    Vasnecov::TransformStore::multiply(raw_M1.constData(), local, newMatrix.data());
 
     m_Ms.set(newMatrix);
 }
@@ -253,7 +278,7 @@ GLfloat VasnecovProduct::renderCalculateDistanceToPlane(const QVector3D &planePo
 */
 GLenum VasnecovProduct::renderUpdateData()
 {
-    // Проверка прозрачности
+    // Проверка прозрачности. Текстура с дырами (альфа только 0 и 255) сортировки не требует
     GLboolean transp = false;
     if(m_material.raw() && m_material.raw()->renderTextureD())
     {
@@ -263,7 +288,7 @@ GLenum VasnecovProduct::renderUpdateData()
     {
         transp = true;
     }
-    m_isTransparency.set(transp);
+    m_isTransparency.renderSet(transp);
 
     // Далее, как обычно
     GLenum updated(raw_wasUpdated);
@@ -310,6 +335,7 @@ void VasnecovProduct::renderDraw()
         else
         {
             pure_pipeline->disableTexture2D();
+            pure_pipeline->disableAlphaTest();
             pure_pipeline->setColor(m_color.pure());
         }
 
@@ -392,19 +418,30 @@ GLboolean VasnecovProduct::designerRemoveChild(VasnecovProduct *child)
 std::vector<VasnecovProduct *> VasnecovProduct::designerAllChildren()
 {
     std::vector<VasnecovProduct *> children;
+    designerAllChildren(children);
+
+    return children;
+}
+/*!
+ \brief Дописывает в конец списка всех потомков (в ширину, без рекурсии и промежуточных списков).
+*/
+void VasnecovProduct::designerAllChildren(std::vector<VasnecovProduct *> &children)
+{
+    size_t begin(children.size());
 
     if(m_type.raw() == ProductTypeAssembly)
     {
-        for(std::vector<VasnecovProduct *>::const_iterator cit = m_children.raw().begin();
-            cit != m_children.raw().end(); ++cit)
-        {
-            children.push_back(*cit);
+        children.insert(children.end(), m_children.raw().begin(), m_children.raw().end());
+    }
 
-            std::vector<VasnecovProduct *> grandchildren = (*cit)->designerAllChildren();
-            children.insert(children.end(), grandchildren.begin(), grandchildren.end());
+    for(size_t i = begin; i < children.size(); ++i)
+    {
+        VasnecovProduct *child(children[i]);
+        if(child->m_type.raw() == ProductTypeAssembly)
+        {
+            children.insert(children.end(), child->m_children.raw().begin(), child->m_children.raw().end());
         }
     }
-    return children;
 }
 /*!
  \brief
@@ -416,10 +453,15 @@ void VasnecovProduct::setMaterial(VasnecovMaterial *material)
 {
     if(material)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
-        if(m_type.raw() == ProductTypePart)
+        if(m_type.raw() == ProductTypePart && m_material.raw() != material)
         {
+            material->designerAddUser();
+            if(m_material.raw())
+            {
+                m_material.raw()->designerRemoveUser();
+            }
             m_material.set(material);
         }
     }
@@ -432,7 +474,7 @@ void VasnecovProduct::setMaterial(VasnecovMaterial *material)
 */
 VasnecovMaterial *VasnecovProduct::material() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     VasnecovMaterial * material(m_material.raw());
     return material;
@@ -447,10 +489,15 @@ void VasnecovProduct::setMesh(VasnecovMesh *mesh)
 {
     if(mesh)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
-        if(m_type.raw() == ProductTypePart)
+        if(m_type.raw() == ProductTypePart && m_mesh.raw() != mesh)
         {
+            mesh->designerAddUser();
+            if(m_mesh.raw())
+            {
+                m_mesh.raw()->designerRemoveUser();
+            }
             m_mesh.set(mesh);
         }
     }
@@ -463,7 +510,7 @@ void VasnecovProduct::setMesh(VasnecovMesh *mesh)
 */
 VasnecovMesh *VasnecovProduct::mesh() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     VasnecovMesh *mesh(m_mesh.raw());
     return mesh;
@@ -477,7 +524,7 @@ VasnecovMesh *VasnecovProduct::mesh() const
 */
 GLuint VasnecovProduct::level() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     GLuint level(m_level.raw());
     return level;
@@ -490,7 +537,7 @@ GLuint VasnecovProduct::level() const
 */
 VasnecovProduct::ProductTypes VasnecovProduct::type() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     VasnecovProduct::ProductTypes type(m_type.raw());
     return type;
@@ -504,7 +551,7 @@ VasnecovProduct::ProductTypes VasnecovProduct::type() const
 */
 VasnecovProduct *VasnecovProduct::parent() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     VasnecovProduct *parent(m_parent.raw());
     return parent;
@@ -512,7 +559,13 @@ VasnecovProduct *VasnecovProduct::parent() const
 
 void VasnecovProduct::changeParent(VasnecovProduct *newParent)
 {
-    QMutexLocker locker(mtx_data);
+    if(newParent && newParent->mtx_data != mtx_data)
+    {
+        Vasnecov::problem("Родительский узел принадлежит другому миру");
+        return;
+    }
+
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     if(m_parent.raw())
     {
@@ -537,7 +590,7 @@ void VasnecovProduct::changeParent(VasnecovProduct *newParent)
 */
 std::vector<VasnecovProduct *> VasnecovProduct::children() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     std::vector<VasnecovProduct *> children(m_children.raw());
     return children;
@@ -551,7 +604,7 @@ std::vector<VasnecovProduct *> VasnecovProduct::children() const
 */
 void VasnecovProduct::setColor(const QColor &color)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     if(m_color.raw() != color)
     {
@@ -566,7 +619,7 @@ void VasnecovProduct::setColor(const QColor &color)
 */
 void VasnecovProduct::setCoordinates(const QVector3D &coordinates)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     if(raw_coordinates != coordinates)
     {
@@ -587,7 +640,7 @@ void VasnecovProduct::incrementCoordinates(const QVector3D &increment)
 {
     if(increment.x() != 0.0 || increment.y() != 0.0 || increment.z() != 0.0)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
         raw_coordinates += increment;
 
@@ -603,7 +656,7 @@ void VasnecovProduct::incrementCoordinates(const QVector3D &increment)
 */
 QVector3D VasnecovProduct::globalCoordinates()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     QVector3D coordinates(m_Ms.raw()(0, 3), m_Ms.raw()(1, 3), m_Ms.raw()(2, 3));
     return coordinates;
@@ -617,7 +670,7 @@ QVector3D VasnecovProduct::globalCoordinates()
 */
 void VasnecovProduct::setAngles(const QVector3D &angles)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     if(raw_angles != angles)
     {
@@ -660,7 +713,7 @@ void VasnecovProduct::incrementAngles(const QVector3D &increment)
 {
     if(increment.x() != 0.0 || increment.y() != 0.0 || increment.z() != 0.0)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
         GLenum rotate(0);
 
@@ -699,7 +752,7 @@ void VasnecovProduct::incrementAngles(const QVector3D &increment)
 */
 void VasnecovProduct::setScale(GLfloat scale)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerProduct);
 
     if(m_scale.set(scale))
     {
@@ -743,7 +796,11 @@ void VasnecovProduct::designerSetColorRecursively(const QColor &color)
     }
     if(m_type.raw() == ProductTypePart && m_material.raw())
     {
-        m_material.raw()->designerSetAmbientAndDiffuseColor(color);
+        // Материалы общие для всех миров и защищены мьютексом Вселенной
+        VasnecovMaterial *material(m_material.raw());
+        Vasnecov::StatsLocker locker(material->mtx_data, Vasnecov::SyncStats::LockDesignerMaterial);
+
+        material->designerSetAmbientAndDiffuseColor(color);
     }
 }
 /*!
@@ -753,16 +810,61 @@ void VasnecovProduct::designerSetColorRecursively(const QColor &color)
 */
 void VasnecovProduct::designerUpdateChildrenMatrix()
 {
-    if(!m_children.raw().empty())
+    if(m_children.raw().empty())
     {
-        for(std::vector<VasnecovProduct *>::const_iterator cit = m_children.raw().begin();
-            cit != m_children.raw().end();
+        return;
+    }
+
+    // Всё поддерево собирается в хранилище трансформаций в порядке обхода в ширину (родитель раньше детей),
+    // матрицы считаются одним пакетом и раскладываются обратно по элементам.
+    // Матрица преобразований элемента передается дочерним в качестве матрицы начальных преобразований.
+    // Хранилище принадлежит корню дерева (дерево - в одном домене блокировки) и переиспользуется между вызовами,
+    // поэтому после первого пересчёта память не выделяется
+    VasnecovProduct *root(this);
+    while(root->m_parent.raw())
+    {
+        root = root->m_parent.raw();
+    }
+    if(!root->raw_transforms)
+    {
+        root->raw_transforms = new TransformWorkspace();
+    }
+
+    std::vector<VasnecovProduct *> &nodes(root->raw_transforms->nodes);
+    nodes.clear();
+    nodes.push_back(this);
+
+    Vasnecov::TransformStore &store(root->raw_transforms->store);
+    store.clear();
+    store.addFixed(m_Ms.raw());
+
+    for(size_t i = 0; i < nodes.size(); ++i)
+    {
+        const std::vector<VasnecovProduct *> &children(nodes[i]->m_children.raw());
+        for(std::vector<VasnecovProduct *>::const_iterator cit = children.begin();
+            cit != children.end();
             ++cit)
         {
-            // Матрица преобразований элемента передается дочерним в качестве матрицы начальных преобразований
-            (*cit)->designerSetMatrixM1Recursively(m_Ms.raw());
+            VasnecovProduct *child(*cit);
+            store.add(child->raw_coordinates,
+                      child->raw_qZ * child->raw_qX * child->raw_qY,
+                      child->m_scale.raw(),
+                      static_cast<Vasnecov::TransformStore::Handle>(i));
+            nodes.push_back(child);
         }
     }
+
+    store.update();
+
+    QMatrix4x4 matrix;
+    for(size_t i = 1; i < nodes.size(); ++i)
+    {
+        Vasnecov::TransformStore::Handle handle(static_cast<Vasnecov::TransformStore::Handle>(i));
+
+        store.worldMatrix(store.parent(handle), nodes[i]->raw_M1);
+        store.worldMatrix(handle, matrix);
+        nodes[i]->m_Ms.set(matrix);
+    }
 }
 
 /*!
@@ -109,8 +109,10 @@ protected:
     GLboolean designerAddChild(VasnecovProduct *child); // Добавить дочерний элемент, параметром передается индекс элемента
     GLboolean designerRemoveChild(VasnecovProduct *child);
     std::vector<VasnecovProduct *> designerAllChildren(); // Возвращает общий список всех детей
+    void designerAllChildren(std::vector<VasnecovProduct *> &children);
     VasnecovProduct *designerParent() const;
     VasnecovMaterial *designerMaterial() const;
+    VasnecovMesh *designerMesh() const;
 
     void designerSetMatrixM1(const QMatrix4x4 &M1);
 
@@ -139,8 +141,11 @@ protected:
     const std::vector<VasnecovProduct *> *renderChildren() const;
 
 protected:
+    struct TransformWorkspace; // Хранилище трансформаций и порядок обхода поддерева
+
     QMatrix4x4 raw_M1; // Матрица родительских трансформаций
     bool raw_ownVisible;
+    TransformWorkspace *raw_transforms; // Только у корня дерева, создаётся при первом пересчёте поддерева
 
     Vasnecov::MutualData<ProductTypes> m_type; // тип: узел, деталь
     Vasnecov::MutualData<VasnecovProduct *> m_parent; // Индекс родительского элемента (если уровень больше нуля, иначе 0)
@@ -203,6 +208,10 @@ inline VasnecovMaterial *VasnecovProduct::designerMaterial() const
 {
     return m_material.raw();
 }
+inline VasnecovMesh *VasnecovProduct::designerMesh() const
+{
+    return m_mesh.raw();
+}
 
 inline void VasnecovProduct::designerUpdateMatrixM1(const QMatrix4x4 &M1)
 {
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "vasnecovtext.h"
+#include <QStringList>
+#include <QMatrix4x4>
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+/*!
+  \class VasnecovText
+  \brief Текстовая метка на атласе глифов (Vasnecov::GlyphAtlas).
+
+  Смена текста только перестраивает список прямоугольников глифов в фазе обновления данных: строка не
+  растеризуется и текстура не создаётся. Новые глифы растеризуются один раз на весь шрифт. Прямоугольники
+  меток собираются \a Vasnecov::LabelBatcher в общий пакет атласа.
+ */
+
+VasnecovText::VasnecovText(QMutex *mutex, VasnecovPipeline *pipeline, const std::string &name,
+                           Vasnecov::GlyphAtlas *glyphs, GLfloat height) :
+    VasnecovLabel(mutex, pipeline, name, QVector2D()),
+    m_glyphs(glyphs),
+    m_text(raw_wasUpdated, Text),
+    m_textHeight(raw_wasUpdated, TextHeight, height)
+{
+    m_vertices.clear();
+    m_textures.clear();
+    m_indices.clear();
+}
+
+VasnecovText::~VasnecovText()
+{
+}
+
+void VasnecovText::setText(const QString &text)
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLabel);
+
+    m_text.set(text);
+}
+
+QString VasnecovText::text() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLabel);
+
+    return m_text.raw();
+}
+
+void VasnecovText::setTextHeight(GLfloat height)
+{
+    if(height > 0.0f)
+    {
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLabel);
+
+        m_textHeight.set(height);
+    }
+}
+
+GLfloat VasnecovText::textHeight() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerLabel);
+
+    return m_textHeight.raw();
+}
+
+GLenum VasnecovText::renderUpdateData()
+{
+    GLenum updated(0);
+
+    if(raw_wasUpdated)
+    {
+        updated |= m_text.update();
+        updated |= m_textHeight.update();
+
+        if(updated)
+        {
+            renderBuildQuads();
+        }
+    }
+
+    updated |= VasnecovLabel::renderUpdateData();
+
+    return updated;
+}
+
+/*!
+ \brief Прямоугольники глифов относительно центра метки, в пикселях.
+*/
+void VasnecovText::renderBuildQuads()
+{
+    m_vertices.clear();
+    m_textures.clear();
+    m_indices.clear();
+
+    const QString &text(m_text.pure());
+    if(text.isEmpty() || !m_glyphs)
+    {
+        renderUpdateBounds();
+        return;
+    }
+
+    const GLfloat scale(m_textHeight.pure());
+    const GLfloat lineStep(m_glyphs->renderLineSpacing() * scale);
+    const QStringList lines(text.split('\n'));
+
+    // Базовая линия первой строки - так, чтобы блок строк был по центру
+    GLfloat baseline(lines.size() * lineStep * 0.5f - m_glyphs->renderAscent() * scale);
+
+    for(QStringList::const_iterator line = lines.begin(); line != lines.end(); ++line, baseline -= lineStep)
+    {
+        GLfloat width(0.0f);
+        for(QString::const_iterator ch = line->begin(); ch != line->end(); ++ch)
+        {
+            width += m_glyphs->renderGlyph(*ch).advance;
+        }
+
+        GLfloat pen(-width * scale * 0.5f);
+        for(QString::const_iterator ch = line->begin(); ch != line->end(); ++ch)
+        {
+            const Vasnecov::GlyphAtlas::Glyph &glyph(m_glyphs->renderGlyph(*ch));
+            if(glyph.visible)
+            {
+                const QVector2D low(pen + glyph.quadMin.x() * scale, baseline + glyph.quadMin.y() * scale);
+                const QVector2D high(pen + glyph.quadMax.x() * scale, baseline + glyph.quadMax.y() * scale);
+                const GLuint base(static_cast<GLuint>(m_vertices.size()));
+
+                m_vertices.push_back(QVector3D(low.x(), low.y(), 0.0f));
+                m_vertices.push_back(QVector3D(high.x(), low.y(), 0.0f));
+                m_vertices.push_back(QVector3D(high.x(), high.y(), 0.0f));
+                m_vertices.push_back(QVector3D(low.x(), high.y(), 0.0f));
+
+                m_textures.push_back(glyph.textureMin);
+                m_textures.push_back(QVector2D(glyph.textureMax.x(), glyph.textureMin.y()));
+                m_textures.push_back(glyph.textureMax);
+                m_textures.push_back(QVector2D(glyph.textureMin.x(), glyph.textureMax.y()));
+
+                const GLuint quad[6] = {0, 1, 2, 2, 3, 0};
+                for(GLuint i = 0; i < 6; ++i)
+                {
+                    m_indices.push_back(base + quad[i]);
+                }
+            }
+            pen += glyph.advance * scale;
+        }
+    }
+
+    renderUpdateBounds();
+}
+
+void VasnecovText::renderDraw()
+{
+    if(m_isHidden.pure() || m_vertices.empty() || !renderAtlasTexture())
+    {
+        return;
+    }
+
+    if(m_alienMs.pure())
+    {
+        pure_pipeline->setMatrixOrtho2D(m_Ms.pure() * (*m_alienMs.pure()));
+    }
+    else
+    {
+        pure_pipeline->setMatrixOrtho2D(m_Ms.pure());
+    }
+
+    QColor color(m_color.pure());
+    color.setAlpha(255);
+    pure_pipeline->setColor(color);
+    pure_pipeline->enableTexture2D(renderAtlasTexture());
+    pure_pipeline->enableAlphaTest(Vasnecov::cfg_glyphSdfThreshold);
+
+    pure_pipeline->drawElements(VasnecovPipeline::Triangles, &m_indices, &m_vertices, 0, &m_textures);
+
+    pure_pipeline->disableAlphaTest();
+}
+
+GLboolean VasnecovText::renderPrepareAtlas()
+{
+    // Пустой текст пакет не прерывает
+    return m_vertices.empty() || renderAtlasTexture() != 0;
+}
+
+GLuint VasnecovText::renderAtlasTexture() const
+{
+    return m_glyphs ? m_glyphs->textureId() : 0;
+}
+
+void VasnecovText::renderFillBatch(QVector3D *vertices, QVector2D *textures, GLubyte *colors)
+{
+    VasnecovLabel::renderFillBatch(vertices, textures, colors);
+
+    for(GLuint i = 0; i < m_vertices.size(); ++i)
+    {
+        colors[i*4 + 3] = 255;
+    }
+}
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Текстовая метка. Глифы из общего атласа шрифта, без растеризации строк
+#ifndef VASNECOVTEXT_H
+#define VASNECOVTEXT_H
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#include <QString>
+#include "configuration.h"
+#include "vasnecovlabel.h"
+#include "glyphatlas.h"
+#ifndef _MSC_VER
+    #pragma GCC diagnostic warning "-Weffc++"
+#endif
+
+// Текст выравнивается по центру метки, строки разделяются '\n'.
+// Контур глифов отсекается тестом альфы, поэтому цвет текста всегда непрозрачный
+class VasnecovText : public VasnecovLabel
+{
+public:
+    VasnecovText(QMutex *mutex,
+                 VasnecovPipeline *pipeline,
+                 const std::string &name,
+                 Vasnecov::GlyphAtlas *glyphs,
+                 GLfloat height = Vasnecov::cfg_textHeightDefault);
+    ~VasnecovText();
+
+    void setText(const QString &text);
+    QString text() const;
+    void setTextHeight(GLfloat height); // Размер шрифта, пикс
+    GLfloat textHeight() const;
+
+protected:
+    GLenum renderUpdateData();
+    void renderDraw();
+
+    GLboolean renderPrepareAtlas();
+    GLuint renderAtlasTexture() const;
+    GLboolean renderDistanceField() const {return true;}
+    void renderFillBatch(QVector3D *vertices, QVector2D *textures, GLubyte *colors);
+
+    void renderBuildQuads();
+
+protected:
+    Vasnecov::GlyphAtlas *const m_glyphs;
+    Vasnecov::MutualData<QString> m_text;
+    Vasnecov::MutualData<GLfloat> m_textHeight;
+
+    enum Updated
+    {
+        Text		= 0x2000,
+        TextHeight	= 0x4000
+    };
+
+    friend class VasnecovUniverse;
+
+private:
+    Q_DISABLE_COPY(VasnecovText)
+};
+
+#ifndef _MSC_VER
+    #pragma GCC diagnostic ignored "-Weffc++"
+#endif
+#endif // VASNECOVTEXT_H
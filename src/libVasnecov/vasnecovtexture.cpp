@@ -8,11 +8,40 @@
  */
 
 #include "vasnecovtexture.h"
+#include <cstring>
+#include <QAtomicInt>
 #include <QImage>
-#include <GL/glu.h>
+#include "mipchain.h"
+#include "texturefile.h"
 #include "technologist.h"
 #pragma GCC diagnostic warning "-Weffc++"
 
+namespace
+{
+    enum NpotSupport
+    {
+        NpotUnknown = 0, // Контекст ещё не создан
+        NpotNative,
+        NpotResample
+    };
+    QAtomicInt npotSupport(NpotUnknown); // Задаётся при инициализации отрисовки, читается потоками загрузки
+
+    inline GLsizei nextPowerOfTwo(GLsizei size)
+    {
+        GLsizei res(1);
+        while(res < size)
+        {
+            res <<= 1;
+        }
+        return res;
+    }
+    inline GLsizei nearestPowerOfTwo(GLsizei size)
+    {
+        const GLsizei upper(nextPowerOfTwo(size));
+        return (upper - size > size - upper / 2) ? upper / 2 : upper;
+    }
+}
+
 /*!
  \brief
 
@@ -20,10 +49,16 @@
  \param image
 */
 VasnecovTexture::VasnecovTexture(QImage *image):
+    Vasnecov::Resource(),
     m_id(0),
     m_image(image),
     m_width(0),	m_height(0),
-    m_isTransparency(false)
+    m_alpha(Vasnecov::TextureAlphaOpaque),
+    m_resampled(false),
+    m_gpuBytes(0),
+    m_used(false),
+    m_lastUsed(0),
+    m_residency(Resident)
 {
 }
 
@@ -38,6 +73,70 @@ VasnecovTexture::~VasnecovTexture()
     {
         glDeleteTextures(1, &m_id);
     }
+    delete m_image; // Картинка, так и не загруженная в текстуру (например, размещённая в атласе меток)
+}
+
+/*!
+ \brief Объём данных для передачи в OpenGL, по нему поток отрисовки соблюдает бюджет загрузки кадра.
+*/
+size_t VasnecovTexture::uploadSize() const
+{
+    if(m_image)
+    {
+        return static_cast<size_t>(m_image->width()) * m_image->height() * 4;
+    }
+    return 0;
+}
+
+/*!
+ \brief Сколько видеопамяти заняла бы текстура, если бы её стороны дополнялись до степени двойки, минус занятое.
+
+ Уровни детализации меняются в той же пропорции, поэтому пересчитывается весь объём.
+*/
+size_t VasnecovTexture::paddingSaved() const
+{
+    if(m_resampled || !m_width || !m_height || isPowerOfTwo(m_width, m_height))
+    {
+        return 0;
+    }
+
+    const double padded(static_cast<double>(nextPowerOfTwo(m_width)) * nextPowerOfTwo(m_height));
+    const double area(static_cast<double>(m_width) * m_height);
+    return static_cast<size_t>(m_gpuBytes * padded / area) - m_gpuBytes;
+}
+
+void VasnecovTexture::renderInitialize(const QString &version, const QString &extensions)
+{
+    const GLint major(version.left(version.indexOf(".")).toInt());
+    if(major >= 2 || extensions.contains("GL_ARB_texture_non_power_of_two"))
+    {
+        npotSupport.storeRelease(NpotNative);
+    }
+    else
+    {
+        npotSupport.storeRelease(NpotResample);
+    }
+}
+
+GLboolean VasnecovTexture::isSizeSupported(GLsizei width, GLsizei height)
+{
+    return isPowerOfTwo(width, height) || npotSupport.loadAcquire() != NpotResample;
+}
+
+GLboolean VasnecovTexture::isPowerOfTwo(GLsizei width, GLsizei height)
+{
+    return (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+}
+
+/*!
+ \brief Картинка, приведённая к ближайшим степеням двойки по каждой стороне (не обязательно бОльшим).
+*/
+QImage VasnecovTexture::toPowerOfTwo(const QImage &image)
+{
+    const QImage scaled(image.scaled(nearestPowerOfTwo(image.width()), nearestPowerOfTwo(image.height()),
+                                     Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    // Сглаживание выдаёт картинку с умноженной на альфу яркостью, а в OpenGL уходят точки как есть
+    return scaled.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -49,9 +148,80 @@ VasnecovTexture::~VasnecovTexture()
  \param image
 */
 VasnecovTextureDiffuse::VasnecovTextureDiffuse(QImage *image) :
-    VasnecovTexture(image)
+    VasnecovTexture(image),
+    m_mipmaps(0),
+    m_file(0),
+    m_source(),
+    m_sourceBaked(false),
+    m_levelsCount(0),
+    m_placeholder()
+{
+}
+
+VasnecovTextureDiffuse::VasnecovTextureDiffuse(Vasnecov::TextureFile *file) :
+    VasnecovTexture(0),
+    m_mipmaps(0),
+    m_file(file),
+    m_source(),
+    m_sourceBaked(false),
+    m_levelsCount(0),
+    m_placeholder()
+{
+}
+
+VasnecovTextureDiffuse::~VasnecovTextureDiffuse()
 {
+    delete m_mipmaps;
+    delete m_file;
+}
+
+/*!
+ \brief Построение уровней детализации из картинки. Картинка после этого не нужна и удаляется.
+
+ Вызывается без OpenGL-контекста, в потоке загрузки: в потоке отрисовки остаётся только передача уровней.
+ Если контекст не поддерживает стороны не степени двойки, картинка сначала приводится к степеням двойки.
+ Пока контекст не создан, это неизвестно: тогда уровни перестраиваются при передаче, в потоке отрисовки.
+*/
+void VasnecovTextureDiffuse::prepareMipmaps()
+{
+    // Готовые уровни файла в таком случае не годятся, файл заменяется своей картинкой
+    if(m_file && m_file->isValid() &&
+       !isSizeSupported(m_file->levels().front().width, m_file->levels().front().height))
+    {
+        delete m_image;
+        m_image = new QImage(m_file->image());
+        delete m_file;
+        m_file = 0;
+    }
+    if(m_mipmaps && m_mipmaps->levelsCount() &&
+       !isSizeSupported(m_mipmaps->levelWidth(0), m_mipmaps->levelHeight(0)))
+    {
+        const QImage base(m_mipmaps->base());
+        m_mipmaps->build(toPowerOfTwo(base));
+        m_resampled = true;
+        return;
+    }
+
+    if(m_mipmaps || !m_image || m_image->isNull())
+    {
+        return;
+    }
+
+    m_mipmaps = new Vasnecov::MipChain();
+    if(isSizeSupported(m_image->width(), m_image->height()))
+    {
+        m_mipmaps->build(*m_image);
+    }
+    else
+    {
+        m_mipmaps->build(toPowerOfTwo(*m_image));
+        m_resampled = true;
+    }
+
+    delete m_image;
+    m_image = 0;
 }
+
 /*!
  \brief
 
@@ -60,30 +230,45 @@ VasnecovTextureDiffuse::VasnecovTextureDiffuse(QImage *image) :
 */
 GLboolean VasnecovTextureDiffuse::loadImage()
 {
-    if(m_image && !m_image->isNull())
+    // Неподготовленная заранее текстура получает уровни здесь же
+    prepareMipmaps();
+
+    if(m_file)
     {
-        m_width = m_image->width();
-        m_height = m_image->height();
+        return loadFile();
+    }
 
-        // Создание и инициализация текстуры
-        glGenTextures(1, &m_id);
-        glBindTexture(GL_TEXTURE_2D, m_id);
+    if(m_mipmaps && m_mipmaps->levelsCount())
+    {
+        m_width = m_mipmaps->levelWidth(0);
+        m_height = m_mipmaps->levelHeight(0);
+        m_alpha = m_mipmaps->alpha();
 
-        if(m_image->hasAlphaChannel())
+        // Создание и инициализация текстуры (после вытеснения имя остаётся прежним)
+        if(!m_id)
         {
-            m_isTransparency = true;
-            gluBuild2DMipmaps(GL_TEXTURE_2D, 4, m_width, m_height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, m_image->bits());
+            glGenTextures(1, &m_id);
         }
-        else
+        glBindTexture(GL_TEXTURE_2D, m_id);
+
+        const GLint components(m_alpha != Vasnecov::TextureAlphaOpaque ? 4 : 3);
+        for(GLuint level = 0; level < m_mipmaps->levelsCount(); ++level)
         {
-            gluBuild2DMipmaps(GL_TEXTURE_2D, 3, m_width, m_height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, m_image->bits());
+            glTexImage2D(GL_TEXTURE_2D, level, components,
+                         m_mipmaps->levelWidth(level), m_mipmaps->levelHeight(level), 0,
+                         GL_BGRA_EXT, GL_UNSIGNED_BYTE, m_mipmaps->levelBits(level));
         }
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        delete m_image;
-        m_image = 0;
+        m_levelsCount = m_mipmaps->levelsCount();
+        m_gpuBytes = m_mipmaps->bytes();
+        memcpy(m_placeholder, m_mipmaps->levelBits(m_levelsCount - 1), sizeof(m_placeholder)); // Уровень 1x1
+        m_residency = Resident;
+
+        delete m_mipmaps;
+        m_mipmaps = 0;
 
         return m_id;
     }
@@ -92,6 +277,123 @@ GLboolean VasnecovTextureDiffuse::loadImage()
     return 0;
 }
 
+/*!
+ \brief Передача уровней из отображённого в память файла. Файл после этого закрывается.
+*/
+GLboolean VasnecovTextureDiffuse::loadFile()
+{
+    if(m_file->isValid())
+    {
+        m_width = m_file->levels().front().width;
+        m_height = m_file->levels().front().height;
+        m_alpha = m_file->alpha();
+
+        if(!m_id)
+        {
+            glGenTextures(1, &m_id);
+        }
+        glBindTexture(GL_TEXTURE_2D, m_id);
+
+        m_file->upload();
+
+        // Неполная цепочка уровней не годится для фильтрации по уровням
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, m_file->isMipmapComplete() ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        m_levelsCount = static_cast<GLuint>(m_file->levels().size());
+        m_gpuBytes = m_file->gpuBytes();
+        m_file->averageColor(m_placeholder);
+        m_residency = Resident;
+    }
+    else
+    {
+        Vasnecov::problem("Текстура не может быть загружена: ", m_file->fileName());
+    }
+
+    delete m_file;
+    m_file = 0;
+
+    return m_id;
+}
+
+void VasnecovTextureDiffuse::setSource(const std::string &path, GLboolean baked)
+{
+    m_source = path;
+    m_sourceBaked = baked;
+}
+
+/*!
+ \brief Освобождение видеопамяти текстуры. Имя сохраняется, вместо уровней - одна точка среднего цвета.
+
+ Уровни, начиная с первого, задаются нулевого размера: так драйвер освобождает их память.
+*/
+void VasnecovTextureDiffuse::renderEvict()
+{
+    if(!m_id || m_residency != Resident)
+    {
+        return;
+    }
+
+    const GLint components(m_alpha != Vasnecov::TextureAlphaOpaque ? 4 : 3);
+
+    glBindTexture(GL_TEXTURE_2D, m_id);
+    glTexImage2D(GL_TEXTURE_2D, 0, components, 1, 1, 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, m_placeholder);
+    for(GLuint level = 1; level < m_levelsCount; ++level)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, components, 0, 0, 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, 0);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+    m_gpuBytes = sizeof(m_placeholder);
+    m_residency = Evicted;
+}
+
+/*!
+ \brief Чтение источника для повторной загрузки. Без OpenGL, в фоновом потоке.
+*/
+void VasnecovTextureDiffuse::prepareReload()
+{
+    if(m_sourceBaked)
+    {
+        Vasnecov::TextureFile *file(new Vasnecov::TextureFile(m_source));
+        if(file->isValid())
+        {
+            m_file = file;
+        }
+        else
+        {
+            delete file;
+        }
+    }
+    else
+    {
+        QImage *image(new QImage(QString::fromStdString(m_source)));
+        if(!image->isNull())
+        {
+            m_image = image;
+        }
+        else
+        {
+            delete image;
+        }
+    }
+    prepareMipmaps();
+}
+
+size_t VasnecovTextureDiffuse::uploadSize() const
+{
+    if(m_file)
+    {
+        return m_file->bytes();
+    }
+    if(m_mipmaps)
+    {
+        return m_mipmaps->bytes();
+    }
+    // Уровни детализации добавляют примерно треть
+    return VasnecovTexture::uploadSize() * 4 / 3;
+}
+
 //--------------------------------------------------------------------------------------------------
 
 /*!
@@ -114,26 +416,38 @@ GLboolean VasnecovTextureInterface::loadImage()
 {
     if(m_image && !m_image->isNull())
     {
+        // Размер остаётся размером картинки: по нему считаются зоны текстуры, приведение их не меняет
         m_width = m_image->width();
         m_height = m_image->height();
 
+        QImage resampled;
+        const QImage *upload(m_image);
+        if(!isSizeSupported(m_width, m_height))
+        {
+            resampled = toPowerOfTwo(*m_image);
+            upload = &resampled;
+            m_resampled = true;
+        }
+
         // Создание и инициализация текстуры
         glGenTextures(1, &m_id);
         glBindTexture(GL_TEXTURE_2D, m_id);
 
         if(m_image->hasAlphaChannel())
         {
-            m_isTransparency = true;
-            glTexImage2D(GL_TEXTURE_2D, 0, 4, m_width, m_height, 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, m_image->bits());
+            m_alpha = Vasnecov::TextureAlphaBlended;
+            glTexImage2D(GL_TEXTURE_2D, 0, 4, upload->width(), upload->height(), 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, upload->bits());
         }
         else
         {
-            glTexImage2D(GL_TEXTURE_2D, 0, 3, m_width, m_height, 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, m_image->bits());
+            glTexImage2D(GL_TEXTURE_2D, 0, 3, upload->width(), upload->height(), 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, upload->bits());
         }
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+        m_gpuBytes = static_cast<size_t>(upload->width()) * upload->height() * 4;
+
         // После загрузки класс сам удаляет более ненужный QImage
         delete m_image;
         m_image = 0;
@@ -145,6 +459,59 @@ GLboolean VasnecovTextureInterface::loadImage()
     return 0;
 }
 
+/*!
+ \brief Замена картинки без пересоздания текстуры.
+
+ Загруженная текстура обновляется через glTexSubImage2D, незагруженная просто получает новую картинку.
+ Размер и наличие прозрачности должны совпадать с прежними, иначе замена не выполняется.
+
+ \return true, если картинка принята (тогда ею владеет текстура)
+*/
+GLboolean VasnecovTextureInterface::replaceImage(QImage *image)
+{
+    if(!image || image->isNull())
+    {
+        return false;
+    }
+
+    if(m_id)
+    {
+        if(image->width() != m_width || image->height() != m_height ||
+           image->hasAlphaChannel() != (m_alpha != Vasnecov::TextureAlphaOpaque))
+        {
+            return false;
+        }
+
+        // Привязка текстуры возвращается прежней, т.к. конвейер её запоминает
+        GLint bound(0);
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+
+        glBindTexture(GL_TEXTURE_2D, m_id);
+        if(m_resampled)
+        {
+            const QImage resampled(toPowerOfTwo(*image));
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resampled.width(), resampled.height(), GL_BGRA_EXT, GL_UNSIGNED_BYTE, resampled.bits());
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_width, m_height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, image->bits());
+        }
+        glBindTexture(GL_TEXTURE_2D, bound);
+
+        delete image;
+        return true;
+    }
+
+    if(m_image && m_image->size() == image->size())
+    {
+        delete m_image;
+        m_image = image;
+        return true;
+    }
+
+    return false;
+}
+
 //--------------------------------------------------------------------------------------------------
 
 /*!
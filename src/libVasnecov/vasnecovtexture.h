@@ -14,33 +14,78 @@
 #ifndef _MSC_VER
     #pragma GCC diagnostic ignored "-Weffc++"
 #endif
+#include <string>
 #include "types.h"
+#include "resource.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
 
 class QImage;
+class QString;
+namespace Vasnecov
+{
+    class MipChain;
+    class TextureFile;
+    class TextureResidency;
+}
 
-class VasnecovTexture
+class VasnecovTexture : public Vasnecov::Resource
 {
 public:
     explicit VasnecovTexture(QImage *image);
     virtual ~VasnecovTexture();
     virtual GLboolean loadImage() = 0; // Загрузка данных из файла
+    virtual size_t uploadSize() const; // Объём, передаваемый в OpenGL при loadImage
 
     void setImage(QImage *image);
 
     GLuint id() const;
+    GLuint takeId(); // Отказ от владения именем OpenGL (деструктор его уже не освободит)
     const QImage *image() const;
     GLsizei width() const {return m_width;}
     GLsizei height() const {return m_height;}
-    GLboolean isTransparency() const;
+    GLboolean isTransparency() const; // Нужно смешивание (и сортировка)
+    GLboolean isAlphaTested() const; // Достаточно отбрасывания фрагментов
+    Vasnecov::TextureAlpha alpha() const {return m_alpha;}
+
+    // Учёт видеопамяти и вытеснение (см. Vasnecov::TextureResidency). Только поток отрисовки
+    enum Residency
+    {
+        Resident,
+        Evicted, // Вместо данных - одна точка среднего цвета
+        Reloading
+    };
+    GLuint renderUse(); // Отметка использования в кадре, возврат - имя текстуры для привязки
+    size_t gpuBytes() const {return m_gpuBytes;}
+    Residency residency() const {return m_residency;}
+    virtual GLboolean isEvictable() const {return false;}
+    virtual void renderEvict() {}
+    virtual void prepareReload() {} // Вызывается в фоновом потоке: чтение данных для повторной загрузки
+
+    // Стороны не степени двойки. Без их поддержки картинка приводится к ближайшим степеням двойки
+    GLboolean isResampled() const {return m_resampled;}
+    size_t paddingSaved() const; // Экономия видеопамяти против дополнения сторон до степени двойки
+
+    // Поддержка сторон не степени двойки: OpenGL 2.0 или GL_ARB_texture_non_power_of_two
+    static void renderInitialize(const QString &version, const QString &extensions);
+    static GLboolean isSizeSupported(GLsizei width, GLsizei height); // До инициализации - любые
+    static GLboolean isPowerOfTwo(GLsizei width, GLsizei height);
+    static QImage toPowerOfTwo(const QImage &image);
 
 protected:
     GLuint m_id;
     QImage *m_image;
     GLsizei m_width, m_height;
-    GLboolean m_isTransparency;
+    Vasnecov::TextureAlpha m_alpha;
+    GLboolean m_resampled;
+
+    size_t m_gpuBytes; // С уровнями детализации
+    GLboolean m_used;
+    quint64 m_lastUsed; // Кадр последнего использования
+    Residency m_residency;
+
+    friend class Vasnecov::TextureResidency;
 
 private:
     Q_DISABLE_COPY(VasnecovTexture)
@@ -51,7 +96,33 @@ class VasnecovTextureDiffuse : public VasnecovTexture
 {
 public:
     explicit VasnecovTextureDiffuse(QImage *image);
+    explicit VasnecovTextureDiffuse(Vasnecov::TextureFile *file); // Подготовленная текстура, уровни уже есть
+    ~VasnecovTextureDiffuse();
     GLboolean loadImage();
+    size_t uploadSize() const;
+
+    void prepareMipmaps(); // Вызывается в потоке загрузки, до передачи текстуры потоку отрисовки
+
+    // Файл, из которого текстура перечитывается после вытеснения. Без него текстура не вытесняется
+    void setSource(const std::string &path, GLboolean baked);
+    GLboolean isEvictable() const {return !m_source.empty();}
+    void renderEvict();
+    void prepareReload();
+
+protected:
+    GLboolean loadFile();
+
+protected:
+    Vasnecov::MipChain *m_mipmaps;
+    Vasnecov::TextureFile *m_file;
+
+    std::string m_source;
+    GLboolean m_sourceBaked; // Источник - подготовленный файл (Vasnecov::TextureFile), иначе картинка
+    GLuint m_levelsCount;
+    GLubyte m_placeholder[4]; // Средний цвет (B, G, R, A) на время вытеснения
+
+private:
+    Q_DISABLE_COPY(VasnecovTextureDiffuse)
 };
 
 
@@ -60,6 +131,7 @@ class VasnecovTextureInterface : public VasnecovTexture
 public:
     explicit VasnecovTextureInterface(QImage *image);
     GLboolean loadImage();
+    GLboolean replaceImage(QImage *image); // Замена картинки того же размера без пересоздания текстуры
 };
 
 class VasnecovTextureNormal : public VasnecovTextureInterface // Карта нормалей. Когда-нибудь я её наконец-то реализую
@@ -78,13 +150,28 @@ inline GLuint VasnecovTexture::id() const
 {
     return m_id;
 }
+inline GLuint VasnecovTexture::takeId()
+{
+    GLuint id(m_id);
+    m_id = 0;
+    return id;
+}
 inline const QImage *VasnecovTexture::image() const
 {
     return m_image;
 }
 inline GLboolean VasnecovTexture::isTransparency() const
 {
-    return m_isTransparency;
+    return m_alpha == Vasnecov::TextureAlphaBlended;
+}
+inline GLboolean VasnecovTexture::isAlphaTested() const
+{
+    return m_alpha == Vasnecov::TextureAlphaTested;
+}
+inline GLuint VasnecovTexture::renderUse()
+{
+    m_used = true;
+    return m_id;
 }
 
 #ifndef _MSC_VER
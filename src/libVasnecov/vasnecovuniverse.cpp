@@ -8,14 +8,17 @@
  */
 
 #include "vasnecovuniverse.h"
+#include <set>
+#include <algorithm>
 #include <QFile>
 #include <QDir>
-#include <QDirIterator>
+#include <QFileInfo>
 #ifdef _MSC_VER
     #include <windows.h>
 #endif
 #include <GL/glu.h>
 #include "vasnecovmesh.h"
+#include "texturefile.h"
 #include "bmcl/Logging.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
@@ -38,6 +41,11 @@ VasnecovUniverse::VasnecovUniverse(const QGLContext *context) :
     m_pipeline(),
     m_context(raw_data.wasUpdated, Context, context),
     m_backgroundColor(raw_data.wasUpdated, BackColor, QColor(0, 0, 0, 255)),
+    m_jobWorkers(raw_data.wasUpdated, JobWorkers, Vasnecov::JobScheduler::defaultWorkersCount()),
+    m_textureBudget(raw_data.wasUpdated, TextureBudget, Vasnecov::cfg_textureMemoryBudget),
+    m_unloadDelay(raw_data.wasUpdated, UnloadDelay, Vasnecov::cfg_resourcesUnloadDelay),
+    m_unloadTimer(),
+    m_unloadCheckedAt(0),
 
     m_width(Vasnecov::cfg_displayWidthDefault),
     m_height(Vasnecov::cfg_displayHeightDefault),
@@ -47,18 +55,34 @@ VasnecovUniverse::VasnecovUniverse(const QGLContext *context) :
     m_loadingImage1(),
     m_loadingImageTimer(Vasnecov::timeDefault()),
     m_lampsCountMax(Vasnecov::cfg_lampsCountMax),
+    m_labelAtlas(&m_pipeline),
+    m_glyphCache(&m_pipeline),
+    m_loadJobs(0),
+    m_meshManifest(Vasnecov::cfg_meshFormat),
+    m_textureManifest(Vasnecov::cfg_textureFormat, Vasnecov::cfg_textureBakedFormat),
 
     raw_data(),
     m_elements(),
+    m_reclaimer(),
+    m_textureResidency(&m_pipeline),
     mtx_data(),
+    mtx_resources(),
+    mtx_loadJobs(),
 
     m_techRenderer(raw_data.wasUpdated, Tech01),
     m_techVersion(raw_data.wasUpdated, Tech02),
     m_techSL(raw_data.wasUpdated, Tech03),
-    m_techExtensions(raw_data.wasUpdated, Tech04)
+    m_techExtensions(raw_data.wasUpdated, Tech04),
+    m_techTextures(raw_data.wasUpdated, Tech05),
+    m_texturesNpot(0),
+    m_texturesResampled(0),
+    m_texturesPaddingSaved(0)
 {
     Q_INIT_RESOURCE(resources);
 
+    raw_data.setUpdateFlag(JobWorkers); // Потоки запускаются в потоке отрисовки
+    m_unloadTimer.start();
+
     if(!m_loadingImage0.load(":/share/loading0.png") ||
        !m_loadingImage1.load(":/share/loading1.png"))
     {
@@ -87,6 +111,10 @@ VasnecovUniverse::VasnecovUniverse(const QGLContext *context) :
 */
 VasnecovUniverse::~VasnecovUniverse()
 {
+    // Ключи содержимого, посчитанные при загрузке отдельных файлов
+    m_meshManifest.save();
+    m_textureManifest.save();
+
     Q_CLEANUP_RESOURCE(resources);
 }
 
@@ -106,9 +134,9 @@ VasnecovWorld *VasnecovUniverse::addWorld(GLint posX, GLint posY, GLsizei width,
     if(width > Vasnecov::cfg_worldWidthMin && width < Vasnecov::cfg_worldWidthMax &&
        height > Vasnecov::cfg_worldHeightMin && height < Vasnecov::cfg_worldHeightMax)
     {
-        VasnecovWorld *newWorld = new VasnecovWorld(&mtx_data, &m_pipeline, posX, posY, width, height);
+        VasnecovWorld *newWorld = new VasnecovWorld(&m_pipeline, posX, posY, width, height);
 
-        QMutexLocker locker(&mtx_data);
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
         m_elements.addElement(newWorld);
 
@@ -136,37 +164,40 @@ VasnecovLamp *VasnecovUniverse::addLamp(const std::string &name, VasnecovWorld *
     }
 
     GLuint index(GL_LIGHT0);
+    VasnecovLamp *lamp(0);
 
-    QMutexLocker locker(&mtx_data);
-
-    // Поиск мира в списке
-    if(!m_elements.findRawElement(world))
-    {
-        Vasnecov::problem("Мир задан неверно");
-        return 0;
-    }
-    size_t count = m_elements.rawLampsCount();
-    if(count < m_lampsCountMax)
+    // Фонарь живёт в домене мира, поэтому мьютекс мира захватывается первым
+    Vasnecov::StatsLocker worldLocker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
     {
-        // Индексы задаются тупо прибавлением. Если какие-то фонари удалялись, то индекс будет неверным.
-        // Но это не страшно, т.к. при обновлении данных в updateData индексы будут переназначены
-        index += count;
-    }
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
-    VasnecovLamp *lamp = new VasnecovLamp(&mtx_data, &m_pipeline, name, type, index);
-    if(m_elements.addElement(lamp))
-    {
-        world->designerAddElement(lamp);
-        return lamp;
-    }
-    else
-    {
-        delete lamp;
-        lamp = 0;
+        // Поиск мира в списке
+        if(!m_elements.findRawElement(world))
+        {
+            Vasnecov::problem("Мир задан неверно");
+            return 0;
+        }
+        size_t count = m_elements.rawLampsCount();
+        if(count < m_lampsCountMax)
+        {
+            // Индексы задаются тупо прибавлением. Если какие-то фонари удалялись, то индекс будет неверным.
+            // Но это не страшно, т.к. при обновлении данных в updateData индексы будут переназначены
+            index += count;
+        }
 
-        Vasnecov::problem("Неверный фонарь либо дублирование данных");
-        return 0;
+        lamp = new VasnecovLamp(world->mtx_data, &m_pipeline, name, type, index);
+        if(!m_elements.addElement(lamp))
+        {
+            delete lamp;
+            lamp = 0;
+
+            Vasnecov::problem("Неверный фонарь либо дублирование данных");
+            return 0;
+        }
     }
+
+    designerAddToWorld(lamp, world);
+    return lamp;
 }
 
 /*!
@@ -191,22 +222,25 @@ VasnecovLamp *VasnecovUniverse::referLampToWorld(VasnecovLamp *lamp, VasnecovWor
         return 0;
     }
 
-    QMutexLocker locker(&mtx_data);
-
-    // Поиск фонаря в общем списке
-    if(!m_elements.findRawElement(lamp))
-    {
-        Vasnecov::problem("Заданный фонарь не найден");
-        return 0;
-    }
-    // Поиск мира в списке
-    if(!m_elements.findRawElement(world))
+    Vasnecov::StatsLocker worldLocker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
     {
-        Vasnecov::problem("Мир задан неверно");
-        return 0;
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+        // Поиск фонаря в общем списке
+        if(!m_elements.findRawElement(lamp))
+        {
+            Vasnecov::problem("Заданный фонарь не найден");
+            return 0;
+        }
+        // Поиск мира в списке
+        if(!m_elements.findRawElement(world))
+        {
+            Vasnecov::problem("Мир задан неверно");
+            return 0;
+        }
     }
 
-    if(world->designerAddElement(lamp, true))
+    if(designerAddToWorld(lamp, world, true))
     {
         return lamp;
     }
@@ -236,19 +270,25 @@ VasnecovProduct *VasnecovUniverse::addAssembly(const std::string &name, Vasnecov
     VasnecovProduct *assembly(0);
     GLuint level(0);
 
-    QMutexLocker locker(&mtx_data);
-
     // Поиск мира в списке
-    if(!m_elements.findRawElement(world))
+    if(!checkWorld(world))
     {
         Vasnecov::problem("Мир задан неверно");
         return 0;
     }
 
+    Vasnecov::StatsLocker worldLocker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+
     if(parent)
     {
         if(world->designerFindElement(parent))
         {
+            // Дерево изделия целиком находится в одном домене блокировки
+            if(parent->mtx_data != world->mtx_data)
+            {
+                Vasnecov::problem("Родительский узел принадлежит другому миру");
+                return 0;
+            }
             level = parent->designerLevel() + 1;
             if(level > Vasnecov::cfg_elementMaxLevel)
             {
@@ -264,15 +304,18 @@ VasnecovProduct *VasnecovUniverse::addAssembly(const std::string &name, Vasnecov
     }
 
     // world && (parent exists)
-    assembly = new VasnecovProduct(&mtx_data, &m_pipeline, name, VasnecovProduct::ProductTypeAssembly, parent, level);
+    assembly = new VasnecovProduct(world->mtx_data, &m_pipeline, name, VasnecovProduct::ProductTypeAssembly, parent, level);
 
     if(parent)
     {
         assembly->designerSetMatrixM1(parent->designerMatrixMs());
         parent->designerAddChild(assembly);
     }
-    m_elements.addElement(assembly);
-    world->designerAddElement(assembly); // Здесь не требуется проверка на дубликаты, т.к. указатель assembly девственно чист
+    {
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+        m_elements.addElement(assembly);
+    }
+    designerAddToWorld(assembly, world); // Здесь не требуется проверка на дубликаты, т.к. указатель assembly девственно чист
 
     return assembly;
 }
@@ -311,20 +354,22 @@ VasnecovProduct *VasnecovUniverse::addPart(const std::string &name, VasnecovWorl
 
     VasnecovProduct *part(0);
     VasnecovMesh *mesh(0);
+    Vasnecov::ResourceHandle<VasnecovMesh> meshHandle; // Меш не выгрузится, пока изделие не создано
     GLuint level(0);
 
-    QMutexLocker locker(&mtx_data);
-
     // Проверка на наличие меша и его догрузка при необходимости
     if(!meshName.empty())
     {
         std::string corMeshName = correctFileId(meshName, Vasnecov::cfg_meshFormat);
         // Поиск меша в списке
-        mesh = designerFindMesh(corMeshName);
+        {
+            QReadLocker locker(&mtx_resources);
+            mesh = designerFindMesh(corMeshName);
+            meshHandle.reset(mesh);
+        }
 
         if(!mesh)
         {
-            locker.unlock();
             // Попытка загрузить насильно
             // Метод загрузки сам управляет мьютексом
             if(!loadMeshFile(corMeshName))
@@ -332,9 +377,10 @@ VasnecovProduct *VasnecovUniverse::addPart(const std::string &name, VasnecovWorl
                 Vasnecov::problem("Не найден заданный меш");
                 return 0;
             }
-            locker.relock();
 
+            QReadLocker locker(&mtx_resources);
             mesh = designerFindMesh(corMeshName);
+            meshHandle.reset(mesh);
 
             if(!mesh)
             {
@@ -350,18 +396,14 @@ VasnecovProduct *VasnecovUniverse::addPart(const std::string &name, VasnecovWorl
         return 0;
     }
 
-    // Поиск мира в списке
-    if(!m_elements.findRawElement(world))
+    Vasnecov::StatsLocker worldLocker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
     {
-        Vasnecov::problem("Мир задан не верно");
-        return 0;
-    }
-    // Поиск материала
-    if(material)
-    {
-        if(!m_elements.findRawElement(material))
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+        // Поиск мира в списке
+        if(!m_elements.findRawElement(world))
         {
-            Vasnecov::problem("Не найден заданный материал");
+            Vasnecov::problem("Мир задан не верно");
             return 0;
         }
     }
@@ -370,6 +412,12 @@ VasnecovProduct *VasnecovUniverse::addPart(const std::string &name, VasnecovWorl
     {
         if(world->designerFindElement(parent))
         {
+            // Дерево изделия целиком находится в одном домене блокировки
+            if(parent->mtx_data != world->mtx_data)
+            {
+                Vasnecov::problem("Родительский узел принадлежит другому миру");
+                return 0;
+            }
             level = parent->designerLevel() + 1;
             if(level > Vasnecov::cfg_elementMaxLevel)
             {
@@ -384,16 +432,37 @@ VasnecovProduct *VasnecovUniverse::addPart(const std::string &name, VasnecovWorl
         }
     }
 
+    // Поиск материала. Материал занимается в той же критической секции: иначе удаление изделия
+    // из другого мира может забрать его последнего пользователя до создания нового изделия
+    if(material)
+    {
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+        if(!m_elements.findRawElement(material))
+        {
+            Vasnecov::problem("Не найден заданный материал");
+            return 0;
+        }
+        material->designerAddUser();
+    }
+
     // world && mesh && (parent exists)
-    part = new VasnecovProduct(&mtx_data, &m_pipeline, name, mesh, material, parent, level);
+    part = new VasnecovProduct(world->mtx_data, &m_pipeline, name, mesh, material, parent, level);
+    if(material)
+    {
+        material->designerRemoveUser(); // Теперь материал занят изделием
+    }
 
     if(parent)
     {
         part->designerSetMatrixM1(parent->designerMatrixMs());
         parent->designerAddChild(part);
     }
-    m_elements.addElement(part);
-    world->designerAddElement(part); // Здесь не требуется проверка на дубликаты, т.к. указатель part девственно чист
+    {
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+        m_elements.addElement(part);
+    }
+    designerAddToWorld(part, world); // Здесь не требуется проверка на дубликаты, т.к. указатель part девственно чист
 
     return part;
 }
@@ -435,22 +504,25 @@ VasnecovProduct *VasnecovUniverse::referProductToWorld(VasnecovProduct *product,
         return 0;
     }
 
-    QMutexLocker locker(&mtx_data);
-
-    // Поиск изделия в общем списке
-    if(!m_elements.findRawElement(product))
-    {
-        Vasnecov::problem("Заданное изделие не найдено");
-        return 0;
-    }
-    // Поиск мира в списке
-    if(!m_elements.findRawElement(world))
+    Vasnecov::StatsLocker worldLocker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
     {
-        Vasnecov::problem("Мир задан неверно");
-        return 0;
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+        // Поиск изделия в общем списке
+        if(!m_elements.findRawElement(product))
+        {
+            Vasnecov::problem("Заданное изделие не найдено");
+            return 0;
+        }
+        // Поиск мира в списке
+        if(!m_elements.findRawElement(world))
+        {
+            Vasnecov::problem("Мир задан неверно");
+            return 0;
+        }
     }
 
-    if(world->designerAddElement(product, true))
+    if(designerAddToWorld(product, world, true))
     {
         return product;
     }
@@ -480,76 +552,108 @@ GLboolean VasnecovUniverse::removeProduct(VasnecovProduct *product)
         return false;
 
     /* Тут необходимо:
-     * 1. Проверить используется ли материал продукта в других продуктах.
+     * 1. Проверить используется ли материал продукта в других продуктах (счётчик пользователей материала).
      * Если нет - удалить материал тоже (при этом текстуру не удалять)
      * 2. Удалить из списка родителя.
      * 3. Удалить всех детей, если продукт является узлом.
-     * 4. Убить все чужие матрицы, которые были от этих (продукт + дети + внуки) продуктов.
+     * 4. Убить все чужие матрицы, которые были от этих (продукт + дети + внуки) продуктов (индексы прикреплений миров).
+     *
+     * Мьютексы захватываются по очереди (мир, затем Вселенная), поэтому другие миры не ждут.
+     * Из миров элементы убираются раньше, чем из общих списков: реальное удаление происходит
+     * в потоке отрисовки только после синхронизации всех миров.
      */
 
-    QMutexLocker locker(&mtx_data);
-
-    if(m_elements.findRawElement(product))
+    QMutex *domain(0);
     {
-        // Удаление продуктов - долгая операция с заблокированным мьютексом
-        std::vector<VasnecovProduct *> delProd(product->designerAllChildren());
-        delProd.push_back(product);
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
-        m_elements.removeElements(delProd);
+        if(!m_elements.findRawElement(product))
+        {
+            return false;
+        }
+        // Мьютекс мира берётся, пока изделие точно существует: параллельное удаление того же дерева
+        // может освободить его сразу после снятия блокировки. Мьютекс принадлежит миру и переживает изделие
+        domain = product->mtx_data;
+    }
 
-        // Удаление материалов
-        std::vector<VasnecovMaterial *> delMat;
-        for(std::vector<VasnecovProduct *>::iterator dit = delProd.begin();
-            dit != delProd.end(); ++dit)
+    std::vector<VasnecovProduct *> delProd;
+    std::vector<VasnecovMaterial *> delMat;
+    std::vector<VasnecovMesh *> delMeshUsers;
+    std::map<VasnecovWorld *, std::vector<VasnecovProduct *> > byWorld;
+    {
+        // Дерево изделия - в домене мира, где оно создано
+        Vasnecov::StatsLocker locker(domain, Vasnecov::SyncStats::LockDesignerWorld);
         {
-            if((*dit)->designerMaterial())
+            // Изделие, которое ещё в списке, не уничтожится, пока держится мьютекс мира:
+            // удалённые элементы освобождаются только после синхронизации всех миров
+            Vasnecov::StatsLocker dataLocker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+            if(!m_elements.findRawElement(product))
             {
-                delMat.push_back((*dit)->designerMaterial());
+                return false;
             }
         }
-        // Если материал встречается где-то в других продуктах, то из списка претендентов он вычеркивается
-        for(std::vector<VasnecovProduct *>::const_iterator pit = m_elements.rawProducts().begin();
-            pit != m_elements.rawProducts().end(); ++pit)
+
+        delProd.push_back(product);
+        product->designerAllChildren(delProd);
+
         {
-            for(std::vector<VasnecovMaterial *>::iterator mit = delMat.begin();
-                mit != delMat.end(); ++mit)
+            // Членство забирается один раз: параллельный вызов для того же изделия здесь остановится
+            Vasnecov::StatsLocker dataLocker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+            if(!designerTakeMembership(delProd, byWorld))
             {
-                if((*pit)->designerMaterial() == (*mit))
-                {
-                    delMat.erase(mit);
-                    break;
-                }
+                return false;
             }
         }
-        // Непосредственное удаление больше не нужных материалов
-        m_elements.removeElements(delMat);
 
-        // Прочие удаления
+        // Удаление из списка родителей
+        if(product->designerParent())
+        {
+            product->designerParent()->designerRemoveChild(product);
+        }
+
         for(std::vector<VasnecovProduct *>::iterator dit = delProd.begin();
             dit != delProd.end(); ++dit)
         {
-            // Удаление из мира
-            for(std::vector<VasnecovWorld *>::const_iterator wit = m_elements.rawWorlds().begin();
-                wit != m_elements.rawWorlds().end(); ++wit)
+            VasnecovMaterial *material((*dit)->designerMaterial());
+            if(material && material->designerRemoveUser())
             {
-                (*wit)->designerRemoveElement((*dit));
+                delMat.push_back(material); // Окончательно решается под мьютексом Вселенной
             }
-
-            // Удаление из списка родителей
-            if((*dit)->designerParent())
+            if((*dit)->designerMesh())
             {
-                (*dit)->designerParent()->designerRemoveChild(*dit);
+                delMeshUsers.push_back((*dit)->designerMesh());
             }
-
-            // Удаление чужих матриц
-            const QMatrix4x4 *matrix = (*dit)->designerExportingMatrix();
-            designerRemoveThisAlienMatrix(matrix);
         }
+    }
 
-        return true;
+    designerRemoveFromWorlds(delProd, byWorld);
+
+    // Ресурсы освобождаются, только когда элементы уже убраны из сырых списков:
+    // тогда выгрузка после синхронизации всех миров их уже не застанет
+    for(std::vector<VasnecovMesh *>::iterator mit = delMeshUsers.begin(); mit != delMeshUsers.end(); ++mit)
+    {
+        (*mit)->designerRemoveUser();
     }
 
-    return false;
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    m_elements.removeElements(delProd);
+
+    // Непосредственное удаление больше не нужных материалов. Пока мьютекс был отпущен, материал
+    // мог занять addPart (тогда он остаётся) или удалить параллельное удаление (тогда его уже нет в списке)
+    delMat.erase(std::remove_if(delMat.begin(), delMat.end(),
+                                [this](VasnecovMaterial *material)
+                                {
+                                    return material->isUsed() || !m_elements.findRawElement(material);
+                                }),
+                 delMat.end());
+    m_elements.removeElements(delMat);
+    for(std::vector<VasnecovMaterial *>::iterator mit = delMat.begin(); mit != delMat.end(); ++mit)
+    {
+        (*mit)->designerReleaseTextures();
+    }
+
+    return true;
 }
 
 VasnecovFigure *VasnecovUniverse::addFigure(const std::string &name, VasnecovWorld *world)
@@ -562,7 +666,8 @@ VasnecovFigure *VasnecovUniverse::addFigure(const std::string &name, VasnecovWor
 
     VasnecovFigure *figure(0);
 
-    QMutexLocker locker(&mtx_data);
+    Vasnecov::StatsLocker worldLocker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
     // Поиск мира в списке
     if(!m_elements.findRawElement(world))
@@ -571,11 +676,12 @@ VasnecovFigure *VasnecovUniverse::addFigure(const std::string &name, VasnecovWor
         return 0;
     }
 
-    figure = new VasnecovFigure(&mtx_data, &m_pipeline, name);
+    figure = new VasnecovFigure(world->mtx_data, &m_pipeline, name);
 
     if(m_elements.addElement(figure))
     {
-        world->designerAddElement(figure);
+        locker.unlock();
+        designerAddToWorld(figure, world);
         return figure;
     }
     else
@@ -588,32 +694,115 @@ VasnecovFigure *VasnecovUniverse::addFigure(const std::string &name, VasnecovWor
     }
 }
 
+VasnecovPointCloud *VasnecovUniverse::addPointCloud(const std::string &name,
+                                                    VasnecovWorld *world,
+                                                    const std::string &fileName)
+{
+    if(!world)
+    {
+        Vasnecov::problem("Мир не задан");
+        return 0;
+    }
+
+    // Файл отображается в память до захвата мьютексов
+    std::shared_ptr<Vasnecov::PointCloudFile> file(new Vasnecov::PointCloudFile(fileName));
+    if(!file->isValid())
+    {
+        return 0;
+    }
+
+    VasnecovPointCloud *cloud(0);
+
+    Vasnecov::StatsLocker worldLocker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    // Поиск мира в списке
+    if(!m_elements.findRawElement(world))
+    {
+        Vasnecov::problem("Мир задан не верно");
+        return 0;
+    }
+
+    cloud = new VasnecovPointCloud(world->mtx_data, &m_pipeline, name);
+    cloud->m_cloud.set(file);
+
+    if(m_elements.addElement(cloud))
+    {
+        locker.unlock();
+        designerAddToWorld(static_cast<VasnecovFigure *>(cloud), world);
+        return cloud;
+    }
+    else
+    {
+        delete cloud;
+        cloud = 0;
+
+        Vasnecov::problem("Неверное облако точек либо дублирование данных");
+        return 0;
+    }
+}
+
+VasnecovParticles *VasnecovUniverse::addParticles(const std::string &name, VasnecovWorld *world, GLuint capacity)
+{
+    if(!world)
+    {
+        Vasnecov::problem("Мир не задан");
+        return 0;
+    }
+
+    VasnecovParticles *particles(0);
+
+    Vasnecov::StatsLocker worldLocker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    // Поиск мира в списке
+    if(!m_elements.findRawElement(world))
+    {
+        Vasnecov::problem("Мир задан не верно");
+        return 0;
+    }
+
+    particles = new VasnecovParticles(world->mtx_data, &m_pipeline, name, capacity);
+
+    if(m_elements.addElement(particles))
+    {
+        locker.unlock();
+        designerAddToWorld(static_cast<VasnecovFigure *>(particles), world);
+        return particles;
+    }
+    else
+    {
+        delete particles;
+        particles = 0;
+
+        Vasnecov::problem("Неверная система частиц либо дублирование данных");
+        return 0;
+    }
+}
+
 GLboolean VasnecovUniverse::removeFigure(VasnecovFigure *figure)
 {
     if(!figure)
         return false;
 
-    QMutexLocker locker(&mtx_data);
-
-    if(m_elements.findRawElement(figure))
+    std::vector<VasnecovFigure *> deleting(1, figure);
+    std::map<VasnecovWorld *, std::vector<VasnecovFigure *> > byWorld;
     {
-        m_elements.removeElement(figure);
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
-        // Прочие удаления
-        // Удаление из мира
-        for(std::vector<VasnecovWorld *>::const_iterator wit = m_elements.rawWorlds().begin();
-            wit != m_elements.rawWorlds().end(); ++wit)
+        if(!m_elements.findRawElement(figure) || !designerTakeMembership(deleting, byWorld))
         {
-            (*wit)->designerRemoveElement(figure);
+            return false;
         }
+    }
 
-        // Удаление чужих матриц
-        designerRemoveThisAlienMatrix(figure->designerExportingMatrix());
+    // Прочие удаления: из миров и чужие матрицы
+    designerRemoveFromWorlds(deleting, byWorld);
 
-        return true;
-    }
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+    m_elements.removeElement(figure);
 
-    return false;
+    return true;
 }
 /*!
    \brief Добавление новой метки
@@ -647,29 +836,36 @@ VasnecovLabel *VasnecovUniverse::addLabel(const std::string &name, VasnecovWorld
 
     VasnecovLabel *label(0);
     VasnecovTexture *texture(0);
-
-    QMutexLocker locker(&mtx_data);
+    Vasnecov::ResourceHandle<VasnecovTexture> textureHandle; // Текстура не выгрузится, пока метка не создана
 
     // Проверка на наличие текстуры и её догрузка при необходимости
     if(!textureName.empty()) // Иначе нулевая текстура
     {
-        std::string corTextureName = correctFileId(textureName, Vasnecov::cfg_textureFormat);
+        std::string texturePath;
+        {
+            Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+            texturePath = raw_data.dirTexturesIPref + correctFileId(textureName, Vasnecov::cfg_textureFormat);
+        }
 
-        texture = designerFindTexture(raw_data.dirTexturesIPref + corTextureName);
+        {
+            QReadLocker locker(&mtx_resources);
+            texture = designerFindTexture(texturePath);
+            textureHandle.reset(texture);
+        }
 
         if(!texture)
         {
-            locker.unlock();
             // Попытка загрузить насильно
             // Метод загрузки сам управляет мьютексом
-            if(!loadTextureFile(raw_data.dirTexturesIPref + corTextureName))
+            if(!loadTextureFile(texturePath))
             {
                 Vasnecov::problem("Не найдена заданная текстура");
                 return 0;
             }
-            locker.relock();
 
-            texture = designerFindTexture(raw_data.dirTexturesIPref + corTextureName);
+            QReadLocker locker(&mtx_resources);
+            texture = designerFindTexture(texturePath);
+            textureHandle.reset(texture);
             if(!texture)
             {
                 // Условие невозможное после попытки загрузки, но для надёжности оставим :)
@@ -679,6 +875,9 @@ VasnecovLabel *VasnecovUniverse::addLabel(const std::string &name, VasnecovWorld
         }
     }
 
+    Vasnecov::StatsLocker worldLocker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
     // Поиск мира в списке
     if(!m_elements.findRawElement(world))
     {
@@ -686,11 +885,12 @@ VasnecovLabel *VasnecovUniverse::addLabel(const std::string &name, VasnecovWorld
         return 0;
     }
 
-    label = new VasnecovLabel(&mtx_data, &m_pipeline, name, QVector2D(width, height), texture);
+    label = new VasnecovLabel(world->mtx_data, &m_pipeline, name, QVector2D(width, height), texture, &m_labelAtlas);
 
     if(m_elements.addElement(label))
     {
-        world->designerAddElement(label);
+        locker.unlock();
+        designerAddToWorld(label, world);
         return label;
     }
     else
@@ -703,30 +903,85 @@ VasnecovLabel *VasnecovUniverse::addLabel(const std::string &name, VasnecovWorld
     }
 }
 
-VasnecovLabel *VasnecovUniverse::referLabelToWorld(VasnecovLabel *label, VasnecovWorld *world)
+/*!
+   \brief Добавляет текстовую метку.
+
+   Глифы берутся из общего для начертания шрифта атласа, размер текста задаётся размером шрифта
+   (см. \a VasnecovText::setTextHeight).
+ */
+VasnecovText *VasnecovUniverse::addText(const std::string &name, VasnecovWorld *world, const QFont &font, const QString &text)
 {
-    if(!label || !world)
+    if(!world)
     {
-        Vasnecov::problem("Элемент или мир не заданы");
+        Vasnecov::problem("Мир не задан");
         return 0;
     }
 
-    QMutexLocker locker(&mtx_data);
-
-    // Поиск в общем списке
-    if(!m_elements.findRawElement(label))
+    GLfloat height(Vasnecov::cfg_textHeightDefault);
+    if(font.pixelSize() > 0)
     {
-        Vasnecov::problem("Заданная метка не найдена");
-        return 0;
+        height = font.pixelSize();
+    }
+    else if(font.pointSizeF() > 0.0)
+    {
+        height = font.pointSizeF() * 96.0 / 72.0;
     }
+
+    Vasnecov::StatsLocker worldLocker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
     // Поиск мира в списке
     if(!m_elements.findRawElement(world))
     {
-        Vasnecov::problem("Мир задан неверно");
+        Vasnecov::problem("Мир задан не верно");
+        return 0;
+    }
+
+    VasnecovText *label(new VasnecovText(world->mtx_data, &m_pipeline, name, m_glyphCache.atlas(font), height));
+    label->m_text.set(text);
+
+    if(m_elements.addElement(label))
+    {
+        locker.unlock();
+        designerAddToWorld(static_cast<VasnecovLabel *>(label), world);
+        return label;
+    }
+    else
+    {
+        delete label;
+
+        Vasnecov::problem("Неверная метка либо дублирование данных");
+        return 0;
+    }
+}
+
+VasnecovLabel *VasnecovUniverse::referLabelToWorld(VasnecovLabel *label, VasnecovWorld *world)
+{
+    if(!label || !world)
+    {
+        Vasnecov::problem("Элемент или мир не заданы");
         return 0;
     }
 
-    if(world->designerAddElement(label, true))
+    Vasnecov::StatsLocker worldLocker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+    {
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+        // Поиск в общем списке
+        if(!m_elements.findRawElement(label))
+        {
+            Vasnecov::problem("Заданная метка не найдена");
+            return 0;
+        }
+        // Поиск мира в списке
+        if(!m_elements.findRawElement(world))
+        {
+            Vasnecov::problem("Мир задан неверно");
+            return 0;
+        }
+    }
+
+    if(designerAddToWorld(label, world, true))
     {
         return label;
     }
@@ -749,27 +1004,33 @@ GLboolean VasnecovUniverse::removeLabel(VasnecovLabel *label)
     if(!label)
         return false;
 
-    QMutexLocker locker(&mtx_data);
-
-    if(m_elements.findRawElement(label))
+    std::vector<VasnecovLabel *> deleting(1, label);
+    std::map<VasnecovWorld *, std::vector<VasnecovLabel *> > byWorld;
     {
-        m_elements.removeElement(label);
+        Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
-        // Прочие удаления
-        // Удаление из мира
-        for(std::vector<VasnecovWorld *>::const_iterator wit = m_elements.rawWorlds().begin();
-            wit != m_elements.rawWorlds().end(); ++wit)
+        if(!m_elements.findRawElement(label) || !designerTakeMembership(deleting, byWorld))
         {
-            (*wit)->designerRemoveElement(label);
+            return false;
         }
+    }
 
-        // Удаление чужих матриц
-        designerRemoveThisAlienMatrix(label->designerExportingMatrix());
+    // Прочие удаления: из миров и чужие матрицы
+    designerRemoveFromWorlds(deleting, byWorld);
 
-        return true;
+    {
+        // Текстура освобождается, когда метки уже нет в сырых списках миров
+        Vasnecov::StatsLocker worldLocker(label->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+        if(label->designerTexture())
+        {
+            label->designerTexture()->designerRemoveUser();
+        }
     }
 
-    return false;
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+    m_elements.removeElement(label);
+
+    return true;
 }
 
 /*!
@@ -781,8 +1042,7 @@ GLboolean VasnecovUniverse::removeLabel(VasnecovLabel *label)
 VasnecovMaterial *VasnecovUniverse::addMaterial(const std::string &textureName)
 {
     VasnecovTexture *texture(0);
-
-    QMutexLocker locker(&mtx_data);
+    Vasnecov::ResourceHandle<VasnecovTexture> textureHandle; // Текстура не выгрузится, пока материал не создан
 
     // Проверка на наличие текстуры и её догрузка при необходимости
     if(!textureName.empty()) // Иначе нулевая текстура
@@ -790,11 +1050,14 @@ VasnecovMaterial *VasnecovUniverse::addMaterial(const std::string &textureName)
         // Поиск текстуры в списке
         std::string corTextureName = correctFileId(textureName, Vasnecov::cfg_textureFormat);
 
-        texture = designerFindTexture(corTextureName);
+        {
+            QReadLocker locker(&mtx_resources);
+            texture = designerFindTexture(corTextureName);
+            textureHandle.reset(texture);
+        }
 
         if(!texture)
         {
-            locker.unlock();
             // Попытка загрузить насильно
             // Метод загрузки сам управляет мьютексом
             if(!loadTextureFile(corTextureName))
@@ -802,9 +1065,10 @@ VasnecovMaterial *VasnecovUniverse::addMaterial(const std::string &textureName)
                 Vasnecov::problem("Заданная текстура не найдена");
                 return 0;
             }
-            locker.relock();
 
+            QReadLocker locker(&mtx_resources);
             texture = designerFindTexture(corTextureName);
+            textureHandle.reset(texture);
 
             if(!texture)
             {
@@ -815,6 +1079,8 @@ VasnecovMaterial *VasnecovUniverse::addMaterial(const std::string &textureName)
         }
     }
 
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
     VasnecovMaterial *material = new VasnecovMaterial(&mtx_data, &m_pipeline, texture);
     if(m_elements.addElement(material))
     {
@@ -837,6 +1103,8 @@ VasnecovMaterial *VasnecovUniverse::addMaterial(const std::string &textureName)
 */
 VasnecovMaterial *VasnecovUniverse::addMaterial()
 {
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
     VasnecovMaterial *material = new VasnecovMaterial(&mtx_data, &m_pipeline);
     if(m_elements.addElement(material))
     {
@@ -864,7 +1132,7 @@ VasnecovTexture *VasnecovUniverse::textureByName(const std::string &textureName,
     VasnecovTexture *texture(0);
     std::string newName;
 
-    QMutexLocker locker(&mtx_data);
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
     switch(type)
     {
@@ -880,7 +1148,9 @@ VasnecovTexture *VasnecovUniverse::textureByName(const std::string &textureName,
         default: // Использовать путь без префиксов
             newName = textureName;
     }
+    locker.unlock();
 
+    QReadLocker resourcesLocker(&mtx_resources);
     texture = designerFindTexture(newName);
 
     return texture;
@@ -893,7 +1163,7 @@ VasnecovTexture *VasnecovUniverse::textureByName(const std::string &textureName,
 */
 void VasnecovUniverse::setBackgroundColor(const QColor &color)
 {
-    QMutexLocker locker(&mtx_data);
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
     m_backgroundColor.set(color);
 }
@@ -908,14 +1178,99 @@ void VasnecovUniverse::setBackgroundColor(QRgb rgb)
     setBackgroundColor(color);
 }
 /*!
- \brief
+ \brief Задаёт количество рабочих потоков для подготовки кадра.
+
+ Между этими потоками и потоком отрисовки распределяются обновление данных изделий и фигур, расчёт
+ расстояний для сортировки прозрачных объектов и заполнение общих массивов фигур. Вызовы OpenGL остаются
+ только в потоке отрисовки. Мировые матрицы здесь не считаются: они пересчитываются в потоке конструктора
+ при изменении положения. Изделия и фигуры покадрово не отсекаются, отсечение узлов облаков точек и меток
+ идёт при отрисовке, в потоке OpenGL.
+
+ Каждая параллельная задача пишет только в данные своего элемента (или свой участок общего массива),
+ поэтому результат кадра не зависит от количества потоков и порядка выполнения. При нулевом значении
+ всё выполняется последовательно в потоке отрисовки (детерминированный режим, удобен для отладки).
+ Значение применяется при следующем обновлении данных.
+
+ \param count количество рабочих потоков (не больше Vasnecov::cfg_jobWorkersMax)
+*/
+void VasnecovUniverse::setJobWorkers(GLuint count)
+{
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    m_jobWorkers.set(qMin(count, Vasnecov::cfg_jobWorkersMax));
+}
+/*!
+ \brief
+
+ \return GLuint
+*/
+GLuint VasnecovUniverse::jobWorkers()
+{
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    return m_jobWorkers.raw();
+}
+/*!
+ \brief Задаёт объём видеопамяти под текстуры, загруженные из файлов.
+
+ При превышении в конце кадра давно не использовавшиеся диффузные текстуры вытесняются: до следующего
+ использования они рисуются своим средним цветом, затем перечитываются в фоновом потоке.
+ Значение применяется при следующем обновлении данных.
+
+ \param bytes объём в байтах, 0 - без ограничения
+*/
+void VasnecovUniverse::setTextureMemoryBudget(size_t bytes)
+{
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    m_textureBudget.set(bytes);
+}
+/*!
+ \brief
+
+ \return size_t
+*/
+size_t VasnecovUniverse::textureMemoryBudget()
+{
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    return m_textureBudget.raw();
+}
+/*!
+ \brief Задаёт автоматическую выгрузку ресурсов.
+
+ Поток отрисовки периодически (\a cfg_resourcesCheckPeriod) проверяет меши и текстуры и выгружает те,
+ которые не используются ни одним элементом дольше задержки. Проверка пропускается, если ресурсы
+ в этот момент заняты управляющим потоком.
+
+ \param msec задержка в миллисекундах, 0 - только явная выгрузка \a unloadUnusedResources()
+*/
+void VasnecovUniverse::setResourcesUnloadDelay(GLuint msec)
+{
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    m_unloadDelay.set(msec);
+}
+/*!
+ \brief
+
+ \return GLuint
+*/
+GLuint VasnecovUniverse::resourcesUnloadDelay()
+{
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    return m_unloadDelay.raw();
+}
+/*!
+ \brief
 
  \param dir
  \return GLboolean
 */
 GLboolean VasnecovUniverse::setTexturesDir(const std::string &dir)
 {
-    QMutexLocker locker(&mtx_data);
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
     return setDirectory(dir, raw_data.dirTextures);
 }
@@ -927,7 +1282,7 @@ GLboolean VasnecovUniverse::setTexturesDir(const std::string &dir)
 */
 GLboolean VasnecovUniverse::setMeshesDir(const std::string &dir)
 {
-    QMutexLocker locker(&mtx_data);
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
     return setDirectory(dir, raw_data.dirMeshes);
 }
@@ -975,7 +1330,8 @@ GLuint VasnecovUniverse::loadMeshes(const std::string &dirName, GLboolean withSu
     LoadingStatus lStatus(&mtx_data, &m_loading);
     GLuint res(0);
 
-    res = handleFilesInDir(raw_data.dirMeshes, dirName, Vasnecov::cfg_meshFormat, &VasnecovUniverse::loadMeshFile, withSub);
+    res = handleFilesInDir(m_meshManifest, raw_data.dirMeshes, dirName, &VasnecovUniverse::loadMeshFile, withSub);
+    m_meshManifest.save();
 
     return res;
 }
@@ -1010,16 +1366,84 @@ GLuint VasnecovUniverse::loadTextures(const std::string &dirName, GLboolean with
     LoadingStatus lStatus(&mtx_data, &m_loading);
     GLuint res(0);
 
-    res  = handleFilesInDir(raw_data.dirTextures, raw_data.dirTexturesDPref + dirName, Vasnecov::cfg_textureFormat, &VasnecovUniverse::loadTextureFile, withSub);
-    res += handleFilesInDir(raw_data.dirTextures, raw_data.dirTexturesIPref + dirName, Vasnecov::cfg_textureFormat, &VasnecovUniverse::loadTextureFile, withSub);
-    res += handleFilesInDir(raw_data.dirTextures, raw_data.dirTexturesNPref + dirName, Vasnecov::cfg_textureFormat, &VasnecovUniverse::loadTextureFile, withSub);
+    std::vector<std::string> files;
+    findFilesInDir(m_textureManifest, raw_data.dirTextures, raw_data.dirTexturesDPref + dirName, files, withSub);
+    findFilesInDir(m_textureManifest, raw_data.dirTextures, raw_data.dirTexturesIPref + dirName, files, withSub);
+    findFilesInDir(m_textureManifest, raw_data.dirTextures, raw_data.dirTexturesNPref + dirName, files, withSub);
+
+    // Чтение файлов и построение уровней детализации - параллельно, в потоках загрузки.
+    // Порядок манифеста (по директориям) держит чтение с диска близким к последовательному
+    res = handleFilesInParallel(files, [this](const std::string &fileName)
+    {
+        return loadTextureFile(fileName);
+    });
+    m_textureManifest.save();
 
     return res;
 }
 
+/*!
+ \brief Подготовка диффузных текстур из директории dirName (относительно директории диффузных текстур).
+
+ Для каждой картинки строятся уровни детализации и записываются рядом, в файл с расширением
+ \a Vasnecov::cfg_textureBakedFormat (см. Vasnecov::TextureFile). При загрузке такой текстуры картинка не
+ декодируется, а уровни со сжатием DXT так и остаются сжатыми в видеопамяти.
+
+ \return количество записанных файлов
+*/
+GLuint VasnecovUniverse::bakeTextures(const std::string &dirName, GLboolean withSub, GLboolean compress)
+{
+    std::vector<std::string> files;
+    findFilesInDir(m_textureManifest, raw_data.dirTextures, raw_data.dirTexturesDPref + dirName, files, withSub);
+
+    return handleFilesInParallel(files, [this, compress](const std::string &fileName)
+    {
+        return bakeTextureFile(fileName, compress);
+    });
+}
+
+/*!
+ \brief Выгрузка мешей и текстур, которые не использует ни один элемент.
+
+ Ресурсы сразу убираются из списков имён (повторное обращение к имени загрузит файл заново),
+ а освобождаются в потоке отрисовки, когда их гарантированно нет в чистых данных миров.
+ Удобно вызывать после смены сцены: память остаётся на уровне текущей сцены.
+
+ \return количество выгруженных ресурсов
+*/
+GLuint VasnecovUniverse::unloadUnusedResources()
+{
+    QWriteLocker locker(&mtx_resources);
+    Vasnecov::StatsLocker dataLocker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    return collectUnusedResources(-1, 0);
+}
+
 QString VasnecovUniverse::info(GLuint type)
 {
-    QMutexLocker locker(&mtx_data);
+    if(type == InfoDuplicates)
+    {
+        // Под мьютексом ресурсов, который при вложенных захватах берётся раньше мьютекса Вселенной
+        QReadLocker locker(&mtx_resources);
+
+        return QString("Duplicate meshes: %1 (%2 KiB saved), duplicate textures: %3 (%4 KiB saved)")
+               .arg(raw_data.meshDuplicates)
+               .arg(QString::number(static_cast<quint64>(raw_data.meshBytesSaved / 1024)))
+               .arg(raw_data.textureDuplicates)
+               .arg(QString::number(static_cast<quint64>(raw_data.textureBytesSaved / 1024)));
+    }
+    if(type == InfoResources)
+    {
+        QReadLocker locker(&mtx_resources);
+
+        return QString("Mesh names: %1, texture names: %2, unloaded meshes: %3, unloaded textures: %4")
+               .arg(raw_data.meshes.size())
+               .arg(raw_data.textures.size())
+               .arg(raw_data.meshesUnloaded)
+               .arg(raw_data.texturesUnloaded);
+    }
+
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
     QString res;
 
@@ -1043,6 +1467,13 @@ QString VasnecovUniverse::info(GLuint type)
             m_techExtensions.update();
             res = m_techExtensions.pure();
             break;
+        case InfoSyncStats:
+            res = Vasnecov::SyncStats::report();
+            break;
+        case InfoTextures:
+            m_techTextures.update();
+            res = m_techTextures.pure();
+            break;
         default:
             m_techVersion.update();
             m_techRenderer.update();
@@ -1053,6 +1484,11 @@ QString VasnecovUniverse::info(GLuint type)
                   " at " + m_techRenderer.pure() +
                   " with " + m_techSL.pure() +
                   " and \n" + m_techExtensions.pure();
+
+            if(Vasnecov::SyncStats::isEnabled())
+            {
+                res += "\n" + Vasnecov::SyncStats::report();
+            }
             break;
     }
 
@@ -1074,18 +1510,119 @@ void VasnecovUniverse::renderInitialize()
     QString exts(reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS)));
     exts = exts.replace(" ", "\n");
 
-    QMutexLocker locker(&mtx_data);
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
     BMCL_INFO() << "OpenGL " << reinterpret_cast<const char *>(glGetString(GL_VERSION));
-    m_techRenderer.set(reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
-    m_techVersion.set(reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+    m_techRenderer.renderSet(reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+    m_techVersion.renderSet(reinterpret_cast<const char *>(glGetString(GL_VERSION)));
 #ifndef _MSC_VER
-    m_techSL.set(reinterpret_cast<const char *>(glGetString(GL_SHADING_LANGUAGE_VERSION)));
+    m_techSL.renderSet(reinterpret_cast<const char *>(glGetString(GL_SHADING_LANGUAGE_VERSION)));
 #endif
-    m_techExtensions.set(exts);
+    m_techExtensions.renderSet(exts);
+
+    Vasnecov::TextureFile::renderInitialize(exts);
+    VasnecovTexture::renderInitialize(reinterpret_cast<const char *>(glGetString(GL_VERSION)), exts);
+}
+
+/*!
+ \brief Учёт загруженной текстуры со сторонами не степени двойки в отчёте \a info(InfoTextures).
+
+ Вызывается под мьютексом Вселенной.
+*/
+void VasnecovUniverse::renderCountTexture(const VasnecovTexture *texture)
+{
+    if(texture->isResampled())
+    {
+        ++m_texturesResampled;
+    }
+    else if(!VasnecovTexture::isPowerOfTwo(texture->width(), texture->height()))
+    {
+        ++m_texturesNpot;
+        m_texturesPaddingSaved += texture->paddingSaved();
+    }
+    else
+    {
+        return;
+    }
+
+    m_techTextures.renderSet(QString("Textures with non power of two sides: %1 as is (%2 KiB saved against padding), %3 resampled")
+                             .arg(m_texturesNpot)
+                             .arg(QString::number(static_cast<quint64>(m_texturesPaddingSaved / 1024)))
+                             .arg(m_texturesResampled));
 }
 
 
+/*!
+ \brief Ресурсы, отобранные на выгрузку, переходят к ожиданию синхронизации всех миров.
+
+ Вызывается под мьютексом Вселенной, после обновления материалов. Ресурс, который снова кем-то занят
+ (указатель был получен до выгрузки), откладывается до следующей проверки.
+*/
+void VasnecovUniverse::renderPassUnloading()
+{
+    raw_data.meshesDeferred.insert(raw_data.meshesDeferred.end(),
+                                   raw_data.meshesForUnloading.begin(), raw_data.meshesForUnloading.end());
+    raw_data.meshesForUnloading.clear();
+    raw_data.texturesDeferred.insert(raw_data.texturesDeferred.end(),
+                                     raw_data.texturesForUnloading.begin(), raw_data.texturesForUnloading.end());
+    raw_data.texturesForUnloading.clear();
+
+    std::vector<VasnecovMesh *>::iterator mit = std::stable_partition(raw_data.meshesDeferred.begin(), raw_data.meshesDeferred.end(),
+                                                                      [](const VasnecovMesh *mesh){return mesh->isUsed();});
+    raw_data.meshesUnloading.insert(raw_data.meshesUnloading.end(), mit, raw_data.meshesDeferred.end());
+    raw_data.meshesDeferred.erase(mit, raw_data.meshesDeferred.end());
+
+    std::vector<VasnecovTexture *>::iterator tit = std::stable_partition(raw_data.texturesDeferred.begin(), raw_data.texturesDeferred.end(),
+                                                                         [](const VasnecovTexture *texture){return texture->isUsed();});
+    raw_data.texturesUnloading.insert(raw_data.texturesUnloading.end(), tit, raw_data.texturesDeferred.end());
+    raw_data.texturesDeferred.erase(tit, raw_data.texturesDeferred.end());
+}
+
+/*!
+ \brief Освобождение выгружаемых ресурсов. Вызывается, когда все миры синхронизированы после
+ \a renderPassUnloading(): ссылок на эти ресурсы в чистых данных уже нет.
+
+ Имена текстур OpenGL освобождаются понемногу вместе с текстурами удалённых элементов,
+ сами объекты удаляются в фоновом потоке.
+*/
+void VasnecovUniverse::renderUnloadResources()
+{
+    std::vector<VasnecovMesh *> meshes;
+    for(std::vector<VasnecovMesh *>::iterator mit = raw_data.meshesUnloading.begin();
+        mit != raw_data.meshesUnloading.end(); ++mit)
+    {
+        if((*mit)->isUsed())
+        {
+            raw_data.meshesDeferred.push_back(*mit);
+        }
+        else
+        {
+            meshes.push_back(*mit);
+        }
+    }
+    raw_data.meshesUnloading.clear();
+
+    std::vector<VasnecovTexture *> textures;
+    for(std::vector<VasnecovTexture *>::iterator tit = raw_data.texturesUnloading.begin();
+        tit != raw_data.texturesUnloading.end(); ++tit)
+    {
+        // Перечитываемая после вытеснения текстура ещё у фонового потока
+        if((*tit)->isUsed() || !m_textureResidency.renderRemove(*tit))
+        {
+            raw_data.texturesDeferred.push_back(*tit);
+        }
+        else
+        {
+            m_reclaimer.renderReleaseTexture((*tit)->takeId());
+            textures.push_back(*tit);
+        }
+    }
+    raw_data.texturesUnloading.clear();
+
+    m_reclaimer.dispose(meshes);
+    m_reclaimer.dispose(textures);
+}
+
 VasnecovMesh *VasnecovUniverse::designerFindMesh(const std::string &name)
 {
     if(raw_data.meshes.count(name))
@@ -1116,31 +1653,153 @@ VasnecovTexture *VasnecovUniverse::designerFindTexture(const std::string &name)
     }
 }
 
-GLboolean VasnecovUniverse::designerRemoveThisAlienMatrix(const QMatrix4x4 *alienMs)
+/*!
+ \brief Отбор ресурсов без пользователей и перенос их из списков имён в очередь выгрузки.
+
+ Вызывается под \a mtx_resources на запись и \a mtx_data: явно из управляющего потока
+ или при автоматической выгрузке из потока отрисовки.
+
+ \param now текущее время таймера выгрузки, мс. Меньше нуля - выгрузить сразу, без учёта задержки
+ \param delay сколько ресурс должен простаивать, мс
+ \return количество отобранных ресурсов
+*/
+GLuint VasnecovUniverse::collectUnusedResources(qint64 now, qint64 delay)
 {
-    GLboolean res(false);
+    const GLuint meshes(collectUnused(raw_data.meshes, raw_data.meshContents,
+                                      raw_data.meshesForLoading, raw_data.meshesForUnloading, now, delay));
+    const GLuint textures(collectUnused(raw_data.textures, raw_data.textureContents,
+                                        raw_data.texturesForLoading, raw_data.texturesForUnloading, now, delay));
+    raw_data.meshesUnloaded += meshes;
+    raw_data.texturesUnloaded += textures;
 
-    for(std::vector<VasnecovLamp *>::const_iterator lit = m_elements.rawLamps().begin();
-        lit != m_elements.rawLamps().end(); ++lit)
+    if(meshes)
     {
-        res |= (*lit)->designerRemoveThisAlienMatrix(alienMs);
+        raw_data.setUpdateFlag(Meshes);
     }
-    for(std::vector<VasnecovProduct *>::const_iterator pit = m_elements.rawProducts().begin();
-        pit != m_elements.rawProducts().end(); ++pit)
+    if(textures)
     {
-        res |= (*pit)->designerRemoveThisAlienMatrix(alienMs);
+        raw_data.setUpdateFlag(Textures);
     }
-    for(std::vector<VasnecovFigure *>::const_iterator lit = m_elements.rawFigures().begin();
-        lit != m_elements.rawFigures().end(); ++lit)
+    return meshes + textures;
+}
+
+template <typename T>
+GLuint VasnecovUniverse::collectUnused(std::map<std::string, T *> &names,
+                                       std::map<Vasnecov::ContentKey, Vasnecov::UniverseAttributes::Content> &contents,
+                                       std::vector<T *> &forLoading,
+                                       std::vector<T *> &forUnloading,
+                                       qint64 now, qint64 delay)
+{
+    // Одинаковые по содержимому ресурсы записаны под несколькими именами
+    std::set<T *> unused;
+    for(typename std::map<std::string, T *>::const_iterator rit = names.begin(); rit != names.end(); ++rit)
     {
-        res |= (*lit)->designerRemoveThisAlienMatrix(alienMs);
+        if(isUnloadable(rit->second, now, delay))
+        {
+            unused.insert(rit->second);
+        }
     }
-    for(std::vector<VasnecovLabel *>::const_iterator lit = m_elements.rawLabels().begin();
-        lit != m_elements.rawLabels().end(); ++lit)
+    if(unused.empty())
     {
-        res |= (*lit)->designerRemoveThisAlienMatrix(alienMs);
+        return 0;
     }
-    return res;
+
+    std::set<std::string> removed;
+    for(typename std::map<std::string, T *>::iterator rit = names.begin(); rit != names.end();)
+    {
+        if(unused.count(rit->second))
+        {
+            removed.insert(rit->first);
+            names.erase(rit++);
+        }
+        else
+        {
+            ++rit;
+        }
+    }
+    // Новый файл с тем же содержимым загрузится заново, а не станет псевдонимом выгруженного
+    for(typename std::map<Vasnecov::ContentKey, Vasnecov::UniverseAttributes::Content>::iterator cit = contents.begin();
+        cit != contents.end();)
+    {
+        if(removed.count(cit->second.fileId))
+        {
+            contents.erase(cit++);
+        }
+        else
+        {
+            ++cit;
+        }
+    }
+    // Ещё не переданные в OpenGL передавать уже не нужно
+    forLoading.erase(std::remove_if(forLoading.begin(), forLoading.end(), [&unused](T *resource)
+    {
+        return unused.count(resource) != 0;
+    }), forLoading.end());
+
+    forUnloading.insert(forUnloading.end(), unused.begin(), unused.end());
+    return static_cast<GLuint>(unused.size());
+}
+
+/*!
+ \brief Ресурс без пользователей и, при автоматической выгрузке, простаивающий дольше задержки.
+*/
+GLboolean VasnecovUniverse::isUnloadable(Vasnecov::Resource *resource, qint64 now, qint64 delay)
+{
+    if(resource->isUsed())
+    {
+        resource->m_unusedSince = -1;
+        return false;
+    }
+    if(now < 0)
+    {
+        return true;
+    }
+    if(resource->m_unusedSince < 0)
+    {
+        resource->m_unusedSince = now; // Простой отсчитывается с первой проверки без пользователей
+        return false;
+    }
+    return now - resource->m_unusedSince >= delay;
+}
+
+GLboolean VasnecovUniverse::designerRemoveThisAlienMatrix(VasnecovWorld *world, const QMatrix4x4 *alienMs)
+{
+    // Вызывается под мьютексом мира. Индекс мира содержит только элементы, принадлежащие этому миру:
+    // элементы других миров обнуляются при проходе по своему миру
+    typedef Vasnecov::AttachmentIndex::iterator Iterator;
+    std::pair<Iterator, Iterator> range(world->m_attachments.equal_range(alienMs));
+
+    if(range.first == range.second)
+    {
+        return false;
+    }
+
+    for(Iterator ait = range.first; ait != range.second; ++ait)
+    {
+        ait->second->designerRemoveThisAlienMatrix(alienMs);
+    }
+    world->m_attachments.erase(range.first, range.second);
+
+    return true;
+}
+
+/*!
+ \brief Проверка, что мир зарегистрирован во Вселенной (захватывает мьютекс Вселенной).
+*/
+GLboolean VasnecovUniverse::checkWorld(VasnecovWorld *world)
+{
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    return m_elements.findRawElement(world) != 0;
+}
+/*!
+ \brief Снимок списка миров (захватывает мьютекс Вселенной).
+*/
+std::vector<VasnecovWorld *> VasnecovUniverse::worlds()
+{
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
+    return m_elements.rawWorlds();
 }
 
 /*!
@@ -1172,48 +1831,61 @@ GLboolean VasnecovUniverse::setDirectory(const std::string &newDir, std::string
 /*!
  \brief
 
+ \param manifest
  \param dirPref
  \param targetDir
- \param format
  \param workFun
  \param withSub
  \return GLuint
 */
-GLuint VasnecovUniverse::handleFilesInDir(const std::string &dirPref, const std::string &targetDir, const std::string &format, GLboolean (VasnecovUniverse::*workFun)(const std::string &), GLboolean withSub)
+GLuint VasnecovUniverse::handleFilesInDir(Vasnecov::ResourceManifest &manifest, const std::string &dirPref, const std::string &targetDir, GLboolean (VasnecovUniverse::*workFun)(const std::string &), GLboolean withSub)
 {
     GLuint res(0);
 
-    QString qdirPref = QString::fromStdString(dirPref);
-    QString qtargetDir = QString::fromStdString(targetDir);
-    QString qformat = "." + QString::fromStdString(format);
-
-    QDir dir(qdirPref + qtargetDir);
+    std::vector<std::string> files;
+    findFilesInDir(manifest, dirPref, targetDir, files, withSub);
 
-    QDirIterator::IteratorFlag flag(QDirIterator::NoIteratorFlags);
-    if(withSub)
+    for(std::vector<std::string>::const_iterator fit = files.begin(); fit != files.end(); ++fit)
     {
-        flag = QDirIterator::Subdirectories;
+        res += (this->*workFun)(*fit);
     }
+    return res;
+}
+
+/*!
+ \brief Поиск файлов формата манифеста. Имена дописываются в files относительно dirPref.
+
+ Директории, не изменившиеся с прошлого запуска, не перечитываются: список берётся из манифеста.
+ Порядок - по директориям и по именам, т.е. близкий к расположению файлов на диске.
+*/
+void VasnecovUniverse::findFilesInDir(Vasnecov::ResourceManifest &manifest, const std::string &dirPref, const std::string &targetDir, std::vector<std::string> &files, GLboolean withSub)
+{
+    manifest.list(dirPref, targetDir, withSub, files);
+}
 
-    QDirIterator iterator(dir.path(), flag);
+/*!
+ \brief Выполнение workFun с файлами параллельно. Потоки загрузки живут только на время вызова.
+*/
+GLuint VasnecovUniverse::handleFilesInParallel(const std::vector<std::string> &files,
+                                               const std::function<GLboolean (const std::string &)> &workFun)
+{
+    QMutexLocker jobsLocker(&mtx_loadJobs);
+    QAtomicInt res(0);
 
-    while(iterator.hasNext())
+    m_loadJobs.setWorkersCount(Vasnecov::JobScheduler::defaultWorkersCount());
+    m_loadJobs.parallelFor(files.size(), 1, [&files, &workFun, &res](size_t begin, size_t end)
     {
-        iterator.next();
-        if (!iterator.fileInfo().isDir())
+        for(size_t i = begin; i < end; ++i)
         {
-            QString fileName = iterator.fileName();
-
-            if(fileName.endsWith(qformat))
+            if(workFun(files[i]))
             {
-                QString fullFileName = iterator.filePath();
-                fullFileName.remove(0, qdirPref.size());
-
-                res += (this->*workFun)(fullFileName.toStdString());
+                res.fetchAndAddRelaxed(1);
             }
         }
-    }
-    return res;
+    });
+    m_loadJobs.setWorkersCount(0);
+
+    return res.load();
 }
 
 /*!
@@ -1227,14 +1899,27 @@ GLboolean VasnecovUniverse::loadMeshFile(const std::string &fileName)
     std::string path = raw_data.dirMeshes + fileName; // Путь файла с расширением
     std::string fileId = fileName;
 
-    if(correctPath(path, fileId, Vasnecov::cfg_meshFormat))
+    if(correctPath(path, fileId, Vasnecov::cfg_meshFormat, &m_meshManifest))
     {
-        if(!raw_data.meshes.count(fileId))
+        GLboolean loaded(false);
+        {
+            QReadLocker locker(&mtx_resources);
+            loaded = raw_data.meshes.count(fileId) != 0;
+        }
+        // Чтение файла идёт без блокировок, повторная проверка - в addMesh
+        if(!loaded)
         {
+            // Тот же файл под другим именем не разбирается повторно
+            const Vasnecov::ContentKey key(m_meshManifest.contentKey(path));
+            if(key.isValid() && shareMesh(fileId, key))
+            {
+                return true;
+            }
+
             VasnecovMesh *mesh = new VasnecovMesh(path, &m_pipeline, fileId);
             if(mesh->loadModel())
             {
-                if(addMesh(mesh, fileId))
+                if(addMesh(mesh, fileId, key))
                 {
                     return true;
                 }
@@ -1275,65 +1960,154 @@ GLboolean VasnecovUniverse::loadTextureFile(const std::string &fileName)
 
     std::string fileId = fileName;
 
-    if(correctPath(path, fileId, Vasnecov::cfg_textureFormat))
+    if(correctPath(path, fileId, Vasnecov::cfg_textureFormat, &m_textureManifest))
     {
-        if(!raw_data.textures.count(fileId)) // Данные
+        GLboolean loaded(false);
+        {
+            QReadLocker locker(&mtx_resources);
+            loaded = raw_data.textures.count(fileId) != 0;
+        }
+        // Чтение файла идёт без блокировок, повторная проверка - в addTexture
+        Vasnecov::ContentKey key;
+        if(!loaded)
+        {
+            // Одна и та же картинка разных типов - разные текстуры
+            key = m_textureManifest.contentKey(path, type);
+            if(key.isValid() && shareTexture(fileId, key))
+            {
+                return true;
+            }
+        }
+        if(!loaded && type == Vasnecov::TextureTypeDiffuse && m_textureManifest.mayHaveCache(path))
+        {
+            // Подготовленная текстура - без декодирования картинки и построения уровней
+            Vasnecov::TextureFile *baked(openBakedTexture(path));
+            if(baked)
+            {
+                VasnecovTextureDiffuse *texture(new VasnecovTextureDiffuse(baked));
+                texture->setSource(baked->fileName(), true); // Для перечитывания после вытеснения
+                texture->prepareMipmaps(); // Только если стороны не поддерживаются контекстом
+                if(addTexture(texture, fileId, key))
+                {
+                    return true;
+                }
+                delete texture;
+                return false;
+            }
+        }
+        if(!loaded) // Данные
         {
             QImage *image = new QImage(QString::fromStdString(path));
 
             if(!image->isNull())
             {
-                // Проверка на соотношение сторон (чудо-алгоритм от Мастана)
-                if((image->width() & (image->width() - 1)) == 0 && (image->height() & (image->height() - 1)) == 0)
-                {
-                    VasnecovTexture *texture(0);
-
-                    switch(type)
-                    {
-                        case Vasnecov::TextureTypeDiffuse:
-                            texture = new VasnecovTextureDiffuse(image);
-                            break;
-                        case Vasnecov::TextureTypeInterface:
-                            texture = new VasnecovTextureInterface(image);
-                            break;
-                        case Vasnecov::TextureTypeNormal:
-                            texture = new VasnecovTextureNormal(image);
-                            break;
-                        default:
-                            Vasnecov::problem("Тип текстуры указан неверно: ", path);
-                            return false;
-                    }
+                VasnecovTexture *texture(0);
 
-                    if(addTexture(texture, fileId))
+                switch(type)
+                {
+                    case Vasnecov::TextureTypeDiffuse:
                     {
-                        return true;
+                        VasnecovTextureDiffuse *diffuse(new VasnecovTextureDiffuse(image));
+                        diffuse->prepareMipmaps(); // Уровни строятся здесь, в вызывающем потоке
+                        diffuse->setSource(path, false);
+                        texture = diffuse;
+                        break;
                     }
-
-                    delete texture;
-                    texture = 0;
-
-                    delete image;
-                    image = 0;
+                    case Vasnecov::TextureTypeInterface:
+                        texture = new VasnecovTextureInterface(image);
+                        break;
+                    case Vasnecov::TextureTypeNormal:
+                        texture = new VasnecovTextureNormal(image);
+                        break;
+                    default:
+                        Vasnecov::problem("Тип текстуры указан неверно: ", path);
+                        delete image;
+                        return false;
                 }
-                else
+
+                if(addTexture(texture, fileId, key))
                 {
-                    Vasnecov::problem("Текстура неверного размера: ", path);
+                    return true;
                 }
+
+                delete texture; // Вместе с картинкой
+                texture = 0;
+                return false;
             }
+            delete image;
         }
     }
     return false;
 }
 
+GLboolean VasnecovUniverse::bakeTextureFile(const std::string &fileName, GLboolean compress)
+{
+    std::string path = raw_data.dirTextures + fileName;
+    std::string fileId = fileName;
+
+    if(!correctPath(path, fileId, Vasnecov::cfg_textureFormat, &m_textureManifest))
+    {
+        return false;
+    }
+
+    QImage image(QString::fromStdString(path));
+    if(image.isNull())
+    {
+        Vasnecov::problem("Не удалось прочитать текстуру: ", path);
+        return false;
+    }
+
+    if(!Vasnecov::TextureFile::write(bakedTexturePath(path), image, compress))
+    {
+        return false;
+    }
+    m_textureManifest.setCached(path); // Иначе до следующего запуска подготовленный файл не используется
+    return true;
+}
+
+std::string VasnecovUniverse::bakedTexturePath(const std::string &path) const
+{
+    std::string res(path);
+    const std::string suffix("." + Vasnecov::cfg_textureFormat);
+
+    if(res.size() >= suffix.size() && res.compare(res.size() - suffix.size(), suffix.size(), suffix) == 0)
+    {
+        res.erase(res.size() - suffix.size());
+    }
+    return res + "." + Vasnecov::cfg_textureBakedFormat;
+}
+
+Vasnecov::TextureFile *VasnecovUniverse::openBakedTexture(const std::string &path) const
+{
+    const std::string bakedPath(bakedTexturePath(path));
+    const QFileInfo baked(QString::fromStdString(bakedPath));
+
+    // Картинка, изменённая после подготовки, важнее
+    if(!baked.exists() || baked.lastModified() < QFileInfo(QString::fromStdString(path)).lastModified())
+    {
+        return 0;
+    }
+
+    Vasnecov::TextureFile *file(new Vasnecov::TextureFile(bakedPath));
+    if(!file->isValid())
+    {
+        delete file;
+        return 0;
+    }
+    return file;
+}
+
 /*!
  \brief
 
  \param path
  \param fileId
  \param format
+ \param manifest
  \return GLboolean
 */
-GLboolean VasnecovUniverse::correctPath(std::string &path, std::string &fileId, const std::string &format) const
+GLboolean VasnecovUniverse::correctPath(std::string &path, std::string &fileId, const std::string &format,
+                                        Vasnecov::ResourceManifest *manifest) const
 {
     if(!format.empty())
     {
@@ -1353,6 +2127,12 @@ GLboolean VasnecovUniverse::correctPath(std::string &path, std::string &fileId,
         }
     }
 
+    // Файлы из списка манифеста только что были в директории
+    if(manifest && manifest->isListed(path))
+    {
+        return true;
+    }
+
     QFile file(QString::fromStdString(path));
     if(file.exists())
     {
@@ -1382,21 +2162,52 @@ std::string VasnecovUniverse::correctFileId(const std::string &fileId, const std
     return res;
 }
 
-GLboolean VasnecovUniverse::addTexture(VasnecovTexture *texture, const std::string &fileId)
+/*!
+ \brief Добавление текстуры под именем fileId.
+
+ Если тем временем (параллельная загрузка) появилась текстура того же содержимого, имя получает её,
+ а переданная текстура удаляется. В остальных случаях при успехе текстурой владеет Вселенная.
+
+ \param key ключ содержимого файла, недействительный - без поиска одинаковых
+ \return true, если имя получило текстуру
+*/
+GLboolean VasnecovUniverse::addTexture(VasnecovTexture *texture, const std::string &fileId, const Vasnecov::ContentKey &key)
 {
     if(texture)
     {
         GLboolean added(true);
 
+        QWriteLocker locker(&mtx_resources);
+
         if(raw_data.textures.count(fileId))
         {
             added = false;
         }
-        if(added)
+        if(added && key.isValid())
         {
-            QMutexLocker locker(&mtx_data);
+            std::map<Vasnecov::ContentKey, Vasnecov::UniverseAttributes::Content>::const_iterator cit(raw_data.textureContents.find(key));
+            if(cit != raw_data.textureContents.end())
+            {
+                raw_data.textures[fileId] = raw_data.textures[cit->second.fileId];
+                ++raw_data.textureDuplicates;
+                raw_data.textureBytesSaved += cit->second.bytes;
+
+                delete texture;
+                return true;
+            }
 
+            Vasnecov::UniverseAttributes::Content content;
+            content.fileId = fileId;
+            content.bytes = texture->uploadSize();
+            raw_data.textureContents[key] = content;
+        }
+        if(added)
+        {
             raw_data.textures[fileId] = texture;
+
+            // Очередь загрузки читается потоком отрисовки под основным мьютексом
+            Vasnecov::StatsLocker dataLocker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+
             raw_data.texturesForLoading.push_back(texture);
             raw_data.setUpdateFlag(Textures);
         }
@@ -1414,20 +2225,39 @@ GLboolean VasnecovUniverse::addTexture(VasnecovTexture *texture, const std::stri
  \param fileId
  \return GLboolean
 */
-GLboolean VasnecovUniverse::addMesh(VasnecovMesh *mesh, const std::string &fileId)
+GLboolean VasnecovUniverse::addMesh(VasnecovMesh *mesh, const std::string &fileId, const Vasnecov::ContentKey &key)
 {
     if(mesh)
     {
         GLboolean added(true);
 
+        QWriteLocker locker(&mtx_resources);
+
         if(raw_data.meshes.count(fileId))
         {
             added = false;
         }
-        if(added)
+        if(added && key.isValid())
         {
-            QMutexLocker locker(&mtx_data);
+            // Как и у текстур: одинаковый меш мог загрузиться параллельно под другим именем
+            std::map<Vasnecov::ContentKey, Vasnecov::UniverseAttributes::Content>::const_iterator cit(raw_data.meshContents.find(key));
+            if(cit != raw_data.meshContents.end())
+            {
+                raw_data.meshes[fileId] = raw_data.meshes[cit->second.fileId];
+                ++raw_data.meshDuplicates;
+                raw_data.meshBytesSaved += cit->second.bytes;
+
+                delete mesh;
+                return true;
+            }
 
+            Vasnecov::UniverseAttributes::Content content;
+            content.fileId = fileId;
+            content.bytes = mesh->bytes();
+            raw_data.meshContents[key] = content;
+        }
+        if(added)
+        {
             raw_data.meshes[fileId] = mesh;
 //			raw_data.meshesForLoading.push_back(texture);
 //			raw_data.setUpdateFlag(Meshes);
@@ -1439,6 +2269,42 @@ GLboolean VasnecovUniverse::addMesh(VasnecovMesh *mesh, const std::string &fileI
     return false;
 }
 
+GLboolean VasnecovUniverse::shareTexture(const std::string &fileId, const Vasnecov::ContentKey &key)
+{
+    QWriteLocker locker(&mtx_resources);
+
+    std::map<Vasnecov::ContentKey, Vasnecov::UniverseAttributes::Content>::const_iterator cit(raw_data.textureContents.find(key));
+    if(cit == raw_data.textureContents.end())
+    {
+        return false;
+    }
+    if(!raw_data.textures.count(fileId))
+    {
+        raw_data.textures[fileId] = raw_data.textures[cit->second.fileId];
+        ++raw_data.textureDuplicates;
+        raw_data.textureBytesSaved += cit->second.bytes;
+    }
+    return true;
+}
+
+GLboolean VasnecovUniverse::shareMesh(const std::string &fileId, const Vasnecov::ContentKey &key)
+{
+    QWriteLocker locker(&mtx_resources);
+
+    std::map<Vasnecov::ContentKey, Vasnecov::UniverseAttributes::Content>::const_iterator cit(raw_data.meshContents.find(key));
+    if(cit == raw_data.meshContents.end())
+    {
+        return false;
+    }
+    if(!raw_data.meshes.count(fileId))
+    {
+        raw_data.meshes[fileId] = raw_data.meshes[cit->second.fileId];
+        ++raw_data.meshDuplicates;
+        raw_data.meshBytesSaved += cit->second.bytes;
+    }
+    return true;
+}
+
 
 /*!
  \brief
@@ -1448,8 +2314,18 @@ GLboolean VasnecovUniverse::addMesh(VasnecovMesh *mesh, const std::string &fileI
 GLenum VasnecovUniverse::renderUpdateData()
 {
     GLenum wasUpdated(0);
+    const GLboolean stats(Vasnecov::SyncStats::isEnabled());
+    quint64 lockedAt(0);
+    size_t uploaded(0); // Объём текстур, переданных в OpenGL за кадр
+
+    GLboolean universeLocked(mtx_data.tryLock());
+    if(stats)
+    {
+        Vasnecov::SyncStats::addTryLock(Vasnecov::SyncStats::LockRenderUniverse, universeLocked);
+        lockedAt = Vasnecov::SyncStats::now();
+    }
 
-    if(mtx_data.tryLock())
+    if(universeLocked)
     {
         // Обновление настроек
         if(raw_data.wasUpdated)
@@ -1461,6 +2337,28 @@ GLenum VasnecovUniverse::renderUpdateData()
 
             m_loading.update();
             m_backgroundColor.update();
+
+            if(m_jobWorkers.update())
+            {
+                m_pipeline.jobs().setWorkersCount(m_jobWorkers.pure());
+            }
+            if(m_textureBudget.update())
+            {
+                m_textureResidency.renderSetBudget(m_textureBudget.pure());
+            }
+            m_unloadDelay.update();
+        }
+
+        // Автоматическая выгрузка. Ресурсы захватываются после Вселенной, поэтому только попыткой
+        if(m_unloadDelay.pure())
+        {
+            const qint64 now(m_unloadTimer.elapsed());
+            if(now - m_unloadCheckedAt >= Vasnecov::cfg_resourcesCheckPeriod && mtx_resources.tryLockForWrite())
+            {
+                collectUnusedResources(now, m_unloadDelay.pure());
+                mtx_resources.unlock();
+                m_unloadCheckedAt = now;
+            }
         }
 
         // Обновление содержимого списков
@@ -1496,15 +2394,23 @@ GLenum VasnecovUniverse::renderUpdateData()
             {
                 if(!raw_data.texturesForLoading.empty())
                 {
-                    for(std::vector<VasnecovTexture *>::iterator tit = raw_data.texturesForLoading.begin();
-                        tit != raw_data.texturesForLoading.end(); ++tit)
+                    // Уровни детализации готовы заранее, здесь - только передача данных в OpenGL.
+                    // За кадр передаётся не больше бюджета (но хотя бы одна текстура), остальные - в следующих кадрах
+                    std::vector<VasnecovTexture *>::iterator tit = raw_data.texturesForLoading.begin();
+                    for(; tit != raw_data.texturesForLoading.end() && uploaded < Vasnecov::cfg_textureUploadBudget; ++tit)
                     {
-                        if(!(*tit)->loadImage())
+                        uploaded += (*tit)->uploadSize();
+                        if((*tit)->loadImage())
+                        {
+                            m_textureResidency.renderAdd(*tit);
+                            renderCountTexture(*tit);
+                        }
+                        else
                         {
                             // TODO: remove wrong textures from raw_data.textures and all objects
                         }
                     }
-                    raw_data.texturesForLoading.clear();
+                    raw_data.texturesForLoading.erase(raw_data.texturesForLoading.begin(), tit);
                     glBindTexture(GL_TEXTURE_2D, m_pipeline.m_texture2D); // Возврат текущей текстуры
                 }
             }
@@ -1512,27 +2418,124 @@ GLenum VasnecovUniverse::renderUpdateData()
             wasUpdated = true;
         }
 
-        // Обновление данных элементов
-        m_elements.forEachPureWorld(renderUpdateElementData<VasnecovWorld>);
+        // Материалы принадлежат Вселенной
         m_elements.forEachPureMaterial(renderUpdateElementData<VasnecovMaterial>);
 
-        m_elements.forEachPureLamp(renderUpdateElementData<VasnecovLamp>);
-        m_elements.forEachPureProduct(renderUpdateElementData<VasnecovProduct>);
-        m_elements.forEachPureFigure(renderUpdateElementData<VasnecovFigure>);
-        m_elements.forEachPureLabel(renderUpdateElementData<VasnecovLabel>);
-
+        renderPassUnloading();
 
         raw_data.wasUpdated = 0;
-
-        if(m_pipeline.wasSomethingUpdated())
+        if(!raw_data.texturesForLoading.empty())
         {
-            wasUpdated = true;
-            m_pipeline.clearSomethingUpdates();
+            raw_data.setUpdateFlag(Textures); // Остаток очереди загрузки
+            m_pipeline.setSomethingWasUpdated();
         }
 
+        if(stats)
+        {
+            Vasnecov::SyncStats::addLockHold(Vasnecov::SyncStats::LockRenderUniverse, Vasnecov::SyncStats::now() - lockedAt);
+        }
         mtx_data.unlock(); // Выход из tryLock()
     }
 
+    // Каждый мир обновляется под своим мьютексом: занятый мир пропускается до следующего кадра,
+    // не задерживая остальные
+    GLboolean allWorlds(true);
+    for(std::vector<VasnecovWorld *>::const_iterator wit = m_elements.pureWorlds().begin();
+        wit != m_elements.pureWorlds().end(); ++wit)
+    {
+        GLboolean worldLocked((*wit)->mtx_data->tryLock());
+        if(stats)
+        {
+            Vasnecov::SyncStats::addTryLock(Vasnecov::SyncStats::LockRenderWorld, worldLocked);
+            lockedAt = Vasnecov::SyncStats::now();
+        }
+
+        if(worldLocked)
+        {
+            wasUpdated |= renderUpdateWorldData(*wit);
+
+            if(stats)
+            {
+                Vasnecov::SyncStats::addLockHold(Vasnecov::SyncStats::LockRenderWorld, Vasnecov::SyncStats::now() - lockedAt);
+            }
+            (*wit)->mtx_data->unlock();
+        }
+        else
+        {
+            allWorlds = false;
+        }
+    }
+
+    // Удалённые элементы уничтожаются, только когда их гарантированно нет в чистых списках миров
+    if(allWorlds)
+    {
+        m_elements.reclaimAll(&m_reclaimer);
+        renderUnloadResources();
+
+        if(stats && universeLocked)
+        {
+            Vasnecov::SyncStats::notePure();
+        }
+    }
+
+    // Перечитанные после вытеснения текстуры - в пределах остатка того же бюджета передачи
+    const size_t budgetLeft(uploaded < Vasnecov::cfg_textureUploadBudget ? Vasnecov::cfg_textureUploadBudget - uploaded : 0);
+    if(budgetLeft && m_textureResidency.renderUploadReady(budgetLeft))
+    {
+        glBindTexture(GL_TEXTURE_2D, m_pipeline.m_texture2D);
+        wasUpdated = true;
+    }
+
+    // Текстуры удалённых элементов - понемногу каждый кадр
+    m_reclaimer.renderReleaseBatch();
+
+    if(m_pipeline.wasSomethingUpdated())
+    {
+        wasUpdated = true;
+        m_pipeline.clearSomethingUpdates();
+    }
+
+    return wasUpdated;
+}
+
+/*!
+ \brief Обновление мира и принадлежащих ему элементов. Вызывается под мьютексом мира.
+
+ Элементы, подключенные к миру из других миров, обновляются при обработке своих миров.
+*/
+GLenum VasnecovUniverse::renderUpdateWorldData(VasnecovWorld *world)
+{
+    GLenum wasUpdated(world->renderUpdateData());
+
+    const QMutex *domain(world->mtx_data);
+    const VasnecovWorld::WorldElementList &elements(world->m_elements);
+
+    for(std::vector<VasnecovLamp *>::const_iterator lit = elements.pureLamps().begin();
+        lit != elements.pureLamps().end(); ++lit)
+    {
+        if((*lit)->mtx_data == domain)
+            (*lit)->renderUpdateData();
+    }
+
+    // Изделия и фигуры не трогают OpenGL при обновлении, их можно обновлять параллельно
+    m_pipeline.jobs().forEach(elements.pureProducts(), [domain](VasnecovProduct *product)
+    {
+        if(product->mtx_data == domain)
+            product->renderUpdateData();
+    });
+    m_pipeline.jobs().forEach(elements.pureFigures(), [domain](VasnecovFigure *figure)
+    {
+        if(figure->mtx_data == domain)
+            figure->renderUpdateData();
+    });
+
+    for(std::vector<VasnecovLabel *>::const_iterator lit = elements.pureLabels().begin();
+        lit != elements.pureLabels().end(); ++lit)
+    {
+        if((*lit)->mtx_data == domain)
+            (*lit)->renderUpdateData();
+    }
+
     return wasUpdated;
 }
 
@@ -1590,6 +2593,8 @@ void VasnecovUniverse::renderDrawLoadingImage()
 */
 void VasnecovUniverse::renderDrawAll(GLsizei width, GLsizei height)
 {
+    m_labelAtlas.nextFrame(); // Картинки меток, размещённые с этого момента, не вытесняются до конца кадра
+
     // Обновление данных
     renderUpdateData();
 
@@ -1609,11 +2614,16 @@ void VasnecovUniverse::renderDrawAll(GLsizei width, GLsizei height)
         // Прогонка миров по списку
         m_elements.forEachPureWorld(VasnecovWorld::renderDrawElement<VasnecovWorld>);
 
+        // Использованные в кадре текстуры известны только теперь
+        m_textureResidency.renderEndFrame();
+        glBindTexture(GL_TEXTURE_2D, m_pipeline.m_texture2D); // Вытеснение меняет привязку
+
         // Возврат для отрисовки интерфейса
         m_pipeline.setDrawingType(Vasnecov::PolygonDrawingTypeNormal);
         m_pipeline.disableDepth(true); // Иначе Qt рисует коряво, почему-то
         m_pipeline.enableBackFaces(true);
         m_pipeline.enableTexture2D(0, true);
+        m_pipeline.disableAlphaTest(); // Могла остаться от материала с дырявой текстурой
         m_pipeline.clearZBuffer();
 
         m_pipeline.setViewport(0, 0, m_width, m_height);
@@ -1624,6 +2634,11 @@ void VasnecovUniverse::renderDrawAll(GLsizei width, GLsizei height)
     {
         renderDrawLoadingImage();
     }
+
+    if(Vasnecov::SyncStats::isEnabled())
+    {
+        Vasnecov::SyncStats::noteFrame();
+    }
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -1642,18 +2657,37 @@ VasnecovUniverse::UniverseElementList::UniverseElementList() :
 
 Vasnecov::UniverseAttributes::~UniverseAttributes()
 {
+    // Одинаковые по содержимому ресурсы записаны под несколькими именами, удаляются один раз
+    std::set<VasnecovMesh *> uniqueMeshes;
     for(std::map<std::string, VasnecovMesh *>::iterator rit = meshes.begin();
         rit != meshes.end(); ++rit)
     {
-        delete (rit->second);
+        uniqueMeshes.insert(rit->second);
         rit->second = 0;
     }
+    // Выгружаемые, но ещё не освобождённые
+    uniqueMeshes.insert(meshesForUnloading.begin(), meshesForUnloading.end());
+    uniqueMeshes.insert(meshesUnloading.begin(), meshesUnloading.end());
+    uniqueMeshes.insert(meshesDeferred.begin(), meshesDeferred.end());
+    for(std::set<VasnecovMesh *>::iterator rit = uniqueMeshes.begin(); rit != uniqueMeshes.end(); ++rit)
+    {
+        delete (*rit);
+    }
+
+    std::set<VasnecovTexture *> uniqueTextures;
     for(std::map<std::string, VasnecovTexture *>::iterator rit = textures.begin();
         rit != textures.end(); ++rit)
     {
-        delete (rit->second);
+        uniqueTextures.insert(rit->second);
         rit->second = 0;
     }
+    uniqueTextures.insert(texturesForUnloading.begin(), texturesForUnloading.end());
+    uniqueTextures.insert(texturesUnloading.begin(), texturesUnloading.end());
+    uniqueTextures.insert(texturesDeferred.begin(), texturesDeferred.end());
+    for(std::set<VasnecovTexture *>::iterator rit = uniqueTextures.begin(); rit != uniqueTextures.end(); ++rit)
+    {
+        delete (*rit);
+    }
 }
 
 
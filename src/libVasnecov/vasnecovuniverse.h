@@ -18,14 +18,25 @@
 #endif
 #include <QString>
 #include <QImage>
+#include <QReadWriteLock>
+#include <QElapsedTimer>
 #include <map>
+#include <unordered_map>
+#include <functional>
 #include "configuration.h"
 #include "vasnecovmaterial.h"
 #include "vasnecovfigure.h"
+#include "vasnecovparticles.h"
+#include "vasnecovpointcloud.h"
 #include "vasnecovworld.h"
 #include "vasnecovproduct.h"
 #include "vasnecovlabel.h"
+#include "vasnecovtext.h"
 #include "elementlist.h"
+#include "reclaimer.h"
+#include "textureresidency.h"
+#include "contenthash.h"
+#include "resourcemanifest.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
@@ -34,12 +45,30 @@ class VasnecovMaterial;
 
 namespace Vasnecov
 {
+    class TextureFile;
+
     struct UniverseAttributes : public Attributes
     {
         // Данные, используемые только в потоке управления
         std::map<std::string, VasnecovMesh *> meshes;
         std::map<std::string, VasnecovTexture *> textures;
 
+        // Одинаковые по содержимому файлы под разными именами делят один ресурс
+        struct Content
+        {
+            std::string fileId; // Первое загруженное имя
+            size_t bytes; // Объём ресурса, который не пришлось загружать повторно
+
+            Content() :
+                fileId(),
+                bytes(0)
+            {}
+        };
+        std::map<Vasnecov::ContentKey, Content> meshContents;
+        std::map<Vasnecov::ContentKey, Content> textureContents;
+        GLuint meshDuplicates, textureDuplicates;
+        size_t meshBytesSaved, textureBytesSaved;
+
         std::string dirMeshes; // Основная директория мешей
         std::string dirTextures; // Основная директория текстур
         std::string dirTexturesDPref;
@@ -51,10 +80,25 @@ namespace Vasnecov
         std::vector<VasnecovMesh *> meshesForLoading;
         std::vector<VasnecovTexture *> texturesForLoading;
 
+        // Выгрузка ресурсов без пользователей. Ресурсы уже убраны из имён, но ещё могут быть в чистых данных.
+        // Ждущие синхронизации Вселенной (под mtx_data):
+        std::vector<VasnecovMesh *> meshesForUnloading;
+        std::vector<VasnecovTexture *> texturesForUnloading;
+        GLuint meshesUnloaded, texturesUnloaded; // Под mtx_resources
+        // Только поток отрисовки: ждущие синхронизации всех миров и отложенные до повторной проверки
+        std::vector<VasnecovMesh *> meshesUnloading, meshesDeferred;
+        std::vector<VasnecovTexture *> texturesUnloading, texturesDeferred;
+
         UniverseAttributes() :
             Attributes(),
             meshes(),
             textures(),
+            meshContents(),
+            textureContents(),
+            meshDuplicates(0),
+            textureDuplicates(0),
+            meshBytesSaved(0),
+            textureBytesSaved(0),
 
             dirMeshes(Vasnecov::cfg_dirMeshes),
             dirTextures(Vasnecov::cfg_dirTextures),
@@ -63,7 +107,16 @@ namespace Vasnecov
             dirTexturesIPref(Vasnecov::cfg_dirTexturesIPref),
 
             meshesForLoading(),
-            texturesForLoading()
+            texturesForLoading(),
+
+            meshesForUnloading(),
+            texturesForUnloading(),
+            meshesUnloaded(0),
+            texturesUnloaded(0),
+            meshesUnloading(),
+            meshesDeferred(),
+            texturesUnloading(),
+            texturesDeferred()
         {
         }
         ~UniverseAttributes();
@@ -79,13 +132,13 @@ class VasnecovUniverse
             m_mutex(mutex),
             m_loading(loading)
         {
-            QMutexLocker locker(m_mutex);
+            Vasnecov::StatsLocker locker(m_mutex, Vasnecov::SyncStats::LockDesignerUniverse);
 
             m_loading->set(true);
         }
         ~LoadingStatus()
         {
-            QMutexLocker locker(m_mutex);
+            Vasnecov::StatsLocker locker(m_mutex, Vasnecov::SyncStats::LockDesignerUniverse);
 
             m_loading->set(false);
         }
@@ -105,11 +158,16 @@ class VasnecovUniverse
         ~ElementFullBox();
 
         virtual GLboolean synchronize();
-        GLboolean removeElement(T *element);
         const std::vector<T *> &deleting() const;
 
+        GLboolean reclaim(Vasnecov::Reclaimer *reclaimer); // Удаление элементов, которые уже исчезли из чистых списков всех миров
+
     protected:
-        std::vector<T *> m_deleting;
+        void elementRemoved(T *element);
+
+    protected:
+        std::vector<T *> m_deleting; // Удалённые из сырого списка (заполняется в управляющем потоке)
+        std::vector<T *> m_reclaiming; // Ожидают удаления (поток отрисовки)
     };
 
     // Список контейнеров списков, расширенный
@@ -164,6 +222,19 @@ class VasnecovUniverse
 
             return res;
         }
+        GLboolean reclaimAll(Vasnecov::Reclaimer *reclaimer)
+        {
+            GLboolean res(false);
+
+            res |= m_worlds.reclaim(reclaimer);
+            res |= m_materials.reclaim(reclaimer);
+            res |= m_lamps.reclaim(reclaimer);
+            res |= m_products.reclaim(reclaimer);
+            res |= m_figures.reclaim(reclaimer);
+            res |= m_labels.reclaim(reclaimer);
+
+            return res;
+        }
 
         // Работа со списками удаления
         const std::vector<VasnecovWorld *>	  &deletingWorlds() const {return m_worlds.deleting();}
@@ -221,6 +292,15 @@ public:
                               VasnecovWorld *world);
     GLboolean removeFigure(VasnecovFigure *figure);
 
+    // Облако точек из файла (Vasnecov::PointCloudFile), удаляется как фигура
+    VasnecovPointCloud *addPointCloud(const std::string &name,
+                                      VasnecovWorld *world,
+                                      const std::string &fileName);
+    // Система частиц, удаляется как фигура
+    VasnecovParticles *addParticles(const std::string &name,
+                                    VasnecovWorld *world,
+                                    GLuint capacity = Vasnecov::cfg_particlesCapacity);
+
     VasnecovLabel *addLabel(const std::string &name,
                             VasnecovWorld *world,
                             GLfloat width,
@@ -230,6 +310,11 @@ public:
                             GLfloat width,
                             GLfloat height,
                             const std::string &textureName);
+    // Текстовая метка, удаляется как метка. Размер текста по умолчанию - размер шрифта
+    VasnecovText *addText(const std::string &name,
+                          VasnecovWorld *world,
+                          const QFont &font,
+                          const QString &text = QString());
     VasnecovLabel *referLabelToWorld(VasnecovLabel *label, VasnecovWorld *world);
     GLboolean removeLabel(VasnecovLabel *label);
 
@@ -243,6 +328,15 @@ public:
     void setContext(const QGLContext *context);
     void setBackgroundColor(const QColor &color);
     void setBackgroundColor(QRgb rgb);
+    // Потоки подготовки кадра. 0 - всё в потоке отрисовки, в детерминированном порядке
+    void setJobWorkers(GLuint count);
+    GLuint jobWorkers();
+    // Видеопамять под текстуры файлов, байт. 0 - без ограничения
+    void setTextureMemoryBudget(size_t bytes);
+    size_t textureMemoryBudget();
+    // Автоматическая выгрузка ресурсов, которые никто не использует дольше задержки, мс. 0 - только явная
+    void setResourcesUnloadDelay(GLuint msec);
+    GLuint resourcesUnloadDelay();
 
     // Загрузка ресурсов
     /*
@@ -250,7 +344,6 @@ public:
      * [pathToApp]/stuff/ - по умолчанию.
      * Имена ресурсов соответствуют адресу файла из этой директории.
      */
-    // TODO: Unloading resources with full cleaning Worlds's content
     GLboolean setTexturesDir(const std::string &dir);
     GLboolean setMeshesDir(const std::string &dir);
 
@@ -260,35 +353,90 @@ public:
     GLuint loadMeshes(const std::string &dirName = "", GLboolean withSub = true); // Загрузка всех мешей
     GLboolean loadTexture(const std::string &fileName);
     GLuint loadTextures(const std::string &dirName = "", GLboolean withSub = true); // Загрузка всех текстур
-
+    // Подготовка диффузных текстур: рядом с каждой картинкой записывается DDS с уровнями детализации,
+    // сжатый (compress) или нет. Дальше такие текстуры загружаются из него, пока картинка не новее.
+    // OpenGL не требуется, можно вызывать в любой момент, в том числе отдельной утилитой
+    GLuint bakeTextures(const std::string &dirName = "", GLboolean withSub = true, GLboolean compress = true);
+
+    // Выгрузка мешей и текстур, на которые не ссылается ни один элемент (изделие, материал, метка).
+    // Имена остаются известными: при следующем обращении ресурс загружается заново.
+    // Указатели из textureByName() на выгруженные текстуры недействительны. Возврат - количество выгруженных
+    GLuint unloadUnusedResources();
+
+    // Тип - GL_VERSION, GL_RENDERER, GL_SHADING_LANGUAGE_VERSION, GL_EXTENSIONS, InfoSyncStats, InfoTextures,
+    // InfoDuplicates или InfoResources.
+    // По умолчанию - всё сразу (статистика - если включена, см. Vasnecov::SyncStats)
     QString info(GLuint type = 0);
+    static const GLuint InfoSyncStats = 0x10000;
+    static const GLuint InfoTextures = 0x10001; // Текстуры со сторонами не степени двойки и сэкономленная память
+    static const GLuint InfoDuplicates = 0x10002; // Одинаковые ресурсы под разными именами и сэкономленная память
+    static const GLuint InfoResources = 0x10003; // Загруженные и выгруженные ресурсы
 
 protected:
     // Блокирует мьютекс, но вызывается из других методов
-    // TODO: make abstract class Resource for textures, meshes, may be shaders. And use with template like an Element
-    GLboolean addTexture(VasnecovTexture *texture, const std::string &fileId);
-    GLboolean addMesh(VasnecovMesh *mesh, const std::string &fileId);
+    GLboolean addTexture(VasnecovTexture *texture, const std::string &fileId,
+                         const Vasnecov::ContentKey &key = Vasnecov::ContentKey());
+    GLboolean addMesh(VasnecovMesh *mesh, const std::string &fileId,
+                      const Vasnecov::ContentKey &key = Vasnecov::ContentKey());
+    // Имя для уже загруженного ресурса того же содержимого. false, если такого ещё нет
+    GLboolean shareTexture(const std::string &fileId, const Vasnecov::ContentKey &key);
+    GLboolean shareMesh(const std::string &fileId, const Vasnecov::ContentKey &key);
 
     // Работа с файлами ресурсов
-    GLuint handleFilesInDir(const std::string &dirPref,
+    GLuint handleFilesInDir(Vasnecov::ResourceManifest &manifest,
+                            const std::string &dirPref,
                             const std::string &targetDir,
-                            const std::string &format,
                             GLboolean (VasnecovUniverse::*workFun)(const std::string &),
                             GLboolean withSub = true); // Поиск файлов в директории и выполнение с ними метода
+    void findFilesInDir(Vasnecov::ResourceManifest &manifest,
+                        const std::string &dirPref,
+                        const std::string &targetDir,
+                        std::vector<std::string> &files,
+                        GLboolean withSub = true); // По манифесту: обходятся только изменившиеся директории
+    GLuint handleFilesInParallel(const std::vector<std::string> &files,
+                                 const std::function<GLboolean (const std::string &)> &workFun); // В потоках загрузки
     GLboolean loadMeshFile(const std::string &fileName);
     GLboolean loadTextureFile(const std::string &fileName);
+    GLboolean bakeTextureFile(const std::string &fileName, GLboolean compress);
+    std::string bakedTexturePath(const std::string &path) const; // Путь картинки с расширением -> путь DDS
+    Vasnecov::TextureFile *openBakedTexture(const std::string &path) const; // 0, если его нет или он устарел
 
 protected:
     // Методы, вызываемые из внешних потоков (работают с сырыми данными)
+    // Поиск ресурсов, вызывается под mtx_resources (хотя бы на чтение)
     VasnecovMesh *designerFindMesh(const std::string &name);
     VasnecovTexture *designerFindTexture(const std::string &name);
+    // Вызывается под mtx_resources на запись и mtx_data (из любого потока). now < 0 - без учёта задержки
+    GLuint collectUnusedResources(qint64 now, qint64 delay);
+    template <typename T>
+    static GLuint collectUnused(std::map<std::string, T *> &names,
+                                std::map<Vasnecov::ContentKey, Vasnecov::UniverseAttributes::Content> &contents,
+                                std::vector<T *> &forLoading,
+                                std::vector<T *> &forUnloading,
+                                qint64 now, qint64 delay);
+    static GLboolean isUnloadable(Vasnecov::Resource *resource, qint64 now, qint64 delay);
+
+    // Вызываются под мьютексом мира
+    GLboolean designerRemoveThisAlienMatrix(VasnecovWorld *world, const QMatrix4x4 *alienMs);
+    template <typename T>
+    GLboolean designerAddToWorld(T *element, VasnecovWorld *world, GLboolean check = false); // Захватывает и мьютекс Вселенной
+
+    // Удаление элементов из миров. Сначала под мьютексом Вселенной забирается членство элементов,
+    // затем каждый мир обрабатывается под своим мьютексом
+    template <typename T>
+    GLboolean designerTakeMembership(const std::vector<T *> &elements, std::map<VasnecovWorld *, std::vector<T *> > &byWorld);
+    template <typename T>
+    void designerRemoveFromWorlds(const std::vector<T *> &elements, const std::map<VasnecovWorld *, std::vector<T *> > &byWorld);
 
-    GLboolean designerRemoveThisAlienMatrix(const QMatrix4x4 *alienMs);
+    // Блокируют мьютекс Вселенной
+    GLboolean checkWorld(VasnecovWorld *world);
+    std::vector<VasnecovWorld *> worlds();
 
 protected:
     // Вспомогательные (не привязаны к внутренним данным)
     GLboolean setDirectory(const std::string &newDir, std::string &oldDir) const;
-    GLboolean correctPath(std::string &path, std::string &fileId, const std::string &format) const; // Добавляет расширение в путь, удаляет его из fileId, проверяет наличие файла
+    GLboolean correctPath(std::string &path, std::string &fileId, const std::string &format,
+                          Vasnecov::ResourceManifest *manifest = 0) const; // Добавляет расширение в путь, удаляет его из fileId, проверяет наличие файла (если его нет в списке манифеста)
     std::string correctFileId(const std::string &fileId, const std::string &format) const; // Удаляет формат из имени
 
 protected:
@@ -300,6 +448,11 @@ protected:
     void renderDrawAll(GLsizei width, GLsizei height);
     void renderDrawLoadingImage();
 
+    GLenum renderUpdateWorldData(VasnecovWorld *world); // Вызывается под мьютексом мира
+    void renderCountTexture(const VasnecovTexture *texture);
+    void renderPassUnloading(); // Под мьютексом Вселенной
+    void renderUnloadResources(); // После синхронизации всех миров
+
     template <typename T>
     static void renderUpdateElementData(T *element)
     {
@@ -313,6 +466,11 @@ private:
     VasnecovPipeline m_pipeline;
     Vasnecov::MutualData<const QGLContext *> m_context;
     Vasnecov::MutualData<QColor> m_backgroundColor;
+    Vasnecov::MutualData<GLuint> m_jobWorkers;
+    Vasnecov::MutualData<size_t> m_textureBudget;
+    Vasnecov::MutualData<GLuint> m_unloadDelay;
+    QElapsedTimer m_unloadTimer; // Только поток отрисовки
+    qint64 m_unloadCheckedAt;
 
     GLsizei m_width, m_height; // Размеры окна вывода
 
@@ -322,13 +480,30 @@ private:
     timespec m_loadingImageTimer;
 
     GLuint m_lampsCountMax;
+    Vasnecov::LabelAtlas m_labelAtlas; // Объявлен до списков: метки освобождают в нём участки при удалении
+    Vasnecov::GlyphCache m_glyphCache;
+    Vasnecov::JobScheduler m_loadJobs; // Потоки загрузки текстур, не связаны с подготовкой кадра
+    Vasnecov::ResourceManifest m_meshManifest; // Списки файлов директорий ресурсов между запусками
+    Vasnecov::ResourceManifest m_textureManifest;
 
     // Списки миров
     // Списки общих (между мирами) данных
     Vasnecov::UniverseAttributes raw_data;
     UniverseElementList m_elements;
+    std::unordered_map<const Vasnecov::CoreObject *, std::vector<VasnecovWorld *> > m_membership; // Миры, в которых состоит элемент
+    Vasnecov::Reclaimer m_reclaimer; // Объявлен после списков: его очередь опустошается раньше их удаления
+    Vasnecov::TextureResidency m_textureResidency; // Объявлен после текстур: его поток останавливается раньше их удаления
 
+    /*
+     * Блокировки разделены по доменам:
+     * mtx_data - общие списки Вселенной, материалы и настройки;
+     * мьютекс каждого мира - сам мир и элементы, созданные в нём;
+     * mtx_resources - меши и текстуры (почти всегда только чтение).
+     * Допустимый порядок вложенных захватов: мир -> Вселенная. Два мира одновременно не захватываются.
+     */
     QMutex mtx_data;
+    QReadWriteLock mtx_resources;
+    QMutex mtx_loadJobs; // Потоки загрузки - для одного вызова за раз
 
     enum Updated
     {
@@ -343,12 +518,16 @@ private:
         Flags			= 0x0001000,
         Loading			= 0x0002000,
         BackColor		= 0x0004000,
+        JobWorkers		= 0x0008000,
+        TextureBudget	= 0x0010000,
+        UnloadDelay		= 0x0020000,
 
         Context			= 0x0080000,
         Tech01			= 0x0100000,
         Tech02			= 0x0200000,
         Tech03			= 0x0400000,
-        Tech04			= 0x0800000
+        Tech04			= 0x0800000,
+        Tech05			= 0x1000000
     };
 
     // Технологическая информация (raw - из потока ренедеринга, pure - во внешнем)
@@ -356,6 +535,9 @@ private:
     Vasnecov::MutualData<QString> m_techVersion;
     Vasnecov::MutualData<QString> m_techSL;
     Vasnecov::MutualData<QString> m_techExtensions;
+    Vasnecov::MutualData<QString> m_techTextures;
+    GLuint m_texturesNpot, m_texturesResampled; // Только поток отрисовки
+    size_t m_texturesPaddingSaved;
 
     friend class VasnecovScene;
     friend class VasnecovWidget;
@@ -369,7 +551,7 @@ inline void VasnecovUniverse::setContext(const QGLContext *context)
     if(!context)
         return;
 
-    QMutexLocker locker(&mtx_data);
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
 
     m_context.set(context);
 }
@@ -377,7 +559,8 @@ inline void VasnecovUniverse::setContext(const QGLContext *context)
 //--------------------------------------------------------------------------------------------------
 template <typename T>
 VasnecovUniverse::ElementFullBox<T>::ElementFullBox() :
-    m_deleting()
+    m_deleting(),
+    m_reclaiming()
 {}
 template <typename T>
 VasnecovUniverse::ElementFullBox<T>::~ElementFullBox()
@@ -395,6 +578,13 @@ VasnecovUniverse::ElementFullBox<T>::~ElementFullBox()
         delete (*eit);
         (*eit) = 0;
     }
+
+    for(typename std::vector<T *>::iterator eit = this->m_reclaiming.begin();
+        eit != this->m_reclaiming.end(); ++eit)
+    {
+        delete (*eit);
+        (*eit) = 0;
+    }
 }
 template <typename T>
 GLboolean VasnecovUniverse::ElementFullBox<T>::synchronize()
@@ -404,49 +594,133 @@ GLboolean VasnecovUniverse::ElementFullBox<T>::synchronize()
         this->m_pure.swap(this->m_buffer);
         this->m_wasUpdated = false;
 
+        // Сразу удалять нельзя: миры синхронизируются под своими мьютексами и могут ещё ссылаться на элементы
         if(!m_deleting.empty())
         {
-            for(typename std::vector<T *>::iterator eit = m_deleting.begin();
-                eit != m_deleting.end(); ++eit)
-            {
-                delete (*eit);
-                (*eit) = 0;
-            }
+            m_reclaiming.insert(m_reclaiming.end(), m_deleting.begin(), m_deleting.end());
             m_deleting.clear();
         }
         return true;
     }
     return false;
 }
+template <typename T>
+GLboolean VasnecovUniverse::ElementFullBox<T>::reclaim(Vasnecov::Reclaimer *reclaimer)
+{
+    if(m_reclaiming.empty())
+    {
+        return false;
+    }
+
+    // Ресурсы OpenGL отдаются здесь, в потоке отрисовки, а память освобождается в фоне
+    for(typename std::vector<T *>::iterator eit = m_reclaiming.begin();
+        eit != m_reclaiming.end(); ++eit)
+    {
+        (*eit)->renderReleaseResources(reclaimer);
+    }
+    reclaimer->dispose(m_reclaiming);
+
+    return true;
+}
 
 template <typename T>
-GLboolean VasnecovUniverse::ElementFullBox<T>::removeElement(T *element)
+void VasnecovUniverse::ElementFullBox<T>::elementRemoved(T *element)
 {
-    if(element)
+    m_deleting.push_back(element);
+}
+
+template <typename T>
+const std::vector<T *> &VasnecovUniverse::ElementFullBox<T>::deleting() const
+{
+    return m_deleting;
+}
+
+//--------------------------------------------------------------------------------------------------
+template <typename T>
+GLboolean VasnecovUniverse::designerAddToWorld(T *element, VasnecovWorld *world, GLboolean check)
+{
+    if(!world->designerAddElement(element, check))
     {
-        for(typename std::vector<T *>::iterator eit = this->m_raw.begin();
-            eit != this->m_raw.end(); ++eit)
-        {
-            if((*eit) == element)
-            {
-                m_deleting.push_back(*eit);
+        return false;
+    }
+
+    // Прикрепления элемента учитываются в индексе мира, в котором он создан
+    if(element->mtx_data == world->mtx_data)
+    {
+        element->designerSetAttachmentIndex(&world->m_attachments);
+    }
+
+    Vasnecov::StatsLocker locker(&mtx_data, Vasnecov::SyncStats::LockDesignerUniverse);
+    m_membership[element].push_back(world);
 
-                this->m_raw.erase(eit);
-                this->m_buffer = this->m_raw;
+    return true;
+}
+/*!
+ \brief Забирает членство элементов в мирах. Вызывается под мьютексом Вселенной.
+
+ \return false, если элементы уже удаляются (членство забрано другим вызовом)
+*/
+template <typename T>
+GLboolean VasnecovUniverse::designerTakeMembership(const std::vector<T *> &elements,
+                                                   std::map<VasnecovWorld *, std::vector<T *> > &byWorld)
+{
+    GLboolean res(false);
 
-                this->m_wasUpdated = true;
-                return true;
+    for(typename std::vector<T *>::const_iterator eit = elements.begin();
+        eit != elements.end(); ++eit)
+    {
+        std::unordered_map<const Vasnecov::CoreObject *, std::vector<VasnecovWorld *> >::iterator mit = m_membership.find(*eit);
+        if(mit != m_membership.end())
+        {
+            for(std::vector<VasnecovWorld *>::const_iterator wit = mit->second.begin();
+                wit != mit->second.end(); ++wit)
+            {
+                byWorld[*wit].push_back(*eit);
             }
+            m_membership.erase(mit);
+            res = true;
         }
     }
-
-    return false;
+    return res;
 }
+/*!
+ \brief Удаление элементов из миров и обнуление прикреплённых к ним чужих матриц.
 
+ Каждый мир захватывается отдельно. Работа пропорциональна количеству удаляемых элементов
+ (плюс по одному проходу по сырым спискам тех миров, где они состоят).
+*/
 template <typename T>
-const std::vector<T *> &VasnecovUniverse::ElementFullBox<T>::deleting() const
+void VasnecovUniverse::designerRemoveFromWorlds(const std::vector<T *> &elements,
+                                                const std::map<VasnecovWorld *, std::vector<T *> > &byWorld)
 {
-    return m_deleting;
+    // Прикреплённые элементы могут быть в любом мире
+    std::vector<VasnecovWorld *> allWorlds(worlds());
+
+    for(std::vector<VasnecovWorld *>::const_iterator wit = allWorlds.begin();
+        wit != allWorlds.end(); ++wit)
+    {
+        VasnecovWorld *world(*wit);
+        Vasnecov::StatsLocker locker(world->mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+
+        typename std::map<VasnecovWorld *, std::vector<T *> >::const_iterator bit = byWorld.find(world);
+        if(bit != byWorld.end())
+        {
+            world->m_elements.removeElements(bit->second);
+        }
+
+        for(typename std::vector<T *>::const_iterator eit = elements.begin();
+            eit != elements.end(); ++eit)
+        {
+            // Удаление чужих матриц
+            designerRemoveThisAlienMatrix(world, (*eit)->designerExportingMatrix());
+
+            // И собственного прикрепления - из индекса своего мира
+            if((*eit)->mtx_data == world->mtx_data)
+            {
+                (*eit)->designerSetAlienMatrix(0);
+            }
+        }
+    }
 }
 
 #ifndef _MSC_VER
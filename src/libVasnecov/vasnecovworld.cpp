@@ -24,19 +24,21 @@
  \brief
 
  \fn VasnecovWorld::VasnecovWorld
- \param mutex
+
+ Мир создаёт собственный мьютекс, который защищает данные самого мира и всех элементов, созданных в нём.
+ Поэтому изменения в разных мирах не блокируют друг друга.
+
  \param pipeline
  \param mx
  \param my
  \param width
  \param height
 */
-VasnecovWorld::VasnecovWorld(QMutex *mutex,
-                             VasnecovPipeline *pipeline,
+VasnecovWorld::VasnecovWorld(VasnecovPipeline *pipeline,
                              GLint mx, GLint my,
                              GLsizei width, GLsizei height,
                              const std::string &name) :
-    Vasnecov::CoreObject(mutex, pipeline, name),
+    Vasnecov::CoreObject(new QMutex(), pipeline, name),
     m_parameters(raw_wasUpdated, Parameters),
     m_perspective(raw_wasUpdated, Perspective),
     m_ortho(raw_wasUpdated, Ortho),
@@ -44,7 +46,11 @@ VasnecovWorld::VasnecovWorld(QMutex *mutex,
     m_projectionMatrix(raw_wasUpdated, Matrix),
     m_lightModel(),
 
-    m_elements()
+    m_elements(),
+    m_attachments(),
+    m_figureBatcher(pipeline),
+    m_labelBatcher(pipeline),
+    m_labelPlacer(pipeline)
 {
     m_parameters.editableRaw().x = mx;
     m_parameters.editableRaw().y = my;
@@ -65,6 +71,7 @@ VasnecovWorld::VasnecovWorld(QMutex *mutex,
 */
 VasnecovWorld::~VasnecovWorld()
 {
+    delete mtx_data;
 }
 
 /*!
@@ -105,7 +112,7 @@ void VasnecovWorld::designerUpdateOrtho()
 */
 void VasnecovWorld::setCameraAngles(GLfloat yaw, GLfloat pitch)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     QVector3D vec(1.0, 0.0, 0.0); // Единичный вектор по направлению X
 
@@ -134,7 +141,7 @@ void VasnecovWorld::setCameraAngles(GLfloat yaw, GLfloat pitch)
 */
 void VasnecovWorld::setCameraAngles(GLfloat yaw, GLfloat pitch, GLfloat roll)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
     if(m_camera.raw().roll != roll)
     {
         m_camera.editableRaw().roll = roll;
@@ -146,7 +153,7 @@ void VasnecovWorld::setCameraAngles(GLfloat yaw, GLfloat pitch, GLfloat roll)
 
 void VasnecovWorld::flyCamera(const QVector3D &step)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     QVector3D forward = (m_camera.raw().target - m_camera.raw().position).normalized();
 
@@ -207,7 +214,7 @@ void VasnecovWorld::flyCamera(GLfloat x, GLfloat y, GLfloat z)
 
 void VasnecovWorld::moveCamera(const QVector3D &step)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     bool updated(false);
     QVector3D target, position;
@@ -267,7 +274,7 @@ void VasnecovWorld::moveCamera(GLfloat x, GLfloat y, GLfloat z)
 
 void VasnecovWorld::rotateCamera(GLfloat yaw, GLfloat pitch)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     QVector3D vec = m_camera.raw().target - m_camera.raw().position;
 
@@ -287,7 +294,7 @@ void VasnecovWorld::rotateCamera(GLfloat yaw, GLfloat pitch)
 
 void VasnecovWorld::rotateCamera(GLfloat yaw, GLfloat pitch, GLfloat roll)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
     if(m_camera.raw().roll != roll)
     {
         m_camera.editableRaw().roll = roll;
@@ -299,7 +306,7 @@ void VasnecovWorld::rotateCamera(GLfloat yaw, GLfloat pitch, GLfloat roll)
 
 void VasnecovWorld::setCameraRoll(GLfloat roll)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
     if(m_camera.raw().roll != roll)
     {
         m_camera.editableRaw().roll = roll;
@@ -309,7 +316,7 @@ void VasnecovWorld::setCameraRoll(GLfloat roll)
 
 void VasnecovWorld::tiltCamera(GLfloat roll)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
     if(roll)
     {
         m_camera.editableRaw().roll = m_camera.raw().roll + roll;
@@ -407,6 +414,7 @@ void VasnecovWorld::renderDraw()
             pure_pipeline->disableSmoothShading();
 
             transFigures.reserve(m_elements.pureFigures().size());
+            m_figureBatcher.begin();
             for(std::vector<VasnecovFigure *>::const_iterator fit = m_elements.pureFigures().begin();
                 fit != m_elements.pureFigures().end(); ++fit)
             {
@@ -417,7 +425,7 @@ void VasnecovWorld::renderDraw()
                     {
                         transFigures.push_back(fig);
                     }
-                    else
+                    else if(!m_figureBatcher.add(fig))
                     {
                         if(fig->renderLighting() && lampsWork)
                         {
@@ -431,6 +439,7 @@ void VasnecovWorld::renderDraw()
                     }
                 }
             }
+            m_figureBatcher.draw();
 
             pure_pipeline->setLineWidth(1.0f);
             pure_pipeline->setPointSize(1.0f);
@@ -472,15 +481,10 @@ void VasnecovWorld::renderDraw()
                 QVector3D viewVector = (m_camera.pure().target - m_camera.pure().position).normalized();
                 QVector3D viewPoint = m_camera.pure().position;
 
-                for(std::vector<VasnecovProduct *>::const_iterator pit = transProducts.begin();
-                    pit != transProducts.end(); ++pit)
+                pure_pipeline->jobs().forEach(transProducts, [&viewPoint, &viewVector](VasnecovProduct *prod)
                 {
-                    VasnecovProduct *prod(*pit);
-                    if(prod)
-                    {
-                        prod->renderCalculateDistanceToPlane(viewPoint, viewVector);
-                    }
-                }
+                    prod->renderCalculateDistanceToPlane(viewPoint, viewVector);
+                });
 
                 std::sort(transProducts.begin(), transProducts.end(), VasnecovElement::renderCompareByReverseDistance);
             }
@@ -496,6 +500,9 @@ void VasnecovWorld::renderDraw()
             }
         }
 
+        // Альфа-тест мог остаться от материала изделия с дырявой текстурой
+        pure_pipeline->disableAlphaTest();
+
         // Рисование фигур (прозрачных)
         if(!transFigures.empty())
         {
@@ -504,15 +511,10 @@ void VasnecovWorld::renderDraw()
                 QVector3D viewVector = (m_camera.pure().target - m_camera.pure().position).normalized();
                 QVector3D viewPoint = m_camera.pure().position;
 
-                for(std::vector<VasnecovFigure *>::iterator fit = transFigures.begin();
-                    fit != transFigures.end(); ++fit)
+                pure_pipeline->jobs().forEach(transFigures, [&viewPoint, &viewVector](VasnecovFigure *fig)
                 {
-                    VasnecovFigure *fig(*fit);
-                    if(fig)
-                    {
-                        fig->renderCalculateDistanceToPlane(viewPoint, viewVector);
-                    }
-                }
+                    fig->renderCalculateDistanceToPlane(viewPoint, viewVector);
+                });
 
                 std::sort(transFigures.begin(), transFigures.end(), VasnecovElement::renderCompareByReverseDistance);
             }
@@ -559,8 +561,25 @@ void VasnecovWorld::renderDraw()
             pure_pipeline->disableLamps();
             pure_pipeline->disableBackFaces();
 
+            // Метки вне окна (и скрытые разрежением) дальше не обрабатываются
+            m_labelPlacer.place(m_elements.pureLabels(), m_parameters.pure().labelsDeclutter);
+
             pure_pipeline->setOrtho2D();
-                m_elements.forEachPureLabel(renderDrawElement<VasnecovLabel>);
+                m_labelBatcher.begin();
+                for(std::vector<VasnecovLabel *>::const_iterator lit = m_elements.pureLabels().begin();
+                    lit != m_elements.pureLabels().end(); ++lit)
+                {
+                    if(!(*lit)->renderIsPlaced())
+                    {
+                        continue;
+                    }
+                    if(!m_labelBatcher.add(*lit))
+                    {
+                        m_labelBatcher.draw(); // Сохранение порядка наложения
+                        (*lit)->renderDraw();
+                    }
+                }
+                m_labelBatcher.draw();
             pure_pipeline->unsetOrtho2D();
         }
     }
@@ -574,7 +593,7 @@ void VasnecovWorld::renderDraw()
 */
 Vasnecov::WorldParameters VasnecovWorld::worldParameters() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     Vasnecov::WorldParameters parameters(m_parameters.raw());
     return parameters;
@@ -582,7 +601,7 @@ Vasnecov::WorldParameters VasnecovWorld::worldParameters() const
 
 Vasnecov::WorldTypes VasnecovWorld::projection() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     Vasnecov::WorldTypes projection(m_parameters.raw().projection);
     return projection;
@@ -590,35 +609,35 @@ Vasnecov::WorldTypes VasnecovWorld::projection() const
 
 GLint VasnecovWorld::x() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     return m_parameters.raw().x;
 }
 
 GLint VasnecovWorld::y() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     return m_parameters.raw().y;
 }
 
 GLsizei VasnecovWorld::width() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     return m_parameters.raw().width;
 }
 
 GLsizei VasnecovWorld::height() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     return m_parameters.raw().height;
 }
 
 QSize VasnecovWorld::size() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     return QSize(m_parameters.raw().width, m_parameters.raw().height);
 }
@@ -630,7 +649,7 @@ QSize VasnecovWorld::size() const
 */
 QRect VasnecovWorld::window() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     return QRect(m_parameters.raw().x,
                  m_parameters.raw().y,
@@ -645,7 +664,7 @@ QRect VasnecovWorld::window() const
 */
 void VasnecovWorld::setDrawingType(Vasnecov::PolygonDrawingTypes type)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     if(m_parameters.raw().drawingType != type)
     {
@@ -655,7 +674,7 @@ void VasnecovWorld::setDrawingType(Vasnecov::PolygonDrawingTypes type)
 
 void VasnecovWorld::setCameraPosition(const QVector3D &position)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     if(m_camera.raw().position != position)
     {
@@ -677,7 +696,7 @@ void VasnecovWorld::setCameraPosition(GLfloat x, GLfloat y, GLfloat z)
 }
 void VasnecovWorld::setCameraTarget(const QVector3D &target)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     if(m_camera.raw().target != target)
     {
@@ -705,7 +724,7 @@ void VasnecovWorld::setCameraTarget(GLfloat x, GLfloat y, GLfloat z)
 */
 void VasnecovWorld::setCamera(const Vasnecov::Camera &camera)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     if(m_camera.set(camera))
         designerUpdateOrtho(); // т.к. изменяется расстояние между фронтальными границами
@@ -719,7 +738,7 @@ void VasnecovWorld::setCamera(const Vasnecov::Camera &camera)
 */
 Vasnecov::Camera VasnecovWorld::camera() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     Vasnecov::Camera camera(m_camera.raw());
     return camera;
@@ -732,7 +751,7 @@ Vasnecov::Line VasnecovWorld::unprojectPointToLine(const QPointF &point)
 
 Vasnecov::Line VasnecovWorld::unprojectPointToLine(GLfloat x, GLfloat y)
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     if(x >= m_parameters.raw().x &&
        y >= m_parameters.raw().y &&
@@ -775,7 +794,7 @@ Vasnecov::Line VasnecovWorld::unprojectPointToLine(GLfloat x, GLfloat y)
 */
 Vasnecov::Perspective VasnecovWorld::perspective() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     Vasnecov::Perspective perspective(m_perspective.raw());
     return perspective;
@@ -788,7 +807,7 @@ Vasnecov::Perspective VasnecovWorld::perspective() const
 */
 Vasnecov::Ortho VasnecovWorld::ortho() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     Vasnecov::Ortho orto(m_ortho.raw());
     return orto;
@@ -805,7 +824,7 @@ GLboolean VasnecovWorld::setProjection(Vasnecov::WorldTypes type)
 {
     if(type == Vasnecov::WorldTypePerspective || type == Vasnecov::WorldTypeOrthographic)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
         if(m_parameters.raw().projection != type)
         {
@@ -833,7 +852,7 @@ GLboolean VasnecovWorld::setWindow(GLint x, GLint y, GLsizei width, GLsizei heig
     if(width > Vasnecov::cfg_worldWidthMin && width < Vasnecov::cfg_worldWidthMax &&
        height > Vasnecov::cfg_worldHeightMin && height < Vasnecov::cfg_worldHeightMax)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
         GLboolean updated (false);
 
@@ -893,7 +912,7 @@ GLboolean VasnecovWorld::setParameters(Vasnecov::WorldParameters parameters) //
        (parameters.projection == Vasnecov::WorldTypePerspective ||
         parameters.projection == Vasnecov::WorldTypeOrthographic))
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
         GLboolean updated(false);
 
@@ -929,7 +948,7 @@ GLboolean VasnecovWorld::setPerspective(GLfloat angle, GLfloat frontBorder, GLfl
 {
     if((angle > 0.0f && angle < 180.0f) && frontBorder > 0.0f)
     {
-        QMutexLocker locker(mtx_data);
+        Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
         GLboolean updated(false);
 
@@ -969,7 +988,7 @@ GLboolean VasnecovWorld::setPerspective(GLfloat angle, GLfloat frontBorder, GLfl
 */
 void VasnecovWorld::setDepth()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     if(!m_parameters.raw().depth)
         m_parameters.editableRaw().depth = true;
@@ -981,7 +1000,7 @@ void VasnecovWorld::setDepth()
 */
 void VasnecovWorld::unsetDepth()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     if(m_parameters.raw().depth)
         m_parameters.editableRaw().depth = false;
@@ -989,14 +1008,14 @@ void VasnecovWorld::unsetDepth()
 
 GLboolean VasnecovWorld::depth() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     return m_parameters.raw().depth;
 }
 
 void VasnecovWorld::switchDepth()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     m_parameters.editableRaw().depth = !m_parameters.raw().depth;
 }
@@ -1008,7 +1027,7 @@ void VasnecovWorld::switchDepth()
 */
 void VasnecovWorld::setLight()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     if(!m_parameters.raw().light)
         m_parameters.editableRaw().light = true;
@@ -1020,7 +1039,7 @@ void VasnecovWorld::setLight()
 */
 void VasnecovWorld::unsetLight()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     if(m_parameters.editableRaw().light)
         m_parameters.editableRaw().light = false;
@@ -1028,18 +1047,41 @@ void VasnecovWorld::unsetLight()
 
 GLboolean VasnecovWorld::light() const
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     return m_parameters.raw().light;
 }
 
 void VasnecovWorld::switchLight()
 {
-    QMutexLocker locker(mtx_data);
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
 
     m_parameters.editableRaw().light = !m_parameters.raw().light;
 }
 
+void VasnecovWorld::setLabelsDeclutter()
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+
+    if(!m_parameters.raw().labelsDeclutter)
+        m_parameters.editableRaw().labelsDeclutter = true;
+}
+
+void VasnecovWorld::unsetLabelsDeclutter()
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+
+    if(m_parameters.raw().labelsDeclutter)
+        m_parameters.editableRaw().labelsDeclutter = false;
+}
+
+GLboolean VasnecovWorld::labelsDeclutter() const
+{
+    Vasnecov::StatsLocker locker(mtx_data, Vasnecov::SyncStats::LockDesignerWorld);
+
+    return m_parameters.raw().labelsDeclutter;
+}
+
 VasnecovPipeline::CameraAttributes VasnecovWorld::renderCalculateCamera() const
 {
     // Расчет направлений камеры
@@ -17,6 +17,9 @@
 #endif
 #include "elementlist.h"
 #include "vasnecovlamp.h"
+#include "figurebatcher.h"
+#include "labelbatcher.h"
+#include "labelplacer.h"
 #ifndef _MSC_VER
     #pragma GCC diagnostic warning "-Weffc++"
 #endif
@@ -44,8 +47,7 @@ class VasnecovWorld : public Vasnecov::CoreObject
 
 
 public:
-    VasnecovWorld(QMutex *mutex,
-                  VasnecovPipeline *pipeline,
+    VasnecovWorld(VasnecovPipeline *pipeline,
                   GLint mx, GLint my,
                   GLsizei width, GLsizei height,
                   const std::string &name = std::string());
@@ -76,6 +78,11 @@ public:
     GLboolean light() const;
     void switchLight();
 
+    // Перекрывающиеся метки скрываются по приоритету (VasnecovLabel::setPriority)
+    void setLabelsDeclutter();
+    void unsetLabelsDeclutter();
+    GLboolean labelsDeclutter() const;
+
     GLboolean setPerspective(GLfloat angle, GLfloat frontBorder, GLfloat backBorder); // Задать характеристики перспективной проекции
     Vasnecov::Perspective perspective() const;
     Vasnecov::Ortho ortho() const;
@@ -159,6 +166,10 @@ private:
 
     Vasnecov::LightModel m_lightModel;
     WorldElementList m_elements;
+    Vasnecov::AttachmentIndex m_attachments; // Прикрепления элементов мира к чужим матрицам
+    Vasnecov::FigureBatcher m_figureBatcher; // Пакеты мелких непрозрачных фигур
+    Vasnecov::LabelBatcher m_labelBatcher; // Метки из атласа
+    Vasnecov::LabelPlacer m_labelPlacer; // Отсечение и разрежение меток
 
     friend class VasnecovUniverse;
 